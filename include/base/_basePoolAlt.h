@@ -57,6 +57,7 @@ extern int BASE_NO_MEMORY_EXCEPTION;
 #define bpool_reset(pool)		    bpool_reset_imp(pool)
 #define bpool_get_capacity(pool)	    bpool_get_capacity_imp(pool)
 #define bpool_get_used_size(pool)	    bpool_get_used_size_imp(pool)
+#define bpool_get_wasted_size(pool)	    bpool_get_wasted_size_imp(pool)
 #define bpool_alloc(pool,sz)		    \
 	bpool_alloc_imp(__FILE__, __LINE__, pool, sz)
 
@@ -95,6 +96,9 @@ bsize_t bpool_get_capacity_imp(bpool_t *pool);
 /* Get total used size */
 bsize_t bpool_get_used_size_imp(bpool_t *pool);
 
+/* Get wasted size */
+bsize_t bpool_get_wasted_size_imp(bpool_t *pool);
+
 /* Allocate memory from the pool */
 void* bpool_alloc_imp(const char *file, int line, 
 				 bpool_t *pool, bsize_t sz);
@@ -38,6 +38,11 @@ BASE_IDEF(bsize_t) bpool_get_used_size( bpool_t *pool )
     return used_size;
 }
 
+BASE_IDEF(bsize_t) bpool_get_wasted_size( bpool_t *pool )
+{
+    return pool->wasted_size;
+}
+
 BASE_IDEF(void*) bpool_alloc_from_block( bpool_block *block, bsize_t size )
 {
     /* The operation below is valid for size==0. 
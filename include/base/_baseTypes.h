@@ -139,6 +139,11 @@ typedef struct _blist blist;
  */
 typedef struct _bhash_table_t bhash_table_t;
 
+/**
+ * Opaque data type for open addressing hash tables.
+ */
+typedef struct _bohash_table_t bohash_table_t;
+
 /**
  * Opaque data type for hash entry (only used internally by hash table).
  */
@@ -242,6 +247,9 @@ typedef void bsockaddr_t;
 /** Forward declaration. */
 typedef struct _bsockaddr_in bsockaddr_in;
 
+/** Buffer of a scatter/gather send, see bsock_sendv(). */
+typedef struct bsock_iovec bsock_iovec;
+
 /** Color type. */
 typedef unsigned int bcolor_t;
 
@@ -523,6 +531,13 @@ enum
 #define	BASE_DEBUG(msg,...)		BASE_LOG(6, (THIS_FILE, "%s().%d:" msg, __FUNCTION__, __LINE__, ##__VA_ARGS__) )
 #endif
 
+/* Trace of the hot paths, compiled out unless BASE_LOG_HOT_PATH is enabled */
+#if BASE_LOG_HOT_PATH
+#define	BASE_HOT_INFO(msg,...)		BASE_INFO(msg, ##__VA_ARGS__)
+#else
+#define	BASE_HOT_INFO(msg,...)
+#endif
+
 //#define	BASE_STR_INFO(str, msg,...)		BASE_LOG(6, (str, "%s %s().%d" msg, __FILE__,  __FUNCTION__, __LINE__, ##__VA_ARGS__) )
 #define	BASE_STR_INFO(str, msg,...)		BASE_LOG(5, (str, msg, ##__VA_ARGS__) )
 
@@ -4,7 +4,7 @@
 #ifndef __BASE_ASYNCSOCK_H__
 #define __BASE_ASYNCSOCK_H__
 
-#include <baseIoQueue.h>
+#include <baseIoqueue.h>
 #include <baseSock.h>
 
 
@@ -30,6 +30,38 @@ extern "C" {
 /* This opaque structure describes the active socket.  */
 typedef struct _bactivesock_t bactivesock_t;
 
+/* This opaque structure describes the pool of read buffers, which can be
+ * shared by many active sockets. See #bactivesock_buf_pool_create().
+ */
+typedef struct _bactivesock_buf_pool bactivesock_buf_pool;
+
+/**
+ * Reference counted read buffer, taken from a #bactivesock_buf_pool.
+ * The active socket holds one reference while the buffer is used for
+ * reading. The application may keep the buffer after the read callback
+ * returns by adding its own reference with #bactivesock_buf_add_ref(),
+ * and gives it back with #bactivesock_buf_dec_ref(). The buffer goes back
+ * to its pool when the last reference is released.
+ */
+typedef struct _bactivesock_buf
+{
+    /** The data of the buffer. */
+    void			*data;
+
+    /** Size of the data area, which is the buffer size of the pool. */
+    unsigned			 max_size;
+
+    /** Private: the pool which the buffer belongs to. */
+    bactivesock_buf_pool	*pool;
+
+    /** Private: reference counter. */
+    int				 ref_cnt;
+
+    /** Private: next buffer in the free list of the pool. */
+    struct _bactivesock_buf	*next;
+
+} bactivesock_buf;
+
 /**
  * This structure contains the callbacks to be called by the active socket.
  */
@@ -166,6 +198,58 @@ typedef struct _bactivesock_cb
      */
     bbool_t (*on_connect_complete)(bactivesock_t *asock, bstatus_t status);
 
+    /**
+     * Same as \a on_data_read(), except that it is called when the read
+     * has been started with #bactivesock_start_read_buf(), and the data
+     * is given in a reference counted buffer. The application may add a
+     * reference to the buffer to keep the data after the callback returns,
+     * e.g. to queue it to another thread without copying it. In that case
+     * the active socket continues with a new buffer from the pool, into
+     * which the remainder (if any) is copied.
+     *
+     * @param asock	The active socket.
+     * @param buf	The buffer, the data starts at \a buf->data. This
+     *			is NULL when no buffer could be taken from the pool
+     *			and \a status is BASE_ENOMEM; the read has stopped
+     *			then.
+     * @param size	The length of data in the buffer.
+     * @param status	The status of the read operation.
+     * @param remainder	See \a on_data_read().
+     *
+     * @return		BASE_TRUE if further read is desired, and BASE_FALSE
+     *			when application no longer wants to receive data.
+     *			Application may destroy the active socket in the
+     *			callback and return BASE_FALSE here.
+     */
+    bbool_t (*on_data_read_buf)(bactivesock_t *asock,
+				  bactivesock_buf *buf,
+				  bsize_t size,
+				  bstatus_t status,
+				  bsize_t *remainder);
+
+    /**
+     * Same as \a on_data_recvfrom(), except that it is called when the
+     * read has been started with #bactivesock_start_recvfrom_buf(), and
+     * the packet is given in a reference counted buffer. See
+     * \a on_data_read_buf().
+     *
+     * @param asock	The active socket.
+     * @param buf	The buffer containing the packet, if any.
+     * @param size	The length of packet in the buffer.
+     * @param src_addr	Source address of the packet.
+     * @param addr_len	Length of the source address.
+     * @param status	The status of the read operation.
+     *
+     * @return		BASE_TRUE if further read is desired, and BASE_FALSE
+     *			when application no longer wants to receive data.
+     */
+    bbool_t (*on_data_recvfrom_buf)(bactivesock_t *asock,
+				      bactivesock_buf *buf,
+				      bsize_t size,
+				      const bsockaddr_t *src_addr,
+				      int addr_len,
+				      bstatus_t status);
+
 } bactivesock_cb;
 
 
@@ -224,6 +308,17 @@ typedef struct _bactivesock_cfg
      */
     bbool_t whole_data;
 
+    /**
+     * If this option is specified on a datagram socket, the \a async_cnt
+     * read operations started by #bactivesock_start_recvfrom() are
+     * filled together with #bioqueue_recvfrom_batch(), i.e. one system
+     * call delivers a burst of up to \a async_cnt datagrams. This is only
+     * useful when \a async_cnt is greater than one.
+     *
+     * Default value is 0.
+     */
+    bbool_t batch_recv;
+
 } bactivesock_cfg;
 
 
@@ -442,6 +537,92 @@ bstatus_t bactivesock_start_recvfrom2(bactivesock_t *asock,
 						   void *readbuf[],
 						   buint32_t flags);
 
+/**
+ * Create a pool of reference counted read buffers. Buffers are allocated
+ * on demand and recycled when they are released, so the pool grows to
+ * the number of buffers in use at the same time. The pool may be shared
+ * by any number of active sockets and is thread safe.
+ *
+ * @param pool	    Pool whose factory is used to allocate the buffers.
+ * @param name	    Optional name of the pool.
+ * @param buff_size The size of each buffer, in bytes.
+ * @param max_cnt   Maximum number of buffers, or zero for no limit.
+ * @param p_bufpool Pointer to receive the buffer pool.
+ *
+ * @return	    BASE_SUCCESS if the operation has been successful,
+ *		    or the appropriate error code on failure.
+ */
+bstatus_t bactivesock_buf_pool_create(bpool_t *pool,
+				      const char *name,
+				      unsigned buff_size,
+				      unsigned max_cnt,
+				      bactivesock_buf_pool **p_bufpool);
+
+/**
+ * Destroy the buffer pool. All buffers must have been released, i.e. the
+ * active sockets using the pool have been closed and the application
+ * holds no more references.
+ *
+ * @param bufpool   The buffer pool.
+ *
+ * @return	    BASE_SUCCESS, or BASE_EBUSY if some buffers are still
+ *		    in use.
+ */
+bstatus_t bactivesock_buf_pool_destroy(bactivesock_buf_pool *bufpool);
+
+/**
+ * Add a reference to the buffer, to keep it after the read callback.
+ *
+ * @param buf	    The buffer.
+ */
+void bactivesock_buf_add_ref(bactivesock_buf *buf);
+
+/**
+ * Release a reference of the buffer. The buffer goes back to its pool
+ * when the last reference is released.
+ *
+ * @param buf	    The buffer.
+ */
+void bactivesock_buf_dec_ref(bactivesock_buf *buf);
+
+/**
+ * Same as #bactivesock_start_read(), except that the buffers are taken
+ * from the buffer pool, and incoming data is reported with the
+ * \a on_data_read_buf() callback, so that the application may keep the
+ * data without copying it. The buffers of the active socket are given
+ * back to the pool by #bactivesock_close().
+ *
+ * @param asock	    The active socket.
+ * @param pool	    Pool used to allocate the read operations.
+ * @param bufpool   The buffer pool.
+ * @param flags	    Flags to be given to bioqueue_recv().
+ *
+ * @return	    BASE_SUCCESS if the operation has been successful,
+ *		    or the appropriate error code on failure.
+ */
+bstatus_t bactivesock_start_read_buf(bactivesock_t *asock,
+				     bpool_t *pool,
+				     bactivesock_buf_pool *bufpool,
+				     buint32_t flags);
+
+/**
+ * Same as #bactivesock_start_recvfrom(), except that the buffers are taken
+ * from the buffer pool, and incoming packets are reported with the
+ * \a on_data_recvfrom_buf() callback. See #bactivesock_start_read_buf().
+ *
+ * @param asock	    The active socket.
+ * @param pool	    Pool used to allocate the read operations.
+ * @param bufpool   The buffer pool.
+ * @param flags	    Flags to be given to bioqueue_recvfrom().
+ *
+ * @return	    BASE_SUCCESS if the operation has been successful,
+ *		    or the appropriate error code on failure.
+ */
+bstatus_t bactivesock_start_recvfrom_buf(bactivesock_t *asock,
+					 bpool_t *pool,
+					 bactivesock_buf_pool *bufpool,
+					 buint32_t flags);
+
 /**
  * Send data using the socket.
  *
@@ -468,6 +649,33 @@ bstatus_t bactivesock_send(bactivesock_t *asock,
 					bssize_t *size,
 					unsigned flags);
 
+/**
+ * Send the buffers of \a iov using the socket, in order and without
+ * coalescing them into one buffer, see #bioqueue_sendv(). The whole data
+ * is always sent, regardless of \a whole_data setting of the socket.
+ *
+ * @param asock	    The active socket.
+ * @param send_key  The operation key to send the data.
+ * @param iov	    Array of buffers to be sent. The array and the buffers
+ *		    must remain valid until the data has been sent.
+ * @param count	    Number of buffers, up to #BASE_SOCK_MAX_IOV.
+ * @param size	    On return, the total size of the data sent when
+ *		    BASE_SUCCESS is returned.
+ * @param flags	    Flags to be given to bioqueue_sendv().
+ *
+ * @return	    BASE_SUCCESS if data has been sent immediately, or
+ *		    BASE_EPENDING if data cannot be sent immediately. In
+ *		    this case the \a on_data_sent() callback will be
+ *		    called with the total size when data is actually sent.
+ *		    Any other return value indicates error condition.
+ */
+bstatus_t bactivesock_sendv(bactivesock_t *asock,
+					 bioqueue_op_key_t *send_key,
+					 const bsock_iovec *iov,
+					 unsigned count,
+					 bssize_t *size,
+					 unsigned flags);
+
 /**
  * Send datagram using the socket.
  *
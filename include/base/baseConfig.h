@@ -403,6 +403,116 @@
 #  define BASE_LOG_MAX_SIZE	    4000
 #endif
 
+/**
+ * Compile in the trace messages of the hot paths of the library, such as
+ * the creation of every hash table entry, every allocation of the fifo
+ * buffer and every block of the memory pool. When disabled these messages
+ * and the evaluation of their arguments are stripped entirely, whatever
+ * the log level is at run time.
+ *
+ * Default: 0
+ */
+#ifndef BASE_LOG_HOT_PATH
+#  define BASE_LOG_HOT_PATH	    0
+#endif
+
+/**
+ * Compile in the asynchronous log, see #blog_set_async(). It needs threads
+ * and the atomic builtins of GCC/clang.
+ *
+ * Default: 1 when both are available, otherwise 0
+ */
+#ifndef BASE_LOG_HAS_ASYNC
+#  if BASE_HAS_THREADS && defined(__GNUC__)
+#    define BASE_LOG_HAS_ASYNC	    1
+#  else
+#    define BASE_LOG_HAS_ASYNC	    0
+#  endif
+#endif
+
+/**
+ * Default size of the ring of each logging thread of the asynchronous log,
+ * in bytes. It is rounded up to a power of 2 of at least twice
+ * BASE_LOG_MAX_SIZE.
+ *
+ * Default: 65536
+ */
+#ifndef BASE_LOG_ASYNC_RING_SIZE
+#  define BASE_LOG_ASYNC_RING_SIZE    65536
+#endif
+
+/**
+ * Default interval at which the drain thread of the asynchronous log writes
+ * the queued messages, in milliseconds.
+ *
+ * Default: 10
+ */
+#ifndef BASE_LOG_ASYNC_FLUSH_MSEC
+#  define BASE_LOG_ASYNC_FLUSH_MSEC   10
+#endif
+
+/**
+ * Compile in the binary log, see #blog_bin_start(). It needs memory mapped
+ * files and the atomic builtins of GCC/clang.
+ *
+ * Default: 1 when both are available, otherwise 0
+ */
+#ifndef BASE_LOG_HAS_BINARY
+#  if defined(BASE_HAS_UNISTD_H) && BASE_HAS_UNISTD_H != 0 && defined(__GNUC__)
+#    define BASE_LOG_HAS_BINARY	    1
+#  else
+#    define BASE_LOG_HAS_BINARY	    0
+#  endif
+#endif
+
+/**
+ * Default size of the ring of records of the binary log, in bytes.
+ *
+ * Default: 16 MB
+ */
+#ifndef BASE_LOG_BIN_RING_SIZE
+#  define BASE_LOG_BIN_RING_SIZE	    (16*1024*1024)
+#endif
+
+/**
+ * Default size of the area for the strings of the binary log, in bytes.
+ *
+ * Default: 256 KB
+ */
+#ifndef BASE_LOG_BIN_STR_SIZE
+#  define BASE_LOG_BIN_STR_SIZE	    (256*1024)
+#endif
+
+/**
+ * Default maximum number of different strings of the binary log.
+ *
+ * Default: 4096
+ */
+#ifndef BASE_LOG_BIN_STR_COUNT
+#  define BASE_LOG_BIN_STR_COUNT	    4096
+#endif
+
+/**
+ * Default level up to which messages of the binary log are also formatted
+ * and written to the log function.
+ *
+ * Default: 3
+ */
+#ifndef BASE_LOG_BIN_TEXT_LEVEL
+#  define BASE_LOG_BIN_TEXT_LEVEL	    3
+#endif
+
+/**
+ * Maximum number of arguments of a message recorded by the binary log,
+ * counting '*' width and precision. Messages with more are recorded
+ * already formatted.
+ *
+ * Default: 16
+ */
+#ifndef BASE_LOG_BIN_MAX_ARGS
+#  define BASE_LOG_BIN_MAX_ARGS	    16
+#endif
+
 /**
  * Log buffer.
  * Does the log get the buffer from the stack? (default is yes).
@@ -509,6 +619,36 @@
 #endif
 
 
+/**
+ * Number of released pools of each size class which each thread keeps in
+ * its own cache (magazine) of a caching pool, so that the thread creates
+ * and releases pools without taking the lock of the caching pool. Zero
+ * disables the thread caches. See #bcaching_pool_set_magazine().
+ *
+ * Default: 0
+ */
+#ifndef BASE_CACHING_POOL_MAGAZINE_SIZE
+#  define BASE_CACHING_POOL_MAGAZINE_SIZE    0
+#endif
+
+
+/**
+ * Probe the tags of the open addressing hash tables (#bohash_create()) 16
+ * at a time with SSE2 instructions. Without it the tags are probed one by
+ * one.
+ *
+ * Default: 1 when the compiler targets SSE2, otherwise 0
+ */
+#ifndef BASE_OHASH_HAS_SSE2
+#  if defined(__SSE2__) || defined(_M_X64) || \
+      (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    define BASE_OHASH_HAS_SSE2	    1
+#  else
+#    define BASE_OHASH_HAS_SSE2	    0
+#  endif
+#endif
+
+
 /**
  * Enable timer heap debugging facility. When this is enabled, application
  * can call btimer_heap_dump() to show the contents of the timer heap
@@ -522,6 +662,41 @@
 #endif
 
 
+/**
+ * Implementation of the timer heaps created with btimer_heap_create(),
+ * either BASE_TIMER_HEAP_BINARY or BASE_TIMER_HEAP_WHEEL. See
+ * #btimer_heap_type.
+ *
+ * Default: BASE_TIMER_HEAP_BINARY
+ */
+#ifndef BASE_TIMER_HEAP_DEFAULT_TYPE
+#  define BASE_TIMER_HEAP_DEFAULT_TYPE	    BASE_TIMER_HEAP_BINARY
+#endif
+
+
+/**
+ * Tick of the timing wheel timer heap, in milliseconds, rounded down to a
+ * power of two. Timers expire up to one tick late.
+ *
+ * Default: 1
+ */
+#ifndef BASE_TIMER_WHEEL_TICK_MSEC
+#  define BASE_TIMER_WHEEL_TICK_MSEC	    1
+#endif
+
+
+/**
+ * Expire the timers of the timer heaps created with btimer_heap_create()
+ * in batches, under a single hold of the timer heap lock per poll. See
+ * #btimer_heap_cfg.
+ *
+ * Default: 0
+ */
+#ifndef BASE_TIMER_BATCH_POLL
+#  define BASE_TIMER_BATCH_POLL		    0
+#endif
+
+
 /**
  * Set this to 1 to enable debugging on the group lock. Default: 0
  */
@@ -676,6 +851,70 @@
 #endif
 
 
+/**
+ * Make the epoll ioqueue backend register descriptors edge-triggered
+ * (EPOLLET). Each descriptor is then registered once for both directions,
+ * no epoll_ctl() is needed when operations are queued or completed, and
+ * bioqueue_poll() drains every ready key (up to
+ * BASE_IOQUEUE_EPOLL_MAX_DRAIN operations) instead of dispatching one
+ * operation per key per epoll_wait(). The backend then reports itself as
+ * "epoll-et" in bioqueue_name().
+ *
+ * Only meaningful for the epoll backend.
+ *
+ * Default: 0
+ */
+#ifndef BASE_IOQUEUE_EPOLL_EDGE_TRIGGERED
+#   define BASE_IOQUEUE_EPOLL_EDGE_TRIGGERED	0
+#endif
+
+
+/**
+ * Maximum number of operations dispatched to a single ready key in one
+ * edge-triggered poll cycle before the key is re-armed and the poll moves
+ * on, so one busy socket can not starve the others.
+ *
+ * Default: 64
+ */
+#ifndef BASE_IOQUEUE_EPOLL_MAX_DRAIN
+#   define BASE_IOQUEUE_EPOLL_MAX_DRAIN	64
+#endif
+
+
+/**
+ * Number of submission queue entries of the io_uring ioqueue. The
+ * completion queue is sized from this and the ioqueue's max_fd.
+ *
+ * Default: 256
+ */
+#ifndef BASE_IOQUEUE_URING_ENTRIES
+#   define BASE_IOQUEUE_URING_ENTRIES		256
+#endif
+
+
+/**
+ * Use recvmmsg() and sendmmsg() for the batched datagram operations of the
+ * ioqueue (#bioqueue_recvfrom_batch(), #bioqueue_sendto_batch()). When
+ * disabled, batches are served one datagram per system call. The build
+ * enables it when the C library has recvmmsg().
+ *
+ * Default: 0
+ */
+#ifndef BASE_IOQUEUE_HAS_MMSG
+#   define BASE_IOQUEUE_HAS_MMSG		0
+#endif
+
+
+/**
+ * Maximum number of datagrams moved by one recvmmsg() or sendmmsg() call.
+ *
+ * Default: 16
+ */
+#ifndef BASE_IOQUEUE_MMSG_MAX
+#   define BASE_IOQUEUE_MMSG_MAX		16
+#endif
+
+
 /**
  * Determine if FD_SETSIZE is changeable/set-able. If so, then we will
  * set it to BASE_IOQUEUE_MAX_HANDLES. Currently we detect this by checking
@@ -960,6 +1199,19 @@
 #endif
 
 
+/**
+ * Define the number of client sessions kept in the TLS session cache,
+ * which is shared by all secure sockets. Sessions are keyed by server
+ * name (or address) and port, the least recently used one is replaced
+ * when the cache is full. See bssl_sock_param::session_cache.
+ *
+ * Default: 64
+ */
+#ifndef BASE_SSL_SOCK_SESS_CACHE_SIZE
+#  define BASE_SSL_SOCK_SESS_CACHE_SIZE   64
+#endif
+
+
 /**
  * Disable WSAECONNRESET error for UDP sockets on Win32 platforms. See
  * https://trac.extsip.org/repos/ticket/1197.
@@ -981,6 +1233,18 @@
 #endif
 
 
+/**
+ * Maximum number of buffers in one scatter/gather send, see
+ * #bsock_sendv() and #bioqueue_sendv(). It must not exceed the IOV_MAX of
+ * the platform (1024 on Linux, at least 16 by POSIX).
+ *
+ * Default: 64
+ */
+#ifndef BASE_SOCK_MAX_IOV
+#   define BASE_SOCK_MAX_IOV		    64
+#endif
+
+
 
 /** @} */
 
@@ -136,7 +136,7 @@ void bhash_set( bpool_t *pool, bhash_table_t *ht,
 
 /**
  * Variant of #bhash_set() with the key being converted to lowercase when
- * calculating the hash value.
+ * calculating the hash value. The key copied to the pool keeps its case.
  *
  * @see bhash_set()
  */
@@ -224,6 +224,152 @@ bhash_iterator_t* bhash_next( bhash_table_t *ht,
 void* bhash_this( bhash_table_t *ht,
 			     bhash_iterator_t *it );
 
+
+/*
+ * Open addressing hash table.
+ *
+ * #bohash_table_t keeps the calls of #bhash_table_t, but stores the entries
+ * in a flat array instead of chains of entries: every slot has a 1-byte tag
+ * with 7 bits of the hash value, and the tags are probed 16 at a time (with
+ * SSE2 where available, see #BASE_OHASH_HAS_SSE2). The table grows by
+ * itself, and moves the entries to the bigger array a few at a time on each
+ * insertion, so no single call pays for the whole resize. The arrays are
+ * allocated from the policy of the pool factory, so the table must be
+ * destroyed with #bohash_destroy().
+ *
+ * The hash values of this table are calculated with #bohash_calc(), and
+ * are not interchangeable with the ones of #bhash_calc().
+ */
+
+/**
+ * Data type for open addressing hash table iterator. The table may not be
+ * modified while it is being iterated, except that the current entry may
+ * be deleted.
+ */
+typedef struct _bohash_iterator_t
+{
+	unsigned	index;		/**< Internal index.	*/
+} bohash_iterator_t;
+
+/**
+ * Calculate the hash value of the key for the open addressing hash table.
+ * Keys of 16 bytes and longer are hashed 8 bytes at a time.
+ *
+ * @param hval	    the initial hash value, or zero.
+ * @param key	    the key to calculate.
+ * @param keylen    the length of the key, or BASE_HASH_KEY_STRING to treat
+ *		    the key as null terminated string.
+ *
+ * @return          the hash value, which is never zero.
+ */
+buint32_t bohash_calc(buint32_t hval, const void *key, unsigned keylen);
+
+/**
+ * Create an open addressing hash table.
+ *
+ * @param pool	the pool from which the hash table will be allocated from.
+ *		The arrays of the entries are allocated from the policy of
+ *		the factory of this pool.
+ * @param size	the number of entries expected, the table grows beyond it
+ *		when needed.
+ *
+ * @return the hash table, or NULL when no memory.
+ */
+bohash_table_t* bohash_create(bpool_t *pool, unsigned size);
+
+/**
+ * Destroy the open addressing hash table, and free its arrays. The values
+ * and the keys are not touched.
+ *
+ * @param ht	the hash table.
+ */
+void bohash_destroy(bohash_table_t *ht);
+
+/**
+ * Get the value associated with the specified key.
+ *
+ * @see bhash_get()
+ */
+void *bohash_get(bohash_table_t *ht, const void *key, unsigned keylen, buint32_t *hval);
+
+/**
+ * Variant of #bohash_get() with the key being converted to lowercase when
+ * calculating the hash value.
+ *
+ * @see bhash_get_lower()
+ */
+void *bohash_get_lower(bohash_table_t *ht, const void *key, unsigned keylen, buint32_t *hval);
+
+/**
+ * Associate/disassociate a value with the specified key, like
+ * #bhash_set(). The entry needs no memory of its own, so pool is only
+ * used to copy the key of a new entry. If pool is NULL, the key MUST point
+ * to buffer that remains valid for the duration of the entry.
+ *
+ * @param pool	    the pool to copy the key of a new entry, or NULL.
+ * @param ht	    the hash table.
+ * @param key	    the key.
+ * @param keylen    the length of the key, or BASE_HASH_KEY_STRING to use the
+ *		    string length of the key.
+ * @param hval	    if the value is not zero, then the hash table will use
+ *		    this value to search the entry, otherwise it will compute
+ *		    the key. This value can be obtained when calling
+ *		    #bohash_get().
+ * @param value	    value to be associated, or NULL to delete the entry with
+ *		    the specified key.
+ *
+ * @return BASE_SUCCESS, or BASE_ENOMEM when the table is full and can not
+ *	    grow.
+ */
+bstatus_t bohash_set(bpool_t *pool, bohash_table_t *ht, const void *key, unsigned keylen, buint32_t hval, void *value);
+
+/**
+ * Variant of #bohash_set() with the key being converted to lowercase when
+ * calculating the hash value.
+ *
+ * @see bohash_set()
+ */
+bstatus_t bohash_set_lower(bpool_t *pool, bohash_table_t *ht, const void *key, unsigned keylen, buint32_t hval, void *value);
+
+/**
+ * Get the total number of entries in the hash table.
+ *
+ * @param ht	the hash table.
+ *
+ * @return the number of entries in the hash table.
+ */
+unsigned bohash_count(bohash_table_t *ht);
+
+/**
+ * Get the iterator to the first element in the hash table.
+ *
+ * @param ht	the hash table.
+ * @param it	the iterator for iterating hash elements.
+ *
+ * @return the iterator to the hash element, or NULL if no element presents.
+ */
+bohash_iterator_t *bohash_first(bohash_table_t *ht, bohash_iterator_t *it);
+
+/**
+ * Get the next element from the iterator.
+ *
+ * @param ht	the hash table.
+ * @param it	the hash iterator.
+ *
+ * @return the next iterator, or NULL if there's no more element.
+ */
+bohash_iterator_t *bohash_next(bohash_table_t *ht, bohash_iterator_t *it);
+
+/**
+ * Get the value associated with a hash iterator.
+ *
+ * @param ht	the hash table.
+ * @param it	the hash iterator.
+ *
+ * @return the value associated with the current element in iterator.
+ */
+void *bohash_this(bohash_table_t *ht, bohash_iterator_t *it);
+
 BASE_END_DECL
 
 #endif
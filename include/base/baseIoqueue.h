@@ -324,6 +324,53 @@ const char* bioqueue_name(void);
  */
 bstatus_t bioqueue_create( bpool_t *pool, bsize_t max_fd, bioqueue_t **ioqueue);
 
+
+/**
+ * Additional settings for #bioqueue_create2().
+ */
+typedef struct bioqueue_cfg
+{
+    /**
+     * Number of shards of the ioqueue. Each shard has its own descriptor
+     * set, keys are spread over the shards when they are registered, and
+     * every thread calling #bioqueue_poll() polls the shard it got on its
+     * first poll (shards are handed out in turn). A shard left without
+     * poller, because its thread stopped polling or exited, is taken over
+     * by the next thread which polls, so keys are served with fewer
+     * threads too, but only with this many threads is every shard polled
+     * all the time. Writes started by other threads on a key are handed to
+     * the poller of the key's shard.
+     *
+     * Only the epoll ioqueue has shards, the others take this as 1.
+     *
+     * Default: 1
+     */
+    unsigned	shard_cnt;
+
+} bioqueue_cfg;
+
+
+/**
+ * Initialize the ioqueue settings with default values.
+ *
+ * @param cfg		The settings to be initialized.
+ */
+void bioqueue_cfg_default(bioqueue_cfg *cfg);
+
+
+/**
+ * Create a new I/O Queue framework with additional settings.
+ *
+ * @param pool		The pool to allocate the I/O queue structure.
+ * @param max_fd	The maximum number of handles to be supported, which
+ *			should not exceed BASE_IOQUEUE_MAX_HANDLES.
+ * @param cfg		Additional settings, or NULL for the defaults.
+ * @param ioqueue	Pointer to hold the newly created I/O Queue.
+ * @return		BASE_SUCCESS on success.
+ */
+bstatus_t bioqueue_create2(bpool_t *pool, bsize_t max_fd,
+			   const bioqueue_cfg *cfg, bioqueue_t **ioqueue);
+
 /**
  * Destroy the I/O queue.
  * @param ioque	        The I/O Queue to be destroyed.
@@ -732,6 +779,45 @@ bstatus_t bioqueue_send( bioqueue_key_t *key,
 				      bssize_t *length,
 				      buint32_t flags );
 
+/**
+ * Instruct the I/O Queue to write the buffers of \a iov to the handle in
+ * order, as one send, without copying them into one buffer first. The
+ * buffers are handed to the kernel together (writev()/sendmsg(), or
+ * WSASend() with several buffers). On a datagram socket they make one
+ * datagram.
+ *
+ * Unlike #bioqueue_send(), a write which is only partially accepted by a
+ * stream socket is not reported to caller: the rest, which may start in
+ * the middle of any buffer, is queued, and the callback reports the whole
+ * length once everything has been sent.
+ *
+ * @param key	    The key that identifies the handle.
+ * @param op_key    An operation specific key to be associated with the
+ *                  pending operation. It must not have a pending operation.
+ * @param iov	    Array of buffers to send. Caller MUST make sure that the
+ *		    array and the buffers remain valid until the write
+ *		    operation completes.
+ * @param count	    Number of buffers, up to #BASE_SOCK_MAX_IOV.
+ * @param length    On return, the total length of the buffers when they
+ *		    were sent immediately. This parameter doesn't have to
+ *		    remain valid until the operation has completed.
+ * @param flags     Send flags.
+ *
+ * @return
+ *  - BASE_SUCCESS    If all data was immediately transferred. The callback
+ *                  WILL NOT be called.
+ *  - BASE_EPENDING   If the operation, or the rest of the data, has been
+ *                  queued. Once all data has been transferred, the callback
+ *                  will be called with the total length.
+ *  - non-zero      The return value indicates the error code.
+ */
+bstatus_t bioqueue_sendv( bioqueue_key_t *key,
+                                       bioqueue_op_key_t *op_key,
+				       const bsock_iovec *iov,
+				       unsigned count,
+				       bssize_t *length,
+				       buint32_t flags );
+
 
 /**
  * Instruct the I/O Queue to write to the handle. This function will return
@@ -770,6 +856,74 @@ bstatus_t bioqueue_sendto( bioqueue_key_t *key,	bioqueue_op_key_t *op_key, const
 	buint32_t flags, const bsockaddr_t *addr, int addrlen);
 
 
+/**
+ * Instruct the I/O Queue to receive up to \c count datagrams from the
+ * handle, one per operation key. The operations are always queued: when
+ * the handle becomes readable, the I/O Queue fills as many of them as
+ * there are datagrams with one system call (recvmmsg() where available,
+ * see #BASE_IOQUEUE_HAS_MMSG), and calls \a on_read_complete() for each
+ * filled operation in turn. The operations which were not filled remain
+ * queued.
+ *
+ * An operation key which completes may be queued again with this function
+ * and \c count 1 to keep it in the batch. Operations queued with
+ * #bioqueue_recvfrom() are served one datagram per system call as usual.
+ *
+ * @param key	    The key that identifies the datagram socket.
+ * @param op_key    Array of \c count operation keys, none of them may have
+ *		    a pending operation.
+ * @param buffer    Array of \c count buffers, each MUST remain valid until
+ *		    its operation completes.
+ * @param length    Array of \c count buffer sizes.
+ * @param count	    Number of operations.
+ * @param flags     Recv flags, the same for all operations.
+ *		    BASE_IOQUEUE_ALWAYS_ASYNC is implied.
+ * @param addr      Optional array of \c count buffers to receive the
+ *		    source addresses. Can be NULL.
+ * @param addrlen   Array of \c count address lengths, as in
+ *		    #bioqueue_recvfrom(). Can be NULL if \c addr is NULL.
+ *
+ * @return
+ *  - BASE_EPENDING   If the operations have been queued.
+ *  - non-zero      The return value indicates the error code.
+ */
+bstatus_t bioqueue_recvfrom_batch( bioqueue_key_t *key, bioqueue_op_key_t *op_key[], void *buffer[], const bssize_t length[],
+	unsigned count, buint32_t flags, bsockaddr_t *addr[], int *addrlen[]);
+
+/**
+ * Instruct the I/O Queue to send \c count datagrams, each to its own
+ * destination. When there is no pending write on the key, the datagrams
+ * are sent immediately with as few system calls as possible (sendmmsg()
+ * where available, see #BASE_IOQUEUE_HAS_MMSG). The datagrams which can
+ * not be sent immediately are queued in order, and sent in batches when
+ * the socket becomes writable; \a on_write_complete() is called for each
+ * of them.
+ *
+ * @param key	    The key that identifies the datagram socket.
+ * @param op_key    Array of \c count operation keys.
+ * @param data	    Array of \c count datagrams. Each MUST remain valid
+ *		    until its operation completes.
+ * @param length    Array of \c count datagram lengths. For the datagrams
+ *		    sent immediately, it is filled with the length sent.
+ * @param count	    Number of datagrams.
+ * @param flags     Send flags, the same for all datagrams.
+ * @param addr      Array of \c count destination addresses.
+ * @param addrlen   Array of \c count destination address lengths.
+ * @param sent_cnt  On return, the number of datagrams, from the start of
+ *		    the arrays, which have been sent immediately. The
+ *		    callback will NOT be called for them.
+ *
+ * @return
+ *  - BASE_SUCCESS    If all datagrams were sent immediately.
+ *  - BASE_EPENDING   If the datagrams after \c sent_cnt have been queued.
+ *  - non-zero      The return value indicates the error code of the
+ *		    datagram after \c sent_cnt, which has not been sent nor
+ *		    queued, like the ones after it.
+ */
+bstatus_t bioqueue_sendto_batch( bioqueue_key_t *key, bioqueue_op_key_t *op_key[], const void *data[], bssize_t length[],
+	unsigned count, buint32_t flags, const bsockaddr_t *addr[], const int addrlen[], unsigned *sent_cnt);
+
+
 #ifdef __cplusplus
 }
 #endif
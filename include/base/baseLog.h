@@ -93,6 +93,100 @@ typedef void blog_func(int level, const char *data, int len);
  */
 void blog_write(int level, const char *buffer, int len);
 
+/**
+ * A log message, as passed to #blog_batch_func.
+ */
+typedef struct blog_msg
+{
+	int		level;	/**< Log level.				*/
+	const char	*data;	/**< Log message, NULL terminated.	*/
+	int		len;	/**< Message length.			*/
+} blog_msg;
+
+/**
+ * Signature for function to write a batch of log messages at once. The
+ * drain thread of the asynchronous log (see #blog_set_async()) passes the
+ * messages it collected to this function.
+ *
+ * @param msgs	    The messages, in order for each logging thread.
+ * @param count	    Number of messages.
+ */
+typedef void blog_batch_func(const blog_msg msgs[], unsigned count);
+
+/**
+ * Default batch writer, used by the asynchronous log when the log function
+ * is #blog_write(). It writes the whole batch to stdout with one writev()
+ * where available, or message by message with #blog_write() otherwise and
+ * when the messages are colored.
+ *
+ * @param msgs	    The messages.
+ * @param count	    Number of messages.
+ */
+void blog_write_batch(const blog_msg msgs[], unsigned count);
+
+/**
+ * Settings of the asynchronous log, see #blog_set_async().
+ */
+typedef struct blog_async_cfg
+{
+	/**
+	 * Size of the ring of each logging thread, in bytes. Messages which
+	 * don't fit in the ring are dropped and counted.
+	 *
+	 * Default: BASE_LOG_ASYNC_RING_SIZE
+	 */
+	unsigned	ring_size;
+
+	/**
+	 * Interval at which the drain thread writes the queued messages, in
+	 * milliseconds.
+	 *
+	 * Default: BASE_LOG_ASYNC_FLUSH_MSEC
+	 */
+	unsigned	flush_msec;
+
+} blog_async_cfg;
+
+/**
+ * Settings of the binary log, see #blog_bin_start().
+ */
+typedef struct blog_bin_cfg
+{
+	/**
+	 * Size of the ring of records in the file, in bytes, rounded up to a
+	 * power of 2. When it is full, the oldest records are overwritten.
+	 *
+	 * Default: BASE_LOG_BIN_RING_SIZE
+	 */
+	bsize_t		ring_size;
+
+	/**
+	 * Size of the area in the file for the text of the format strings,
+	 * senders and thread names, in bytes.
+	 *
+	 * Default: BASE_LOG_BIN_STR_SIZE
+	 */
+	unsigned	str_size;
+
+	/**
+	 * Maximum number of different format strings, senders and thread
+	 * names, rounded up to a power of 2. Messages whose strings don't fit
+	 * are recorded already formatted.
+	 *
+	 * Default: BASE_LOG_BIN_STR_COUNT
+	 */
+	unsigned	str_count;
+
+	/**
+	 * Messages with this level or lower are also formatted and written
+	 * to the log function as usual. Use -1 to only record them.
+	 *
+	 * Default: BASE_LOG_BIN_TEXT_LEVEL
+	 */
+	int		text_level;
+
+} blog_bin_cfg;
+
 
 #if BASE_LOG_MAX_LEVEL >= 1
 
@@ -200,6 +294,129 @@ void blog_set_color(int level, bcolor_t color);
  */
 bcolor_t blog_get_color(int level);
 
+/**
+ * Change the function used by the drain thread of the asynchronous log to
+ * write the messages in batches. When it is NULL, the messages are passed
+ * to #blog_write_batch() if the log function is #blog_write(), or to the
+ * log function one by one otherwise.
+ *
+ * @param func	    The batch function, or NULL.
+ */
+void blog_set_batch_func(blog_batch_func *func);
+
+/**
+ * Get the current batch function of the asynchronous log.
+ *
+ * @return	    Current batch function, or NULL.
+ */
+blog_batch_func* blog_get_batch_func(void);
+
+/**
+ * Initialize the settings of the asynchronous log with the defaults.
+ *
+ * @param cfg	    The settings.
+ */
+void blog_async_cfg_default(blog_async_cfg *cfg);
+
+/**
+ * Switch logging between synchronous and asynchronous mode at run time.
+ *
+ * In asynchronous mode #blog() still formats the message on the calling
+ * thread, but copies it to a lock-free ring of that thread instead of
+ * calling the log function. A drain thread takes the messages from all
+ * rings every flush interval and writes them in batches. The messages of
+ * each thread keep their order, the messages of different threads may
+ * be interleaved differently than they were logged.
+ *
+ * Switching off writes all queued messages before returning. The rings are
+ * kept, and reused if the asynchronous mode is switched on again, until
+ * the library is shut down. The ring of an exited thread is reused by the
+ * next thread which logs, if it has the current ring size.
+ *
+ * @param enable    BASE_TRUE for asynchronous mode.
+ * @param cfg	    Settings, used when switching on, or NULL for the
+ *		    defaults. The ring size applies to the rings created
+ *		    afterwards.
+ *
+ * @return	    BASE_SUCCESS, BASE_ENOTSUP when the library is built
+ *		    without BASE_LOG_HAS_ASYNC, or the error of creating the
+ *		    drain thread.
+ */
+bstatus_t blog_set_async(bbool_t enable, const blog_async_cfg *cfg);
+
+/**
+ * Get the total number of messages dropped by the asynchronous log because
+ * the ring of the logging thread was full. The drain thread also writes a
+ * message with the number of the newly dropped messages.
+ *
+ * @return	    Number of dropped messages.
+ */
+bsize_t blog_get_dropped(void);
+
+/**
+ * Initialize the settings of the binary log with the defaults.
+ *
+ * @param cfg	    The settings.
+ */
+void blog_bin_cfg_default(blog_bin_cfg *cfg);
+
+/**
+ * Start recording the messages in binary form to a memory mapped file.
+ *
+ * For each message #blog() records the address of the format string, a
+ * timestamp from #bTimeStampGet() and the raw arguments, which is much
+ * cheaper than formatting it. The format strings, senders and thread names
+ * are stored once. Records are written by the logging threads themselves
+ * into a ring in the file, which survives a crash of the process. Use
+ * #blog_bin_decode() or the logDecode tool to render the file as text.
+ *
+ * Messages with conversions which can't be recorded (such as "%n" or wide
+ * strings) are recorded already formatted.
+ *
+ * @param path	    Path of the file, which is created or truncated.
+ * @param cfg	    Settings, or NULL for the defaults.
+ *
+ * @return	    BASE_SUCCESS, BASE_ENOTSUP when the library is built
+ *		    without BASE_LOG_HAS_BINARY, BASE_EBUSY when it is
+ *		    already started, or the error of creating the file.
+ */
+bstatus_t blog_bin_start(const char *path, const blog_bin_cfg *cfg);
+
+/**
+ * Stop the binary log and close the file. Messages are formatted again.
+ */
+void blog_bin_stop(void);
+
+/**
+ * Render the content of a binary log file as text, as #blog() would have
+ * formatted the messages with the log decoration in effect when the
+ * binary log was started. The file must be written on the same platform.
+ *
+ * @param data	    Content of the file.
+ * @param size	    Size of the content.
+ * @param writer    Function to receive the messages, oldest first.
+ *
+ * @return	    BASE_SUCCESS, or BASE_EINVAL if this is not a binary log
+ *		    file.
+ */
+bstatus_t blog_bin_decode(const void *data, bsize_t size, blog_func *writer);
+
+/**
+ * Internal function to render the decoration of a log message.
+ *
+ * @return	    Length of the decoration.
+ */
+int blog_decorate(char *buf, unsigned decor, int level, const btime_val *now,
+	const char *sender, const char *thread_name, bbool_t thread_switched, int indent);
+
+/**
+ * Internal function to be called by #blog(), to record the message in the
+ * binary log.
+ *
+ * @return	    BASE_TRUE when it is recorded and needs no formatting.
+ */
+bbool_t extLogBinWrite(const char *sender, int level, int indent, const char *format, va_list marker);
+
 /**
  * Internal function to be called by libBaseInit()
  */
@@ -230,6 +447,15 @@ bstatus_t extLogInit(void);
 #define blog_get_color(level) 0
 
 #define extLogInit()	BASE_SUCCESS
+#define blog_set_batch_func(func)
+#define blog_get_batch_func()	NULL
+#define blog_async_cfg_default(cfg)
+#define blog_set_async(enable, cfg)	BASE_SUCCESS
+#define blog_get_dropped()	0
+#define blog_bin_cfg_default(cfg)
+#define blog_bin_start(path, cfg)	BASE_ENOTSUP
+#define blog_bin_stop()
+#define blog_bin_decode(data, size, writer)	BASE_ENOTSUP
 
 #endif	/* #if BASE_LOG_MAX_LEVEL >= 1 */
 
@@ -364,6 +364,20 @@ bstatus_t bthread_get_stack_info(bthread_t *thread,
  */
 bstatus_t bthreadLocalAlloc(long *index);
 
+/**
+ * Allocate thread local storage index, like #bthreadLocalAlloc(), with a
+ * function called when a thread exits with a non-NULL value at the index.
+ * The value is reset to NULL before the function is called with it. The
+ * function is not called once the index is deallocated, nor for the main
+ * thread returning from main().
+ *
+ * @param index	    Pointer to hold the return value.
+ * @param destructor Function called with the value of the exiting thread.
+ * @return	    BASE_SUCCESS on success, BASE_ENOTSUP when the platform
+ *		    can't call a function at thread exit, or the error code.
+ */
+bstatus_t bthreadLocalAlloc2(long *index, void (*destructor)(void *value));
+
 /**
  * Deallocate thread local variable.
  *
@@ -281,6 +281,8 @@ typedef struct bpool_block
     unsigned char    *buf;                      /**< Start of buffer.       */
     unsigned char    *cur;                      /**< Current alloc ptr.     */
     unsigned char    *end;                      /**< End of buffer.         */
+    struct bpool_block *free_prev, *free_next;  /**< Index of the blocks
+						     with free space.	    */
 } bpool_block;
 
 
@@ -313,6 +315,14 @@ struct _bpool_t
     /** The callback to be called when the pool is unable to allocate memory. */
     bpool_callback *callback;
 
+    /** Blocks other than the current one (the first of block_list) which
+     *  have free space, by size of the space. Created when the pool grows.
+     */
+    struct bpool_block_index *block_index;
+
+    /** Free space at the end of the blocks other than the current one. */
+    bsize_t	    wasted_size;
+
 };
 
 
@@ -428,6 +438,18 @@ bsize_t bpool_get_capacity( bpool_t *pool );
  */
 bsize_t bpool_get_used_size( bpool_t *pool );
 
+/**
+ * Get the number of bytes left at the end of the blocks which are no longer
+ * the current block of the pool. These bytes only can serve allocations
+ * which fit in them, a large value means that the increment size of the
+ * pool is too small for its allocations.
+ *
+ * @param pool	the pool.
+ *
+ * @return the wasted size.
+ */
+bsize_t bpool_get_wasted_size( bpool_t *pool );
+
 /**
  * Allocate storage with the specified size from the pool.
  * If there's no storage available in the pool, then the pool can allocate more
@@ -809,7 +831,9 @@ struct _bcaching_pool
      *  and available for application in this factory. The factory's
      *  capacity represents the size of all pools kept by this factory
      *  in it's free list, which will be returned to application when it
-     *  requests to create a new pool.
+     *  requests to create a new pool. The pools kept in the thread caches
+     *  are counted too, up to the last time each thread took the lock of
+     *  the factory.
      */
     bsize_t	    capacity;
 
@@ -823,7 +847,8 @@ struct _bcaching_pool
     /**
      * Number of pools currently held by applications. This number gets
      * incremented everytime #bpool_create() is called, and gets
-     * decremented when #bpool_release() is called.
+     * decremented when #bpool_release() is called. The pools created with
+     * the thread caches are not counted here, but in the thread caches.
      */
     bsize_t       used_count;
 
@@ -857,6 +882,27 @@ struct _bcaching_pool
      * Mutex.
      */
     block_t	   *lock;
+
+    /**
+     * Number of pools of each size kept in the cache of each thread, or
+     * zero when the thread caches are disabled.
+     */
+    unsigned	    magazine_size;
+
+    /**
+     * Thread local index of the cache of the calling thread.
+     */
+    long	    magazine_tls;
+
+    /**
+     * Caches of all threads.
+     */
+    struct bcaching_pool_magazine *magazines;
+
+    /**
+     * Number of pools moved between the thread caches and the free lists.
+     */
+    bsize_t	    magazine_refills, magazine_flushes;
 };
 
 
@@ -884,6 +930,53 @@ void bcaching_pool_init( bcaching_pool *ch_pool,
  */
 void bcaching_pool_destroy( bcaching_pool *ch_pool );
 
+/**
+ * Enable or disable the per-thread caches (magazines) of the caching pool.
+ * With the thread caches, each thread keeps up to \a size released pools
+ * of each size class and creates its next pools from them without taking
+ * the lock of the caching pool. A thread moves half of its cache back to
+ * the free lists of the caching pool when the cache is full, and takes
+ * half a cache from them when it is empty. When the free lists have no pool
+ * of the size either, it takes them from the caches of the idle threads,
+ * including the threads which have exited.
+ *
+ * The pools held in the thread caches are counted in the capacity of the
+ * caching pool each time the thread takes the lock of the caching pool, so
+ * the thread caches may go over the maximum capacity in between. The pools
+ * created with the thread caches enabled are in the used list of the cache
+ * of the creating thread rather than of the caching pool. They are still
+ * listed by the detailed #bpool_factory_dump() and destroyed by
+ * #bcaching_pool_destroy(), but a second release of them is not detected.
+ * Thus the thread caches are never enabled when BASE_SAFE_POOL is set.
+ *
+ * Setting the size to zero disables the thread caches and moves the pools
+ * of all caches back to the free lists, see
+ * #bcaching_pool_flush_magazines().
+ *
+ * This must be called after #bcaching_pool_init(), and the thread caches
+ * must be enabled before other threads use the caching pool. The initial
+ * value is BASE_CACHING_POOL_MAGAZINE_SIZE.
+ *
+ * @param ch_pool	The caching pool.
+ * @param size		Number of pools of each size class in each thread
+ *			cache, or zero to disable the thread caches.
+ *
+ * @return		BASE_SUCCESS, or the appropriate error code.
+ */
+bstatus_t bcaching_pool_set_magazine( bcaching_pool *ch_pool, unsigned size );
+
+/**
+ * Move the pools of the thread caches back to the free lists of the caching
+ * pool, where any thread creates its pools from. The caches of the threads
+ * which are creating or releasing a pool at the same time are skipped.
+ * Application may call this periodically, or when threads which used the
+ * caching pool have exited, so that their pools are not kept until
+ * #bcaching_pool_destroy().
+ *
+ * @param ch_pool	The caching pool.
+ */
+void bcaching_pool_flush_magazines( bcaching_pool *ch_pool );
+
 /**
  * @}	// BASE_CACHING_POOL
  */
@@ -637,6 +637,17 @@ typedef struct bsockopt_params
     } options[BASE_MAX_SOCKOPT_PARAMS];
 } bsockopt_params;
 
+/**
+ * One buffer of a scatter/gather send, see #bsock_sendv(). On POSIX it has
+ * the layout of struct iovec, so an array of it is given to the kernel as
+ * it is.
+ */
+struct bsock_iovec
+{
+    void	*base;		/**< Start of the buffer.	*/
+    bsize_t	 len;		/**< Length of the buffer.	*/
+};
+
 /*****************************************************************************
  *
  * SOCKET ADDRESS MANIPULATION.
@@ -1453,6 +1464,27 @@ bstatus_t bsock_sendto(bsock_t sockfd,
 				    const bsockaddr_t *to,
 				    int tolen);
 
+/**
+ * Transmit the buffers of \a iov to the socket in order, with one system
+ * call (sendmsg() or WSASend()). As with #bsock_send(), a stream socket
+ * may take only part of the data; the length returned may end in the
+ * middle of any buffer.
+ *
+ * @param sockfd	Socket descriptor.
+ * @param iov		Array of buffers to be sent.
+ * @param count		Number of buffers, up to #BASE_SOCK_MAX_IOV.
+ * @param len		Upon return, it will be filled with the length
+ *			of data sent.
+ * @param flags		Flags (such as bMSG_DONTROUTE()).
+ *
+ * @return		BASE_SUCCESS or the status code.
+ */
+bstatus_t bsock_sendv(bsock_t sockfd,
+				   const bsock_iovec iov[],
+				   unsigned count,
+				   bssize_t *len,
+				   unsigned flags);
+
 #if BASE_HAS_TCP
 /**
  * The shutdown call causes all or part of a full-duplex connection on the
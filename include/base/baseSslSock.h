@@ -8,7 +8,7 @@
  * @brief Secure socket
  */
 
-#include <baseIoQueue.h>
+#include <baseIoqueue.h>
 #include <baseSock.h>
 #include <baseSockQos.h>
 
@@ -764,6 +764,32 @@ typedef struct bssl_sock_info
      */
     bgrp_lock_t *grp_lock;
 
+    /**
+     * Describes whether the handshake resumed a previous session, this
+     * will only be set when connection is established.
+     */
+    bbool_t session_reused;
+
+    /**
+     * Number of handshakes which resumed a session, for all secure
+     * sockets with \a session_cache enabled.
+     */
+    unsigned session_hits;
+
+    /**
+     * Number of handshakes which could not resume a session and did the
+     * full handshake, for all secure sockets with \a session_cache
+     * enabled.
+     */
+    unsigned session_misses;
+
+    /**
+     * Describes whether the records sent are encrypted by the kernel
+     * (kernel TLS), see bssl_sock_param::ktls. This will only be set
+     * when connection is established.
+     */
+    bbool_t ktls_tx;
+
 } bssl_sock_info;
 
 
@@ -1036,6 +1062,42 @@ typedef struct bssl_sock_param
      */
     bbool_t sockopt_ignore_error;
 
+    /**
+     * Enable TLS session resumption, so that reconnection does not need
+     * the full handshake. A client socket keeps the session in a cache
+     * shared by all secure sockets, keyed by \a server_name (or remote
+     * address) and port, and offers it when connecting to the same
+     * server again; see BASE_SSL_SOCK_SESS_CACHE_SIZE. A server socket
+     * issues session tickets, which are encrypted with a key of its
+     * listener, and only resumes the sessions established with the same
+     * certificates and client verification. Only sessions whose peer
+     * certificate has been verified successfully are kept, and the cache
+     * is freed when the library shuts down.
+     *
+     * This is only supported by the OpenSSL backend (1.1.1 or later).
+     *
+     * Default: BASE_TRUE
+     */
+    bbool_t session_cache;
+
+    /**
+     * Offload the encryption of the records sent to the kernel (kernel
+     * TLS) after the handshake, when both the kernel and the SSL backend
+     * support it for the negotiated cipher. Data given to
+     * bssl_sock_send() is then written to the socket as is, and a file
+     * can be sent without copying with bssl_sock_sendfile(). Received
+     * records are still decrypted by the backend. Without the support,
+     * or if the key cannot be installed, the socket silently keeps
+     * encrypting the records itself.
+     *
+     * This is only supported by the OpenSSL backend (3.0 or later, built
+     * with kernel TLS) on Linux, for stream sockets. Renegotiation is
+     * disabled once the kernel encrypts the records.
+     *
+     * Default: BASE_FALSE
+     */
+    bbool_t ktls;
+
 } bssl_sock_param;
 
 
@@ -1318,6 +1380,32 @@ bstatus_t bssl_sock_sendto(bssl_sock_t *ssock,
 					const bsockaddr_t *addr,
 					int addr_len);
 
+/**
+ * Send part of a file using the socket, without copying the file data
+ * to user space. This requires the records to be encrypted by the
+ * kernel, see \a ktls in #bssl_sock_param, and is done synchronously:
+ * only the data the socket can take now is sent.
+ *
+ * @param ssock		The secure socket.
+ * @param fd		The file, opened with bfile_open().
+ * @param offset	On input, the position in the file to start from.
+ *			On return, the position after the data sent.
+ * @param size		On input, the size of the data to be sent. On
+ *			return, the size of the data actually sent.
+ *
+ * @return		BASE_SUCCESS if some data has been sent, BASE_EBUSY
+ *			if data given to bssl_sock_send() before is still
+ *			being sent (try again from \a on_data_sent()), or
+ *			BASE_ENOTSUP if the kernel does not encrypt the
+ *			records, in which case application should read the
+ *			file and use bssl_sock_send(). Any other return
+ *			value indicates error condition.
+ */
+bstatus_t bssl_sock_sendfile(bssl_sock_t *ssock,
+					  bOsHandle_t fd,
+					  boff_t *offset,
+					  bssize_t *size);
+
 
 /**
  * Starts asynchronous socket accept() operations on this secure socket. 
@@ -129,6 +129,81 @@ bsize_t btimer_heap_mem_size(bsize_t count);
  */
 bstatus_t btimer_heap_create( bpool_t *pool,  bsize_t count, btimer_heap_t **ht);
 
+/**
+ * Implementation of the timer heap, see #btimer_heap_cfg.
+ */
+typedef enum btimer_heap_type
+{
+    /** Binary heap: O(log N) schedule, cancel and expiry, exact ordering. */
+    BASE_TIMER_HEAP_BINARY,
+
+    /**
+     * Hierarchical timing wheel: O(1) schedule and cancel. Timers expire
+     * on the first tick of the wheel at or after their time, timers due
+     * in the same tick expire in the order they were scheduled. Suited to
+     * large numbers of timers which are mostly cancelled before expiry
+     * (keep-alive, retransmission, transaction timeouts).
+     */
+    BASE_TIMER_HEAP_WHEEL
+
+} btimer_heap_type;
+
+/**
+ * Timer heap settings given to #btimer_heap_create2().
+ */
+typedef struct btimer_heap_cfg
+{
+    /**
+     * Implementation of the timer heap.
+     *
+     * Default: BASE_TIMER_HEAP_DEFAULT_TYPE
+     */
+    btimer_heap_type type;
+
+    /**
+     * Tick of the timing wheel, in milliseconds, rounded down to a power
+     * of two. Only used with BASE_TIMER_HEAP_WHEEL.
+     *
+     * Default: BASE_TIMER_WHEEL_TICK_MSEC
+     */
+    unsigned wheel_tick_msec;
+
+    /**
+     * Expire timers in batches: btimer_heap_poll() removes all the expired
+     * timers (up to the limit set by btimer_heap_set_max_timed_out_per_poll())
+     * while holding the lock once, then calls their callbacks and releases
+     * their group locks without the lock. A timer of the batch which is
+     * cancelled or rescheduled before its callback is called, e.g. by the
+     * callback of another timer of the batch, is not called, as with the
+     * default poll.
+     *
+     * Default: BASE_TIMER_BATCH_POLL
+     */
+    bbool_t batch_poll;
+
+} btimer_heap_cfg;
+
+/**
+ * Initialize the timer heap settings with the default values.
+ *
+ * @param cfg       The settings to be initialized.
+ */
+void btimer_heap_cfg_default(btimer_heap_cfg *cfg);
+
+/**
+ * Create a timer heap with the specified implementation. All other
+ * btimer_heap_* functions work the same way with all implementations.
+ *
+ * @param pool      The pool, see #btimer_heap_create().
+ * @param count     The initial number of timer entries, see
+ *                  #btimer_heap_create().
+ * @param cfg       The settings, or NULL for the default settings.
+ * @param ht        Pointer to receive the created timer heap.
+ *
+ * @return          BASE_SUCCESS, or the appropriate error code.
+ */
+bstatus_t btimer_heap_create2( bpool_t *pool, bsize_t count, const btimer_heap_cfg *cfg, btimer_heap_t **ht);
+
 /** Destroy the timer heap */
 void btimer_heap_destroy( btimer_heap_t *ht );
 
@@ -289,6 +364,10 @@ bsize_t btimer_heap_count( btimer_heap_t *ht );
  * MUST have at least one timer being scheduled (application should use
  * #btimer_heap_count() before calling this function).
  *
+ * With BASE_TIMER_HEAP_WHEEL this is a lower bound: the start of the first
+ * tick at which the wheel has work to do, which is found without walking
+ * the timers, and it is in the past when some timers are already due.
+ *
  * @param ht        The timer heap.
  * @param timeval   The time deadline of the earliest timer entry.
  *
@@ -7,7 +7,9 @@
 
 
 /**
- * This is a very simple implementation of a fifo.
+ * Bounded multi-producer/single-consumer fifo: any thread can add elements, only one thread
+ * (normally the owner CmnThread) gets them. Adding does not allocate nor lock; the consumer
+ * blocks on a futex when the fifo is empty.
  */
 
 #ifdef __cplusplus
@@ -17,6 +19,8 @@ extern "C"
 
 #define	DEFAULT_THREAD_QUEUE_LENGTH			100
 
+#define	CMN_FIFO_CACHE_LINE					64
+
 typedef enum
 {
 	ok,
@@ -25,22 +29,36 @@ typedef enum
 }cmn_fifo_etat;
 
 
+typedef struct
+{
+	volatile unsigned int	seq;		/**@internal position the slot is ready for */
+	void					*element;
+}cmn_fifo_slot_t;
+
+
 typedef struct cmn_fifo cmn_fifo_t;
 
 struct cmn_fifo
 {
-	cmn_mutex_t			*qislocked;  /**@internal */
-#if defined(HAVE_SEMAPHORE_H)
-	cmn_sem_t			*qisempty;     /**@internal */
-#else
+	cmn_fifo_slot_t		*slots;		/**@internal ring of elements, size is power of 2 */
+	unsigned int			mask;		/**@internal size of ring - 1 */
+	int					maxSize;
+
+	char					pad0[CMN_FIFO_CACHE_LINE];
+	volatile unsigned int	tail;		/**@internal next position claimed by producers */
+	char					pad1[CMN_FIFO_CACHE_LINE];
+	volatile unsigned int	head;		/**@internal next position read by consumer */
+	char					pad2[CMN_FIFO_CACHE_LINE];
+	volatile int			waiting;		/**@internal consumer is blocked on it */
+	volatile int			kick;		/**@internal cmn_fifo_wake() is pending */
+	char					pad3[CMN_FIFO_CACHE_LINE];
+
+	cmn_mutex_t			*qislocked;  /**@internal protects front */
+#if !defined(__linux__)
 	cmn_cond_t			*qisempty;     /**@internal */
 #endif
-
-	cmn_list_t			*queue;            /**< list of nodes containing elements */
-	int					nb_elt;                    /**< nb of elements */
-	cmn_fifo_etat			etat;           /**@internal state of the fifo */
-
-	int					maxSize;
+	cmn_list_t			*front;            /**< elements inserted at the beginning */
+	volatile int			nbFront;
 };
 
 /**
@@ -59,16 +77,18 @@ void cmn_fifo_free (cmn_fifo_t * ff);
 int cmn_fifo_insert (cmn_fifo_t * ff, void *element);
 
 /**
- * Add an element in a fifo.
+ * Add an element in a fifo. Can be called by any thread.
  * @param ff The element to work on.
  * @param element The pointer on the element to add.
+ * @return 0, or -1 when the fifo is full.
  */
 int cmn_fifo_add (cmn_fifo_t * ff, void *element);
 
 /* Get the number of element in a fifo. * @param ff The element to work on. */
 int cmn_fifo_size (cmn_fifo_t * ff);
 
-/* Get an element from a fifo or block until one is added. * @param ff The element to work on. */
+/* Get an element from a fifo or block until one is added. Only one thread can get from a fifo.
+ * @param ff The element to work on. */
 void *cmn_fifo_get (cmn_fifo_t * ff);
 
 
@@ -78,6 +98,34 @@ void *cmn_fifo_get (cmn_fifo_t * ff);
  */
 void *cmn_fifo_tryget (cmn_fifo_t * ff);
 
+/**
+ * Get up to max elements from a fifo in order, or block until one is added.
+ * @param ff The element to work on.
+ * @param elements Array receiving the elements.
+ * @param max Size of elements.
+ * @return number of elements got, at least 1.
+ */
+int cmn_fifo_get_batch (cmn_fifo_t * ff, void **elements, int max);
+
+/**
+ * Same as cmn_fifo_get_batch(), but do not block if there is no element.
+ * @return number of elements got, 0 when the fifo is empty.
+ */
+int cmn_fifo_tryget_batch (cmn_fifo_t * ff, void **elements, int max);
+
+/**
+ * Same as cmn_fifo_get_batch(), but block at most ms milliseconds (no limit when ms < 0), and
+ * return at once when cmn_fifo_wake() has been called since the last call.
+ * @return number of elements got, 0 on timeout or wake.
+ */
+int cmn_fifo_get_batch_timed (cmn_fifo_t * ff, void **elements, int max, int ms);
+
+/**
+ * Make the consumer return from cmn_fifo_get_batch_timed(), or its next call return at once.
+ * Can be called by any thread; other get functions are not affected.
+ */
+void cmn_fifo_wake (cmn_fifo_t * ff);
+
 #ifdef __cplusplus
 }
 #endif
@@ -52,11 +52,16 @@ struct	_transition_table_t
 typedef	struct	_transition_table_t			statemachine_t;
 
 
+/* jump table of state x event, built from states by cmnFsmCompile() */
+typedef	struct _cmn_fsm_table		cmn_fsm_table_t;
+
 typedef	struct	_SERVICE_FSM
 {
 	int					size;
 	char					*name;
 	statemachine_t		*states;
+
+	cmn_fsm_table_t		*table;		/* NULL until compiled */
 }SERVICE_FSM;
 
 
@@ -78,8 +83,32 @@ typedef	struct	_FSM_OWNER
 }FSM_OWNER;
 
 
+/* counters of one transition, only updated when profiling is enabled */
+typedef	struct
+{
+	unsigned long			hits;
+	unsigned long long		nsecs;		/* total time in handler */
+	unsigned long long		maxNsecs;
+}CmnFsmStats;
+
+
 int cmnFsmHandle(void *ctx, void *_event);
 
+/* handle events in order; returns number of events handled, which is less than size when one fails */
+int cmnFsmHandleBatch(void *ctx, void **events, int size);
+
+/* Build the jump table of FSM, so an event is dispatched without searching states and transitions. 
+* Call it when FSM is registered; otherwise it is built when FSM handles its first event. 
+* States and transitions must not be changed afterwards */
+int cmnFsmCompile(SERVICE_FSM *fsm);
+void cmnFsmFree(SERVICE_FSM *fsm);
+
+/* count hits and time of every transition */
+void cmnFsmSetProfile(SERVICE_FSM *fsm, int enable);
+int cmnFsmGetStats(SERVICE_FSM *fsm, int state, int event, CmnFsmStats *stats);
+/* log counters of transitions which have been hit */
+void cmnFsmDumpStats(SERVICE_FSM *fsm);
+
 
 #endif
 
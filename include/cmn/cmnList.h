@@ -7,9 +7,11 @@
 
 
 /**
- * This is a very simple implementation of a linked list.
- * There is not much to say about it... Except that it could be a lot improved. Sadly, it would be difficult
- * to improve it without breaking the compatibility with older version!
+ * Doubly linked list with a tail pointer. Nodes come from slabs owned by the list; an empty list
+ * keeps one slab for the next elements, so a list must be released with cmn_list_free(),
+ * cmn_list_special_free() or cmn_list_ofchar_free().
+ * Operations on nodes and at both ends are O(1); the positional API (index from 0, or -1 for the
+ * end) walks from the closer end of the list.
  */
 #ifdef __cplusplus
 extern "C"
@@ -21,6 +23,7 @@ typedef struct __node __node_t;
 struct __node
 {
 	void		*next;			/**< next __node_t containing element */
+	void		*prev;			/**< previous __node_t containing element */
 	void		*element;              /**< element in Current node */
 };
 
@@ -30,8 +33,27 @@ struct cmn_list
 {
 	int			nb_elt;         /**< Number of element in the list */
 	__node_t		*node;     /**< Next node containing element  */
+	__node_t		*tail;		/**< Last node containing element */
+
+	__node_t		*freeNodes;	/**@internal unused nodes of the slabs */
+	void			*slabs;		/**@internal slabs of nodes */
+	int			slabSize;		/**@internal nodes of the next slab */
 };
 
+/* iterate nodes: a node is valid until its element is removed */
+#define	cmn_list_first(li)				((li)->node)
+#define	cmn_list_last(li)				((li)->tail)
+#define	cmn_list_next(n)				((__node_t *)(n)->next)
+#define	cmn_list_prev(n)				((__node_t *)(n)->prev)
+#define	cmn_list_node_element(n)		((n)->element)
+
+#define	CMN_LIST_FOREACH(li, n)	\
+		for((n) = cmn_list_first(li); (n) != NULL; (n) = cmn_list_next(n))
+
+/* same as CMN_LIST_FOREACH, but node 'n' can be removed in the loop */
+#define	CMN_LIST_FOREACH_SAFE(li, n, tmp)	\
+		for((n) = cmn_list_first(li); (n) != NULL && (((tmp) = cmn_list_next(n)), 1); (n) = (tmp))
+
 /**
  * NOTE: this element MUST be previously allocated. * @param li The element to initialise.
  */
@@ -43,6 +65,9 @@ int cmn_list_init (cmn_list_t * li);
 */
 int cmn_list_iterate(cmn_list_t * li, int isContinue, int (*iterateFunc) (int, void *ele, void *priv), void *data);
 
+/* Release the nodes of the list, but not its elements; the list is left empty */
+void cmn_list_free (cmn_list_t * li);
+
 /**
  * Free a list of element.
  * Each element will be free with the method given as the second parameter.
@@ -75,6 +100,16 @@ int cmn_list_add (cmn_list_t * li, void *element, int pos);
 #define	cmn_list_append(li, element)	\
 		cmn_list_add( (li), (element), -1 )
 
+/* Add an element at the end/beginning of a list. @return the new node, or NULL when out of memory */
+__node_t *cmn_list_push_back (cmn_list_t * li, void *element);
+__node_t *cmn_list_push_front (cmn_list_t * li, void *element);
+
+/* Remove a node of the list. @return the element of the node */
+void *cmn_list_remove_node (cmn_list_t * li, __node_t *node);
+
+/* Remove the first element of a list. @return the element, or NULL when the list is empty */
+void *cmn_list_pop_front (cmn_list_t * li);
+
 /*
  * Get an element from a list. @param li The element to work on. @param pos the index of the element to get.
  */
@@ -59,6 +59,10 @@ typedef enum
 #endif
 
 #define	CMN_PROGRAM_NAME_LENGTH			64
+
+#define	CMN_LOG_MAX_FILES				4
+#define	CMN_LOG_FLUSH_MSEC				1000
+#define	CMN_LOG_BUFFER_SIZE				(64*1024)
 struct log_object
 {
 	char			name[CMN_PROGRAM_NAME_LENGTH];
@@ -74,6 +78,12 @@ struct log_object
 	char			logFileName[256];
 
 	FILE			*fp;
+
+	/* buffered writer of USE_FILE, 0 means default for all of them */
+	int			maxFiles;			/* rotated files kept as logFileName.1 ... logFileName.N */
+	int			rotateSeconds;		/* also rotate when current file is older than this */
+	int			flushMsec;			/* interval of background flush */
+	int			bufferSize;			/* in byte */
 };
 
 typedef struct log_object log_stru_t;
@@ -89,6 +99,12 @@ cmn_log_level_t get_current_level();
 
 int cmn_log_init(log_stru_t *lobj);
 
+/* write out messages buffered in log file */
+void cmn_log_flush(void);
+
+/* flush and close log file, stop background flush */
+void cmn_log_close(void);
+
 
 #if CMN_SHARED_DEBUG
 	#ifndef	TRACE
@@ -23,6 +23,8 @@ extern "C"
 
 #define	CMN_THREAD_FLAG_WAIT				1
 
+#define	CMN_THREAD_FLAG_BATCH				2	/* handle all queued events in one loop, within the budget */
+
 
 #define	CMN_THREAD_FLAG_DYNAMIC			16	/* dynamic thread, detached thread */
 
@@ -35,6 +37,19 @@ extern "C"
 					CMN_CHECK_BIT(th->flags, CMN_THREAD_FLAG_WAIT)
 
 
+/* batch mode: one loop handles queued events until eventBudget events or eventTimeBudget ms are
+* used, then returns to mainLoop, so a burst of events does not hold up mainLoop and timers */
+#define	CMN_THREAD_BATCH_SET(th)	\
+					CMN_SET_BIT(th->flags, CMN_THREAD_FLAG_BATCH)
+
+#define	CMN_THREAD_BATCH_CHECK(th)	\
+					CMN_CHECK_BIT(th->flags, CMN_THREAD_FLAG_BATCH)
+
+/* default budget of one loop in batch mode, used when eventBudget/eventTimeBudget is 0 */
+#define	CMN_THREAD_EVENT_BUDGET			64
+#define	CMN_THREAD_EVENT_TIME_BUDGET		CMN_TIMESLICE	/* ms */
+
+
 #define	CMN_THREAD_DYNAMIC_SET(th)	\
 					CMN_SET_BIT(th->flags, CMN_THREAD_FLAG_DYNAMIC)
 
@@ -42,6 +57,16 @@ extern "C"
 					CMN_CHECK_BIT(th->flags, CMN_THREAD_FLAG_DYNAMIC)
 
 
+/* counters of event handling, updated by the thread itself without lock */
+typedef	struct
+{
+	unsigned long		events;		/* events handled */
+	unsigned long		wakeups;		/* loops which handled events */
+	int				maxBatch;		/* most events handled in one loop */
+	int				maxDepth;		/* most events queued when a loop started */
+}CmnThreadStats;
+
+
 typedef	struct _CmnThread
 {
 	char				name[CMN_NAME_LENGTH];
@@ -54,6 +79,12 @@ typedef	struct _CmnThread
 
 	int				flags;
 
+	int				eventBudget;		/* max events of one loop in batch mode */
+	int				eventTimeBudget;	/* max ms of one loop in batch mode */
+	CmnThreadStats	stats;
+
+	cmn_timer_ctx_t	*timers;			/* timers running in this thread, see cmnThreadAddTimer() */
+
 	int				(*init)(struct _CmnThread *th, void *data);
 
 	int				(*mainLoop)(struct _CmnThread *th);
@@ -86,6 +117,17 @@ void cmnThreadLibDestroy(void);
 cmn_list_t *cmnThreadLockList(void);
 void cmnThreadReleaseList(void );
 
+/* Add a timer running in the thread itself, between mainLoop and events, so its callback needs no lock
+* for the data of the thread. Can be called from any thread. Returns a timer ID, or NULL when an error occurs.
+* A thread blocked on its queue wakes up for its timers; mainLoop which blocks otherwise can poll 
+* cmn_timer_ctx_fd(th->timers) */
+void *cmnThreadAddTimer(CmnThread *th, int interval /* in unit of ms, round to 10 ms */, CMN_THREAD_TIMER_CALLBACK callback, void *param, cmn_timer_type type, const char *name);
+int cmnThreadRemoveTimer(CmnThread *th, void *timer);
+
+void cmnThreadGetStats(CmnThread *th, CmnThreadStats *stats);
+/* log queue depth and events per wake-up of all threads in thread list */
+void cmnThreadDumpStats(void);
+
 
 #ifdef __cplusplus
 }
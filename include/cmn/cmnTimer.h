@@ -35,6 +35,10 @@ typedef enum
 
 #define	CMN_TIMER_NAME_LENGTH		256
 
+/* slots of the timing wheel, power of 2; one slot per CMN_TIMER_RESOLUTION, so timers up to
+* 5.12 seconds are found in one turn of the wheel */
+#define	CMN_TIMER_WHEEL_SIZE		512
+
 
 /* Function prototype for the timer callback function */
 typedef int (*CMN_ALARM_TIMER_CALLBACK)(int interval);
@@ -62,17 +66,12 @@ extern void cmn_delay(int	ms);
 *
 * To cancel a currently running timer, call cmn_set_timer(0, NULL);
 *
-* The timer callback function may run in a different thread than your
-* main code, and so shouldn't call any functions from within itself.
+* The callback runs in the timer thread, as the timers of cmn_add_timer(), not in a signal handler.
 *
 * The maximum resolution of this timer is 10 ms, which means that if you request a 16 ms timer, your 
 * callback will run approximately 20 ms later on an unloaded system.  If you wanted to set a flag signaling
 * a frame update at 30 frames per second (every 33 ms), you might set a timer for 30 ms:
 *   cmn_set_timer((33/10)*10, flag_update);
-*
-* Under UNIX, you should not use raise or use SIGALRM and this function in the same program, as it is 
-* implemented using setitimer().  You also should not use this function in multi-threaded applications as 
-* signals to multi-threaded apps have undefined behavior in some implementations.
  */
 extern int cmn_set_timer(int interval /* in unit of ms, round to 10 ms */, CMN_ALARM_TIMER_CALLBACK callback);
 
@@ -91,5 +90,33 @@ extern	void cmn_timer_quit(void);
 
 extern	void cmn_cancel_timers(cmn_timer_mode_t mode);
 
+
+/* Timer context: a hashed timing wheel whose timers run in the thread calling cmn_timer_ctx_run().
+* Adding and removing are O(1) and can be done from any thread; timers expiring in the same tick
+* run in one pass. cmn_add_timer() uses the context of the timer thread, a CmnThread has its own 
+* with cmnThreadAddTimer().
+*/
+typedef	struct cmn_timer_ctx	cmn_timer_ctx_t;
+
+extern	cmn_timer_ctx_t *cmn_timer_ctx_create(const char *name);
+extern	void cmn_timer_ctx_destroy(cmn_timer_ctx_t *ctx);
+
+extern	void *cmn_timer_ctx_add(cmn_timer_ctx_t *ctx, int interval /* in unit of ms */, CMN_THREAD_TIMER_CALLBACK callback, void *param, cmn_timer_type type, const char *name);
+/* Returns a boolean value indicating success; a timer removed while its callback runs is freed after it */
+extern	int cmn_timer_ctx_remove(cmn_timer_ctx_t *ctx, void *_tid);
+extern	void cmn_timer_ctx_remove_all(cmn_timer_ctx_t *ctx);
+
+/* Run the timers expired until now. Returns ms until the next timer may expire, or -1 when there is no timer */
+extern	int cmn_timer_ctx_run(cmn_timer_ctx_t *ctx);
+
+/* timerfd which is readable when timers of the context have expired, so the running thread can poll it 
+* with its other fds; -1 if not supported */
+extern	int cmn_timer_ctx_fd(cmn_timer_ctx_t *ctx);
+
+/* wakeup is called when a timer is added which expires before the time returned by the last 
+* cmn_timer_ctx_run(), so the running thread can shorten its wait. It is called with the context 
+* locked, and must not use the context */
+extern	void cmn_timer_ctx_set_wakeup(cmn_timer_ctx_t *ctx, void (*wakeup)(void *data), void *data);
+
 #endif
 
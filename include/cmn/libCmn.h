@@ -29,6 +29,8 @@
 
 #define	CMN_THREAD_DEBUG						0
 
+#define	CMN_FSM_DEBUG							0
+
 #define	DEBUG_CONFIG_FILE						0
 
 
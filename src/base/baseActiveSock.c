@@ -6,6 +6,7 @@
 #include <baseAssert.h>
 #include <baseErrno.h>
 #include <baseLog.h>
+#include <baseOs.h>
 #include <basePool.h>
 #include <baseSock.h>
 #include <baseString.h>
@@ -38,6 +39,7 @@ struct read_op
 {
     bioqueue_op_key_t	 op_key;
     buint8_t		*pkt;
+    bactivesock_buf	*buf;
     unsigned		 max_size;
     bsize_t		 size;
     bsockaddr		 src_addr;
@@ -52,6 +54,20 @@ struct accept_op
     int			 rem_addr_len;
 };
 
+struct _bactivesock_buf_pool
+{
+    bpool_t		*pool;
+    bmutex_t		*mutex;
+    unsigned		 buff_size;
+    unsigned		 max_cnt;
+    unsigned		 count;
+    unsigned		 free_cnt;
+    bactivesock_buf	*free_list;
+};
+
+/* The data of a pooled read buffer follows its header */
+#define READ_BUF(pkt)	((bactivesock_buf*)(pkt) - 1)
+
 struct send_data
 {
     buint8_t		*data;
@@ -65,6 +81,7 @@ struct _bactivesock_t
     bioqueue_key_t	*key;
     bbool_t		 stream_oriented;
     bbool_t		 whole_data;
+    bbool_t		 batch_recv;
     bioqueue_t	*ioqueue;
     void		*user_data;
     unsigned		 async_count;
@@ -84,6 +101,7 @@ struct _bactivesock_t
     struct send_data	 send_data;
 
     struct read_op	*read_op;
+    bactivesock_buf_pool *bufpool;
     buint32_t		 read_flags;
     enum read_type	 read_type;
 
@@ -184,6 +202,7 @@ bstatus_t bactivesock_create( bpool_t *pool,	bsock_t sock, int sock_type,
 	asock->stream_oriented = (sock_type == bSOCK_STREAM());
 	asock->async_count = (opt? opt->async_cnt : 1);
 	asock->whole_data = (opt? opt->whole_data : 1);
+	asock->batch_recv = (opt && sock_type == bSOCK_DGRAM() && opt->async_cnt > 1 && opt->batch_recv);
 	asock->max_loop = BASE_ACTIVESOCK_MAX_LOOP;
 	asock->user_data = user_data;
 	bmemcpy(&asock->cb, cb, sizeof(*cb));
@@ -294,6 +313,21 @@ bstatus_t bactivesock_close(bactivesock_t *asock)
 	{
 		bioqueue_unregister(key);
 
+		/* Nothing reads into the buffers now, give them back */
+		if (asock->bufpool && asock->read_op)
+		{
+			unsigned i;
+
+			for (i=0; i<asock->async_count; ++i)
+			{
+				if (asock->read_op[i].buf)
+				{
+					bactivesock_buf_dec_ref(asock->read_op[i].buf);
+					asock->read_op[i].buf = NULL;
+				}
+			}
+		}
+
 #if defined(BASE_IPHONE_OS_HAS_MULTITASKING_SUPPORT) && \
 	BASE_IPHONE_OS_HAS_MULTITASKING_SUPPORT!=0
 		activesock_destroy_iphone_os_stream(asock);
@@ -318,6 +352,199 @@ void* bactivesock_get_user_data(bactivesock_t *asock)
 }
 
 
+bstatus_t bactivesock_buf_pool_create(bpool_t *pool, const char *name, unsigned buff_size, unsigned max_cnt,
+	bactivesock_buf_pool **p_bufpool)
+{
+	bactivesock_buf_pool *bufpool;
+	bstatus_t status;
+
+	BASE_ASSERT_RETURN(pool && buff_size && p_bufpool, BASE_EINVAL);
+
+	/* Own pool, buffers are allocated from it under the mutex */
+	pool = bpool_create(pool->factory, (name ? name : "abuf%p"), 4000, 4*(sizeof(bactivesock_buf) + buff_size), NULL);
+	if (!pool)
+		return BASE_ENOMEM;
+
+	bufpool = BASE_POOL_ZALLOC_T(pool, bactivesock_buf_pool);
+	bufpool->pool = pool;
+	bufpool->buff_size = buff_size;
+	bufpool->max_cnt = max_cnt;
+
+	status = bmutex_create_simple(pool, pool->objName, &bufpool->mutex);
+	if (status != BASE_SUCCESS)
+	{
+		bpool_release(pool);
+		return status;
+	}
+
+	*p_bufpool = bufpool;
+	return BASE_SUCCESS;
+}
+
+
+bstatus_t bactivesock_buf_pool_destroy(bactivesock_buf_pool *bufpool)
+{
+	BASE_ASSERT_RETURN(bufpool, BASE_EINVAL);
+
+	bmutex_lock(bufpool->mutex);
+	if (bufpool->free_cnt != bufpool->count)
+	{
+		bmutex_unlock(bufpool->mutex);
+		return BASE_EBUSY;
+	}
+	bmutex_unlock(bufpool->mutex);
+
+	bmutex_destroy(bufpool->mutex);
+	bpool_release(bufpool->pool);
+	return BASE_SUCCESS;
+}
+
+
+/* Take a buffer from the free list, or allocate a new one */
+static bstatus_t buf_pool_get(bactivesock_buf_pool *bufpool, bactivesock_buf **p_buf)
+{
+	bactivesock_buf *buf;
+
+	bmutex_lock(bufpool->mutex);
+	buf = bufpool->free_list;
+	if (buf)
+	{
+		bufpool->free_list = buf->next;
+		--bufpool->free_cnt;
+	}
+	else if (bufpool->max_cnt == 0 || bufpool->count < bufpool->max_cnt)
+	{
+		buf = (bactivesock_buf*) bpool_alloc(bufpool->pool, sizeof(bactivesock_buf) + bufpool->buff_size);
+		if (buf)
+		{
+			buf->data = buf + 1;
+			buf->max_size = bufpool->buff_size;
+			buf->pool = bufpool;
+			++bufpool->count;
+		}
+	}
+	bmutex_unlock(bufpool->mutex);
+
+	if (!buf)
+		return BASE_ENOMEM;
+
+	buf->ref_cnt = 1;
+	buf->next = NULL;
+	*p_buf = buf;
+	return BASE_SUCCESS;
+}
+
+
+void bactivesock_buf_add_ref(bactivesock_buf *buf)
+{
+	__atomic_add_fetch(&buf->ref_cnt, 1, __ATOMIC_RELAXED);
+}
+
+
+void bactivesock_buf_dec_ref(bactivesock_buf *buf)
+{
+	bactivesock_buf_pool *bufpool = buf->pool;
+
+	if (__atomic_sub_fetch(&buf->ref_cnt, 1, __ATOMIC_ACQ_REL) != 0)
+		return;
+
+	bmutex_lock(bufpool->mutex);
+	buf->next = bufpool->free_list;
+	bufpool->free_list = buf;
+	++bufpool->free_cnt;
+	bmutex_unlock(bufpool->mutex);
+}
+
+
+/* Take the read buffers of the active socket from the buffer pool */
+static bstatus_t get_read_bufs(bactivesock_t *asock, bpool_t *pool, bactivesock_buf_pool *bufpool, void ***p_readbuf)
+{
+	void **readbuf;
+	unsigned i;
+
+	BASE_ASSERT_RETURN(asock->read_type == TYPE_NONE, BASE_EINVALIDOP);
+
+	readbuf = (void**) bpool_calloc(pool, asock->async_count, sizeof(void*));
+
+	for (i=0; i<asock->async_count; ++i)
+	{
+		bactivesock_buf *buf;
+
+		if (buf_pool_get(bufpool, &buf) != BASE_SUCCESS)
+		{
+			while (i--)
+				bactivesock_buf_dec_ref(READ_BUF(readbuf[i]));
+			return BASE_ENOMEM;
+		}
+		readbuf[i] = buf->data;
+	}
+
+	asock->bufpool = bufpool;
+	*p_readbuf = readbuf;
+	return BASE_SUCCESS;
+}
+
+/* Before any read is issued, so that close finds all of them */
+static void attach_read_bufs(bactivesock_t *asock, void *readbuf[])
+{
+	unsigned i;
+
+	for (i=0; i<asock->async_count; ++i)
+		asock->read_op[i].buf = asock->bufpool ? READ_BUF(readbuf[i]) : NULL;
+}
+
+/* The application keeps the buffer of the read operation, continue with a
+ * new one, which starts with the remainder of the old one.
+ */
+static bstatus_t renew_read_buf(bactivesock_t *asock, struct read_op *r)
+{
+	bactivesock_buf *buf;
+	bstatus_t status;
+
+	status = buf_pool_get(asock->bufpool, &buf);
+	if (status != BASE_SUCCESS)
+		return status;
+
+	if (r->size)
+		bmemcpy(buf->data, r->pkt, r->size);
+
+	bactivesock_buf_dec_ref(r->buf);
+	r->buf = buf;
+	r->pkt = (buint8_t*) buf->data;
+	return BASE_SUCCESS;
+}
+
+
+bstatus_t bactivesock_start_read_buf(bactivesock_t *asock, bpool_t *pool, bactivesock_buf_pool *bufpool, buint32_t flags)
+{
+	void **readbuf;
+	bstatus_t status;
+
+	BASE_ASSERT_RETURN(asock && pool && bufpool, BASE_EINVAL);
+
+	status = get_read_bufs(asock, pool, bufpool, &readbuf);
+	if (status != BASE_SUCCESS)
+		return status;
+
+	return bactivesock_start_read2(asock, pool, bufpool->buff_size, readbuf, flags);
+}
+
+
+bstatus_t bactivesock_start_recvfrom_buf(bactivesock_t *asock, bpool_t *pool, bactivesock_buf_pool *bufpool, buint32_t flags)
+{
+	void **readbuf;
+	bstatus_t status;
+
+	BASE_ASSERT_RETURN(asock && pool && bufpool, BASE_EINVAL);
+
+	status = get_read_bufs(asock, pool, bufpool, &readbuf);
+	if (status != BASE_SUCCESS)
+		return status;
+
+	return bactivesock_start_recvfrom2(asock, pool, bufpool->buff_size, readbuf, flags);
+}
+
+
 bstatus_t bactivesock_start_read(bactivesock_t *asock,
 					     bpool_t *pool,
 					     unsigned buff_size,
@@ -357,6 +584,7 @@ bstatus_t bactivesock_start_read2( bactivesock_t *asock,
 				    sizeof(struct read_op));
     asock->read_type = TYPE_RECV;
     asock->read_flags = flags;
+    attach_read_bufs(asock, readbuf);
 
     for (i=0; i<asock->async_count; ++i) {
 	struct read_op *r = &asock->read_op[i];
@@ -377,6 +605,56 @@ bstatus_t bactivesock_start_read2( bactivesock_t *asock,
 }
 
 
+/* Queue read operations with bioqueue_recvfrom_batch() */
+static bstatus_t recvfrom_batch(bactivesock_t *asock, unsigned count, struct read_op *r[], buint32_t flags)
+{
+	bioqueue_op_key_t *op_key[BASE_IOQUEUE_MMSG_MAX];
+	void *buf[BASE_IOQUEUE_MMSG_MAX];
+	bssize_t size[BASE_IOQUEUE_MMSG_MAX];
+	bsockaddr_t *addr[BASE_IOQUEUE_MMSG_MAX];
+	int *addr_len[BASE_IOQUEUE_MMSG_MAX];
+	unsigned i;
+
+	BASE_ASSERT_RETURN(count <= BASE_IOQUEUE_MMSG_MAX, BASE_ETOOMANY);
+
+	for (i=0; i<count; ++i)
+	{
+		op_key[i] = &r[i]->op_key;
+		buf[i] = r[i]->pkt;
+		size[i] = r[i]->max_size;
+		addr[i] = &r[i]->src_addr;
+		r[i]->src_addr_len = sizeof(r[i]->src_addr);
+		addr_len[i] = &r[i]->src_addr_len;
+	}
+
+	return bioqueue_recvfrom_batch(asock->key, op_key, buf, size, count, flags, addr, addr_len);
+}
+
+static bstatus_t start_recvfrom_batch(bactivesock_t *asock, unsigned buff_size, void *readbuf[])
+{
+	struct read_op *r[BASE_IOQUEUE_MMSG_MAX];
+	unsigned i, cnt = 0;
+	bstatus_t status;
+
+	for (i=0; i<asock->async_count; ++i)
+	{
+		r[cnt] = &asock->read_op[i];
+		r[cnt]->pkt = (buint8_t*) readbuf[i];
+		r[cnt]->max_size = buff_size;
+
+		if (++cnt == BASE_IOQUEUE_MMSG_MAX || i == asock->async_count-1)
+		{
+			status = recvfrom_batch(asock, cnt, r, asock->read_flags);
+			if (status != BASE_EPENDING)
+				return status;
+			cnt = 0;
+		}
+	}
+
+	return BASE_SUCCESS;
+}
+
+
 bstatus_t bactivesock_start_recvfrom(bactivesock_t *asock,
 						 bpool_t *pool,
 						 unsigned buff_size,
@@ -416,6 +694,12 @@ bstatus_t bactivesock_start_recvfrom2( bactivesock_t *asock, bpool_t *pool, unsi
 	bpool_calloc(pool, asock->async_count, sizeof(struct read_op));
 	asock->read_type = TYPE_RECV_FROM;
 	asock->read_flags = flags;
+	attach_read_bufs(asock, readbuf);
+
+	if (asock->batch_recv)
+	{
+		return start_recvfrom_batch(asock, buff_size, readbuf);
+	}
 
 	for (i=0; i<asock->async_count; ++i)
 	{
@@ -478,9 +762,21 @@ static void ioqueue_on_read_complete(bioqueue_key_t *key,
 	    ret = BASE_TRUE;
 
 	    /* Notify callback */
-	    if (asock->read_type == TYPE_RECV && asock->cb.on_data_read) {
+	    if (asock->read_type == TYPE_RECV && r->buf &&
+		asock->cb.on_data_read_buf)
+	    {
+		ret = (*asock->cb.on_data_read_buf)(asock, r->buf, r->size,
+						    BASE_SUCCESS, &remainder);
+	    } else if (asock->read_type == TYPE_RECV && asock->cb.on_data_read) {
 		ret = (*asock->cb.on_data_read)(asock, r->pkt, r->size,
 						BASE_SUCCESS, &remainder);
+	    } else if (asock->read_type == TYPE_RECV_FROM && r->buf &&
+		       asock->cb.on_data_recvfrom_buf)
+	    {
+		ret = (*asock->cb.on_data_recvfrom_buf)(asock, r->buf, r->size,
+							&r->src_addr,
+							r->src_addr_len,
+							BASE_SUCCESS);
 	    } else if (asock->read_type == TYPE_RECV_FROM && 
 		       asock->cb.on_data_recvfrom) 
 	    {
@@ -534,7 +830,12 @@ static void ioqueue_on_read_complete(bioqueue_key_t *key,
 	    ret = BASE_TRUE;
 
 	    /* Notify callback */
-	    if (asock->read_type == TYPE_RECV && asock->cb.on_data_read) {
+	    if (asock->read_type == TYPE_RECV && r->buf &&
+		asock->cb.on_data_read_buf)
+	    {
+		ret = (*asock->cb.on_data_read_buf)(asock, r->buf, r->size,
+						    status, &remainder);
+	    } else if (asock->read_type == TYPE_RECV && asock->cb.on_data_read) {
 		/* For connection oriented socket, we still need to report 
 		 * the remainder data (if any) to the user to let user do 
 		 * processing with the remainder data before it closes the
@@ -552,7 +853,8 @@ static void ioqueue_on_read_complete(bioqueue_key_t *key,
 						status, &remainder);
 
 	    } else if (asock->read_type == TYPE_RECV_FROM && 
-		       asock->cb.on_data_recvfrom) 
+		       (asock->cb.on_data_recvfrom ||
+			(r->buf && asock->cb.on_data_recvfrom_buf)))
 	    {
 		/* This would always be datagram oriented hence there's 
 		 * nothing in the packet. We can't be sure if there will be
@@ -565,8 +867,14 @@ static void ioqueue_on_read_complete(bioqueue_key_t *key,
 		 * callback if the status is BASE_SUCCESS.
 		 */
 		if (status != BASE_SUCCESS ) {
-		    ret = (*asock->cb.on_data_recvfrom)(asock, NULL, 0,
-							NULL, 0, status);
+		    if (r->buf && asock->cb.on_data_recvfrom_buf) {
+			ret = (*asock->cb.on_data_recvfrom_buf)(asock, NULL, 0,
+								NULL, 0,
+								status);
+		    } else {
+			ret = (*asock->cb.on_data_recvfrom)(asock, NULL, 0,
+							    NULL, 0, status);
+		    }
 		}
 	    }
 
@@ -586,6 +894,29 @@ static void ioqueue_on_read_complete(bioqueue_key_t *key,
 	    }
 	}
 
+	/* The application has kept the buffer, which can't be read into
+	 * anymore. The read stops if there is no buffer left in the pool.
+	 */
+	if (r->buf && __atomic_load_n(&r->buf->ref_cnt, __ATOMIC_ACQUIRE) > 1) {
+	    status = renew_read_buf(asock, r);
+	    if (status != BASE_SUCCESS) {
+		bsize_t remainder = 0;
+
+		if (asock->read_type == TYPE_RECV &&
+		    asock->cb.on_data_read_buf)
+		{
+		    (*asock->cb.on_data_read_buf)(asock, NULL, 0, status,
+						  &remainder);
+		} else if (asock->read_type == TYPE_RECV_FROM &&
+			   asock->cb.on_data_recvfrom_buf)
+		{
+		    (*asock->cb.on_data_recvfrom_buf)(asock, NULL, 0, NULL, 0,
+						      status);
+		}
+		return;
+	    }
+	}
+
 	/* Read next data. We limit ourselves to processing max_loop immediate
 	 * data, so when the loop counter has exceeded this value, force the
 	 * read()/recvfrom() to return pending operation to allow the program
@@ -599,6 +930,9 @@ static void ioqueue_on_read_complete(bioqueue_key_t *key,
 	if (asock->read_type == TYPE_RECV) {
 	    status = bioqueue_recv(key, op_key, r->pkt + r->size, 
 				     &bytes_read, flags);
+	} else if (asock->batch_recv) {
+	    /* Back to the batch, the ioqueue fills it with the others */
+	    status = recvfrom_batch(asock, 1, &r, flags);
 	} else {
 	    r->src_addr_len = sizeof(r->src_addr);
 	    status = bioqueue_recvfrom(key, op_key, r->pkt + r->size,
@@ -700,6 +1034,21 @@ bstatus_t bactivesock_send( bactivesock_t *asock, bioqueue_op_key_t *send_key, c
 }
 
 
+bstatus_t bactivesock_sendv( bactivesock_t *asock, bioqueue_op_key_t *send_key, const bsock_iovec *iov, unsigned count,
+	bssize_t *size, unsigned flags)
+{
+	BASE_ASSERT_RETURN(asock && send_key && iov && count && size, BASE_EINVAL);
+
+	if (asock->shutdown & SHUT_TX)
+		return BASE_EINVALIDOP;
+
+	/* ioqueue sends the rest of a partial write itself */
+	send_key->activesock_data = NULL;
+
+	return bioqueue_sendv(asock->key, send_key, iov, count, size, flags);
+}
+
+
 bstatus_t bactivesock_sendto( bactivesock_t *asock, bioqueue_op_key_t *send_key, const void *data, bssize_t *size,
 	unsigned flags, const bsockaddr_t *addr, int addr_len)
 {
@@ -3,7 +3,7 @@
  */
 #include <baseConfig.h>
 #include <baseLog.h>
-#include <baseIoQueue.h>
+#include <baseIoqueue.h>
 
 static const char *id = "config.c";
 
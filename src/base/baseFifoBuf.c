@@ -47,7 +47,7 @@ void* bfifobuf_alloc (bfifobuf_t *fifobuf, unsigned size)
     BASE_CHECK_STACK();
 
     if (fifobuf->full) {
-	    BASE_INFO("fifobuf_alloc fifobuf=%p, size=%d: full!", fifobuf, size);
+	    BASE_HOT_INFO("fifobuf_alloc fifobuf=%p, size=%d: full!", fifobuf, size);
     	return NULL;
     }
 
@@ -69,7 +69,7 @@ void* bfifobuf_alloc (bfifobuf_t *fifobuf, unsigned size)
     	    *(unsigned*)ptr = size+SZ; // save length in ptr; length|return pointer position
     	    ptr += SZ;
 
-    	    BASE_INFO("fifobuf_alloc fifobuf=%p, size=%d: returning %p, p1=%p, p2=%p", fifobuf, size, ptr, fifobuf->ubegin, fifobuf->uend);
+    	    BASE_HOT_INFO("fifobuf_alloc fifobuf=%p, size=%d: returning %p, p1=%p, p2=%p", fifobuf, size, ptr, fifobuf->ubegin, fifobuf->uend);
     	    return ptr;
     	}
     }
@@ -88,11 +88,11 @@ void* bfifobuf_alloc (bfifobuf_t *fifobuf, unsigned size)
     	*(unsigned*)ptr = size+SZ;
     	ptr += SZ;
 
-    	BASE_INFO("fifobuf_alloc fifobuf=%p, size=%d: returning %p, p1=%p, p2=%p", fifobuf, size, ptr, fifobuf->ubegin, fifobuf->uend);
+    	BASE_HOT_INFO("fifobuf_alloc fifobuf=%p, size=%d: returning %p, p1=%p, p2=%p", fifobuf, size, ptr, fifobuf->ubegin, fifobuf->uend);
     	return ptr;
     }
 
-    BASE_INFO("fifobuf_alloc fifobuf=%p, size=%d: no space left! p1=%p, p2=%p", 
+    BASE_HOT_INFO("fifobuf_alloc fifobuf=%p, size=%d: no space left! p1=%p, p2=%p", 
 	       fifobuf, size, fifobuf->ubegin, fifobuf->uend);
     return NULL;
 }
@@ -120,7 +120,7 @@ bstatus_t bfifobuf_unalloc (bfifobuf_t *fifobuf, void *buf)
     fifobuf->uend = ptr;
     fifobuf->full = 0;
 
-    BASE_INFO("fifobuf_unalloc fifobuf=%p, ptr=%p, size=%d, p1=%p, p2=%p", fifobuf, buf, sz, fifobuf->ubegin, fifobuf->uend);
+    BASE_HOT_INFO("fifobuf_unalloc fifobuf=%p, ptr=%p, size=%d, p1=%p, p2=%p", fifobuf, buf, sz, fifobuf->ubegin, fifobuf->uend);
 
     return 0;
 }
@@ -163,7 +163,7 @@ bstatus_t bfifobuf_free (bfifobuf_t *fifobuf, void *buf)
 
     fifobuf->full = 0;
 
-    BASE_INFO("fifobuf_free fifobuf=%p, ptr=%p, size=%d, p1=%p, p2=%p", fifobuf, buf, sz, fifobuf->ubegin, fifobuf->uend);
+    BASE_HOT_INFO("fifobuf_free fifobuf=%p, ptr=%p, size=%d, p1=%p, p2=%p", fifobuf, buf, sz, fifobuf->ubegin, fifobuf->uend);
 
     return 0;
 }
@@ -14,6 +14,30 @@
  */
 #define BASE_HASH_MULTIPLIER	33
 
+/**
+ * Case folding of the keys of the *_lower functions. Only ASCII letters are
+ * folded, through a table built at compile time, so it costs a load instead
+ * of a call to tolower().
+ */
+#define HASH_FOLD(c)		((buint8_t)((c) + (((unsigned)(c) - 'A') < 26U ? 32 : 0)))
+#define HASH_FOLD4(c)		HASH_FOLD(c), HASH_FOLD(c+1), HASH_FOLD(c+2), HASH_FOLD(c+3)
+#define HASH_FOLD16(c)		HASH_FOLD4(c), HASH_FOLD4(c+4), HASH_FOLD4(c+8), HASH_FOLD4(c+12)
+#define HASH_FOLD64(c)		HASH_FOLD16(c), HASH_FOLD16(c+16), HASH_FOLD16(c+32), HASH_FOLD16(c+48)
+static const buint8_t hash_fold_table[256] = {
+    HASH_FOLD64(0), HASH_FOLD64(64), HASH_FOLD64(128), HASH_FOLD64(192)
+};
+#define HASH_TOLOWER(c)		(hash_fold_table[(buint8_t)(c)])
+
+/**
+ * Lowercase keys up to this length are folded once into a buffer on the
+ * stack. When such a key is copied to the pool, the folded key is stored
+ * after it, and the flag below is set in the key length of the entry, so
+ * the lookups compare the folded keys with memcmp().
+ */
+#define HASH_LOWER_BUF_SIZE	128
+#define HASH_KEY_FOLDED		0x80000000U
+#define HASH_KEYLEN(entry)	((entry)->keylen & ~HASH_KEY_FOLDED)
+
 
 struct _bhash_entry
 {
@@ -61,7 +85,7 @@ buint32_t bhash_calc_tolower( buint32_t hval,
     long i;
 
     for (i=0; i<key->slen; ++i) {
-        int lower = btolower(key->ptr[i]);
+        int lower = HASH_TOLOWER((buint8_t)key->ptr[i]);
 	if (result)
 	    result[i] = (char)lower;
 
@@ -101,6 +125,63 @@ bhash_table_t* bhash_create(bpool_t *pool, unsigned size)
     return h;
 }
 
+/* Calculate the hash of the key folded to lowercase, storing the folded key
+ * in buf as far as it fits. keylen may be BASE_HASH_KEY_STRING, the length
+ * of the key is returned in it.
+ */
+static buint32_t hash_calc_lower(const void *key, unsigned *keylen,
+				 buint8_t *buf, unsigned bufsize)
+{
+    const buint8_t *p = (const buint8_t*)key;
+    buint32_t hash = 0;
+    unsigned i;
+
+    if (*keylen==BASE_HASH_KEY_STRING) {
+	for (i=0; p[i] && i<bufsize; ++i) {
+	    buf[i] = HASH_TOLOWER(p[i]);
+	    hash = hash * BASE_HASH_MULTIPLIER + buf[i];
+	}
+	for ( ; p[i]; ++i)
+	    hash = hash * BASE_HASH_MULTIPLIER + HASH_TOLOWER(p[i]);
+	*keylen = i;
+    } else {
+	for (i=0; i<*keylen && i<bufsize; ++i) {
+	    buf[i] = HASH_TOLOWER(p[i]);
+	    hash = hash * BASE_HASH_MULTIPLIER + buf[i];
+	}
+	for ( ; i<*keylen; ++i)
+	    hash = hash * BASE_HASH_MULTIPLIER + HASH_TOLOWER(p[i]);
+    }
+
+    return hash;
+}
+
+static int hash_cmp_lower(const void *key1, const void *key2, unsigned keylen)
+{
+    const buint8_t *p1 = (const buint8_t*)key1, *p2 = (const buint8_t*)key2;
+    unsigned i;
+
+    for (i=0; i<keylen; ++i) {
+	if (HASH_TOLOWER(p1[i]) != HASH_TOLOWER(p2[i]))
+	    return 1;
+    }
+    return 0;
+}
+
+/* Match the key of the entry, which has the same hash and length. lower_key
+ * is the folded key, or NULL when it is not in the buffer.
+ */
+static bbool_t hash_key_match(const bhash_entry *entry, const void *key,
+			      unsigned keylen, bbool_t lower,
+			      const void *lower_key)
+{
+    if (lower && lower_key && (entry->keylen & HASH_KEY_FOLDED))
+	return bmemcmp((const char*)entry->key + keylen, lower_key, keylen)==0;
+
+    return bmemcmp(entry->key, key, keylen)==0 ||
+	   (lower && hash_cmp_lower(entry->key, key, keylen)==0);
+}
+
 static bhash_entry **find_entry( bpool_t *pool, bhash_table_t *ht, 
 				   const void *key, unsigned keylen,
 				   void *val, buint32_t *hval,
@@ -108,34 +189,37 @@ static bhash_entry **find_entry( bpool_t *pool, bhash_table_t *ht,
 {
     buint32_t hash;
     bhash_entry **p_entry, *entry;
+    buint8_t lower_buf[HASH_LOWER_BUF_SIZE];
+    const void *lower_key;
 
     if (hval && *hval != 0) {
 	hash = *hval;
 	if (keylen==BASE_HASH_KEY_STRING) {
 	    keylen = (unsigned)bansi_strlen((const char*)key);
 	}
+	if (lower && keylen <= sizeof(lower_buf)) {
+	    unsigned i;
+	    for (i=0; i<keylen; ++i)
+		lower_buf[i] = HASH_TOLOWER(((const buint8_t*)key)[i]);
+	}
     } else {
 	/* This slightly differs with bhash_calc() because we need 
 	 * to get the keylen when keylen is BASE_HASH_KEY_STRING.
 	 */
 	hash=0;
-	if (keylen==BASE_HASH_KEY_STRING) {
+	if (lower) {
+	    hash = hash_calc_lower(key, &keylen, lower_buf, sizeof(lower_buf));
+	} else if (keylen==BASE_HASH_KEY_STRING) {
 	    const buint8_t *p = (const buint8_t*)key;
 	    for ( ; *p; ++p ) {
-                if (lower)
-                    hash = hash * BASE_HASH_MULTIPLIER + btolower(*p);
-                else 
-		    hash = hash * BASE_HASH_MULTIPLIER + *p;
+		hash = hash * BASE_HASH_MULTIPLIER + *p;
 	    }
 	    keylen = (unsigned)(p - (const unsigned char*)key);
 	} else {
 	    const buint8_t *p = (const buint8_t*)key,
 				  *end = p + keylen;
 	    for ( ; p!=end; ++p) {
-		if (lower)
-                    hash = hash * BASE_HASH_MULTIPLIER + btolower(*p);
-                else
-                    hash = hash * BASE_HASH_MULTIPLIER + *p;
+		hash = hash * BASE_HASH_MULTIPLIER + *p;
 	    }
 	}
 
@@ -144,15 +228,18 @@ static bhash_entry **find_entry( bpool_t *pool, bhash_table_t *ht,
 	    *hval = hash;
     }
 
+    /* The keys are stored as given, see HASH_KEY_FOLDED for the folded
+     * copy of the lowercase keys.
+     */
+    lower_key = (lower && keylen <= sizeof(lower_buf)) ? lower_buf : NULL;
+
     /* scan the linked list */
     for (p_entry = &ht->table[hash & ht->rows], entry=*p_entry; 
 	 entry; 
 	 p_entry = &entry->next, entry = *p_entry)
     {
-	if (entry->hash==hash && entry->keylen==keylen &&
-            ((lower && bansi_strnicmp((const char*)entry->key,
-        			        (const char*)key, keylen)==0) ||
-	     (!lower && bmemcmp(entry->key, key, keylen)==0)))
+	if (entry->hash==hash && HASH_KEYLEN(entry)==keylen &&
+	    hash_key_match(entry, key, keylen, lower, lower_key))
 	{
 	    break;
 	}
@@ -171,17 +258,24 @@ static bhash_entry **find_entry( bpool_t *pool, bhash_table_t *ht,
 	BASE_ASSERT_RETURN(pool != NULL, NULL);
 
 	entry = BASE_POOL_ALLOC_T(pool, bhash_entry);
-	BASE_INFO( "%p: New p_entry %p created, pool used=%u, cap=%u", ht, entry,  bpool_get_used_size(pool), bpool_get_capacity(pool));
+	BASE_HOT_INFO( "%p: New p_entry %p created, pool used=%u, cap=%u", ht, entry,  bpool_get_used_size(pool), bpool_get_capacity(pool));
     }
     entry->next = NULL;
     entry->hash = hash;
     if (pool) {
-	entry->key = bpool_alloc(pool, keylen);
+	entry->keylen = keylen;
+	if (lower_key) {
+	    entry->key = bpool_alloc(pool, keylen * 2);
+	    bmemcpy((char*)entry->key + keylen, lower_key, keylen);
+	    entry->keylen |= HASH_KEY_FOLDED;
+	} else {
+	    entry->key = bpool_alloc(pool, keylen);
+	}
 	bmemcpy(entry->key, key, keylen);
     } else {
 	entry->key = (void*)key;
+	entry->keylen = keylen;
     }
-    entry->keylen = keylen;
     entry->value = val;
     *p_entry = entry;
     
@@ -219,14 +313,14 @@ static void hash_set( bpool_t *pool, bhash_table_t *ht,
     if (*p_entry) {
 	if (value == NULL) {
 	    /* delete entry */
-	    BASE_INFO("%p: p_entry %p deleted", ht, *p_entry);
+	    BASE_HOT_INFO("%p: p_entry %p deleted", ht, *p_entry);
 		*p_entry = (*p_entry)->next;
 	    --ht->count;
 	    
 	} else {
 	    /* overwrite */
 	    (*p_entry)->value = value;
-	    BASE_INFO("%p: p_entry %p value set to %p", ht, *p_entry, value);
+	    BASE_HOT_INFO("%p: p_entry %p value set to %p", ht, *p_entry, value);
 	}
     }
 }
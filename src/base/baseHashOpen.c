@@ -0,0 +1,565 @@
+/*
+ *
+ */
+/*
+ * Open addressing hash table, see the bohash_* functions in baseHash.h.
+ *
+ * The slots are kept in one flat array, with a parallel array of 1-byte tags:
+ * a used slot has 7 bits of its hash value in its tag, the empty and the
+ * deleted slots have the high bit set. The array is divided in groups of 16
+ * slots, and a lookup compares the tags of a whole group with the tag of
+ * the key at once, then only compares the keys of the slots whose tag
+ * matches. The groups are probed in triangular order until one which still
+ * has an empty slot.
+ *
+ * When the array is 7/8 full it is replaced by a new one (twice as big, or
+ * as big when most of the slots are only deleted ones), and every insertion
+ * moves a few slots of the old array to the new one. Until all slots are
+ * moved, lookups search both arrays.
+ */
+#include <baseHash.h>
+#include <baseLog.h>
+#include <baseString.h>
+#include <basePool.h>
+#include <baseCtype.h>
+#include <baseErrno.h>
+#include <baseAssert.h>
+
+#if BASE_OHASH_HAS_SSE2
+#  include <emmintrin.h>
+#endif
+
+#define OHASH_GROUP		16		/* tags probed at once */
+#define OHASH_MIGRATE		(4*OHASH_GROUP)	/* slots moved per insertion */
+#define OHASH_LONG_KEY		16		/* keys hashed 8 bytes at a time */
+
+#define OHASH_TAG_EMPTY		((buint8_t)0x80)
+#define OHASH_TAG_DELETED	((buint8_t)0xFE)
+
+#define OHASH_MULTIPLIER	33
+
+typedef struct ohash_slot
+{
+	buint32_t	hash;
+	unsigned	keylen;
+	const void	*key;
+	void		*value;
+} ohash_slot;
+
+typedef struct ohash_array
+{
+	ohash_slot	*slots;
+	buint8_t	*tags;
+	unsigned	capacity;	/* power of 2, at least OHASH_GROUP */
+	unsigned	used;		/* used and deleted slots */
+	unsigned	count;		/* used slots */
+} ohash_array;
+
+struct _bohash_table_t
+{
+	bpool_factory	*factory;
+
+	/* Array the new entries are inserted to. */
+	ohash_array	cur;
+
+	/* Array being moved to cur, its slots are NULL when there is none. */
+	ohash_array	old;
+
+	/* Number of slots of old already moved. */
+	unsigned	migrated;
+};
+
+static buint32_t _ohashMix32(buint32_t h)
+{
+	h ^= h >> 16;
+	h *= 0x85EBCA6BU;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35U;
+	h ^= h >> 16;
+	return h;
+}
+
+static buint64_t _ohashLoad64(const buint8_t *p, bbool_t lower)
+{
+	buint8_t buf[8];
+	buint64_t word;
+	unsigned i;
+
+	if (lower)
+	{
+		for (i=0; i<8; ++i)
+			buf[i] = (buint8_t)btolower(p[i]);
+		p = buf;
+	}
+
+	bmemcpy(&word, p, sizeof(word));
+	return word;
+}
+
+static buint64_t _ohashRound(buint64_t acc, buint64_t word)
+{
+	acc ^= word * 0xC2B2AE3D27D4EB4FULL;
+	acc = (acc << 31) | (acc >> 33);
+	return acc * 0x9E3779B97F4A7C15ULL;
+}
+
+/* Short keys are hashed byte by byte like bhash_calc(), long keys 8 bytes
+ * at a time. Both are mixed at the end, as the low bits select the group and
+ * the high bits make the tag.
+ */
+static buint32_t _ohashCalc(buint32_t hval, const void *key, unsigned keylen, bbool_t lower)
+{
+	const buint8_t *p = (const buint8_t*)key;
+
+	if (keylen < OHASH_LONG_KEY)
+	{
+		for ( ; keylen; --keylen, ++p)
+			hval = hval * OHASH_MULTIPLIER + (lower ? btolower(*p) : *p);
+	}
+	else
+	{
+		buint64_t acc = hval ^ (keylen * 0x9E3779B97F4A7C15ULL);
+		buint8_t tail[8];
+
+		for ( ; keylen >= 8; keylen -= 8, p += 8)
+			acc = _ohashRound(acc, _ohashLoad64(p, lower));
+
+		if (keylen)
+		{
+			bmemset(tail, 0, sizeof(tail));
+			bmemcpy(tail, p, keylen);
+			acc = _ohashRound(acc, _ohashLoad64(tail, lower));
+		}
+
+		acc ^= acc >> 29;
+		acc *= 0xBF58476D1CE4E5B9ULL;
+		acc ^= acc >> 32;
+		hval = (buint32_t)acc;
+	}
+
+	hval = _ohashMix32(hval);
+
+	/* Zero means "not calculated" for the hval arguments */
+	return hval ? hval : 1;
+}
+
+buint32_t bohash_calc(buint32_t hval, const void *key, unsigned keylen)
+{
+	if (keylen == BASE_HASH_KEY_STRING)
+		keylen = (unsigned)bansi_strlen((const char*)key);
+
+	return _ohashCalc(hval, key, keylen, BASE_FALSE);
+}
+
+#if BASE_OHASH_HAS_SSE2
+static unsigned _ohashMatch(const buint8_t *tags, buint8_t tag)
+{
+	__m128i group = _mm_loadu_si128((const __m128i*)tags);
+
+	return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)tag)));
+}
+
+/* Empty and deleted slots */
+static unsigned _ohashMatchFree(const buint8_t *tags)
+{
+	return (unsigned)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)tags));
+}
+#else
+static unsigned _ohashMatch(const buint8_t *tags, buint8_t tag)
+{
+	unsigned i, mask = 0;
+
+	for (i=0; i<OHASH_GROUP; ++i)
+	{
+		if (tags[i] == tag)
+			mask |= (1U << i);
+	}
+	return mask;
+}
+
+static unsigned _ohashMatchFree(const buint8_t *tags)
+{
+	unsigned i, mask = 0;
+
+	for (i=0; i<OHASH_GROUP; ++i)
+	{
+		if (tags[i] & OHASH_TAG_EMPTY)
+			mask |= (1U << i);
+	}
+	return mask;
+}
+#endif
+
+static unsigned _ohashCtz(unsigned mask)
+{
+#if defined(__GNUC__)
+	return (unsigned)__builtin_ctz(mask);
+#else
+	unsigned n = 0;
+
+	while ((mask & 1) == 0)
+	{
+		mask >>= 1;
+		++n;
+	}
+	return n;
+#endif
+}
+
+#define OHASH_TAG(hash)		((buint8_t)((hash) >> 25))
+#define OHASH_FIRST_GROUP(a, hash)	((hash) & ((a)->capacity / OHASH_GROUP - 1))
+
+static bstatus_t _ohashArrayCreate(bpool_factory *factory, ohash_array *a, unsigned capacity)
+{
+	bsize_t size = (bsize_t)capacity * (sizeof(ohash_slot) + 1);
+
+	a->slots = (ohash_slot*)(*factory->policy.block_alloc)(factory, size);
+	if (!a->slots)
+		return BASE_ENOMEM;
+
+	a->tags = (buint8_t*)(a->slots + capacity);
+	bmemset(a->tags, OHASH_TAG_EMPTY, capacity);
+	a->capacity = capacity;
+	a->used = a->count = 0;
+
+	return BASE_SUCCESS;
+}
+
+static void _ohashArrayDestroy(bpool_factory *factory, ohash_array *a)
+{
+	if (a->slots && factory->policy.block_free)
+		(*factory->policy.block_free)(factory, a->slots, (bsize_t)a->capacity * (sizeof(ohash_slot) + 1));
+
+	bbzero(a, sizeof(*a));
+}
+
+static ohash_slot *_ohashArrayFind(const ohash_array *a, buint32_t hash, const void *key, unsigned keylen, bbool_t lower, unsigned *index)
+{
+	unsigned groups = a->capacity / OHASH_GROUP;
+	unsigned group = OHASH_FIRST_GROUP(a, hash);
+	unsigned step;
+
+	if (a->count == 0)
+		return NULL;
+
+	for (step=1; step<=groups; ++step)
+	{
+		const buint8_t *tags = a->tags + group*OHASH_GROUP;
+		unsigned mask = _ohashMatch(tags, OHASH_TAG(hash));
+
+		for ( ; mask; mask &= mask - 1)
+		{
+			unsigned i = group*OHASH_GROUP + _ohashCtz(mask);
+			ohash_slot *slot = &a->slots[i];
+
+			if (slot->hash == hash && slot->keylen == keylen &&
+				((lower && bansi_strnicmp((const char*)slot->key, (const char*)key, keylen) == 0) ||
+				(!lower && bmemcmp(slot->key, key, keylen) == 0)))
+			{
+				*index = i;
+				return slot;
+			}
+		}
+
+		if (_ohashMatch(tags, OHASH_TAG_EMPTY))
+			return NULL;
+
+		group = (group + step) & (groups - 1);
+	}
+
+	return NULL;
+}
+
+/* The key must not be in the array, and the array must have a free slot */
+static void _ohashArrayInsert(ohash_array *a, buint32_t hash, const void *key, unsigned keylen, void *value)
+{
+	unsigned groups = a->capacity / OHASH_GROUP;
+	unsigned group = OHASH_FIRST_GROUP(a, hash);
+	unsigned step, mask, i;
+
+	for (step=1; ; ++step)
+	{
+		mask = _ohashMatchFree(a->tags + group*OHASH_GROUP);
+		if (mask)
+			break;
+
+		group = (group + step) & (groups - 1);
+	}
+
+	i = group*OHASH_GROUP + _ohashCtz(mask);
+	if (a->tags[i] == OHASH_TAG_EMPTY)
+		++a->used;
+	++a->count;
+
+	a->tags[i] = OHASH_TAG(hash);
+	a->slots[i].hash = hash;
+	a->slots[i].keylen = keylen;
+	a->slots[i].key = key;
+	a->slots[i].value = value;
+}
+
+static void _ohashArrayErase(ohash_array *a, unsigned index)
+{
+	const buint8_t *tags = a->tags + (index & ~(OHASH_GROUP - 1));
+
+	/* A group which still has an empty slot has never been full, so no
+	 * probe went past it and the slot can be made empty again.
+	 */
+	if (_ohashMatch(tags, OHASH_TAG_EMPTY))
+	{
+		a->tags[index] = OHASH_TAG_EMPTY;
+		--a->used;
+	}
+	else
+	{
+		a->tags[index] = OHASH_TAG_DELETED;
+	}
+	--a->count;
+}
+
+/* Move up to max slots of the old array to the current one */
+static void _ohashMigrate(bohash_table_t *ht, unsigned max)
+{
+	ohash_array *old = &ht->old;
+	unsigned end;
+
+	if (!old->slots)
+		return;
+
+	end = (max < old->capacity - ht->migrated) ? ht->migrated + max : old->capacity;
+	for ( ; ht->migrated < end; ++ht->migrated)
+	{
+		ohash_slot *slot = &old->slots[ht->migrated];
+
+		if (old->tags[ht->migrated] & OHASH_TAG_EMPTY)
+			continue;
+
+		_ohashArrayInsert(&ht->cur, slot->hash, slot->key, slot->keylen, slot->value);
+		old->tags[ht->migrated] = OHASH_TAG_DELETED;
+		--old->count;
+	}
+
+	if (ht->migrated == old->capacity)
+		_ohashArrayDestroy(ht->factory, old);
+}
+
+static bstatus_t _ohashGrow(bohash_table_t *ht)
+{
+	ohash_array array;
+	unsigned capacity;
+	bstatus_t status;
+
+	/* Finish the previous resize first */
+	_ohashMigrate(ht, ht->old.capacity);
+
+	/* Rebuild with the same size when the array is mostly deleted slots */
+	capacity = ht->cur.capacity;
+	if (ht->cur.count >= capacity / 16 * 7)
+		capacity *= 2;
+
+	status = _ohashArrayCreate(ht->factory, &array, capacity);
+	if (status != BASE_SUCCESS)
+		return status;
+
+	BASE_INFO("%p: hash table resized from %u to %u slots, %u entries", ht, ht->cur.capacity, capacity, ht->cur.count);
+
+	ht->old = ht->cur;
+	ht->cur = array;
+	ht->migrated = 0;
+
+	return BASE_SUCCESS;
+}
+
+bohash_table_t* bohash_create(bpool_t *pool, unsigned size)
+{
+	bohash_table_t *ht;
+	unsigned capacity;
+
+	BASE_ASSERT_RETURN(pool, NULL);
+
+	capacity = OHASH_GROUP;
+	while (capacity - capacity / 8 <= size)
+		capacity <<= 1;
+
+	ht = BASE_POOL_ZALLOC_T(pool, bohash_table_t);
+	ht->factory = pool->factory;
+
+	if (_ohashArrayCreate(ht->factory, &ht->cur, capacity) != BASE_SUCCESS)
+		return NULL;
+
+	BASE_INFO("open addressing hash table %p created from pool %s, %u slots", ht, bpool_getobjname(pool), capacity);
+
+	return ht;
+}
+
+void bohash_destroy(bohash_table_t *ht)
+{
+	BASE_ASSERT_ON_FAIL(ht, return);
+
+	_ohashArrayDestroy(ht->factory, &ht->old);
+	_ohashArrayDestroy(ht->factory, &ht->cur);
+}
+
+static buint32_t _ohashKey(const void *key, unsigned *keylen, buint32_t *hval, bbool_t lower)
+{
+	buint32_t hash;
+
+	if (*keylen == BASE_HASH_KEY_STRING)
+		*keylen = (unsigned)bansi_strlen((const char*)key);
+
+	if (hval && *hval != 0)
+		return *hval;
+
+	hash = _ohashCalc(0, key, *keylen, lower);
+
+	/* Report back the computed hash. */
+	if (hval)
+		*hval = hash;
+
+	return hash;
+}
+
+static ohash_slot *_ohashFind(bohash_table_t *ht, buint32_t hash, const void *key, unsigned keylen, bbool_t lower, ohash_array **array, unsigned *index)
+{
+	ohash_slot *slot;
+
+	*array = &ht->cur;
+	slot = _ohashArrayFind(&ht->cur, hash, key, keylen, lower, index);
+	if (!slot && ht->old.slots)
+	{
+		*array = &ht->old;
+		slot = _ohashArrayFind(&ht->old, hash, key, keylen, lower, index);
+	}
+
+	return slot;
+}
+
+static void *_ohashGet(bohash_table_t *ht, const void *key, unsigned keylen, buint32_t *hval, bbool_t lower)
+{
+	ohash_array *array;
+	ohash_slot *slot;
+	unsigned index;
+	buint32_t hash;
+
+	hash = _ohashKey(key, &keylen, hval, lower);
+	slot = _ohashFind(ht, hash, key, keylen, lower, &array, &index);
+
+	return slot ? slot->value : NULL;
+}
+
+void *bohash_get(bohash_table_t *ht, const void *key, unsigned keylen, buint32_t *hval)
+{
+	return _ohashGet(ht, key, keylen, hval, BASE_FALSE);
+}
+
+void *bohash_get_lower(bohash_table_t *ht, const void *key, unsigned keylen, buint32_t *hval)
+{
+	return _ohashGet(ht, key, keylen, hval, BASE_TRUE);
+}
+
+static bstatus_t _ohashSet(bpool_t *pool, bohash_table_t *ht, const void *key, unsigned keylen, buint32_t hval, void *value, bbool_t lower)
+{
+	ohash_array *array;
+	ohash_slot *slot;
+	unsigned index;
+	buint32_t hash;
+
+	hash = _ohashKey(key, &keylen, &hval, lower);
+	slot = _ohashFind(ht, hash, key, keylen, lower, &array, &index);
+
+	if (slot)
+	{
+		if (value)
+			slot->value = value;
+		else
+			_ohashArrayErase(array, index);
+
+		return BASE_SUCCESS;
+	}
+
+	if (value == NULL)
+		return BASE_SUCCESS;
+
+	if (ht->cur.used >= ht->cur.capacity - ht->cur.capacity / 8)
+	{
+		/* Keep on filling the array if it can not grow, until it is full */
+		if (_ohashGrow(ht) != BASE_SUCCESS && ht->cur.count == ht->cur.capacity)
+			return BASE_ENOMEM;
+	}
+
+	if (pool)
+	{
+		void *copy = bpool_alloc(pool, keylen);
+
+		if (!copy)
+			return BASE_ENOMEM;
+
+		bmemcpy(copy, key, keylen);
+		key = copy;
+	}
+
+	_ohashArrayInsert(&ht->cur, hash, key, keylen, value);
+	_ohashMigrate(ht, OHASH_MIGRATE);
+
+	return BASE_SUCCESS;
+}
+
+bstatus_t bohash_set(bpool_t *pool, bohash_table_t *ht, const void *key, unsigned keylen, buint32_t hval, void *value)
+{
+	return _ohashSet(pool, ht, key, keylen, hval, value, BASE_FALSE);
+}
+
+bstatus_t bohash_set_lower(bpool_t *pool, bohash_table_t *ht, const void *key, unsigned keylen, buint32_t hval, void *value)
+{
+	return _ohashSet(pool, ht, key, keylen, hval, value, BASE_TRUE);
+}
+
+unsigned bohash_count(bohash_table_t *ht)
+{
+	return ht->cur.count + ht->old.count;
+}
+
+/* The index runs over the old array, then over the current one */
+static ohash_slot *_ohashSlotAt(bohash_table_t *ht, unsigned index)
+{
+	const ohash_array *a = &ht->old;
+
+	if (index >= a->capacity)
+	{
+		index -= a->capacity;
+		a = &ht->cur;
+	}
+
+	return (a->tags[index] & OHASH_TAG_EMPTY) ? NULL : &a->slots[index];
+}
+
+static bohash_iterator_t *_ohashSeek(bohash_table_t *ht, bohash_iterator_t *it)
+{
+	for ( ; it->index < ht->old.capacity + ht->cur.capacity; ++it->index)
+	{
+		if (_ohashSlotAt(ht, it->index))
+			return it;
+	}
+
+	return NULL;
+}
+
+bohash_iterator_t *bohash_first(bohash_table_t *ht, bohash_iterator_t *it)
+{
+	it->index = 0;
+	return _ohashSeek(ht, it);
+}
+
+bohash_iterator_t *bohash_next(bohash_table_t *ht, bohash_iterator_t *it)
+{
+	++it->index;
+	return _ohashSeek(ht, it);
+}
+
+void *bohash_this(bohash_table_t *ht, bohash_iterator_t *it)
+{
+	ohash_slot *slot = _ohashSlotAt(ht, it->index);
+
+	return slot ? slot->value : NULL;
+}
+
@@ -5,6 +5,8 @@
 #include <baseLog.h>
 #include <baseString.h>
 #include <baseOs.h>
+#include <basePool.h>
+#include <baseErrno.h>
 #include <compat/stdarg.h>
 
 #if BASE_LOG_MAX_LEVEL >= 1
@@ -66,9 +68,424 @@ static char log_buffer[BASE_LOG_MAX_SIZE];
 
 #define LOG_MAX_INDENT		80
 
+static blog_batch_func *log_batch_writer;
+
+#if BASE_LOG_HAS_ASYNC
+/*
+ * Asynchronous log.
+ *
+ * Every logging thread has its own ring. Only the thread writes the tail
+ * of its ring, and only the drain thread (or blog_set_async() when
+ * switching off, after the drain thread is joined) writes the head, so
+ * neither side takes a lock. The rings are linked in a list which only
+ * grows, and are freed when the library is shut down. When a thread exits
+ * its ring goes to the free list and is reused by the next thread which
+ * logs, so the list is as long as the most threads that logged at once.
+ */
+#define LOG_ASYNC_BATCH		64
+#define LOG_REC_ALIGN		8
+#define LOG_REC_WRAP		((unsigned)-1)	/* rest of the ring is unused */
+#define LOG_REC_SIZE(len)	((sizeof(struct log_rec) + (len) + 1 + LOG_REC_ALIGN-1) & ~(LOG_REC_ALIGN-1))
+
+/* Header of a message in the ring, the message and a NULL follow it */
+struct log_rec
+{
+	unsigned	len;
+	int		level;
+};
+
+struct log_ring
+{
+	struct log_ring	*next;
+	struct log_ring	*next_free;	/* in the free list, under the mutex */
+	char		*buf;
+	unsigned	size;		/* power of 2 */
+	unsigned	head;		/* free running, written by the reader */
+	unsigned	tail;		/* free running, written by the owner */
+	int		busy;		/* owner is queueing a message */
+	bsize_t		dropped;	/* written by the owner */
+};
+
+static struct
+{
+	bcaching_pool	cp;
+	bpool_t		*pool;
+	bmutex_t	*mutex;		/* protects the pool and free list */
+	long		ring_tls_id;
+	struct log_ring	*rings;
+	struct log_ring	*free_rings;	/* rings of exited threads */
+	bthread_t	*thread;
+	unsigned	ring_size;
+	unsigned	flush_msec;
+	int		enabled;
+	int		quit;
+	bsize_t		reported_dropped;
+} log_async;
+
+static void _logAsyncNoMem(bpool_t *pool, bsize_t size)
+{
+	/* Let the allocation return NULL, the message is written synchronously */
+	BASE_UNUSED_ARG(pool);
+	BASE_UNUSED_ARG(size);
+}
+
+/* Reuse a ring of an exited thread, or create a new one */
+static struct log_ring *_logAsyncRingCreate(void)
+{
+	struct log_ring *ring, **prev;
+	char *buf;
+
+	bmutex_lock(log_async.mutex);
+
+	/* Only a ring of the current size, see blog_set_async() */
+	for (prev = &log_async.free_rings; *prev; prev = &(*prev)->next_free)
+	{
+		if ((*prev)->size == log_async.ring_size)
+			break;
+	}
+
+	ring = *prev;
+	if (ring)
+	{
+		*prev = ring->next_free;
+		ring->next_free = NULL;
+		buf = ring->buf;
+	}
+	else
+	{
+		ring = (struct log_ring*) bpool_zalloc(log_async.pool, sizeof(struct log_ring));
+		buf = ring ? (char*) bpool_alloc(log_async.pool, log_async.ring_size) : NULL;
+		if (buf)
+		{
+			ring->buf = buf;
+			ring->size = log_async.ring_size;
+			ring->next = log_async.rings;
+			__atomic_store_n(&log_async.rings, ring, __ATOMIC_RELEASE);
+		}
+	}
+	bmutex_unlock(log_async.mutex);
+
+	if (!buf)
+		return NULL;
+
+	bthreadLocalSet(log_async.ring_tls_id, ring);
+	return ring;
+}
+
+/* The thread owning the ring exits. Its queued messages are still drained,
+ * and the next owner appends after them.
+ */
+static void _logAsyncRingRelease(void *value)
+{
+	struct log_ring *ring = (struct log_ring*) value;
+
+	bmutex_lock(log_async.mutex);
+	ring->next_free = log_async.free_rings;
+	log_async.free_rings = ring;
+	bmutex_unlock(log_async.mutex);
+}
+
+/* Queue the message to the ring of this thread. Return BASE_FALSE when the
+ * caller shall write it synchronously.
+ */
+static bbool_t _logAsyncWrite(int level, const char *data, int len)
+{
+	struct log_ring *ring;
+	struct log_rec *rec;
+	unsigned need, head, tail, off, room;
+
+	if (__atomic_load_n(&log_async.pool, __ATOMIC_ACQUIRE) == NULL)
+		return BASE_FALSE;
+
+	ring = (struct log_ring*) bthreadLocalGet(log_async.ring_tls_id);
+	if (ring == NULL)
+	{
+		if (!__atomic_load_n(&log_async.enabled, __ATOMIC_ACQUIRE))
+			return BASE_FALSE;
+
+		ring = _logAsyncRingCreate();
+		if (ring == NULL)
+			return BASE_FALSE;
+	}
+
+	/* After switching off, keep on queueing until the ring is drained, so
+	 * the messages of this thread don't overtake the queued ones. busy
+	 * tells blog_set_async() to wait for this message.
+	 */
+	__atomic_store_n(&ring->busy, 1, __ATOMIC_SEQ_CST);
+	tail = ring->tail;
+	head = __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST);
+	if (!__atomic_load_n(&log_async.enabled, __ATOMIC_SEQ_CST) && head == tail)
+	{
+		__atomic_store_n(&ring->busy, 0, __ATOMIC_RELEASE);
+		return BASE_FALSE;
+	}
+
+	need = LOG_REC_SIZE(len);
+	off = tail & (ring->size - 1);
+	room = ring->size - off;
+	if ((room < need ? room : 0) + need > ring->size - (tail - head))
+	{
+		__atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELAXED);
+	}
+	else
+	{
+		if (room < need)
+		{
+			((struct log_rec*)(ring->buf + off))->len = LOG_REC_WRAP;
+			tail += room;
+			off = 0;
+		}
+
+		rec = (struct log_rec*)(ring->buf + off);
+		rec->len = (unsigned)len;
+		rec->level = level;
+		bmemcpy(rec + 1, data, len);
+		((char*)(rec + 1))[len] = '\0';
+
+		__atomic_store_n(&ring->tail, tail + need, __ATOMIC_RELEASE);
+	}
+
+	__atomic_store_n(&ring->busy, 0, __ATOMIC_RELEASE);
+	return BASE_TRUE;
+}
+
+static void _logAsyncOutput(const blog_msg msgs[], unsigned count)
+{
+	blog_batch_func *batch_writer = log_batch_writer;
+	blog_func *writer = log_writer;
+	unsigned i;
+
+	if (count == 0)
+		return;
+
+	if (batch_writer)
+	{
+		(*batch_writer)(msgs, count);
+	}
+	else if (writer == &blog_write)
+	{
+		blog_write_batch(msgs, count);
+	}
+	else if (writer)
+	{
+		for (i=0; i<count; ++i)
+			(*writer)(msgs[i].level, msgs[i].data, msgs[i].len);
+	}
+}
+
+static void _logAsyncDrainRing(struct log_ring *ring)
+{
+	blog_msg msgs[LOG_ASYNC_BATCH];
+	struct log_rec *rec;
+	unsigned head, tail, off, count;
+
+	head = ring->head;
+	tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+	while (head != tail)
+	{
+		for (count=0; head != tail && count < LOG_ASYNC_BATCH; )
+		{
+			off = head & (ring->size - 1);
+			rec = (struct log_rec*)(ring->buf + off);
+			if (rec->len == LOG_REC_WRAP)
+			{
+				head += ring->size - off;
+				continue;
+			}
+
+			msgs[count].level = rec->level;
+			msgs[count].data = (const char*)(rec + 1);
+			msgs[count].len = (int)rec->len;
+			++count;
+
+			head += LOG_REC_SIZE(rec->len);
+		}
+
+		_logAsyncOutput(msgs, count);
+		__atomic_store_n(&ring->head, head, __ATOMIC_SEQ_CST);
+	}
+}
+
+static bsize_t _logAsyncDropped(void)
+{
+	struct log_ring *ring;
+	bsize_t dropped = 0;
+
+	for (ring = __atomic_load_n(&log_async.rings, __ATOMIC_ACQUIRE); ring; ring = ring->next)
+		dropped += __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+
+	return dropped;
+}
+
+static void _logAsyncDrain(void)
+{
+	struct log_ring *ring;
+	bsize_t dropped;
+
+	for (ring = __atomic_load_n(&log_async.rings, __ATOMIC_ACQUIRE); ring; ring = ring->next)
+		_logAsyncDrainRing(ring);
+
+	dropped = _logAsyncDropped();
+	if (dropped != log_async.reported_dropped)
+	{
+		char buf[80];
+		blog_msg msg;
+
+		msg.level = 2;
+		msg.data = buf;
+		msg.len = bansi_snprintf(buf, sizeof(buf), "<%lu log messages dropped>%s",
+			(unsigned long)(dropped - log_async.reported_dropped),
+			(log_decor & BASE_LOG_HAS_NEWLINE) ? "\n" : "");
+		log_async.reported_dropped = dropped;
+
+		_logAsyncOutput(&msg, 1);
+	}
+}
+
+static int _logAsyncThread(void *arg)
+{
+	BASE_UNUSED_ARG(arg);
+
+	while (!__atomic_load_n(&log_async.quit, __ATOMIC_ACQUIRE))
+	{
+		bthreadSleepMs(log_async.flush_msec);
+		_logAsyncDrain();
+	}
+
+	return 0;
+}
+
+static bstatus_t _logAsyncStart(const blog_async_cfg *cfg)
+{
+	blog_async_cfg default_cfg;
+	bpool_t *pool;
+	bstatus_t status;
+
+	if (cfg == NULL)
+	{
+		blog_async_cfg_default(&default_cfg);
+		cfg = &default_cfg;
+	}
+
+	if (log_async.pool == NULL)
+	{
+		bcaching_pool_init(&log_async.cp, NULL, 0);
+		pool = bpool_create(&log_async.cp.factory, "logasync", 4000, 4000, &_logAsyncNoMem);
+		if (pool == NULL)
+		{
+			bcaching_pool_destroy(&log_async.cp);
+			return BASE_ENOMEM;
+		}
+
+		status = bmutex_create_simple(pool, "logasync", &log_async.mutex);
+		if (status == BASE_SUCCESS)
+		{
+			status = bthreadLocalAlloc2(&log_async.ring_tls_id, &_logAsyncRingRelease);
+			if (status == BASE_ENOTSUP)
+				status = bthreadLocalAlloc(&log_async.ring_tls_id);
+			if (status != BASE_SUCCESS)
+				bmutex_destroy(log_async.mutex);
+		}
+		if (status != BASE_SUCCESS)
+		{
+			bpool_release(pool);
+			bcaching_pool_destroy(&log_async.cp);
+			return status;
+		}
+
+		__atomic_store_n(&log_async.pool, pool, __ATOMIC_RELEASE);
+	}
+
+	/* Round up to power of 2, and leave room for the longest message */
+	bmutex_lock(log_async.mutex);
+	log_async.ring_size = 1;
+	while (log_async.ring_size < cfg->ring_size || log_async.ring_size < 2 * BASE_LOG_MAX_SIZE)
+		log_async.ring_size <<= 1;
+	bmutex_unlock(log_async.mutex);
+
+	log_async.flush_msec = cfg->flush_msec;
+	log_async.quit = 0;
+
+	status = bthreadCreate(log_async.pool, "logdrain", &_logAsyncThread, NULL, 0, 0, &log_async.thread);
+	if (status != BASE_SUCCESS)
+	{
+		log_async.thread = NULL;
+		return status;
+	}
+
+	__atomic_store_n(&log_async.enabled, 1, __ATOMIC_SEQ_CST);
+	return BASE_SUCCESS;
+}
+
+static void _logAsyncStop(void)
+{
+	struct log_ring *ring;
+	bbool_t pending;
+
+	__atomic_store_n(&log_async.enabled, 0, __ATOMIC_SEQ_CST);
+
+	__atomic_store_n(&log_async.quit, 1, __ATOMIC_RELEASE);
+	bthreadJoin(log_async.thread);
+	bthreadDestroy(log_async.thread);
+	log_async.thread = NULL;
+
+	/* Drain until all rings are empty and no thread is queueing, from then
+	 * on all threads write synchronously.
+	 */
+	do
+	{
+		_logAsyncDrain();
+
+		pending = BASE_FALSE;
+		for (ring = __atomic_load_n(&log_async.rings, __ATOMIC_ACQUIRE); ring; ring = ring->next)
+		{
+			if (__atomic_load_n(&ring->busy, __ATOMIC_SEQ_CST) ||
+				__atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) != ring->head)
+			{
+				pending = BASE_TRUE;
+			}
+		}
+
+		if (pending)
+			bthreadSleepMs(1);
+	} while (pending);
+}
+
+static void _logAsyncShutdown(void)
+{
+	bpool_t *pool = log_async.pool;
+
+	if (log_async.thread)
+		_logAsyncStop();
+
+	if (pool == NULL)
+		return;
+
+	__atomic_store_n(&log_async.pool, NULL, __ATOMIC_RELEASE);
+	bthreadLocalFree(log_async.ring_tls_id);
+	bmutex_destroy(log_async.mutex);
+	log_async.mutex = NULL;
+	log_async.rings = NULL;
+	log_async.free_rings = NULL;
+	log_async.reported_dropped = 0;
+
+	bpool_release(pool);
+	bcaching_pool_destroy(&log_async.cp);
+}
+
+#else
+#define _logAsyncWrite(level, data, len)	BASE_FALSE
+#endif	/* BASE_LOG_HAS_ASYNC */
+
 #if BASE_HAS_THREADS
 static void _loggingShutdown(void *data)
 {
+#if BASE_LOG_HAS_ASYNC
+	_logAsyncShutdown();
+#endif
+
 	if (thread_suspended_tls_id != -1)
 	{
 		bthreadLocalFree(thread_suspended_tls_id);
@@ -239,6 +656,48 @@ blog_func* blog_get_log_func(void)
     return log_writer;
 }
 
+void blog_set_batch_func(blog_batch_func *func)
+{
+	log_batch_writer = func;
+}
+
+blog_batch_func* blog_get_batch_func(void)
+{
+	return log_batch_writer;
+}
+
+void blog_async_cfg_default(blog_async_cfg *cfg)
+{
+	cfg->ring_size = BASE_LOG_ASYNC_RING_SIZE;
+	cfg->flush_msec = BASE_LOG_ASYNC_FLUSH_MSEC;
+}
+
+bstatus_t blog_set_async(bbool_t enable, const blog_async_cfg *cfg)
+{
+#if BASE_LOG_HAS_ASYNC
+	if (enable && log_async.thread == NULL)
+		return _logAsyncStart(cfg);
+
+	if (!enable && log_async.thread != NULL)
+		_logAsyncStop();
+
+	return BASE_SUCCESS;
+#else
+	BASE_UNUSED_ARG(enable);
+	BASE_UNUSED_ARG(cfg);
+	return BASE_ENOTSUP;
+#endif
+}
+
+bsize_t blog_get_dropped(void)
+{
+#if BASE_LOG_HAS_ASYNC
+	return (log_async.pool != NULL) ? _logAsyncDropped() : 0;
+#else
+	return 0;
+#endif
+}
+
 /* Temporarily suspend logging facility for this thread.
  * If thread local storage/variable is not used or not initialized, then
  * we can only suspend the logging globally across all threads. This may
@@ -300,70 +759,49 @@ static bbool_t _isSuspended(void)
     }
 }
 
-void blog( const char *sender, int level, const char *format, va_list marker)
+int blog_decorate(char *buf, unsigned decor, int level, const btime_val *now,
+	const char *sender, const char *thread_name, bbool_t thread_switched, int indent)
 {
-	btime_val now;
 	bparsed_time ptime;
-	char *pre;
-#if BASE_LOG_USE_STACK_BUFFER
-	char log_buffer[BASE_LOG_MAX_SIZE];
-#endif
-	int saved_level, len, print_len, indent;
-
-	BASE_CHECK_STACK();
-
-	if (level > blog_max_level)
-		return;
+	char *pre = buf;
 
-	if (_isSuspended())
-		return;
-
-	/* Temporarily disable logging for this thread. Some of  APIs that
-	* this function calls below will recursively call the logging function 
-	* back, hence it will cause infinite recursive calls if we allow that.
-	*/
-	_suspendLogging(&saved_level);
+	btime_decode(now, &ptime);
 
-	/* Get current date/time. */
-	bgettimeofday(&now);
-	btime_decode(&now, &ptime);
-
-	pre = log_buffer;
-	if (log_decor & BASE_LOG_HAS_LEVEL_TEXT)
+	if (decor & BASE_LOG_HAS_LEVEL_TEXT)
 	{
 		static const char *ltexts[] = { "FATAL:", "ERROR:", " WARN:", 	" INFO:", "DEBUG:", "MTRACE:", "DETRC:"};
 		bansi_strcpy(pre, ltexts[level]);
 		pre += 6;
 	}
 	
-	if (log_decor & BASE_LOG_HAS_DAY_NAME)
+	if (decor & BASE_LOG_HAS_DAY_NAME)
 	{
 		static const char *wdays[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
 		bansi_strcpy(pre, wdays[ptime.wday]);
 		pre += 3;
 	}
 	
-	if (log_decor & BASE_LOG_HAS_YEAR)
+	if (decor & BASE_LOG_HAS_YEAR)
 	{
-		if (pre!=log_buffer) *pre++ = ' ';
+		if (pre!=buf) *pre++ = ' ';
 		pre += butoa(ptime.year, pre);
 	}
 	
-	if (log_decor & BASE_LOG_HAS_MONTH)
+	if (decor & BASE_LOG_HAS_MONTH)
 	{
 		*pre++ = '-';
 		pre += butoa_pad(ptime.mon+1, pre, 2, '0');
 	}
 	
-	if (log_decor & BASE_LOG_HAS_DAY_OF_MON)
+	if (decor & BASE_LOG_HAS_DAY_OF_MON)
 	{
 		*pre++ = '-';
 		pre += butoa_pad(ptime.day, pre, 2, '0');
 	}
 	
-	if (log_decor & BASE_LOG_HAS_TIME)
+	if (decor & BASE_LOG_HAS_TIME)
 	{
-		if (pre!=log_buffer)
+		if (pre!=buf)
 			*pre++ = ' ';
 
 		pre += butoa_pad(ptime.hour, pre, 2, '0');
@@ -373,17 +811,17 @@ void blog( const char *sender, int level, const char *format, va_list marker)
 		pre += butoa_pad(ptime.sec, pre, 2, '0');
 	}
 	
-	if (log_decor & BASE_LOG_HAS_MICRO_SEC)
+	if (decor & BASE_LOG_HAS_MICRO_SEC)
 	{
 		*pre++ = '.';
 		pre += butoa_pad(ptime.msec, pre, 3, '0');
 	}
 	
-	if (log_decor & BASE_LOG_HAS_SENDER)
+	if (decor & BASE_LOG_HAS_SENDER)
 	{
 		enum { SENDER_WIDTH = BASE_LOG_SENDER_WIDTH };
 		bsize_t sender_len = strlen(sender);
-		if (pre!=log_buffer)
+		if (pre!=buf)
 			*pre++ = ' ';
 
 		if (sender_len <= SENDER_WIDTH)
@@ -402,11 +840,10 @@ void blog( const char *sender, int level, const char *format, va_list marker)
 		}
 	}
 	
-	if (log_decor & BASE_LOG_HAS_THREAD_ID)
+	if (decor & BASE_LOG_HAS_THREAD_ID)
 	{
 		enum { THREAD_WIDTH = BASE_LOG_THREAD_WIDTH };
 
-		const char *thread_name = bthreadGetName(bthreadThis());
 		bsize_t thread_len = strlen(thread_name);
 		*pre++ = ' ';
 
@@ -427,40 +864,96 @@ void blog( const char *sender, int level, const char *format, va_list marker)
 		}
 	}
 
-	if (log_decor != 0 && log_decor != BASE_LOG_HAS_NEWLINE)
+	if (decor != 0 && decor != BASE_LOG_HAS_NEWLINE)
 		*pre++ = ' ';
 
-	if (log_decor & BASE_LOG_HAS_THREAD_SWC)
+	if (decor & BASE_LOG_HAS_THREAD_SWC)
 	{
-		void *current_thread = (void*)bthreadThis();
-		if (current_thread != g_last_thread)
-		{
-			*pre++ = '!';
-			g_last_thread = current_thread;
-		}
-		else
-		{
-			*pre++ = ' ';
-		}
+		*pre++ = thread_switched ? '!' : ' ';
 	}
-	else if (log_decor & BASE_LOG_HAS_SPACE)
+	else if (decor & BASE_LOG_HAS_SPACE)
 	{
 		*pre++ = ' ';
 	}
 
 #if BASE_LOG_ENABLE_INDENT
-	if (log_decor & BASE_LOG_HAS_INDENT)
+	if ((decor & BASE_LOG_HAS_INDENT) && indent > 0)
 	{
-		indent = _getIndent();
-		if (indent > 0)
+		if (indent > LOG_MAX_INDENT)
+			indent = LOG_MAX_INDENT;
+		bmemset(pre, BASE_LOG_INDENT_CHAR, indent);
+		pre += indent;
+	}
+#else
+	BASE_UNUSED_ARG(indent);
+#endif
+
+	return (int)(pre - buf);
+}
+
+void blog( const char *sender, int level, const char *format, va_list marker)
+{
+	btime_val now;
+	const char *thread_name = NULL;
+	bbool_t thread_switched = BASE_FALSE;
+	char *pre;
+#if BASE_LOG_USE_STACK_BUFFER
+	char log_buffer[BASE_LOG_MAX_SIZE];
+#endif
+	int saved_level, len, print_len;
+	bbool_t queued;
+
+	BASE_CHECK_STACK();
+
+	if (level > blog_max_level)
+		return;
+
+	if (_isSuspended())
+		return;
+
+#if BASE_LOG_HAS_BINARY
+	/* In binary mode, the message is recorded without formatting, and only
+	 * formatted as well when its level is within the text level.
+	 */
+	{
+		va_list arg;
+		bbool_t recorded;
+
+		va_copy(arg, marker);
+		recorded = extLogBinWrite(sender, level, _getIndent(), format, arg);
+		va_end(arg);
+
+		if (recorded)
+			return;
+	}
+#endif
+
+	/* Temporarily disable logging for this thread. Some of  APIs that
+	* this function calls below will recursively call the logging function 
+	* back, hence it will cause infinite recursive calls if we allow that.
+	*/
+	_suspendLogging(&saved_level);
+
+	/* Get current date/time. */
+	bgettimeofday(&now);
+
+	if (log_decor & BASE_LOG_HAS_THREAD_ID)
+	{
+		thread_name = bthreadGetName(bthreadThis());
+	}
+
+	if (log_decor & BASE_LOG_HAS_THREAD_SWC)
+	{
+		void *current_thread = (void*)bthreadThis();
+		if (current_thread != g_last_thread)
 		{
-			bmemset(pre, BASE_LOG_INDENT_CHAR, indent);
-			pre += indent;
+			thread_switched = BASE_TRUE;
+			g_last_thread = current_thread;
 		}
 	}
-#endif
 
-	len = (int)(pre - log_buffer);
+	len = blog_decorate(log_buffer, log_decor, level, &now, sender, thread_name, thread_switched, _getIndent());
+	pre = log_buffer + len;
 
 	/* Print the whole message to the string log_buffer. */
 	print_len = bansi_vsnprintf(pre, sizeof(log_buffer)-len, format, marker);
@@ -509,9 +1002,11 @@ void blog( const char *sender, int level, const char *format, va_list marker)
 	/* It should be safe to resume logging at this point. Application can
 	* recursively call the logging function inside the callback.
 	*/
+	queued = _logAsyncWrite(level, log_buffer, len);
+
 	_resumeLogging(&saved_level);
 
-	if (log_writer)
+	if (log_writer && !queued)
 		(*log_writer)(level, log_buffer, len);
 }
 
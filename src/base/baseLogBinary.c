@@ -0,0 +1,819 @@
+/*
+ *
+ */
+/*
+ * Binary log, see blog_bin_start() in baseLog.h.
+ *
+ * The file has a header, a table of strings and a ring of records. The
+ * format strings, senders and thread names are stored once in the table,
+ * a record only has their slots in the table, a timestamp and the raw
+ * arguments of the message. The types of the arguments are taken from the
+ * format string, once for each format string.
+ *
+ * Logging threads reserve the space of a record by advancing the write
+ * position atomically, and write it without any lock. The magic of a record
+ * is written last, and the record has its own position, so the decoder can
+ * tell valid records from the ones being written or overwritten.
+ */
+#include <baseLog.h>
+#include <baseString.h>
+#include <baseOs.h>
+#include <baseErrno.h>
+#include <compat/stdarg.h>
+
+#if BASE_LOG_MAX_LEVEL >= 1
+
+#define LOG_BIN_MAGIC		0x4E49424C	/* "LBIN" */
+#define LOG_BIN_VERSION		1
+#define LOG_BIN_REC_MAGIC	0x4345524C	/* "LREC" */
+#define LOG_BIN_ALIGN(x)	(((x) + 7) & ~((buint64_t)7))
+#define LOG_BIN_TEXT		0xFFFFFFFF	/* record has the formatted message */
+#define LOG_BIN_NO_STR		0xFFFF		/* string not in the table */
+#define LOG_BIN_MAX_PROBE	16
+#define LOG_BIN_PREC_STAR	0xFFFF		/* precision is the previous argument */
+#define LOG_BIN_PREC_NONE	0xFFFE
+
+struct log_bin_header
+{
+	buint32_t	magic;
+	buint32_t	version;
+	buint32_t	decor;		/* log decoration at start */
+	buint32_t	str_count;	/* slots of the string table, power of 2 */
+	buint64_t	str_offset;	/* of the slots, followed by the texts */
+	buint64_t	str_size;	/* of the texts */
+	buint64_t	ring_offset;
+	buint64_t	ring_size;	/* power of 2 */
+	buint64_t	ts_base;	/* timestamp and time of day at start */
+	buint64_t	ts_freq;
+	buint64_t	sec_base;
+	buint64_t	msec_base;
+	buint64_t	str_used;	/* of the texts, updated atomically */
+	buint64_t	write_pos;	/* free running, updated atomically */
+};
+
+struct log_bin_str
+{
+	buint64_t	key;		/* address of a format, or hash of a name; 0 for free */
+	buint32_t	offset;		/* of the NULL terminated text */
+	buint32_t	len;		/* 0 until the text is written */
+};
+
+struct log_bin_rec
+{
+	buint32_t	magic;
+	buint32_t	size;		/* including the header, aligned */
+	buint64_t	pos;		/* position in the ring */
+	buint64_t	ts;
+	buint32_t	format;		/* slot, or LOG_BIN_TEXT */
+	buint16_t	sender;		/* slot */
+	buint16_t	thread;		/* slot */
+	buint8_t	level;
+	buint8_t	indent;
+	buint16_t	arg_len;	/* followed by the arguments */
+};
+
+/* Conversion specification in a format string */
+struct log_bin_spec
+{
+	const char	*end;		/* after the conversion character */
+	bbool_t		width_star;
+	bbool_t		prec_star;
+	int		prec;		/* -1 if none */
+	char		type;		/* argument type, 0 for "%%" */
+};
+
+/*
+ * Parse the conversion specification at fmt, which points after the '%'.
+ * The argument types are:
+ *  'i' int, 'l' long, 'q' long long, 'z' size_t, 'p' pointer, 'd' double,
+ *  's' string.
+ * Return -1 for conversions which can't be recorded.
+ */
+static int _logBinParseSpec(const char *fmt, struct log_bin_spec *spec)
+{
+	char length = 0;
+
+	spec->width_star = spec->prec_star = BASE_FALSE;
+	spec->prec = -1;
+
+	while (*fmt == '-' || *fmt == '+' || *fmt == ' ' || *fmt == '#' || *fmt == '0' || *fmt == '\'')
+		++fmt;
+
+	if (*fmt == '*')
+	{
+		spec->width_star = BASE_TRUE;
+		++fmt;
+	}
+	else
+	{
+		while (*fmt >= '0' && *fmt <= '9')
+			++fmt;
+	}
+
+	if (*fmt == '.')
+	{
+		++fmt;
+		if (*fmt == '*')
+		{
+			spec->prec_star = BASE_TRUE;
+			++fmt;
+		}
+		else
+		{
+			spec->prec = 0;
+			while (*fmt >= '0' && *fmt <= '9')
+				spec->prec = spec->prec * 10 + (*fmt++ - '0');
+		}
+	}
+
+	switch (*fmt)
+	{
+	case 'h':
+		++fmt;
+		if (*fmt == 'h')
+			++fmt;
+		break;
+	case 'l':
+		++fmt;
+		length = 'l';
+		if (*fmt == 'l')
+		{
+			++fmt;
+			length = 'q';
+		}
+		break;
+	case 'q':
+	case 'j':
+		++fmt;
+		length = 'q';
+		break;
+	case 'z':
+	case 't':
+		++fmt;
+		length = 'z';
+		break;
+	case 'L':
+		return -1;
+	}
+
+	spec->end = fmt + 1;
+
+	switch (*fmt)
+	{
+	case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+		spec->type = length ? length : 'i';
+		return 0;
+	case 'c':
+		spec->type = 'i';
+		return (length == 0) ? 0 : -1;
+	case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+		spec->type = 'd';
+		return 0;
+	case 's':
+		spec->type = 's';
+		return (length == 0) ? 0 : -1;
+	case 'p':
+		spec->type = 'p';
+		return 0;
+	case '%':
+		spec->type = 0;
+		return 0;
+	default:
+		return -1;
+	}
+}
+
+/*
+ * Render the message from the format and the recorded arguments.
+ */
+static int _logBinRender(char *buf, int size, const char *fmt, const char *args, const char *args_end)
+{
+	struct log_bin_spec spec;
+	char sub[64], str[BASE_LOG_MAX_SIZE];
+	int len = 0, n, stars[2], nstar;
+	bint64_t v;
+	double d;
+	buint16_t slen;
+	const char *p;
+	char *q;
+
+#define LOG_BIN_ARG(ptr, n)	do { if (args + (n) > args_end) goto on_error; \
+				     bmemcpy(ptr, args, n); args += (n); } while (0)
+
+	while (*fmt && len < size - 1)
+	{
+		if (*fmt != '%')
+		{
+			buf[len++] = *fmt++;
+			continue;
+		}
+
+		if (_logBinParseSpec(fmt + 1, &spec) != 0 || spec.end - fmt >= (int)sizeof(sub) - 24)
+			goto on_error;
+
+		if (spec.type == 0)
+		{
+			buf[len++] = '%';
+			fmt = spec.end;
+			continue;
+		}
+
+		/* Copy the specification, with the '*' replaced by their values */
+		nstar = 0;
+		if (spec.width_star)
+			LOG_BIN_ARG(&stars[nstar++], sizeof(int));
+		if (spec.prec_star)
+			LOG_BIN_ARG(&stars[nstar++], sizeof(int));
+
+		for (p=fmt, q=sub, nstar=0; p < spec.end; ++p)
+		{
+			if (*p == '*')
+				q += bansi_snprintf(q, 12, "%d", stars[nstar++]);
+			else
+				*q++ = *p;
+		}
+		*q = '\0';
+
+		switch (spec.type)
+		{
+		case 'i':
+			{
+				int i;
+				LOG_BIN_ARG(&i, sizeof(i));
+				n = bansi_snprintf(buf + len, size - len, sub, i);
+			}
+			break;
+		case 'l':
+			LOG_BIN_ARG(&v, sizeof(v));
+			n = bansi_snprintf(buf + len, size - len, sub, (long)v);
+			break;
+		case 'q':
+			LOG_BIN_ARG(&v, sizeof(v));
+			n = bansi_snprintf(buf + len, size - len, sub, (long long)v);
+			break;
+		case 'z':
+			LOG_BIN_ARG(&v, sizeof(v));
+			n = bansi_snprintf(buf + len, size - len, sub, (bsize_t)v);
+			break;
+		case 'p':
+			LOG_BIN_ARG(&v, sizeof(v));
+			n = bansi_snprintf(buf + len, size - len, sub, (void*)(bsize_t)v);
+			break;
+		case 'd':
+			LOG_BIN_ARG(&d, sizeof(d));
+			n = bansi_snprintf(buf + len, size - len, sub, d);
+			break;
+		default: /* 's' */
+			LOG_BIN_ARG(&slen, sizeof(slen));
+			if (slen >= sizeof(str))
+				goto on_error;
+			LOG_BIN_ARG(str, slen);
+			str[slen] = '\0';
+			n = bansi_snprintf(buf + len, size - len, sub, str);
+			break;
+		}
+
+		if (n < 0)
+			goto on_error;
+		len += n;
+		if (len >= size)
+			len = size - 1;
+
+		fmt = spec.end;
+	}
+
+	buf[len] = '\0';
+	return len;
+
+on_error:
+	n = bansi_snprintf(buf + len, size - len, "<bad log record>");
+	if (n > 0)
+		len += n;
+	return (len < size) ? len : size - 1;
+
+#undef LOG_BIN_ARG
+}
+
+static void _logBinRead(const char *ring, buint64_t mask, buint64_t pos, void *data, bsize_t len)
+{
+	bsize_t off = (bsize_t)(pos & mask), part = (bsize_t)(mask + 1 - off);
+
+	if (part >= len)
+	{
+		bmemcpy(data, ring + off, len);
+	}
+	else
+	{
+		bmemcpy(data, ring + off, part);
+		bmemcpy((char*)data + part, ring, len - part);
+	}
+}
+
+static const char *_logBinString(const struct log_bin_header *hdr, unsigned slot)
+{
+	const struct log_bin_str *strs = (const struct log_bin_str*)((const char*)hdr + hdr->str_offset);
+	const char *texts = (const char*)(strs + hdr->str_count);
+
+	if (slot >= hdr->str_count || strs[slot].len == 0 ||
+		(buint64_t)strs[slot].offset + strs[slot].len >= hdr->str_size ||
+		texts[strs[slot].offset + strs[slot].len] != '\0')
+	{
+		return "?";
+	}
+
+	return texts + strs[slot].offset;
+}
+
+bstatus_t blog_bin_decode(const void *data, bsize_t size, blog_func *writer)
+{
+	const struct log_bin_header *hdr = (const struct log_bin_header*)data;
+	const char *ring;
+	buint64_t pos, end, mask;
+	struct log_bin_rec rec;
+	char args[BASE_LOG_MAX_SIZE], buf[BASE_LOG_MAX_SIZE];
+	unsigned last_thread = LOG_BIN_NO_STR + 1;
+	btime_val now;
+	double usec;
+	int len;
+
+	if (size < sizeof(*hdr) || hdr->magic != LOG_BIN_MAGIC || hdr->version != LOG_BIN_VERSION ||
+		hdr->str_offset + hdr->str_count * sizeof(struct log_bin_str) + hdr->str_size > size ||
+		hdr->ring_offset + hdr->ring_size > size || hdr->ring_size == 0 ||
+		(hdr->ring_size & (hdr->ring_size - 1)) != 0 || hdr->ts_freq == 0)
+	{
+		return BASE_EINVAL;
+	}
+
+	ring = (const char*)data + hdr->ring_offset;
+	mask = hdr->ring_size - 1;
+	end = hdr->write_pos;
+	pos = (end > hdr->ring_size) ? end - hdr->ring_size : 0;
+
+	while (pos + sizeof(rec) <= end)
+	{
+		_logBinRead(ring, mask, pos, &rec, sizeof(rec));
+
+		/* Skip to the next record which is complete and not overwritten */
+		if (rec.magic != LOG_BIN_REC_MAGIC || rec.pos != pos || rec.size > end - pos ||
+			rec.size != LOG_BIN_ALIGN(sizeof(rec) + rec.arg_len) || rec.arg_len > sizeof(args))
+		{
+			pos += 8;
+			continue;
+		}
+
+		_logBinRead(ring, mask, pos + sizeof(rec), args, rec.arg_len);
+
+		usec = (double)(bint64_t)(rec.ts - hdr->ts_base) * 1000000.0 / (double)hdr->ts_freq;
+		now.sec = (long)(hdr->sec_base + (bint64_t)(usec / 1000000.0));
+		now.msec = (long)(hdr->msec_base + (bint64_t)(usec / 1000.0) % 1000);
+		btime_val_normalize(&now);
+
+		if (rec.level > 6)
+			rec.level = 6;
+		len = blog_decorate(buf, hdr->decor, rec.level, &now, _logBinString(hdr, rec.sender),
+			_logBinString(hdr, rec.thread), rec.thread != last_thread, rec.indent);
+		last_thread = rec.thread;
+
+		if (rec.format == LOG_BIN_TEXT)
+		{
+			int n = (rec.arg_len < sizeof(buf) - len) ? rec.arg_len : (int)sizeof(buf) - len - 1;
+			bmemcpy(buf + len, args, n);
+			len += n;
+		}
+		else
+		{
+			len += _logBinRender(buf + len, sizeof(buf) - len, _logBinString(hdr, rec.format), args, args + rec.arg_len);
+		}
+
+		if (len > (int)sizeof(buf) - 3)
+			len = sizeof(buf) - 3;
+		if (hdr->decor & BASE_LOG_HAS_CR)
+			buf[len++] = '\r';
+		if (hdr->decor & BASE_LOG_HAS_NEWLINE)
+			buf[len++] = '\n';
+		buf[len] = '\0';
+
+		(*writer)(rec.level, buf, len);
+
+		pos += rec.size;
+	}
+
+	return BASE_SUCCESS;
+}
+
+#if BASE_LOG_HAS_BINARY
+
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+/* Argument types of a format, taken once from the format string */
+struct log_bin_sig
+{
+	buint8_t	nargs;
+	char		type[BASE_LOG_BIN_MAX_ARGS];
+	buint16_t	prec[BASE_LOG_BIN_MAX_ARGS];	/* of 's' */
+};
+
+static struct
+{
+	int			active;
+	int			inflight;	/* threads in extLogBinWrite() */
+	int			fd;
+	char			*map;
+	bsize_t			map_size;
+	struct log_bin_header	*hdr;
+	struct log_bin_str	*strs;
+	char			*texts;
+	char			*ring;
+	struct log_bin_sig	*sigs;		/* in process memory, by slot */
+	int			text_level;
+} log_bin = { 0, 0, -1 };
+
+/* Build the argument types of the format, return -1 if it can't be recorded */
+static int _logBinSignature(const char *fmt, struct log_bin_sig *sig)
+{
+	struct log_bin_spec spec;
+
+	sig->nargs = 0;
+	while (*fmt)
+	{
+		if (*fmt++ != '%')
+			continue;
+
+		if (_logBinParseSpec(fmt, &spec) != 0)
+			return -1;
+		fmt = spec.end;
+
+		if (spec.type == 0)
+			continue;
+
+		if (sig->nargs + spec.width_star + spec.prec_star + 1 > BASE_LOG_BIN_MAX_ARGS)
+			return -1;
+
+		if (spec.width_star)
+			sig->type[sig->nargs++] = 'i';
+		if (spec.prec_star)
+			sig->type[sig->nargs++] = 'i';
+
+		sig->prec[sig->nargs] = spec.prec_star ? LOG_BIN_PREC_STAR :
+			(spec.prec >= 0 && spec.prec < LOG_BIN_PREC_NONE) ? (buint16_t)spec.prec : LOG_BIN_PREC_NONE;
+		sig->type[sig->nargs++] = spec.type;
+	}
+
+	return 0;
+}
+
+static buint64_t _logBinHashName(const char *name)
+{
+	/* FNV-1a, with the high bit set to never collide with an address */
+	buint64_t h = 0xcbf29ce484222325ULL;
+
+	while (*name)
+		h = (h ^ (buint8_t)*name++) * 0x100000001b3ULL;
+
+	return h | (1ULL << 63);
+}
+
+/*
+ * Find the slot of the string, add it if it's not in the table yet.
+ * Return LOG_BIN_NO_STR if it isn't ready to be used.
+ */
+static unsigned _logBinIntern(buint64_t key, const char *text, bbool_t is_format)
+{
+	struct log_bin_header *hdr = log_bin.hdr;
+	unsigned mask = hdr->str_count - 1;
+	unsigned slot = (unsigned)((key * 0x9E3779B97F4A7C15ULL) >> 40) & mask;
+	unsigned probe;
+
+	for (probe=0; probe < LOG_BIN_MAX_PROBE; ++probe, slot = (slot + 1) & mask)
+	{
+		struct log_bin_str *str = &log_bin.strs[slot];
+		buint64_t cur = __atomic_load_n(&str->key, __ATOMIC_ACQUIRE);
+		buint64_t off;
+		bsize_t len;
+
+		if (cur == 0)
+		{
+			if (!__atomic_compare_exchange_n(&str->key, &cur, key, BASE_FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+			{
+				if (cur != key)
+					continue;
+			}
+			else
+			{
+				/* Claimed, publish the text. If the text doesn't fit, the slot
+				 * stays unusable.
+				 */
+				if (is_format && _logBinSignature(text, &log_bin.sigs[slot]) != 0)
+					return LOG_BIN_NO_STR;
+
+				len = strlen(text);
+				off = __atomic_fetch_add(&hdr->str_used, len + 1, __ATOMIC_RELAXED);
+				if (len == 0 || off + len + 1 > hdr->str_size)
+					return LOG_BIN_NO_STR;
+
+				bmemcpy(log_bin.texts + off, text, len + 1);
+				log_bin.strs[slot].offset = (buint32_t)off;
+				__atomic_store_n(&log_bin.strs[slot].len, (buint32_t)len, __ATOMIC_RELEASE);
+				return slot;
+			}
+		}
+
+		if (cur == key)
+			return __atomic_load_n(&str->len, __ATOMIC_ACQUIRE) ? slot : LOG_BIN_NO_STR;
+	}
+
+	return LOG_BIN_NO_STR;
+}
+
+static void _logBinWriteRing(buint64_t pos, const void *data, bsize_t len)
+{
+	buint64_t mask = log_bin.hdr->ring_size - 1;
+	bsize_t off = (bsize_t)(pos & mask), part = (bsize_t)(mask + 1 - off);
+
+	if (part >= len)
+	{
+		bmemcpy(log_bin.ring + off, data, len);
+	}
+	else
+	{
+		bmemcpy(log_bin.ring + off, data, part);
+		bmemcpy(log_bin.ring, (const char*)data + part, len - part);
+	}
+}
+
+/* Copy the arguments of the message, return their length */
+static int _logBinArgs(const struct log_bin_sig *sig, char *args, int size, va_list marker)
+{
+	char *p = args, *end = args + size;
+	int i, prev = -1;
+
+	for (i=0; i<sig->nargs; ++i)
+	{
+		if (end - p < 8)
+			return -1;
+
+		switch (sig->type[i])
+		{
+		case 'i':
+			prev = va_arg(marker, int);
+			bmemcpy(p, &prev, sizeof(int));
+			p += sizeof(int);
+			break;
+		case 'l':
+		case 'q':
+		case 'z':
+		case 'p':
+			{
+				bint64_t v;
+
+				if (sig->type[i] == 'l')
+					v = va_arg(marker, long);
+				else if (sig->type[i] == 'q')
+					v = va_arg(marker, long long);
+				else if (sig->type[i] == 'z')
+					v = (bint64_t)va_arg(marker, bsize_t);
+				else
+					v = (bint64_t)(bsize_t)va_arg(marker, void*);
+
+				bmemcpy(p, &v, sizeof(v));
+				p += sizeof(v);
+			}
+			break;
+		case 'd':
+			{
+				double d = va_arg(marker, double);
+				bmemcpy(p, &d, sizeof(d));
+				p += sizeof(d);
+			}
+			break;
+		default: /* 's' */
+			{
+				const char *s = va_arg(marker, const char*);
+				bsize_t max = end - p - sizeof(buint16_t), len;
+				buint16_t slen;
+
+				/* Honour the precision, the string may not be NULL terminated */
+				if (sig->prec[i] == LOG_BIN_PREC_STAR)
+				{
+					if (prev >= 0 && (bsize_t)prev < max)
+						max = prev;
+				}
+				else if (sig->prec[i] != LOG_BIN_PREC_NONE && sig->prec[i] < max)
+				{
+					max = sig->prec[i];
+				}
+
+				if (s == NULL)
+					s = "(null)";
+				for (len=0; len<max && s[len]; ++len)
+					;
+
+				slen = (buint16_t)len;
+				bmemcpy(p, &slen, sizeof(slen));
+				bmemcpy(p + sizeof(slen), s, len);
+				p += sizeof(slen) + len;
+			}
+			break;
+		}
+	}
+
+	return (int)(p - args);
+}
+
+bbool_t extLogBinWrite(const char *sender, int level, int indent, const char *format, va_list marker)
+{
+	struct log_bin_rec rec;
+	char args[BASE_LOG_MAX_SIZE];
+	btimestamp ts;
+	bbool_t recorded = BASE_FALSE;
+	int len = -1;
+
+	if (!__atomic_load_n(&log_bin.active, __ATOMIC_RELAXED))
+		return BASE_FALSE;
+
+	/* blog_bin_stop() waits until no thread is here before it unmaps the file */
+	__atomic_add_fetch(&log_bin.inflight, 1, __ATOMIC_SEQ_CST);
+	if (!__atomic_load_n(&log_bin.active, __ATOMIC_SEQ_CST))
+		goto on_return;
+
+	bTimeStampGet(&ts);
+
+	rec.magic = 0;
+	rec.ts = ts.u64;
+	rec.level = (buint8_t)level;
+	rec.indent = (buint8_t)(indent > 255 ? 255 : indent);
+	rec.sender = (buint16_t)_logBinIntern(_logBinHashName(sender), sender, BASE_FALSE);
+	{
+		const char *thread_name = bthreadGetName(bthreadThis());
+		rec.thread = (buint16_t)_logBinIntern(_logBinHashName(thread_name), thread_name, BASE_FALSE);
+	}
+
+	rec.format = _logBinIntern((buint64_t)(bsize_t)format, format, BASE_TRUE);
+	if (rec.format != LOG_BIN_NO_STR)
+	{
+		va_list arg;
+
+		va_copy(arg, marker);
+		len = _logBinArgs(&log_bin.sigs[rec.format], args, sizeof(args), arg);
+		va_end(arg);
+	}
+
+	if (len < 0)
+	{
+		/* Unknown format, or too many arguments: record it formatted */
+		rec.format = LOG_BIN_TEXT;
+		len = bansi_vsnprintf(args, sizeof(args), format, marker);
+		if (len < 0)
+			len = 0;
+		else if (len >= (int)sizeof(args))
+			len = sizeof(args) - 1;
+	}
+
+	rec.arg_len = (buint16_t)len;
+	rec.size = (buint32_t)LOG_BIN_ALIGN(sizeof(rec) + len);
+	rec.pos = __atomic_fetch_add(&log_bin.hdr->write_pos, rec.size, __ATOMIC_RELAXED);
+
+	_logBinWriteRing(rec.pos, &rec, sizeof(rec));
+	_logBinWriteRing(rec.pos + sizeof(rec), args, len);
+	__atomic_store_n((buint32_t*)(log_bin.ring + (rec.pos & (log_bin.hdr->ring_size - 1))),
+		LOG_BIN_REC_MAGIC, __ATOMIC_RELEASE);
+
+	recorded = (level > log_bin.text_level);
+
+on_return:
+	__atomic_sub_fetch(&log_bin.inflight, 1, __ATOMIC_RELEASE);
+	return recorded;
+}
+
+#endif	/* BASE_LOG_HAS_BINARY */
+
+void blog_bin_cfg_default(blog_bin_cfg *cfg)
+{
+	cfg->ring_size = BASE_LOG_BIN_RING_SIZE;
+	cfg->str_size = BASE_LOG_BIN_STR_SIZE;
+	cfg->str_count = BASE_LOG_BIN_STR_COUNT;
+	cfg->text_level = BASE_LOG_BIN_TEXT_LEVEL;
+}
+
+bstatus_t blog_bin_start(const char *path, const blog_bin_cfg *cfg)
+{
+#if BASE_LOG_HAS_BINARY
+	blog_bin_cfg default_cfg;
+	struct log_bin_header *hdr;
+	bsize_t ring_size, str_count, sig_size, size;
+	btimestamp ts, freq;
+	btime_val now;
+	bstatus_t status;
+
+	if (log_bin.map)
+		return BASE_EBUSY;
+
+	if (cfg == NULL)
+	{
+		blog_bin_cfg_default(&default_cfg);
+		cfg = &default_cfg;
+	}
+
+	/* Room for the longest record, and slots addressable by 16 bits */
+	for (ring_size = 1; ring_size < cfg->ring_size || ring_size < 2 * (sizeof(struct log_bin_rec) + BASE_LOG_MAX_SIZE); )
+		ring_size <<= 1;
+	for (str_count = 16; str_count < cfg->str_count && str_count < LOG_BIN_NO_STR; )
+		str_count <<= 1;
+
+	size = LOG_BIN_ALIGN(sizeof(struct log_bin_header)) + str_count * sizeof(struct log_bin_str) +
+		LOG_BIN_ALIGN(cfg->str_size);
+	size = (size + 4095) & ~(bsize_t)4095;
+
+	log_bin.fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (log_bin.fd < 0)
+		return BASE_RETURN_OS_ERROR(errno);
+
+	if (ftruncate(log_bin.fd, size + ring_size) != 0)
+		goto on_error;
+
+	log_bin.map = (char*) mmap(NULL, size + ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, log_bin.fd, 0);
+	if (log_bin.map == MAP_FAILED)
+	{
+		log_bin.map = NULL;
+		goto on_error;
+	}
+	log_bin.map_size = size + ring_size;
+
+	sig_size = str_count * sizeof(struct log_bin_sig);
+	log_bin.sigs = (struct log_bin_sig*) mmap(NULL, sig_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (log_bin.sigs == MAP_FAILED)
+	{
+		log_bin.sigs = NULL;
+		goto on_error;
+	}
+
+	hdr = log_bin.hdr = (struct log_bin_header*) log_bin.map;
+	hdr->version = LOG_BIN_VERSION;
+	hdr->decor = blog_get_decor();
+	hdr->str_count = (buint32_t)str_count;
+	hdr->str_offset = LOG_BIN_ALIGN(sizeof(struct log_bin_header));
+	hdr->str_size = size - hdr->str_offset - str_count * sizeof(struct log_bin_str);
+	hdr->ring_offset = size;
+	hdr->ring_size = ring_size;
+
+	bTimeStampGetFreq(&freq);
+	bgettimeofday(&now);
+	bTimeStampGet(&ts);
+	hdr->ts_base = ts.u64;
+	hdr->ts_freq = freq.u64;
+	hdr->sec_base = now.sec;
+	hdr->msec_base = now.msec;
+	hdr->magic = LOG_BIN_MAGIC;
+
+	log_bin.strs = (struct log_bin_str*)(log_bin.map + hdr->str_offset);
+	log_bin.texts = (char*)(log_bin.strs + str_count);
+	log_bin.ring = log_bin.map + size;
+	log_bin.text_level = cfg->text_level;
+
+	__atomic_store_n(&log_bin.active, 1, __ATOMIC_SEQ_CST);
+	return BASE_SUCCESS;
+
+on_error:
+	status = BASE_RETURN_OS_ERROR(errno);
+	if (log_bin.map)
+		munmap(log_bin.map, log_bin.map_size);
+	log_bin.map = NULL;
+	close(log_bin.fd);
+	log_bin.fd = -1;
+	return status;
+#else
+	BASE_UNUSED_ARG(path);
+	BASE_UNUSED_ARG(cfg);
+	return BASE_ENOTSUP;
+#endif
+}
+
+void blog_bin_stop(void)
+{
+#if BASE_LOG_HAS_BINARY
+	bsize_t sig_size;
+
+	if (log_bin.map == NULL)
+		return;
+
+	__atomic_store_n(&log_bin.active, 0, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&log_bin.inflight, __ATOMIC_SEQ_CST) != 0)
+		bthreadSleepMs(1);
+
+	sig_size = log_bin.hdr->str_count * sizeof(struct log_bin_sig);
+	msync(log_bin.map, log_bin.map_size, MS_SYNC);
+	munmap(log_bin.map, log_bin.map_size);
+	munmap(log_bin.sigs, sig_size);
+	close(log_bin.fd);
+
+	log_bin.map = NULL;
+	log_bin.sigs = NULL;
+	log_bin.fd = -1;
+#endif
+}
+
+#endif	/* BASE_LOG_MAX_LEVEL >= 1 */
@@ -5,6 +5,13 @@
 #include <baseOs.h>
 #include <compat/stdfileio.h>
 
+#if defined(BASE_HAS_UNISTD_H) && BASE_HAS_UNISTD_H != 0
+#  include <sys/uio.h>
+#  include <unistd.h>
+#  include <errno.h>
+#  define LOG_BATCH_IOV		64
+#endif
+
 
 static void _termSetColor(int level)
 {
@@ -42,3 +49,60 @@ void blog_write(int level, const char *buffer, int len)
 	}
 }
 
+void blog_write_batch(const blog_msg msgs[], unsigned count)
+{
+	unsigned i;
+
+#if defined(BASE_HAS_UNISTD_H) && BASE_HAS_UNISTD_H != 0
+	if ((blog_get_decor() & BASE_LOG_HAS_COLOR) == 0)
+	{
+		struct iovec iov[LOG_BATCH_IOV], *next;
+		unsigned n, left;
+		ssize_t sent;
+
+		/* Keep the order with what was printed before */
+		fflush(stdout);
+
+		while (count > 0)
+		{
+			n = (count < LOG_BATCH_IOV) ? count : LOG_BATCH_IOV;
+			for (i=0; i<n; ++i)
+			{
+				iov[i].iov_base = (void*)msgs[i].data;
+				iov[i].iov_len = msgs[i].len;
+			}
+
+			/* Write the rest after a short write */
+			for (next = iov, left = n; left > 0; )
+			{
+				sent = writev(fileno(stdout), next, left);
+				if (sent < 0)
+				{
+					if (errno == EINTR)
+						continue;
+					return;
+				}
+
+				while (left > 0 && (size_t)sent >= next->iov_len)
+				{
+					sent -= next->iov_len;
+					++next;
+					--left;
+				}
+				if (left > 0)
+				{
+					next->iov_base = (char*)next->iov_base + sent;
+					next->iov_len -= sent;
+				}
+			}
+
+			msgs += n;
+			count -= n;
+		}
+		return;
+	}
+#endif
+
+	for (i=0; i<count; ++i)
+		blog_write(msgs[i].level, msgs[i].data, msgs[i].len);
+}
@@ -84,6 +84,17 @@ BASE_EXPORT_SYMBOL(bhash_count)
 BASE_EXPORT_SYMBOL(bhash_first)
 BASE_EXPORT_SYMBOL(bhash_next)
 BASE_EXPORT_SYMBOL(bhash_this)
+BASE_EXPORT_SYMBOL(bohash_calc)
+BASE_EXPORT_SYMBOL(bohash_create)
+BASE_EXPORT_SYMBOL(bohash_destroy)
+BASE_EXPORT_SYMBOL(bohash_get)
+BASE_EXPORT_SYMBOL(bohash_get_lower)
+BASE_EXPORT_SYMBOL(bohash_set)
+BASE_EXPORT_SYMBOL(bohash_set_lower)
+BASE_EXPORT_SYMBOL(bohash_count)
+BASE_EXPORT_SYMBOL(bohash_first)
+BASE_EXPORT_SYMBOL(bohash_next)
+BASE_EXPORT_SYMBOL(bohash_this)
 
 /*
  * ioqueue.h
@@ -100,6 +111,7 @@ BASE_EXPORT_SYMBOL(bioqueue_recv)
 BASE_EXPORT_SYMBOL(bioqueue_recvfrom)
 BASE_EXPORT_SYMBOL(bioqueue_write)
 BASE_EXPORT_SYMBOL(bioqueue_send)
+BASE_EXPORT_SYMBOL(bioqueue_sendv)
 BASE_EXPORT_SYMBOL(bioqueue_sendto)
 #if defined(BASE_HAS_TCP) && BASE_HAS_TCP != 0
 BASE_EXPORT_SYMBOL(bioqueue_accept)
@@ -124,9 +136,19 @@ BASE_EXPORT_SYMBOL(blist_search)
  * log.h
  */
 BASE_EXPORT_SYMBOL(blog_write)
+BASE_EXPORT_SYMBOL(blog_write_batch)
 #if BASE_LOG_MAX_LEVEL >= 1
 BASE_EXPORT_SYMBOL(blog_set_log_func)
 BASE_EXPORT_SYMBOL(blog_get_log_func)
+BASE_EXPORT_SYMBOL(blog_set_batch_func)
+BASE_EXPORT_SYMBOL(blog_get_batch_func)
+BASE_EXPORT_SYMBOL(blog_async_cfg_default)
+BASE_EXPORT_SYMBOL(blog_set_async)
+BASE_EXPORT_SYMBOL(blog_get_dropped)
+BASE_EXPORT_SYMBOL(blog_bin_cfg_default)
+BASE_EXPORT_SYMBOL(blog_bin_start)
+BASE_EXPORT_SYMBOL(blog_bin_stop)
+BASE_EXPORT_SYMBOL(blog_bin_decode)
 BASE_EXPORT_SYMBOL(blog_set_level)
 BASE_EXPORT_SYMBOL(blog_get_level)
 BASE_EXPORT_SYMBOL(blog_set_decor)
@@ -174,6 +196,7 @@ BASE_EXPORT_SYMBOL(batomic_get)
 BASE_EXPORT_SYMBOL(batomic_inc)
 BASE_EXPORT_SYMBOL(batomic_dec)
 BASE_EXPORT_SYMBOL(bthreadLocalAlloc)
+BASE_EXPORT_SYMBOL(bthreadLocalAlloc2)
 BASE_EXPORT_SYMBOL(bthreadLocalFree)
 BASE_EXPORT_SYMBOL(bthreadLocalSet)
 BASE_EXPORT_SYMBOL(bthreadLocalGet)
@@ -216,6 +239,7 @@ BASE_EXPORT_SYMBOL(bpool_getobjname)
 BASE_EXPORT_SYMBOL(bpool_reset)
 BASE_EXPORT_SYMBOL(bpool_get_capacity)
 BASE_EXPORT_SYMBOL(bpool_get_used_size)
+BASE_EXPORT_SYMBOL(bpool_get_wasted_size)
 BASE_EXPORT_SYMBOL(bpool_alloc)
 BASE_EXPORT_SYMBOL(bpool_calloc)
 BASE_EXPORT_SYMBOL(bpool_factory_default_policy)
@@ -224,6 +248,8 @@ BASE_EXPORT_SYMBOL(bpool_init_int)
 BASE_EXPORT_SYMBOL(bpool_destroy_int)
 BASE_EXPORT_SYMBOL(bcaching_pool_init)
 BASE_EXPORT_SYMBOL(bcaching_pool_destroy)
+BASE_EXPORT_SYMBOL(bcaching_pool_set_magazine)
+BASE_EXPORT_SYMBOL(bcaching_pool_flush_magazines)
 
 /*
  * rand.h
@@ -291,6 +317,7 @@ BASE_EXPORT_SYMBOL(bsock_recv)
 BASE_EXPORT_SYMBOL(bsock_recvfrom)
 BASE_EXPORT_SYMBOL(bsock_send)
 BASE_EXPORT_SYMBOL(bsock_sendto)
+BASE_EXPORT_SYMBOL(bsock_sendv)
 
 /*
  * sock_select.h
@@ -334,6 +361,8 @@ BASE_EXPORT_SYMBOL(butoa_pad)
  */
 BASE_EXPORT_SYMBOL(btimer_heap_mem_size)
 BASE_EXPORT_SYMBOL(btimer_heap_create)
+BASE_EXPORT_SYMBOL(btimer_heap_create2)
+BASE_EXPORT_SYMBOL(btimer_heap_cfg_default)
 BASE_EXPORT_SYMBOL(btimer_entry_init)
 BASE_EXPORT_SYMBOL(btimer_heap_schedule)
 BASE_EXPORT_SYMBOL(btimer_heap_cancel)
@@ -25,6 +25,13 @@
 
 #define DEFAULT_MAX_TIMED_OUT_PER_POLL  (64)
 
+/* Timers expired per lock hold in batch poll */
+#define BATCH_POLL_SIZE			DEFAULT_MAX_TIMED_OUT_PER_POLL
+
+/* _timer_id of a timer waiting in slot I of a batch of poll_batch() */
+#define TIMER_ID_FIRING			(-2)
+#define TIMER_ID_BATCH_SLOT(id)		((unsigned)(TIMER_ID_FIRING - (id)))
+
 enum
 {
 	F_DONT_CALL = 1,
@@ -33,6 +40,22 @@ enum
 };
 
 
+/**
+ * Timers removed by one round of poll_batch(), whose callbacks are called
+ * without the lock. A slot is taken, by the poll to call the callback or by
+ * cancel()/schedule() to keep it from being called, by swapping <node> to NULL.
+ */
+struct timer_batch
+{
+	struct timer_batch *next;
+
+	struct
+	{
+		btimer_entry *node;
+		bgrp_lock_t *grp_lock;
+	} slot[BATCH_POLL_SIZE];
+};
+
 /**
  * The implementation of timer heap.
  */
@@ -50,6 +73,9 @@ struct _btimer_heap_t
 	/** Max timed out entries to process per poll. */
 	unsigned max_entries_per_poll;
 
+	/** Expire timers in batches, see btimer_heap_cfg. */
+	bbool_t batch_poll;
+
 	/** Lock object. */
 	block_t *lock;
 
@@ -85,6 +111,11 @@ struct _btimer_heap_t
 	/** Callback to be called when a timer expires. */
 	btimer_heap_callback *callback;
 
+	/** Timing wheel, NULL when this is a binary heap. */
+	struct timer_wheel *wheel;
+
+	/** Batches of the polls which are calling callbacks. */
+	struct timer_batch *batches;
 };
 
 
@@ -280,9 +311,485 @@ static void insert_node(btimer_heap_t *ht, btimer_entry *new_node)
 }
 
 
+/*
+ * Hierarchical timing wheel (BASE_TIMER_HEAP_WHEEL).
+ *
+ * Level 0 has one slot per tick for the next 256 ticks, each of the higher
+ * levels has 64 slots spanning a whole turn of the level below. A timer is
+ * linked into the lowest level which covers its expiry, and when level 0
+ * completes a turn the next slot of level 1 is cascaded down (and so on up
+ * the levels), so a timer is moved at most once per level. Timers of the
+ * current tick are moved to the due list, which btimer_heap_poll() drains.
+ *
+ * The lists are doubly linked through <node>, which is indexed by the timer
+ * id like the <timer_ids> of the heap; id 0 is the end of list. Timers are
+ * linked at the head of the slots, so linking and unlinking only touch the
+ * neighbours, and at the tail of the due list, which stays in expiry order.
+ * The tick is a power of two msec, ticks are computed with a shift.
+ */
+#define WHEEL_BITS0		8
+#define WHEEL_BITS		6
+#define WHEEL_LEVELS		5
+#define WHEEL_MASK0		((1 << WHEEL_BITS0) - 1)
+#define WHEEL_MASK		((1 << WHEEL_BITS) - 1)
+#define WHEEL_SLOTS		((1 << WHEEL_BITS0) + (WHEEL_LEVELS-1) * (1 << WHEEL_BITS))
+#define WHEEL_DUE		WHEEL_SLOTS		/* list of expired timers */
+#define WHEEL_NONE		(WHEEL_SLOTS + 1)	/* node is not in use */
+
+/* First tick of slot of level L, and the list of slot I of level L */
+#define WHEEL_SHIFT(L)		((L) == 0 ? 0 : WHEEL_BITS0 + ((L)-1) * WHEEL_BITS)
+#define WHEEL_LIST(L, I)	((L) == 0 ? (I) : (1 << WHEEL_BITS0) + ((L)-1) * (1 << WHEEL_BITS) + (I))
+
+/* Ticks covered by the wheel, later timers wait in the last slot of it */
+#define WHEEL_SPAN		((buint64_t)1 << WHEEL_SHIFT(WHEEL_LEVELS))
+
+struct wheel_node
+{
+	btimer_entry	*entry;
+	buint64_t	expires;	/* tick of the expiry */
+	btimer_id_t	next;
+	btimer_id_t	prev;
+	unsigned	list;
+};
+
+struct timer_wheel
+{
+	/** Nodes of the timers, <max_size> of them, indexed by timer id. */
+	struct wheel_node *node;
+
+	/** First free node, the free nodes are linked by <next>. */
+	btimer_id_t free_list;
+
+	/** First node of each slot and of the due list. */
+	btimer_id_t head[WHEEL_SLOTS + 1];
+
+	/** Last node of the due list. */
+	btimer_id_t due_tail;
+
+	/** Bitmap of the slots which are not empty, one word per level above 0. */
+	buint64_t used[WHEEL_SLOTS / 64];
+
+	/** Next tick to be processed. */
+	buint64_t tick;
+
+	/** Length of a tick, in msec, and its log2. */
+	unsigned tick_msec;
+	unsigned tick_shift;
+
+	/** Number of timers in the slots, i.e. not due yet. */
+	bsize_t slotted;
+};
+
+static unsigned wheel_ctz(buint64_t word)
+{
+#if defined(__GNUC__)
+	return (unsigned)__builtin_ctzll(word);
+#else
+	unsigned n = 0;
+
+	while ((word & 1) == 0)
+	{
+		word >>= 1;
+		++n;
+	}
+	return n;
+#endif
+}
+
+/* Index of the highest bit set */
+static unsigned wheel_fls(buint64_t word)
+{
+#if defined(__GNUC__)
+	return 63 - (unsigned)__builtin_clzll(word);
+#else
+	unsigned n = 0;
+
+	while (word >>= 1)
+		++n;
+	return n;
+#endif
+}
+
+/* First slot of level 0 in [from, to) which is not empty, or -1 */
+static int wheel_find_used(const struct timer_wheel *w, unsigned from, unsigned to)
+{
+	while (from < to)
+	{
+		buint64_t word = w->used[from >> 6] >> (from & 63);
+
+		if (word)
+		{
+			from += wheel_ctz(word);
+			return from < to ? (int)from : -1;
+		}
+		from = (from | 63) + 1;
+	}
+	return -1;
+}
+
+/* Ticks are counted from the tickcount origin */
+static buint64_t wheel_msec(const btime_val *t)
+{
+	return (buint64_t)t->sec * 1000 + t->msec;
+}
+
+static void wheel_link(struct timer_wheel *w, btimer_id_t id, unsigned list)
+{
+	struct wheel_node *n = &w->node[id];
+	btimer_id_t first = w->head[list];
+
+	n->list = list;
+	if (list == WHEEL_DUE)
+	{
+		n->next = 0;
+		n->prev = w->due_tail;
+		if (w->due_tail)
+			w->node[w->due_tail].next = id;
+		else
+			w->head[list] = id;
+		w->due_tail = id;
+		return;
+	}
+
+	n->next = first;
+	n->prev = 0;
+	if (first)
+		w->node[first].prev = id;
+	w->head[list] = id;
+
+	if (list < WHEEL_SLOTS)
+	{
+		w->used[list >> 6] |= (buint64_t)1 << (list & 63);
+		++w->slotted;
+	}
+}
+
+static void wheel_unlink(struct timer_wheel *w, btimer_id_t id)
+{
+	struct wheel_node *n = &w->node[id];
+	unsigned list = n->list;
+
+	if (n->prev)
+		w->node[n->prev].next = n->next;
+	else
+		w->head[list] = n->next;
+	if (n->next)
+		w->node[n->next].prev = n->prev;
+	else if (list == WHEEL_DUE)
+		w->due_tail = n->prev;
+
+	if (list < WHEEL_SLOTS)
+	{
+		if (!w->head[list])
+			w->used[list >> 6] &= ~((buint64_t)1 << (list & 63));
+		--w->slotted;
+	}
+	n->list = WHEEL_NONE;
+}
+
+/* Link the node into the slot of its <expires> */
+static void wheel_insert(struct timer_wheel *w, btimer_id_t id)
+{
+	buint64_t expires = w->node[id].expires;
+	buint64_t delta;
+	unsigned level;
+
+	if (expires < w->tick)
+	{
+		wheel_link(w, id, WHEEL_DUE);
+		return;
+	}
+
+	delta = expires - w->tick;
+	if (delta <= WHEEL_MASK0)
+	{
+		wheel_link(w, id, (unsigned)expires & WHEEL_MASK0);
+		return;
+	}
+
+	if (delta >= WHEEL_SPAN)
+	{
+		delta = WHEEL_SPAN - 1;
+		expires = w->tick + delta;
+	}
+
+	/* The lowest level covering the delta, from its highest bit */
+	level = (wheel_fls(delta) - WHEEL_BITS0) / WHEEL_BITS + 1;
+
+	wheel_link(w, id, WHEEL_LIST(level, (unsigned)(expires >> WHEEL_SHIFT(level)) & WHEEL_MASK));
+}
+
+/* Move the slot to the due list, or to the lower levels when it is above level 0 */
+static void wheel_expire_slot(struct timer_wheel *w, unsigned level, unsigned idx)
+{
+	unsigned list = WHEEL_LIST(level, idx);
+	btimer_id_t id;
+
+	while ((id = w->head[list]) != 0)
+	{
+		wheel_unlink(w, id);
+		if (level == 0)
+			wheel_link(w, id, WHEEL_DUE);
+		else
+			wheel_insert(w, id);
+	}
+}
+
+/* Process the ticks up to and including <now> */
+static void wheel_advance(struct timer_wheel *w, buint64_t now)
+{
+	while (w->tick <= now)
+	{
+		buint64_t tick = w->tick;
+		unsigned idx = (unsigned)tick & WHEEL_MASK0;
+		buint64_t next;
+		int slot;
+
+		if (w->slotted == 0)
+		{
+			w->tick = now + 1;
+			break;
+		}
+
+		/* Level 0 completed a turn, cascade the levels above whose turn completed too */
+		if (idx == 0)
+		{
+			unsigned level;
+
+			for (level = 1; level < WHEEL_LEVELS; ++level)
+			{
+				unsigned i = (unsigned)(tick >> WHEEL_SHIFT(level)) & WHEEL_MASK;
+
+				wheel_expire_slot(w, level, i);
+				if (i != 0)
+					break;
+			}
+		}
+
+		wheel_expire_slot(w, 0, idx);
+
+		/* Skip the empty slots up to the end of this turn */
+		next = (tick | WHEEL_MASK0) + 1;
+		slot = wheel_find_used(w, idx + 1, WHEEL_MASK0 + 1);
+		if (slot > 0)
+			next = tick + (slot - idx);
+
+		w->tick = (next < now + 1) ? next : now + 1;
+	}
+}
+
+/* Tick at which the slot of <level> which comes first in time begins, or (buint64_t)-1 */
+static buint64_t wheel_first_slot(const struct timer_wheel *w, unsigned level, unsigned *list)
+{
+	unsigned shift = WHEEL_SHIFT(level);
+	unsigned cur;
+	int slot;
+
+	if (level == 0)
+	{
+		cur = (unsigned)w->tick & WHEEL_MASK0;
+		slot = wheel_find_used(w, cur, WHEEL_MASK0 + 1);
+		if (slot >= 0)
+		{
+			*list = slot;
+			return w->tick + (slot - cur);
+		}
+
+		slot = wheel_find_used(w, 0, cur);
+		if (slot >= 0)
+		{
+			*list = slot;
+			return w->tick + (WHEEL_MASK0 + 1 - cur) + slot;
+		}
+	}
+	else
+	{
+		buint64_t word = w->used[(WHEEL_LIST(level, 0)) >> 6];
+		unsigned r;
+
+		if (!word)
+			return (buint64_t)-1;
+
+		cur = (unsigned)(w->tick >> shift) & WHEEL_MASK;
+
+		/* The current slot is cascaded when the tick reaches its start, until then it is due first */
+		if ((w->tick & (((buint64_t)1 << shift) - 1)) == 0 && (word >> cur) & 1)
+		{
+			*list = WHEEL_LIST(level, cur);
+			return w->tick;
+		}
+
+		/* Otherwise the following slots come first, and the current slot is a whole turn later */
+		r = (cur + 1) & WHEEL_MASK;
+		if (r)
+			word = (word >> r) | (word << (64 - r));
+		r = wheel_ctz(word) + 1;
+
+		*list = WHEEL_LIST(level, (cur + r) & WHEEL_MASK);
+		return ((w->tick >> shift) + r) << shift;
+	}
+
+	return (buint64_t)-1;
+}
+
+/* Lower bound of the tick of the next expiry, 0 when there are due timers */
+static buint64_t wheel_next_tick(const struct timer_wheel *w)
+{
+	buint64_t best = (buint64_t)-1;
+	unsigned level, list;
+
+	if (w->head[WHEEL_DUE])
+		return 0;
+
+	for (level = 0; level < WHEEL_LEVELS; ++level)
+	{
+		buint64_t tick = wheel_first_slot(w, level, &list);
+
+		if (tick < best)
+			best = tick;
+	}
+
+	return best;
+}
+
+static void wheel_grow(btimer_heap_t *ht)
+{
+	struct timer_wheel *w = ht->wheel;
+	bsize_t new_size = ht->max_size * 2;
+	struct wheel_node *new_node;
+	bsize_t i;
+
+	new_node = (struct wheel_node*)bpool_alloc(ht->pool, new_size * sizeof(struct wheel_node));
+	memcpy(new_node, w->node, ht->max_size * sizeof(struct wheel_node));
+	w->node = new_node;
+
+	for (i = ht->max_size; i < new_size; i++)
+	{
+		w->node[i].entry = NULL;
+		w->node[i].list = WHEEL_NONE;
+		w->node[i].next = (i + 1 < new_size) ? (btimer_id_t)(i + 1) : w->free_list;
+	}
+	w->free_list = (btimer_id_t)ht->max_size;
+
+	ht->max_size = new_size;
+}
+
+static bstatus_t wheel_create(btimer_heap_t *ht, unsigned tick_msec)
+{
+	struct timer_wheel *w;
+	btime_val now;
+	bsize_t i;
+
+	w = BASE_POOL_ZALLOC_T(ht->pool, struct timer_wheel);
+	if (!w)
+		return BASE_ENOMEM;
+
+	w->node = (struct wheel_node*)bpool_alloc(ht->pool, ht->max_size * sizeof(struct wheel_node));
+	if (!w->node)
+		return BASE_ENOMEM;
+
+	/* Node 0 is the end of list */
+	for (i = 0; i < ht->max_size; i++)
+	{
+		w->node[i].entry = NULL;
+		w->node[i].list = WHEEL_NONE;
+		w->node[i].next = (i + 1 < ht->max_size) ? (btimer_id_t)(i + 1) : 0;
+	}
+	w->free_list = 1;
+
+	/* Round the tick down to a power of two */
+	w->tick_shift = wheel_fls(tick_msec);
+	w->tick_msec = 1u << w->tick_shift;
+	bgettickcount(&now);
+	w->tick = wheel_msec(&now) >> w->tick_shift;
+
+	ht->wheel = w;
+	return BASE_SUCCESS;
+}
+
+static void wheel_schedule(btimer_heap_t *ht, btimer_entry *entry)
+{
+	struct timer_wheel *w = ht->wheel;
+	btimer_id_t id;
+
+	if (!w->free_list)
+		wheel_grow(ht);
+
+	id = w->free_list;
+	w->free_list = w->node[id].next;
+
+	entry->_timer_id = id;
+	w->node[id].entry = entry;
+	/* Round up, timers never expire before their time */
+	w->node[id].expires = (wheel_msec(&entry->_timer_value) + w->tick_msec - 1) >> w->tick_shift;
+	wheel_insert(w, id);
+	ht->cur_size++;
+}
+
+static btimer_entry *wheel_remove(btimer_heap_t *ht, btimer_id_t id)
+{
+	struct timer_wheel *w = ht->wheel;
+	btimer_entry *entry = w->node[id].entry;
+
+	wheel_unlink(w, id);
+	w->node[id].entry = NULL;
+	w->node[id].next = w->free_list;
+	w->free_list = id;
+
+	ht->cur_size--;
+	entry->_timer_id = -1;
+
+	return entry;
+}
+
+/* Remove the next timer which expired at <now>, or return NULL */
+static btimer_entry *pop_expired(btimer_heap_t *ht, const btime_val *now)
+{
+	if (ht->wheel)
+	{
+		struct timer_wheel *w = ht->wheel;
+
+		if (!w->head[WHEEL_DUE])
+		{
+			wheel_advance(w, wheel_msec(now) >> w->tick_shift);
+			if (!w->head[WHEEL_DUE])
+				return NULL;
+		}
+		return wheel_remove(ht, w->head[WHEEL_DUE]);
+	}
+
+	if (ht->cur_size && BASE_TIME_VAL_LTE(ht->heap[0]->_timer_value, *now))
+		return remove_node(ht, 0);
+
+	return NULL;
+}
+
+/* Time of the next expiry, a lower bound with the wheel */
+static void next_expiry(btimer_heap_t *ht, btime_val *t)
+{
+	if (ht->wheel)
+	{
+		buint64_t msec = wheel_next_tick(ht->wheel) << ht->wheel->tick_shift;
+
+		t->sec = (long)(msec / 1000);
+		t->msec = (long)(msec % 1000);
+	}
+	else
+	{
+		*t = ht->heap[0]->_timer_value;
+	}
+}
+
+
 static bstatus_t schedule_entry( btimer_heap_t *ht, 	btimer_entry *entry, const btime_val *future_time )
 {
-	if (ht->cur_size < ht->max_size)
+	if (ht->wheel)
+	{
+		entry->_timer_value = *future_time;
+		wheel_schedule(ht, entry);
+		return 0;
+	}
+	else if (ht->cur_size < ht->max_size)
 	{
 		// Obtain the next unique sequence number.
 		// Set the entry
@@ -297,19 +804,82 @@ static bstatus_t schedule_entry( btimer_heap_t *ht, 	btimer_entry *entry, const
 }
 
 
+/*
+ * Take <entry> back from the batch of poll_batch() it waits in, so that its
+ * callback is not called. Returns BASE_TRUE with the group lock reference of
+ * the batch, or BASE_FALSE when the poll already took it. Called with the lock.
+ */
+static bbool_t batch_take( btimer_heap_t *ht, btimer_entry *entry, bgrp_lock_t **grp_lock)
+{
+	unsigned slot = TIMER_ID_BATCH_SLOT(entry->_timer_id);
+	struct timer_batch *b;
+
+	entry->_timer_id = -1;
+	if (slot >= BATCH_POLL_SIZE)
+		return BASE_FALSE;
+
+	for (b = ht->batches; b; b = b->next)
+	{
+		btimer_entry *expected = entry;
+
+		if (__atomic_compare_exchange_n(&b->slot[slot].node, &expected, NULL, BASE_FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		{
+			*grp_lock = b->slot[slot].grp_lock;
+			return BASE_TRUE;
+		}
+	}
+
+	return BASE_FALSE;
+}
+
 static int cancel( btimer_heap_t *ht, btimer_entry *entry, unsigned flags)
 {
 	long timer_node_slot;
 
 	BASE_CHECK_STACK();
 
+	// Expired in a batch whose callbacks are being called
+	if (entry->_timer_id <= TIMER_ID_FIRING)
+	{
+		bgrp_lock_t *grp_lock;
+
+		if (!batch_take(ht, entry, &grp_lock))
+			return 0;
+
+		/* Released by the caller, as for a timer still in the heap */
+		entry->_grp_lock = grp_lock;
+		if ((flags & F_DONT_CALL) == 0)
+			(*ht->callback)(ht, entry);
+		return 1;
+	}
+
 	// Check to see if the timer_id is out of range
-	if (entry->_timer_id < 0 || (bsize_t)entry->_timer_id > ht->max_size)
+	if (entry->_timer_id < 0 || (bsize_t)entry->_timer_id >= ht->max_size)
 	{
 		entry->_timer_id = -1;
 		return 0;
 	}
 
+	if (ht->wheel)
+	{
+		struct wheel_node *n = &ht->wheel->node[entry->_timer_id];
+
+		if (n->list == WHEEL_NONE || n->entry != entry)
+		{
+			if (n->list != WHEEL_NONE && (flags & F_DONT_ASSERT) == 0)
+				bassert(entry == n->entry);
+			entry->_timer_id = -1;
+			return 0;
+		}
+
+		wheel_remove(ht, entry->_timer_id);
+
+		if ((flags & F_DONT_CALL) == 0)
+			// Call the close hook.
+			(*ht->callback)(ht, entry);
+		return 1;
+	}
+
 	timer_node_slot = ht->timer_ids[entry->_timer_id];
 
 	if (timer_node_slot < 0)
@@ -342,24 +912,49 @@ static int cancel( btimer_heap_t *ht, btimer_entry *entry, unsigned flags)
  */
 bsize_t btimer_heap_mem_size(bsize_t count)
 {
+    bsize_t heap_size = (count+2) * (sizeof(btimer_entry*)+sizeof(btimer_id_t));
+    bsize_t wheel_size = sizeof(struct timer_wheel) + (count+2) * sizeof(struct wheel_node);
+
     return /* size of the timer heap itself: */
            sizeof(btimer_heap_t) + 
-           /* size of each entry: */
-           (count+2) * (sizeof(btimer_entry*)+sizeof(btimer_id_t)) +
+           /* size of each entry, with either implementation: */
+           (heap_size > wheel_size ? heap_size : wheel_size) +
            /* lock, pool etc: */
            132;
 }
 
+void btimer_heap_cfg_default(btimer_heap_cfg *cfg)
+{
+	bbzero(cfg, sizeof(*cfg));
+	cfg->type = BASE_TIMER_HEAP_DEFAULT_TYPE;
+	cfg->wheel_tick_msec = BASE_TIMER_WHEEL_TICK_MSEC;
+	cfg->batch_poll = BASE_TIMER_BATCH_POLL;
+}
+
 /*
  * Create a new timer heap.
  */
 bstatus_t btimer_heap_create( bpool_t *pool, bsize_t size, btimer_heap_t **p_heap)
 {
+	return btimer_heap_create2(pool, size, NULL, p_heap);
+}
+
+bstatus_t btimer_heap_create2( bpool_t *pool, bsize_t size, const btimer_heap_cfg *cfg, btimer_heap_t **p_heap)
+{
+	btimer_heap_cfg default_cfg;
 	btimer_heap_t *ht;
 	bsize_t i;
 
 	BASE_ASSERT_RETURN(pool && p_heap, BASE_EINVAL);
 
+	if (!cfg)
+	{
+		btimer_heap_cfg_default(&default_cfg);
+		cfg = &default_cfg;
+	}
+	BASE_ASSERT_RETURN(cfg->type == BASE_TIMER_HEAP_BINARY ||
+		(cfg->type == BASE_TIMER_HEAP_WHEEL && cfg->wheel_tick_msec > 0), BASE_EINVAL);
+
 	*p_heap = NULL;
 
 	/* Magic? */
@@ -374,6 +969,7 @@ bstatus_t btimer_heap_create( bpool_t *pool, bsize_t size, btimer_heap_t **p_hea
 	ht->max_size = size;
 	ht->cur_size = 0;
 	ht->max_entries_per_poll = DEFAULT_MAX_TIMED_OUT_PER_POLL;
+	ht->batch_poll = cfg->batch_poll;
 	ht->timer_ids_freelist = 1;
 	ht->pool = pool;
 
@@ -381,6 +977,23 @@ bstatus_t btimer_heap_create( bpool_t *pool, bsize_t size, btimer_heap_t **p_hea
 	ht->lock = NULL;
 	ht->auto_delete_lock = 0;
 
+	ht->wheel = NULL;
+	ht->batches = NULL;
+	if (cfg->type == BASE_TIMER_HEAP_WHEEL)
+	{
+		bstatus_t status;
+
+		ht->heap = NULL;
+		ht->timer_ids = NULL;
+
+		status = wheel_create(ht, cfg->wheel_tick_msec);
+		if (status != BASE_SUCCESS)
+			return status;
+
+		*p_heap = ht;
+		return BASE_SUCCESS;
+	}
+
 	// Create the heap array.
 	ht->heap = (btimer_entry**)bpool_alloc(pool, sizeof(btimer_entry*) * size);
 	if (!ht->heap)
@@ -492,6 +1105,15 @@ static bstatus_t schedule_w_grp_lock(btimer_heap_t *ht,
 		return BASE_EINVALIDOP;
 	}
 
+	/* Expired in a batch: it is not called there any more, but at its new time */
+	if (entry->_timer_id <= TIMER_ID_FIRING)
+	{
+		bgrp_lock_t *old_grp_lock = NULL;
+
+		if (batch_take(ht, entry, &old_grp_lock) && old_grp_lock)
+			bgrp_lock_dec_ref(old_grp_lock);
+	}
+
 	status = schedule_entry(ht, entry, &expires);
 	if (status == BASE_SUCCESS)
 	{
@@ -592,6 +1214,77 @@ int btimer_heap_cancel_if_active(btimer_heap_t *ht,	btimer_entry *entry, int id_
 	return _cancelTimer(ht, entry, F_SET_ID | F_DONT_ASSERT, id_val);
 }
 
+/*
+ * Remove up to BATCH_POLL_SIZE expired timers while holding the lock, then
+ * call them without the lock; repeat until no timer expired or the limit of
+ * the poll is reached. Called and returns with the lock held.
+ *
+ * A timer of the batch which is cancelled or rescheduled, e.g. by a callback
+ * called before it, is taken out of the batch by batch_take() and is not
+ * called, as if it were still in the heap.
+ */
+static unsigned poll_batch( btimer_heap_t *ht, const btime_val *now )
+{
+	struct timer_batch batch, **pb;
+	unsigned count = 0;
+
+	batch.next = ht->batches;
+	ht->batches = &batch;
+
+	while (count < ht->max_entries_per_poll)
+	{
+		unsigned i, n = 0;
+
+		while (n < BATCH_POLL_SIZE && count + n < ht->max_entries_per_poll)
+		{
+			btimer_entry *node = pop_expired(ht, now);
+
+			if (!node)
+				break;
+
+			node->_timer_id = TIMER_ID_FIRING - (btimer_id_t)n;
+			batch.slot[n].node = node;
+			batch.slot[n].grp_lock = node->_grp_lock;
+			node->_grp_lock = NULL;
+			++n;
+		}
+
+		if (n == 0)
+			break;
+		count += n;
+
+		unlock_timer_heap(ht);
+
+		BASE_RACE_ME(5);
+
+		for (i = 0; i < n; ++i)
+		{
+			btimer_entry *node = __atomic_exchange_n(&batch.slot[i].node, NULL, __ATOMIC_ACQ_REL);
+
+			/* Cancelled or rescheduled, the group lock was taken over too */
+			if (!node)
+				continue;
+
+			if (node->cb)
+				(*node->cb)(ht, node);
+
+			if (batch.slot[i].grp_lock)
+				bgrp_lock_dec_ref(batch.slot[i].grp_lock);
+		}
+
+		lock_timer_heap(ht);
+
+		if (n < BATCH_POLL_SIZE)
+			break;
+	}
+
+	for (pb = &ht->batches; *pb != &batch; pb = &(*pb)->next)
+		;
+	*pb = batch.next;
+
+	return count;
+}
+
 unsigned btimer_heap_poll( btimer_heap_t *ht, btime_val *nbdelay )
 {
 	btime_val now;
@@ -610,37 +1303,46 @@ unsigned btimer_heap_poll( btimer_heap_t *ht, btime_val *nbdelay )
 	count = 0;
 	bgettickcount(&now);
 
-	while ( ht->cur_size &&  BASE_TIME_VAL_LTE(ht->heap[0]->_timer_value, now) && count < ht->max_entries_per_poll ) 
+	if (ht->batch_poll)
 	{
-		btimer_entry *node = remove_node(ht, 0);
-		/* Avoid re-use of this timer until the callback is done. */
-		///Not necessary, even causes problem (see also #2176).
-		///btimer_id_t node_timer_id = pop_freelist(ht);
-		bgrp_lock_t *grp_lock;
+		count = poll_batch(ht, &now);
+	}
+	else
+	{
+		while ( count < ht->max_entries_per_poll ) 
+		{
+			btimer_entry *node = pop_expired(ht, &now);
+			/* Avoid re-use of this timer until the callback is done. */
+			///Not necessary, even causes problem (see also #2176).
+			///btimer_id_t node_timer_id = pop_freelist(ht);
+			bgrp_lock_t *grp_lock;
 
-		++count;
+			if (!node)
+				break;
+			++count;
 
-		grp_lock = node->_grp_lock;
-		node->_grp_lock = NULL;
+			grp_lock = node->_grp_lock;
+			node->_grp_lock = NULL;
 
-		unlock_timer_heap(ht);
+			unlock_timer_heap(ht);
 
-		BASE_RACE_ME(5);
+			BASE_RACE_ME(5);
 
-		if (node->cb)
-			(*node->cb)(ht, node);
+			if (node->cb)
+				(*node->cb)(ht, node);
 
-		if (grp_lock)
-			bgrp_lock_dec_ref(grp_lock);
+			if (grp_lock)
+				bgrp_lock_dec_ref(grp_lock);
 
-		lock_timer_heap(ht);
-		/* Now, the timer is really free for re-use. */
-		///push_freelist(ht, node_timer_id);
+			lock_timer_heap(ht);
+			/* Now, the timer is really free for re-use. */
+			///push_freelist(ht, node_timer_id);
+		}
 	}
 	
 	if (ht->cur_size && nbdelay)
 	{
-		*nbdelay = ht->heap[0]->_timer_value;
+		next_expiry(ht, nbdelay);
 		BASE_TIME_VAL_SUB(*nbdelay, now);
 		
 		if (nbdelay->sec < 0 || nbdelay->msec < 0)
@@ -669,7 +1371,7 @@ bstatus_t btimer_heap_earliest_time( btimer_heap_t * ht, btime_val *timeval)
 		return BASE_ENOTFOUND;
 
 	lock_timer_heap(ht);
-	*timeval = ht->heap[0]->_timer_value;
+	next_expiry(ht, timeval);
 	unlock_timer_heap(ht);
 
 	return BASE_SUCCESS;
@@ -682,6 +1384,8 @@ void btimer_heap_dump(btimer_heap_t *ht)
 
 	BASE_INFO("Dumping timer heap:");
 	BASE_INFO("  Cur size: %d entries, max: %d", (int)ht->cur_size, (int)ht->max_size);
+	if (ht->wheel)
+		BASE_INFO("  Timing wheel: tick %u msec, %d entries due", ht->wheel->tick_msec, (int)(ht->cur_size - ht->wheel->slotted));
 
 	if (ht->cur_size)
 	{
@@ -694,11 +1398,20 @@ void btimer_heap_dump(btimer_heap_t *ht)
 
 		bgettickcount(&now);
 
-		for (i=0; i<(unsigned)ht->cur_size; ++i)
+		for (i=0; i<(unsigned)(ht->wheel ? ht->max_size : ht->cur_size); ++i)
 		{
-			btimer_entry *e = ht->heap[i];
+			btimer_entry *e;
 			btime_val delta;
 
+			if (ht->wheel)
+			{
+				e = ht->wheel->node[i].entry;
+				if (!e)
+					continue;
+			}
+			else
+				e = ht->heap[i];
+
 			if (BASE_TIME_VAL_LTE(e->_timer_value, now))
 				delta.sec = delta.msec = 0;
 			else
@@ -14,6 +14,40 @@
 
 #define PENDING_RETRY	2
 
+/* Backends which poll edge-triggered (epoll with EPOLLET) are only told once
+ * that a descriptor became ready. When such backend dispatches an operation
+ * and the socket reports EWOULDBLOCK, the operation must be put back to the
+ * key instead of being completed with error, and the backend is told via
+ * ioqueue_on_would_block() that the edge has been consumed.
+ */
+#ifndef IOQUEUE_EDGE_TRIGGERED
+#   define IOQUEUE_EDGE_TRIGGERED	0
+#endif
+
+#if IOQUEUE_EDGE_TRIGGERED
+static void ioqueue_on_would_block( bioqueue_t *ioqueue,
+                                    bioqueue_key_t *key,
+                                    enum ioqueue_event_type event_type);
+#endif
+
+/* Backends with several pollers, each owning part of the keys, do not let
+ * other threads queue writes on a key directly: ioqueue_post_write() hands
+ * the write to the owner of the key, or returns BASE_FALSE when the caller
+ * may queue it itself. ioqueue_has_mail() tells if writes handed over are
+ * still on their way, the fast path must not overtake them.
+ */
+#ifndef IOQUEUE_HAS_MAILBOX
+#   define IOQUEUE_HAS_MAILBOX		0
+#endif
+
+#if IOQUEUE_HAS_MAILBOX
+static bbool_t ioqueue_has_mail(bioqueue_key_t *key);
+static bbool_t ioqueue_post_write(bioqueue_key_t *key,
+                                  struct write_operation *write_op);
+#else
+#   define ioqueue_has_mail(key)	BASE_FALSE
+#endif
+
 static void ioqueue_init( bioqueue_t *ioqueue )
 {
     ioqueue->lock = NULL;
@@ -50,6 +84,15 @@ bstatus_t bioqueue_set_lock( bioqueue_t *ioqueue,
     return BASE_SUCCESS;
 }
 
+/*
+ * bioqueue_cfg_default()
+ */
+void bioqueue_cfg_default(bioqueue_cfg *cfg)
+{
+    bbzero(cfg, sizeof(*cfg));
+    cfg->shard_cnt = 1;
+}
+
 static bstatus_t ioqueue_init_key( bpool_t *pool,
                                      bioqueue_t *ioqueue,
                                      bioqueue_key_t *key,
@@ -173,12 +216,312 @@ BASE_INLINE_SPECIFIER int key_has_pending_connect(bioqueue_key_t *key)
 #endif
 
 
+/*
+ * ioqueue_sendto_ops()
+ *
+ * Send the datagrams of the write operations in order, until one of them
+ * can not be sent. Returns the number of datagrams sent, status tells why
+ * the next one was not.
+ */
+static unsigned ioqueue_sendto_ops( bioqueue_key_t *key,
+                                    struct write_operation *ops[],
+                                    unsigned count,
+                                    bstatus_t *status)
+{
+#if BASE_IOQUEUE_HAS_MMSG
+    struct mmsghdr msgs[BASE_IOQUEUE_MMSG_MAX];
+    struct iovec iov[BASE_IOQUEUE_MMSG_MAX];
+#endif
+    unsigned done = 0;
+
+    *status = BASE_SUCCESS;
+
+    while (done < count) {
+#if BASE_IOQUEUE_HAS_MMSG
+	unsigned i, cnt = count - done;
+	int n;
+
+	if (cnt > BASE_IOQUEUE_MMSG_MAX)
+	    cnt = BASE_IOQUEUE_MMSG_MAX;
+
+	for (i=0; i<cnt; ++i) {
+	    struct write_operation *write_op = ops[done+i];
+
+	    iov[i].iov_base = write_op->buf;
+	    iov[i].iov_len = write_op->size;
+	    bbzero(&msgs[i], sizeof(msgs[i]));
+	    if (write_op->rmt_addrlen) {
+		msgs[i].msg_hdr.msg_name = &write_op->rmt_addr;
+		msgs[i].msg_hdr.msg_namelen = write_op->rmt_addrlen;
+	    }
+	    msgs[i].msg_hdr.msg_iov = &iov[i];
+	    msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	n = sendmmsg(key->fd, msgs, cnt, ops[done]->flags);
+	if (n < 0) {
+	    *status = bget_netos_error();
+	    break;
+	}
+
+	/* A short count means the next datagram failed, the next round
+	 * tells why.
+	 */
+	for (i=0; i<(unsigned)n; ++i)
+	    ops[done+i]->written = msgs[i].msg_len;
+	done += n;
+#else
+	struct write_operation *write_op = ops[done];
+	bssize_t sent = write_op->size;
+
+	*status = bsock_sendto(key->fd, write_op->buf, &sent, write_op->flags,
+			       &write_op->rmt_addr, write_op->rmt_addrlen);
+	if (*status != BASE_SUCCESS)
+	    break;
+
+	write_op->written = sent;
+	++done;
+#endif
+    }
+
+    return done;
+}
+
+#if BASE_IOQUEUE_HAS_MMSG
+/*
+ * ioqueue_dispatch_sendmmsg()
+ *
+ * Called with the key locked when the first pending write of a datagram
+ * key was queued by bioqueue_sendto_batch(): send it together with the
+ * batch writes following it.
+ */
+static bbool_t ioqueue_dispatch_sendmmsg( bioqueue_t *ioqueue,
+                                          bioqueue_key_t *h)
+{
+    struct write_operation *ops[BASE_IOQUEUE_MMSG_MAX];
+    unsigned flags = h->write_list.next->flags;
+    unsigned i, cnt = 0, done;
+    bstatus_t status;
+    bbool_t blocked;
+    bbool_t has_lock;
+
+    while (cnt < BASE_IOQUEUE_MMSG_MAX && !blist_empty(&h->write_list)) {
+	struct write_operation *write_op = h->write_list.next;
+
+	if (write_op->op != BASE_IOQUEUE_OP_SEND_TO || !write_op->batch ||
+	    write_op->flags != flags)
+	{
+	    break;
+	}
+	blist_erase(write_op);
+	ops[cnt++] = write_op;
+    }
+
+    done = ioqueue_sendto_ops(h, ops, cnt, &status);
+    blocked = (status == BASE_STATUS_FROM_OS(BASE_BLOCKING_ERROR_VAL));
+    if (done < cnt && !blocked) {
+	/* The datagram which failed completes with the error */
+	ops[done++]->written = -status;
+    }
+
+    /* Put back what is left, in order */
+    for (i=cnt; i>done; --i)
+	blist_push_front(&h->write_list, ops[i-1]);
+
+    if (blist_empty(&h->write_list))
+	ioqueue_remove_from_set(ioqueue, h, WRITEABLE_EVENT);
+#if IOQUEUE_EDGE_TRIGGERED
+    else if (blocked)
+	ioqueue_on_would_block(ioqueue, h, WRITEABLE_EVENT);
+#else
+    BASE_UNUSED_ARG(blocked);
+#endif
+
+    if (done == 0) {
+	bioqueue_unlock_key(h);
+	return BASE_FALSE;
+    }
+
+    for (i=0; i<done; ++i)
+	ops[i]->op = BASE_IOQUEUE_OP_NONE;
+
+    /* Unlock; from this point we don't need to hold key's mutex
+     * (unless concurrency is disabled, which in this case we should
+     * hold the mutex while calling the callback) */
+    if (h->allow_concurrent) {
+	has_lock = BASE_FALSE;
+	bioqueue_unlock_key(h);
+	BASE_RACE_ME(5);
+    } else {
+	has_lock = BASE_TRUE;
+    }
+
+    for (i=0; i<done; ++i) {
+	if (h->cb.on_write_complete && !IS_CLOSING(h)) {
+	    (*h->cb.on_write_complete)(h, (bioqueue_op_key_t*)ops[i],
+				       ops[i]->written);
+	}
+    }
+
+    if (has_lock) {
+	bioqueue_unlock_key(h);
+    }
+
+    return BASE_TRUE;
+}
+
+/*
+ * ioqueue_dispatch_recvmmsg()
+ *
+ * Called with the key locked when the first pending read was queued by
+ * bioqueue_recvfrom_batch(): fill it and the batch reads following it
+ * with one recvmmsg().
+ */
+static bbool_t ioqueue_dispatch_recvmmsg( bioqueue_t *ioqueue,
+                                          bioqueue_key_t *h)
+{
+    struct read_operation *ops[BASE_IOQUEUE_MMSG_MAX];
+    struct mmsghdr msgs[BASE_IOQUEUE_MMSG_MAX];
+    struct iovec iov[BASE_IOQUEUE_MMSG_MAX];
+    bssize_t bytes_read[BASE_IOQUEUE_MMSG_MAX];
+    unsigned flags = h->read_list.next->flags;
+    unsigned i, cnt = 0, done;
+    bbool_t drained;
+    bbool_t has_lock;
+    int n;
+
+    while (cnt < BASE_IOQUEUE_MMSG_MAX && !blist_empty(&h->read_list)) {
+	struct read_operation *read_op = h->read_list.next;
+
+	if (read_op->op != BASE_IOQUEUE_OP_RECV_FROM || !read_op->batch ||
+	    read_op->flags != flags)
+	{
+	    break;
+	}
+	blist_erase(read_op);
+
+	iov[cnt].iov_base = read_op->buf;
+	iov[cnt].iov_len = read_op->size;
+	bbzero(&msgs[cnt], sizeof(msgs[cnt]));
+	if (read_op->rmt_addr && read_op->rmt_addrlen) {
+	    msgs[cnt].msg_hdr.msg_name = read_op->rmt_addr;
+	    msgs[cnt].msg_hdr.msg_namelen = *read_op->rmt_addrlen;
+	}
+	msgs[cnt].msg_hdr.msg_iov = &iov[cnt];
+	msgs[cnt].msg_hdr.msg_iovlen = 1;
+	ops[cnt++] = read_op;
+    }
+
+    n = recvmmsg(h->fd, msgs, cnt, flags, NULL);
+    if (n >= 0) {
+	/* Fewer datagrams than operations: the socket has been drained */
+	done = n;
+	drained = (done < cnt);
+	for (i=0; i<done; ++i) {
+	    bytes_read[i] = msgs[i].msg_len;
+	    if (ops[i]->rmt_addr && ops[i]->rmt_addrlen)
+		*ops[i]->rmt_addrlen = msgs[i].msg_hdr.msg_namelen;
+	}
+    } else {
+	bstatus_t rc = bget_netos_error();
+
+	drained = (rc == BASE_STATUS_FROM_OS(BASE_BLOCKING_ERROR_VAL));
+	if (drained) {
+	    done = 0;
+	} else {
+	    /* Report the error with the first operation */
+	    bytes_read[0] = -rc;
+	    done = 1;
+	}
+    }
+
+    /* Put back the operations not filled, in order */
+    for (i=cnt; i>done; --i)
+	blist_push_front(&h->read_list, ops[i-1]);
+
+    if (blist_empty(&h->read_list))
+	ioqueue_remove_from_set(ioqueue, h, READABLE_EVENT);
+#if IOQUEUE_EDGE_TRIGGERED
+    else if (drained)
+	ioqueue_on_would_block(ioqueue, h, READABLE_EVENT);
+#else
+    BASE_UNUSED_ARG(drained);
+#endif
+
+    if (done == 0) {
+	bioqueue_unlock_key(h);
+	return BASE_FALSE;
+    }
+
+    for (i=0; i<done; ++i)
+	ops[i]->op = BASE_IOQUEUE_OP_NONE;
+
+    /* Unlock; from this point we don't need to hold key's mutex
+     * (unless concurrency is disabled, which in this case we should
+     * hold the mutex while calling the callback) */
+    if (h->allow_concurrent) {
+	has_lock = BASE_FALSE;
+	bioqueue_unlock_key(h);
+	BASE_RACE_ME(5);
+    } else {
+	has_lock = BASE_TRUE;
+    }
+
+    for (i=0; i<done; ++i) {
+	if (h->cb.on_read_complete && !IS_CLOSING(h)) {
+	    (*h->cb.on_read_complete)(h, (bioqueue_op_key_t*)ops[i],
+				      bytes_read[i]);
+	}
+    }
+
+    if (has_lock) {
+	bioqueue_unlock_key(h);
+    }
+
+    return BASE_TRUE;
+}
+#endif	/* BASE_IOQUEUE_HAS_MMSG */
+
+
 /*
  * ioqueue_dispatch_event()
  *
  * Report occurence of an event in the key to be processed by the
  * framework.
  */
+/*
+ * ioqueue_sendv_rest()
+ *
+ * Send the vectors of a sendv() operation after the part already written,
+ * which may end in the middle of a vector.
+ */
+static bstatus_t ioqueue_sendv_rest( bioqueue_key_t *key,
+				     struct write_operation *write_op,
+				     bssize_t *sent)
+{
+    const bsock_iovec *iov = write_op->iov;
+    unsigned cnt = write_op->iov_cnt;
+    bsize_t skip = write_op->written;
+    bsock_iovec part[BASE_SOCK_MAX_IOV];
+    unsigned i;
+
+    while (cnt > 1 && skip >= iov->len) {
+	skip -= iov->len;
+	++iov;
+	--cnt;
+    }
+
+    if (skip == 0)
+	return bsock_sendv(key->fd, iov, cnt, sent, write_op->flags);
+
+    for (i=0; i<cnt; ++i)
+	part[i] = iov[i];
+    part[0].base = (char*)part[0].base + skip;
+    part[0].len -= skip;
+
+    return bsock_sendv(key->fd, part, cnt, sent, write_op->flags);
+}
+
 bbool_t ioqueue_dispatch_write_event( bioqueue_t *ioqueue,
 				        bioqueue_key_t *h)
 {
@@ -284,6 +627,14 @@ bbool_t ioqueue_dispatch_write_event( bioqueue_t *ioqueue,
         bssize_t sent;
         bstatus_t send_rc = BASE_SUCCESS;
 
+#if BASE_IOQUEUE_HAS_MMSG
+        if (h->fd_type == bSOCK_DGRAM() && h->write_list.next->batch &&
+            h->write_list.next->op == BASE_IOQUEUE_OP_SEND_TO)
+        {
+            return ioqueue_dispatch_sendmmsg(ioqueue, h);
+        }
+#endif
+
         /* Get the first in the queue. */
         write_op = h->write_list.next;
 
@@ -303,7 +654,9 @@ bbool_t ioqueue_dispatch_write_event( bioqueue_t *ioqueue,
          * preventing parallel write on a single key.. :-((
          */
         sent = write_op->size - write_op->written;
-        if (write_op->op == BASE_IOQUEUE_OP_SEND) {
+        if (write_op->op == BASE_IOQUEUE_OP_SEND && write_op->iov) {
+            send_rc = ioqueue_sendv_rest(h, write_op, &sent);
+        } else if (write_op->op == BASE_IOQUEUE_OP_SEND) {
             send_rc = bsock_send(h->fd, write_op->buf+write_op->written,
                                    &sent, write_op->flags);
 	    /* Can't do this. We only clear "op" after we're finished sending
@@ -344,6 +697,17 @@ bbool_t ioqueue_dispatch_write_event( bioqueue_t *ioqueue,
             send_rc = BASE_EBUG;
         }
 
+#if IOQUEUE_EDGE_TRIGGERED
+        if (send_rc == BASE_STATUS_FROM_OS(BASE_BLOCKING_ERROR_VAL)) {
+            /* Edge consumed; keep the operation for the next edge. */
+            if (h->fd_type == bSOCK_DGRAM())
+                blist_push_front(&h->write_list, write_op);
+            ioqueue_on_would_block(ioqueue, h, WRITEABLE_EVENT);
+            bioqueue_unlock_key(h);
+            return BASE_FALSE;
+        }
+#endif
+
         if (send_rc == BASE_SUCCESS) {
             write_op->written += sent;
         } else {
@@ -447,6 +811,17 @@ bbool_t ioqueue_dispatch_read_event( bioqueue_t *ioqueue, 		       bioqueue_key_
 			ioqueue_remove_from_set(ioqueue, h, READABLE_EVENT);
 
 		rc=bsock_accept(h->fd, accept_op->accept_fd, accept_op->rmt_addr, accept_op->addrlen);
+#if IOQUEUE_EDGE_TRIGGERED
+		if (rc == BASE_STATUS_FROM_OS(BASE_BLOCKING_ERROR_VAL))
+		{
+			/* No connection is pending after all: keep the operation */
+			accept_op->op = BASE_IOQUEUE_OP_ACCEPT;
+			blist_push_front(&h->accept_list, accept_op);
+			ioqueue_on_would_block(ioqueue, h, READABLE_EVENT);
+			bioqueue_unlock_key(h);
+			return BASE_FALSE;
+		}
+#endif
 		if (rc==BASE_SUCCESS && accept_op->local_addr)
 		{
 			rc = bsock_getsockname(*accept_op->accept_fd, accept_op->local_addr, accept_op->addrlen);
@@ -487,10 +862,23 @@ bbool_t ioqueue_dispatch_read_event( bioqueue_t *ioqueue, 		       bioqueue_key_
 		struct read_operation *read_op;
 		bssize_t bytes_read;
 		bbool_t has_lock;
+#if IOQUEUE_EDGE_TRIGGERED
+		bioqueue_operation_e op;
+#endif
+
+#if BASE_IOQUEUE_HAS_MMSG
+		if (h->read_list.next->op == BASE_IOQUEUE_OP_RECV_FROM && h->read_list.next->batch)
+		{
+			return ioqueue_dispatch_recvmmsg(ioqueue, h);
+		}
+#endif
 
 		/* Get one pending read operation from the list. */
 		read_op = h->read_list.next;
 		blist_erase(read_op);
+#if IOQUEUE_EDGE_TRIGGERED
+		op = read_op->op;
+#endif
 
 		/* Clear fdset if there is no pending read. */
 		if (blist_empty(&h->read_list))
@@ -538,6 +926,18 @@ bbool_t ioqueue_dispatch_read_event( bioqueue_t *ioqueue, 		       bioqueue_key_
 #endif
 		}
 
+#if IOQUEUE_EDGE_TRIGGERED
+		if (rc == BASE_STATUS_FROM_OS(BASE_BLOCKING_ERROR_VAL))
+		{
+			/* Socket has been drained: keep the operation for the next edge */
+			read_op->op = op;
+			blist_push_front(&h->read_list, read_op);
+			ioqueue_on_would_block(ioqueue, h, READABLE_EVENT);
+			bioqueue_unlock_key(h);
+			return BASE_FALSE;
+		}
+#endif
+
 		if (rc != BASE_SUCCESS)
 		{
 #if (defined(BASE_WIN32) && BASE_WIN32 != 0) || \
@@ -743,6 +1143,7 @@ bstatus_t bioqueue_recv(  bioqueue_key_t *key,
      * Must schedule asynchronous operation to the ioqueue.
      */
     read_op->op = BASE_IOQUEUE_OP_RECV;
+    read_op->batch = BASE_FALSE;
     read_op->buf = buffer;
     read_op->size = *length;
     read_op->flags = flags;
@@ -818,6 +1219,7 @@ bstatus_t bioqueue_recvfrom( bioqueue_key_t *key,
      * Must schedule asynchronous operation to the ioqueue.
      */
     read_op->op = BASE_IOQUEUE_OP_RECV_FROM;
+    read_op->batch = BASE_FALSE;
     read_op->buf = buffer;
     read_op->size = *length;
     read_op->flags = flags;
@@ -880,7 +1282,7 @@ bstatus_t bioqueue_send( bioqueue_key_t *key,
      *      - blist_empty() is safe to be invoked by multiple threads,
      *        even when other threads are modifying the list.
      */
-    if (blist_empty(&key->write_list)) {
+    if (blist_empty(&key->write_list) && !ioqueue_has_mail(key)) {
         /*
          * See if data can be sent immediately.
          */
@@ -933,10 +1335,17 @@ bstatus_t bioqueue_send( bioqueue_key_t *key,
     }
 
     write_op->op = BASE_IOQUEUE_OP_SEND;
+    write_op->batch = BASE_FALSE;
     write_op->buf = (char*)data;
+    write_op->iov = NULL;
     write_op->size = *length;
     write_op->written = 0;
     write_op->flags = flags;
+
+#if IOQUEUE_HAS_MAILBOX
+    if (ioqueue_post_write(key, write_op))
+	return BASE_EPENDING;
+#endif
     
     bioqueue_lock_key(key);
     /* Check again. Handle may have been closed after the previous check
@@ -955,6 +1364,97 @@ bstatus_t bioqueue_send( bioqueue_key_t *key,
 }
 
 
+/*
+ * bioqueue_sendv()
+ *
+ * Start asynchronous send() of several buffers to the descriptor.
+ */
+bstatus_t bioqueue_sendv( bioqueue_key_t *key,
+                                      bioqueue_op_key_t *op_key,
+				      const bsock_iovec *iov,
+				      unsigned count,
+				      bssize_t *length,
+                                      unsigned flags)
+{
+    struct write_operation *write_op;
+    bstatus_t status;
+    unsigned i, retry;
+    bsize_t total = 0;
+    bssize_t sent = 0;
+
+    BASE_ASSERT_RETURN(key && op_key && iov && count && length, BASE_EINVAL);
+    BASE_ASSERT_RETURN(count <= BASE_SOCK_MAX_IOV, BASE_ETOOMANY);
+    BASE_CHECK_STACK();
+
+    /* Check if key is closing. */
+    if (IS_CLOSING(key))
+	return BASE_ECANCELLED;
+
+    /* We can not use BASE_IOQUEUE_ALWAYS_ASYNC for socket write. */
+    flags &= ~(BASE_IOQUEUE_ALWAYS_ASYNC);
+
+    for (i=0; i<count; ++i)
+	total += iov[i].len;
+
+    write_op = (struct write_operation*)op_key;
+
+    /* The rest of a partial write is queued with this operation key, so
+     * it must be free before anything is sent.
+     */
+    for (retry=0; write_op->op != 0 && retry<PENDING_RETRY; ++retry)
+	bthreadSleepMs(0);
+
+    if (write_op->op)
+	return BASE_EBUSY;
+
+    /* Fast track, see bioqueue_send() */
+    if (blist_empty(&key->write_list) && !ioqueue_has_mail(key)) {
+        status = bsock_sendv(key->fd, iov, count, &sent, flags);
+        if (status == BASE_SUCCESS) {
+	    if (sent == (bssize_t)total || key->fd_type == bSOCK_DGRAM()) {
+		*length = sent;
+		return BASE_SUCCESS;
+	    }
+	    /* Partially sent, the rest is queued below */
+        } else if (status != BASE_STATUS_FROM_OS(BASE_BLOCKING_ERROR_VAL)) {
+            return status;
+        } else {
+	    sent = 0;
+	}
+    }
+
+    /*
+     * Schedule asynchronous send.
+     */
+    write_op->op = BASE_IOQUEUE_OP_SEND;
+    write_op->batch = BASE_FALSE;
+    write_op->buf = NULL;
+    write_op->iov = iov;
+    write_op->iov_cnt = count;
+    write_op->size = total;
+    write_op->written = sent;
+    write_op->flags = flags;
+
+#if IOQUEUE_HAS_MAILBOX
+    if (ioqueue_post_write(key, write_op))
+	return BASE_EPENDING;
+#endif
+
+    bioqueue_lock_key(key);
+    /* Check again, see bioqueue_send() */
+    if (IS_CLOSING(key)) {
+	bioqueue_unlock_key(key);
+	write_op->op = BASE_IOQUEUE_OP_NONE;
+	return BASE_ECANCELLED;
+    }
+    blist_insert_before(&key->write_list, write_op);
+    ioqueue_add_to_set(key->ioqueue, key, WRITEABLE_EVENT);
+    bioqueue_unlock_key(key);
+
+    return BASE_EPENDING;
+}
+
+
 /*
  * bioqueue_sendto()
  *
@@ -1004,7 +1504,7 @@ retry_on_restart:
      *      - blist_empty() is safe to be invoked by multiple threads,
      *        even when other threads are modifying the list.
      */
-    if (blist_empty(&key->write_list)) {
+    if (blist_empty(&key->write_list) && !ioqueue_has_mail(key)) {
         /*
          * See if data can be sent immediately.
          */
@@ -1081,12 +1581,19 @@ retry_on_restart:
     }
 
     write_op->op = BASE_IOQUEUE_OP_SEND_TO;
+    write_op->batch = BASE_FALSE;
     write_op->buf = (char*)data;
+    write_op->iov = NULL;
     write_op->size = *length;
     write_op->written = 0;
     write_op->flags = flags;
     bmemcpy(&write_op->rmt_addr, addr, addrlen);
     write_op->rmt_addrlen = addrlen;
+
+#if IOQUEUE_HAS_MAILBOX
+    if (ioqueue_post_write(key, write_op))
+	return BASE_EPENDING;
+#endif
     
     bioqueue_lock_key(key);
     /* Check again. Handle may have been closed after the previous check
@@ -1104,6 +1611,192 @@ retry_on_restart:
     return BASE_EPENDING;
 }
 
+/*
+ * bioqueue_recvfrom_batch()
+ *
+ * Queue recvfrom() operations to be filled together.
+ */
+bstatus_t bioqueue_recvfrom_batch( bioqueue_key_t *key,
+                                   bioqueue_op_key_t *op_key[],
+                                   void *buffer[],
+                                   const bssize_t length[],
+                                   unsigned count,
+                                   buint32_t flags,
+                                   bsockaddr_t *addr[],
+                                   int *addrlen[])
+{
+    unsigned i;
+
+    BASE_ASSERT_RETURN(key && op_key && buffer && length && count,
+		       BASE_EINVAL);
+    BASE_ASSERT_RETURN(!addr || addrlen, BASE_EINVAL);
+    BASE_CHECK_STACK();
+
+    /* Check if key is closing. */
+    if (IS_CLOSING(key))
+	return BASE_ECANCELLED;
+
+    for (i=0; i<count; ++i) {
+	struct read_operation *read_op = (struct read_operation*)op_key[i];
+	BASE_ASSERT_RETURN(read_op->op == BASE_IOQUEUE_OP_NONE, BASE_EPENDING);
+    }
+
+    flags &= ~(BASE_IOQUEUE_ALWAYS_ASYNC);
+
+    bioqueue_lock_key(key);
+    /* Check again. Handle may have been closed after the previous check
+     * in multithreaded app. See #913
+     */
+    if (IS_CLOSING(key)) {
+	bioqueue_unlock_key(key);
+	return BASE_ECANCELLED;
+    }
+    for (i=0; i<count; ++i) {
+	struct read_operation *read_op = (struct read_operation*)op_key[i];
+
+	read_op->op = BASE_IOQUEUE_OP_RECV_FROM;
+	read_op->batch = BASE_TRUE;
+	read_op->buf = buffer[i];
+	read_op->size = length[i];
+	read_op->flags = flags;
+	read_op->rmt_addr = addr ? addr[i] : NULL;
+	read_op->rmt_addrlen = addr ? addrlen[i] : NULL;
+	blist_insert_before(&key->read_list, read_op);
+    }
+    ioqueue_add_to_set(key->ioqueue, key, READABLE_EVENT);
+    bioqueue_unlock_key(key);
+
+    return BASE_EPENDING;
+}
+
+
+/*
+ * bioqueue_sendto_batch()
+ *
+ * Send datagrams with as few system calls as possible, queue the rest.
+ */
+bstatus_t bioqueue_sendto_batch( bioqueue_key_t *key,
+                                 bioqueue_op_key_t *op_key[],
+                                 const void *data[],
+                                 bssize_t length[],
+                                 unsigned count,
+                                 buint32_t flags,
+                                 const bsockaddr_t *addr[],
+                                 const int addrlen[],
+                                 unsigned *sent_cnt)
+{
+    struct write_operation *write_op;
+    unsigned i, retry, done = 0;
+
+    BASE_ASSERT_RETURN(key && op_key && data && length && count && addr &&
+		       addrlen && sent_cnt, BASE_EINVAL);
+    BASE_CHECK_STACK();
+
+    *sent_cnt = 0;
+
+    /* Check if key is closing. */
+    if (IS_CLOSING(key))
+	return BASE_ECANCELLED;
+
+    /* We can not use BASE_IOQUEUE_ALWAYS_ASYNC for socket write */
+    flags &= ~(BASE_IOQUEUE_ALWAYS_ASYNC);
+
+    for (i=0; i<count; ++i) {
+	/* Check that address storage can hold the address parameter. */
+	BASE_ASSERT_RETURN(addrlen[i] <= (int)sizeof(bsockaddr_in), BASE_EBUG);
+
+	write_op = (struct write_operation*)op_key[i];
+
+	/* Spin if write_op has pending operation */
+	for (retry=0; write_op->op != 0 && retry<PENDING_RETRY; ++retry)
+	    bthreadSleepMs(0);
+
+	/* See bioqueue_sendto() */
+	if (write_op->op)
+	    return BASE_EBUSY;
+    }
+
+    for (i=0; i<count; ++i) {
+	write_op = (struct write_operation*)op_key[i];
+
+	write_op->batch = BASE_TRUE;
+	write_op->buf = (char*)data[i];
+	write_op->iov = NULL;
+	write_op->size = length[i];
+	write_op->written = 0;
+	write_op->flags = flags;
+	bmemcpy(&write_op->rmt_addr, addr[i], addrlen[i]);
+	write_op->rmt_addrlen = addrlen[i];
+    }
+
+    /* Fast track, as in bioqueue_sendto(): send right away when there is
+     * no pending write to overtake.
+     */
+    if (blist_empty(&key->write_list) && !ioqueue_has_mail(key)) {
+	bstatus_t status = BASE_SUCCESS;
+
+	while (done < count && status == BASE_SUCCESS) {
+	    struct write_operation *ops[BASE_IOQUEUE_MMSG_MAX];
+	    unsigned cnt = count - done, n;
+
+	    if (cnt > BASE_IOQUEUE_MMSG_MAX)
+		cnt = BASE_IOQUEUE_MMSG_MAX;
+	    for (i=0; i<cnt; ++i)
+		ops[i] = (struct write_operation*)op_key[done+i];
+
+	    n = ioqueue_sendto_ops(key, ops, cnt, &status);
+	    for (i=0; i<n; ++i)
+		length[done+i] = ops[i]->written;
+	    done += n;
+	}
+
+	*sent_cnt = done;
+	if (done == count)
+	    return BASE_SUCCESS;
+
+	/* If error is not EWOULDBLOCK (or EAGAIN on Linux), report
+	 * the error to caller.
+	 */
+	if (status != BASE_STATUS_FROM_OS(BASE_BLOCKING_ERROR_VAL))
+	    return status;
+    }
+
+    /*
+     * Schedule asynchronous send of the rest.
+     */
+    for (i=done; i<count; ++i)
+	((struct write_operation*)op_key[i])->op = BASE_IOQUEUE_OP_SEND_TO;
+
+#if IOQUEUE_HAS_MAILBOX
+    /* Once the first write is in the mailbox, the rest must follow it */
+    if (ioqueue_post_write(key, (struct write_operation*)op_key[done])) {
+	for (i=done+1; i<count; ++i) {
+	    write_op = (struct write_operation*)op_key[i];
+	    if (!ioqueue_post_write(key, write_op))
+		write_op->op = BASE_IOQUEUE_OP_NONE;
+	}
+	return BASE_EPENDING;
+    }
+#endif
+
+    bioqueue_lock_key(key);
+    /* Check again. Handle may have been closed after the previous check
+     * in multithreaded app. See #913
+     */
+    if (IS_CLOSING(key)) {
+	bioqueue_unlock_key(key);
+	for (i=done; i<count; ++i)
+	    ((struct write_operation*)op_key[i])->op = BASE_IOQUEUE_OP_NONE;
+	return BASE_ECANCELLED;
+    }
+    for (i=done; i<count; ++i)
+	blist_insert_before(&key->write_list, (struct write_operation*)op_key[i]);
+    ioqueue_add_to_set(key->ioqueue, key, WRITEABLE_EVENT);
+    bioqueue_unlock_key(key);
+
+    return BASE_EPENDING;
+}
+
 #if BASE_HAS_TCP
 /*
  * Initiate overlapped accept() operation.
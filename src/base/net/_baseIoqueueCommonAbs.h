@@ -36,6 +36,7 @@ struct read_operation
     unsigned                flags;
     bsockaddr_t	   *rmt_addr;
     int			   *rmt_addrlen;
+    bbool_t		    batch;	/* Queued by recvfrom_batch()	    */
 };
 
 struct write_operation
@@ -44,11 +45,14 @@ struct write_operation
     bioqueue_operation_e  op;
 
     char		   *buf;
+    const bsock_iovec	   *iov;	/* Vectors of sendv(), buf is NULL  */
+    unsigned		    iov_cnt;
     bsize_t		    size;
     bssize_t              written;
     unsigned                flags;
     bsockaddr_in	    rmt_addr;
     int			    rmt_addrlen;
+    bbool_t		    batch;	/* Queued by sendto_batch()	    */
 };
 
 struct accept_operation
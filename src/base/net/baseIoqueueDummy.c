@@ -1,7 +1,7 @@
 /* 
  *
  */
-#include <baseIoQueue.h>
+#include <baseIoqueue.h>
 #include <baseOs.h>
 #include <baseLog.h>
 #include <baseList.h>
@@ -5,9 +5,18 @@
 /*
  * This is the implementation of IOQueue framework using /dev/epoll
  * API in _both_ Linux user-mode and kernel-mode.
+ *
+ * When BASE_IOQUEUE_EPOLL_EDGE_TRIGGERED is enabled, descriptors are
+ * registered with EPOLLET for both directions once, and each ready key is
+ * drained in bioqueue_poll() until the socket reports EWOULDBLOCK.
  */
 
-#include <baseIoQueue.h>
+/* recvmmsg() and sendmmsg() are GNU extensions */
+#if defined(BASE_IOQUEUE_HAS_MMSG) && BASE_IOQUEUE_HAS_MMSG!=0 && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE
+#endif
+
+#include <baseIoqueue.h>
 #include <baseOs.h>
 #include <baseLock.h>
 #include <baseLog.h>
@@ -21,6 +30,7 @@
 #include <baseRand.h>
 
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <errno.h>
 #include <unistd.h>
 
@@ -31,11 +41,24 @@
 #define os_getsockopt		getsockopt
 #define os_ioctl		ioctl
 #define os_read			read
+#define os_write		write
 #define os_close		close
 #define os_epoll_create		epoll_create
 #define os_epoll_ctl		epoll_ctl
 #define os_epoll_wait		epoll_wait
 
+#if BASE_IOQUEUE_EPOLL_EDGE_TRIGGERED
+#   define IOQUEUE_EDGE_TRIGGERED	1
+#   define IOQUEUE_KEY_EVENTS		(EPOLLIN | EPOLLOUT | EPOLLERR | EPOLLET)
+#else
+#   define IOQUEUE_KEY_EVENTS		(EPOLLIN | EPOLLERR)
+#endif
+
+/* Writes from threads other than the poller of the key's shard go through
+ * the shard's mailbox.
+ */
+#define IOQUEUE_HAS_MAILBOX		1
+
 
 /*
  * Include common ioqueue abstraction.
@@ -48,14 +71,68 @@
 struct bioqueue_key_t
 {
     DECLARE_COMMON_KEY
+    unsigned		    shard;	/* Fixed at registration	    */
+    int			    mail_cnt;	/* Writes in the shard's mailbox    */
+#if IOQUEUE_EDGE_TRIGGERED
+    /* Set when an edge is reported, cleared when dispatch gets EWOULDBLOCK,
+     * both under the key's lock.
+     */
+    bbool_t		    read_ready;
+    bbool_t		    write_ready;
+#endif
+#ifdef IOQUEUE_KEY_EXTRA_FIELDS
+    /* Backends built on top of this one (io_uring) */
+    IOQUEUE_KEY_EXTRA_FIELDS
+#endif
 };
 
 struct queue
 {
     bioqueue_key_t	    *key;
     enum ioqueue_event_type  event_type;
+#if IOQUEUE_EDGE_TRIGGERED
+    buint32_t		     events;
+#endif
+};
+
+/*
+ * Write handed over to the poller of the key's shard. Overlaid on
+ * bioqueue_op_key_t like the common operation key.
+ */
+struct mail_operation
+{
+    union operation_key	    base;
+    bioqueue_key_t	   *key;
+    struct mail_operation  *next_mail;
 };
 
+/*
+ * Part of the I/O queue served by one polling thread.
+ */
+struct ioqueue_shard
+{
+    int			    epfd;
+    int			    evfd;	/* Signals new mail to the poller   */
+
+    /* Protects reference counters of the shard's keys, and keeps a key
+     * from being closed while the poller takes the events of it.
+     */
+    bmutex_t		   *lock;
+
+    /* Lock-free LIFO of writes from other threads, pushed with CAS and
+     * taken as a whole by the poller.
+     */
+    struct mail_operation  *mailbox;
+
+    /* Threads polling the shard now, and the poll count of the ioqueue
+     * when the shard was last polled.
+     */
+    int			    pollers;
+    unsigned		    last_poll;
+};
+
+#define KEY_SHARD(key)	(&(key)->ioqueue->shards[(key)->shard])
+
 /*
  * This describes the I/O queue.
  */
@@ -66,15 +143,24 @@ struct bioqueue_t
     unsigned		max, count;
     //bioqueue_key_t	hlist;
     bioqueue_key_t	active_list;    
-    int			epfd;
     //struct epoll_event *events;
     //struct queue       *queue;
 
+    struct ioqueue_shard *shards;
+    unsigned		shard_cnt;
+    unsigned		next_key_shard;	/* Shard of the next key	    */
+    unsigned		next_poller;	/* Shard of the next new poller	    */
+    unsigned		poll_seq;	/* Polls of all shards		    */
+    long		shard_tls;	/* Shard of the polling thread + 1  */
+
 #if BASE_IOQUEUE_HAS_SAFE_UNREG
-    bmutex_t	       *ref_cnt_mutex;
     bioqueue_key_t	closing_list;
     bioqueue_key_t	free_list;
 #endif
+
+#ifdef IOQUEUE_EXTRA_FIELDS
+    IOQUEUE_EXTRA_FIELDS
+#endif
 };
 
 /* Include implementation for common abstraction after we declare
@@ -92,22 +178,90 @@ static void scan_closing_keys(bioqueue_t *ioqueue);
  */
 const char* bioqueue_name(void)
 {
+#if IOQUEUE_EDGE_TRIGGERED
+    return "epoll-et";
+#else
     return "epoll";
+#endif
 }
 
 /*
- * bioqueue_create()
+ * ioqueue_destroy_shards()
+ */
+static void ioqueue_destroy_shards(bioqueue_t *ioqueue, unsigned cnt)
+{
+    unsigned i;
+
+    for (i=0; i<cnt; ++i) {
+	struct ioqueue_shard *shard = &ioqueue->shards[i];
+
+	if (shard->epfd > 0)
+	    os_close(shard->epfd);
+	if (shard->evfd > 0)
+	    os_close(shard->evfd);
+	if (shard->lock)
+	    bmutex_destroy(shard->lock);
+	shard->epfd = shard->evfd = 0;
+	shard->lock = NULL;
+    }
+
+    if (ioqueue->shard_cnt > 1)
+	bthreadLocalFree(ioqueue->shard_tls);
+}
+
+/*
+ * ioqueue_create_shard()
+ */
+static bstatus_t ioqueue_create_shard(bpool_t *pool, bioqueue_t *ioqueue,
+				      struct ioqueue_shard *shard,
+				      bsize_t max_fd)
+{
+    struct epoll_event ev;
+    bstatus_t rc;
+
+    rc = bmutex_create_simple(pool, NULL, &shard->lock);
+    if (rc != BASE_SUCCESS)
+	return rc;
+
+    shard->epfd = os_epoll_create(max_fd);
+    if (shard->epfd < 0) {
+	shard->epfd = 0;
+	return BASE_RETURN_OS_ERROR(bget_native_os_error());
+    }
+
+    if (ioqueue->shard_cnt == 1)
+	return BASE_SUCCESS;
+
+    shard->evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (shard->evfd < 0) {
+	shard->evfd = 0;
+	return BASE_RETURN_OS_ERROR(bget_native_os_error());
+    }
+
+    /* The shard itself is the data of its eventfd, keys can't be there */
+    ev.events = EPOLLIN;
+    ev.epoll_data = (epoll_data_type)shard;
+    if (os_epoll_ctl(shard->epfd, EPOLL_CTL_ADD, shard->evfd, &ev) < 0)
+	return BASE_RETURN_OS_ERROR(bget_native_os_error());
+
+    return BASE_SUCCESS;
+}
+
+/*
+ * bioqueue_create2()
  *
- * Create select ioqueue.
+ * Create epoll ioqueue.
  */
-bstatus_t bioqueue_create( bpool_t *pool, 
-                                       bsize_t max_fd,
-                                       bioqueue_t **p_ioqueue)
+bstatus_t bioqueue_create2(bpool_t *pool,
+			   bsize_t max_fd,
+			   const bioqueue_cfg *cfg,
+			   bioqueue_t **p_ioqueue)
 {
     bioqueue_t *ioqueue;
+    bioqueue_cfg default_cfg;
     bstatus_t rc;
     block_t *lock;
-    int i;
+    unsigned i;
 
     /* Check that arguments are valid. */
     BASE_ASSERT_RETURN(pool != NULL && p_ioqueue != NULL && 
@@ -115,7 +269,14 @@ bstatus_t bioqueue_create( bpool_t *pool,
 
     /* Check that size of bioqueue_op_key_t is sufficient */
     BASE_ASSERT_RETURN(sizeof(bioqueue_op_key_t)-sizeof(void*) >=
-                     sizeof(union operation_key), BASE_EBUG);
+                     sizeof(struct mail_operation), BASE_EBUG);
+
+    if (!cfg) {
+	bioqueue_cfg_default(&default_cfg);
+	cfg = &default_cfg;
+    }
+    BASE_ASSERT_RETURN(cfg->shard_cnt > 0 && cfg->shard_cnt <= max_fd,
+		     BASE_EINVAL);
 
     ioqueue = bpool_alloc(pool, sizeof(bioqueue_t));
 
@@ -125,19 +286,38 @@ bstatus_t bioqueue_create( bpool_t *pool,
     ioqueue->count = 0;
     blist_init(&ioqueue->active_list);
 
+    ioqueue->shard_cnt = cfg->shard_cnt;
+    ioqueue->next_key_shard = 0;
+    ioqueue->next_poller = 0;
+    ioqueue->poll_seq = 0;
+    ioqueue->shards = (struct ioqueue_shard*)
+		      bpool_calloc(pool, ioqueue->shard_cnt,
+				   sizeof(struct ioqueue_shard));
+
+    if (ioqueue->shard_cnt > 1) {
+	rc = bthreadLocalAlloc(&ioqueue->shard_tls);
+	if (rc != BASE_SUCCESS)
+	    return rc;
+    }
+
+    for (i=0; i<ioqueue->shard_cnt; ++i) {
+	rc = ioqueue_create_shard(pool, ioqueue, &ioqueue->shards[i],
+				  max_fd / ioqueue->shard_cnt + 1);
+	if (rc != BASE_SUCCESS) {
+	    ioqueue_destroy_shards(ioqueue, i + 1);
+	    return rc;
+	}
+    }
+
 #if BASE_IOQUEUE_HAS_SAFE_UNREG
     /* When safe unregistration is used (the default), we pre-create
      * all keys and put them in the free list.
      */
 
-    /* Mutex to protect key's reference counter 
+    /* Key's reference counter is protected by the lock of its shard.
      * We don't want to use key's mutex or ioqueue's mutex because
      * that would create deadlock situation in some cases.
      */
-    rc = bmutex_create_simple(pool, NULL, &ioqueue->ref_cnt_mutex);
-    if (rc != BASE_SUCCESS)
-	return rc;
-
 
     /* Init key list */
     blist_init(&ioqueue->free_list);
@@ -161,7 +341,7 @@ bstatus_t bioqueue_create( bpool_t *pool,
 				key = key->next;
 			}
 
-			bmutex_destroy(ioqueue->ref_cnt_mutex);
+			ioqueue_destroy_shards(ioqueue, ioqueue->shard_cnt);
 			return rc;
 		}
 
@@ -177,25 +357,31 @@ bstatus_t bioqueue_create( bpool_t *pool,
     if (rc != BASE_SUCCESS)
         return rc;
 
-    ioqueue->epfd = os_epoll_create(max_fd);
-    if (ioqueue->epfd < 0)
-	{
-		ioqueue_destroy(ioqueue);
-		return BASE_RETURN_OS_ERROR(bget_native_os_error());
-    }
-    
     /*ioqueue->events = bpool_calloc(pool, max_fd, sizeof(struct epoll_event));
     BASE_ASSERT_RETURN(ioqueue->events != NULL, BASE_ENOMEM);
 
     ioqueue->queue = bpool_calloc(pool, max_fd, sizeof(struct queue));
     BASE_ASSERT_RETURN(ioqueue->queue != NULL, BASE_ENOMEM);
    */
-    BASE_INFO("epoll I/O Queue created (%p)", ioqueue);
+    BASE_INFO("%s I/O Queue created (%p), %u shard(s)", bioqueue_name(), ioqueue,
+	      ioqueue->shard_cnt);
 
     *p_ioqueue = ioqueue;
     return BASE_SUCCESS;
 }
 
+/*
+ * bioqueue_create()
+ *
+ * Create epoll ioqueue.
+ */
+bstatus_t bioqueue_create( bpool_t *pool, 
+                                       bsize_t max_fd,
+                                       bioqueue_t **p_ioqueue)
+{
+    return bioqueue_create2(pool, max_fd, NULL, p_ioqueue);
+}
+
 /*
  * bioqueue_destroy()
  *
@@ -206,11 +392,10 @@ bstatus_t bioqueue_destroy(bioqueue_t *ioqueue)
     bioqueue_key_t *key;
 
     BASE_ASSERT_RETURN(ioqueue, BASE_EINVAL);
-    BASE_ASSERT_RETURN(ioqueue->epfd > 0, BASE_EINVALIDOP);
+    BASE_ASSERT_RETURN(ioqueue->shards[0].epfd > 0, BASE_EINVALIDOP);
 
     block_acquire(ioqueue->lock);
-    os_close(ioqueue->epfd);
-    ioqueue->epfd = 0;
+    ioqueue_destroy_shards(ioqueue, ioqueue->shard_cnt);
 
 #if BASE_IOQUEUE_HAS_SAFE_UNREG
     /* Destroy reference counters */
@@ -231,8 +416,6 @@ bstatus_t bioqueue_destroy(bioqueue_t *ioqueue)
 	block_destroy(key->lock);
 	key = key->next;
     }
-
-    bmutex_destroy(ioqueue->ref_cnt_mutex);
 #endif
     return ioqueue_destroy(ioqueue);
 }
@@ -309,10 +492,21 @@ bstatus_t bioqueue_register_sock2(bpool_t *pool,
 	goto on_return;
     }
 */
+#if IOQUEUE_EDGE_TRIGGERED
+    key->read_ready = BASE_FALSE;
+    key->write_ready = BASE_FALSE;
+#endif
+
+    /* Pin the key to a shard, in turn */
+    key->shard = ioqueue->next_key_shard;
+    if (++ioqueue->next_key_shard == ioqueue->shard_cnt)
+	ioqueue->next_key_shard = 0;
+    key->mail_cnt = 0;
+
     /* os_epoll_ctl. */
-    ev.events = EPOLLIN | EPOLLERR;
+    ev.events = IOQUEUE_KEY_EVENTS;
     ev.epoll_data = (epoll_data_type)key;
-    status = os_epoll_ctl(ioqueue->epfd, EPOLL_CTL_ADD, sock, &ev);
+    status = os_epoll_ctl(KEY_SHARD(key)->epfd, EPOLL_CTL_ADD, sock, &ev);
     if (status < 0) {
 	rc = bget_os_error();
 	block_destroy(key->lock);
@@ -353,22 +547,30 @@ bstatus_t bioqueue_register_sock( bpool_t *pool,
 /* Increment key's reference counter */
 static void increment_counter(bioqueue_key_t *key)
 {
-    bmutex_lock(key->ioqueue->ref_cnt_mutex);
+    bmutex_lock(KEY_SHARD(key)->lock);
     ++key->ref_count;
-    bmutex_unlock(key->ioqueue->ref_cnt_mutex);
+    bmutex_unlock(KEY_SHARD(key)->lock);
 }
 
 /* Decrement the key's reference counter, and when the counter reach zero,
  * destroy the key.
  *
+ * The counter only reaches zero after the key is closing, and pollers do
+ * not take closing keys (checked under the shard's lock), so ioqueue's lock
+ * is only needed for the last reference.
+ *
  * Note: MUST NOT CALL THIS FUNCTION WHILE HOLDING ioqueue's LOCK.
  */
 static void decrement_counter(bioqueue_key_t *key)
 {
-    block_acquire(key->ioqueue->lock);
-    bmutex_lock(key->ioqueue->ref_cnt_mutex);
-    --key->ref_count;
-    if (key->ref_count == 0) {
+    bbool_t last;
+
+    bmutex_lock(KEY_SHARD(key)->lock);
+    last = (--key->ref_count == 0);
+    bmutex_unlock(KEY_SHARD(key)->lock);
+
+    if (last) {
+	block_acquire(key->ioqueue->lock);
 
 	bassert(key->closing == 1);
 	bgettickcount(&key->free_time);
@@ -378,9 +580,8 @@ static void decrement_counter(bioqueue_key_t *key)
 	blist_erase(key);
 	blist_push_back(&key->ioqueue->closing_list, key);
 
+	block_release(key->ioqueue->lock);
     }
-    bmutex_unlock(key->ioqueue->ref_cnt_mutex);
-    block_release(key->ioqueue->lock);
 }
 #endif
 
@@ -431,7 +632,7 @@ bstatus_t bioqueue_unregister( bioqueue_key_t *key)
 
     ev.events = 0;
     ev.epoll_data = (epoll_data_type)key;
-    status = os_epoll_ctl( ioqueue->epfd, EPOLL_CTL_DEL, key->fd, &ev);
+    status = os_epoll_ctl( KEY_SHARD(key)->epfd, EPOLL_CTL_DEL, key->fd, &ev);
     if (status != 0) {
 	bstatus_t rc = bget_os_error();
 	block_release(ioqueue->lock);
@@ -495,14 +696,55 @@ static void ioqueue_remove_from_set( bioqueue_t *ioqueue,
                                      bioqueue_key_t *key, 
                                      enum ioqueue_event_type event_type)
 {
+#if IOQUEUE_EDGE_TRIGGERED
+    /* Key stays registered for both directions */
+    BASE_UNUSED_ARG(ioqueue);
+    BASE_UNUSED_ARG(key);
+    BASE_UNUSED_ARG(event_type);
+#else
     if (event_type == WRITEABLE_EVENT) {
 	struct epoll_event ev;
 
 	ev.events = EPOLLIN | EPOLLERR;
 	ev.epoll_data = (epoll_data_type)key;
-	os_epoll_ctl( ioqueue->epfd, EPOLL_CTL_MOD, key->fd, &ev);
+	os_epoll_ctl( KEY_SHARD(key)->epfd, EPOLL_CTL_MOD, key->fd, &ev);
     }	
+#endif
+}
+
+#if IOQUEUE_EDGE_TRIGGERED
+/*
+ * ioqueue_rearm_key()
+ * Modifying the registration makes epoll check the descriptor again and
+ * report it if it is still ready, so an edge which was not fully consumed
+ * is not lost.
+ */
+static void ioqueue_rearm_key( bioqueue_t *ioqueue, bioqueue_key_t *key)
+{
+    struct epoll_event ev;
+
+    ev.events = IOQUEUE_KEY_EVENTS;
+    ev.epoll_data = (epoll_data_type)key;
+    os_epoll_ctl( KEY_SHARD(key)->epfd, EPOLL_CTL_MOD, key->fd, &ev);
+}
+
+/*
+ * ioqueue_on_would_block()
+ * Called by the common dispatcher when the socket returns EWOULDBLOCK, i.e.
+ * the current edge has been consumed.
+ */
+static void ioqueue_on_would_block( bioqueue_t *ioqueue,
+                                    bioqueue_key_t *key,
+                                    enum ioqueue_event_type event_type)
+{
+    BASE_UNUSED_ARG(ioqueue);
+
+    if (event_type == WRITEABLE_EVENT)
+	key->write_ready = BASE_FALSE;
+    else
+	key->read_ready = BASE_FALSE;
 }
+#endif
 
 /*
  * ioqueue_add_to_set()
@@ -514,13 +756,201 @@ static void ioqueue_add_to_set( bioqueue_t *ioqueue,
                                 bioqueue_key_t *key,
                                 enum ioqueue_event_type event_type )
 {
+#if IOQUEUE_EDGE_TRIGGERED
+    /* Only when the last edge in this direction was not drained may the
+     * socket be ready without another edge coming; re-arm in that case.
+     */
+    if ((event_type == READABLE_EVENT && key->read_ready) ||
+	(event_type == WRITEABLE_EVENT && key->write_ready))
+    {
+	ioqueue_rearm_key(ioqueue, key);
+    }
+#else
     if (event_type == WRITEABLE_EVENT) {
 	struct epoll_event ev;
 
 	ev.events = EPOLLIN | EPOLLOUT | EPOLLERR;
 	ev.epoll_data = (epoll_data_type)key;
-	os_epoll_ctl( ioqueue->epfd, EPOLL_CTL_MOD, key->fd, &ev);
+	os_epoll_ctl( KEY_SHARD(key)->epfd, EPOLL_CTL_MOD, key->fd, &ev);
     }	
+#endif
+}
+
+/* A shard without poller is taken over by the next thread which polls,
+ * once the other shards could have been polled this many times each.
+ */
+#define IOQUEUE_SHARD_IDLE_POLLS	2
+
+/*
+ * ioqueue_poll_shard()
+ * Shard polled by the calling thread. Threads get the shards in turn on
+ * their first poll and keep polling the same shard, unless another shard
+ * has been left without poller (its thread stopped polling or exited):
+ * then the thread takes that one over.
+ */
+static struct ioqueue_shard* ioqueue_poll_shard(bioqueue_t *ioqueue)
+{
+    struct ioqueue_shard *shard;
+    unsigned seq, i;
+    long idx, home;
+
+    if (ioqueue->shard_cnt == 1)
+	return &ioqueue->shards[0];
+
+    seq = __atomic_add_fetch(&ioqueue->poll_seq, 1, __ATOMIC_RELAXED);
+
+    home = idx = (long)bthreadLocalGet(ioqueue->shard_tls);
+    if (idx == 0) {
+	idx = __atomic_fetch_add(&ioqueue->next_poller, 1, __ATOMIC_RELAXED) %
+	      ioqueue->shard_cnt + 1;
+    }
+
+    for (i=0; i<ioqueue->shard_cnt; ++i) {
+	int idle = 0;
+
+	shard = &ioqueue->shards[i];
+	if ((long)i + 1 == idx ||
+	    seq - __atomic_load_n(&shard->last_poll, __ATOMIC_RELAXED) <=
+	    IOQUEUE_SHARD_IDLE_POLLS * ioqueue->shard_cnt)
+	{
+	    continue;
+	}
+	/* Only one thread takes it over */
+	if (__atomic_compare_exchange_n(&shard->pollers, &idle, 1, BASE_FALSE,
+					__ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+	{
+	    idx = i + 1;
+	    break;
+	}
+    }
+
+    shard = &ioqueue->shards[idx - 1];
+    if (i == ioqueue->shard_cnt)
+	__atomic_add_fetch(&shard->pollers, 1, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&shard->last_poll, seq, __ATOMIC_RELAXED);
+
+    if (idx != home)
+	bthreadLocalSet(ioqueue->shard_tls, (void*)idx);
+    return shard;
+}
+
+/*
+ * ioqueue_poll_done()
+ * The calling thread has finished polling the shard.
+ */
+static void ioqueue_poll_done(bioqueue_t *ioqueue, struct ioqueue_shard *shard)
+{
+    if (ioqueue->shard_cnt == 1)
+	return;
+
+    __atomic_store_n(&shard->last_poll,
+		     __atomic_load_n(&ioqueue->poll_seq, __ATOMIC_RELAXED),
+		     __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&shard->pollers, 1, __ATOMIC_ACQ_REL);
+}
+
+static bbool_t ioqueue_has_mail(bioqueue_key_t *key)
+{
+    return __atomic_load_n(&key->mail_cnt, __ATOMIC_ACQUIRE) != 0;
+}
+
+/*
+ * ioqueue_post_write()
+ * Called by bioqueue_send() and bioqueue_sendto() when the write has to
+ * wait. Only the poller of the key's shard puts it to the key directly, as
+ * long as earlier writes handed over are not pending; others leave it in
+ * the mailbox of the shard and wake the poller.
+ */
+static bbool_t ioqueue_post_write(bioqueue_key_t *key,
+                                  struct write_operation *write_op)
+{
+    bioqueue_t *ioqueue = key->ioqueue;
+    struct ioqueue_shard *shard;
+    struct mail_operation *mail = (struct mail_operation*)write_op;
+    struct mail_operation *head;
+    long home;
+
+    if (ioqueue->shard_cnt == 1 || IS_CLOSING(key))
+	return BASE_FALSE;
+
+    home = (long)bthreadLocalGet(ioqueue->shard_tls);
+    if (home == (long)key->shard + 1 && !ioqueue_has_mail(key))
+	return BASE_FALSE;
+
+    /* Keep the key until the poller has taken the write */
+#if BASE_IOQUEUE_HAS_SAFE_UNREG
+    increment_counter(key);
+#endif
+    if (key->grp_lock)
+	bgrp_lock_add_ref_dbg(key->grp_lock, "ioqueue", 0);
+
+    shard = KEY_SHARD(key);
+    mail->key = key;
+    __atomic_add_fetch(&key->mail_cnt, 1, __ATOMIC_ACQ_REL);
+
+    head = __atomic_load_n(&shard->mailbox, __ATOMIC_RELAXED);
+    do {
+	mail->next_mail = head;
+    } while (!__atomic_compare_exchange_n(&shard->mailbox, &head, mail, BASE_TRUE,
+					  __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    /* Only the first mail wakes the poller, the rest come along */
+    if (head == NULL) {
+	buint64_t one = 1;
+
+	if (os_write(shard->evfd, &one, sizeof(one)) < 0)
+	    BASE_WARN("Unable to wake shard %u: %d", key->shard, errno);
+    }
+
+    return BASE_TRUE;
+}
+
+/*
+ * ioqueue_drain_mailbox()
+ * Called by the poller of the shard to put the writes handed over to their
+ * keys, in the order they were posted.
+ */
+static void ioqueue_drain_mailbox(bioqueue_t *ioqueue, struct ioqueue_shard *shard)
+{
+    struct mail_operation *mail, *next, *fifo = NULL;
+    buint64_t value;
+
+    /* Reset the eventfd before taking the mail, so a mail posted after the
+     * exchange wakes us again.
+     */
+    if (os_read(shard->evfd, &value, sizeof(value)) < 0 && errno != EAGAIN)
+	BASE_WARN("Unable to read shard eventfd: %d", errno);
+
+    mail = __atomic_exchange_n(&shard->mailbox, NULL, __ATOMIC_ACQUIRE);
+    while (mail) {
+	next = mail->next_mail;
+	mail->next_mail = fifo;
+	fifo = mail;
+	mail = next;
+    }
+
+    for (mail = fifo; mail; mail = next) {
+	bioqueue_key_t *key = mail->key;
+	struct write_operation *write_op = &mail->base.write;
+
+	next = mail->next_mail;
+
+	bioqueue_lock_key(key);
+	if (IS_CLOSING(key)) {
+	    write_op->op = BASE_IOQUEUE_OP_NONE;
+	} else {
+	    blist_insert_before(&key->write_list, write_op);
+	    ioqueue_add_to_set(ioqueue, key, WRITEABLE_EVENT);
+	}
+	__atomic_sub_fetch(&key->mail_cnt, 1, __ATOMIC_ACQ_REL);
+	bioqueue_unlock_key(key);
+
+#if BASE_IOQUEUE_HAS_SAFE_UNREG
+	decrement_counter(key);
+#endif
+	if (key->grp_lock)
+	    bgrp_lock_dec_ref_dbg(key->grp_lock, "ioqueue", 0);
+    }
 }
 
 #if BASE_IOQUEUE_HAS_SAFE_UNREG
@@ -550,6 +980,73 @@ static void scan_closing_keys(bioqueue_t *ioqueue)
 }
 #endif
 
+#if IOQUEUE_EDGE_TRIGGERED
+/*
+ * ioqueue_drain_key()
+ * Dispatch pending operations of a key reported by epoll until the socket
+ * runs dry, the key runs out of operations, or the drain budget is spent.
+ * Returns the number of operations processed.
+ */
+static int ioqueue_drain_key( bioqueue_t *ioqueue, bioqueue_key_t *h, buint32_t events)
+{
+    int processed = 0;
+    int n;
+
+    /* Dispatch clears the flags under the key's lock when the socket runs
+     * dry. Setting them under the same lock, the edge comes either after
+     * that I/O, or before it and only costs another EWOULDBLOCK.
+     */
+    bioqueue_lock_key(h);
+    if (events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+	h->read_ready = BASE_TRUE;
+    if (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+	h->write_ready = BASE_TRUE;
+    bioqueue_unlock_key(h);
+
+#if BASE_HAS_TCP
+    if (h->connecting && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+	{
+		bbool_t done;
+
+		if (events & EPOLLERR)
+			done = ioqueue_dispatch_exception_event(ioqueue, h);
+		else
+			done = ioqueue_dispatch_write_event(ioqueue, h);
+		if (done)
+			++processed;
+    }
+#endif
+
+    for (n=0; n<BASE_IOQUEUE_EPOLL_MAX_DRAIN && h->read_ready && !IS_CLOSING(h) &&
+		(key_has_pending_read(h) || key_has_pending_accept(h)); ++n)
+	{
+		if (!ioqueue_dispatch_read_event(ioqueue, h))
+			break;
+		++processed;
+    }
+
+    for (n=0; n<BASE_IOQUEUE_EPOLL_MAX_DRAIN && h->write_ready && !IS_CLOSING(h) &&
+		key_has_pending_write(h); ++n)
+	{
+		if (!ioqueue_dispatch_write_event(ioqueue, h))
+			break;
+		++processed;
+    }
+
+    /* Drain stopped before EWOULDBLOCK (budget spent, or other thread owns
+     * the key): let epoll report the key again.
+     */
+    if (!IS_CLOSING(h) &&
+		((h->read_ready && (key_has_pending_read(h) || key_has_pending_accept(h))) ||
+		 (h->write_ready && key_has_pending_write(h))))
+	{
+		ioqueue_rearm_key(ioqueue, h);
+    }
+
+    return processed;
+}
+#endif
+
 /*
  * bioqueue_poll()
  *
@@ -563,17 +1060,21 @@ int bioqueue_poll( bioqueue_t *ioqueue, const btime_val *timeout)
     enum { MAX_EVENTS = BASE_IOQUEUE_MAX_CAND_EVENTS };
     struct epoll_event events[MAX_EVENTS];
     struct queue queue[MAX_EVENTS];
+    struct ioqueue_shard *shard;
+    bbool_t has_mail = BASE_FALSE;
     btimestamp t1, t2;
     
     BASE_CHECK_STACK();
 
+    shard = ioqueue_poll_shard(ioqueue);
+
     msec = timeout ? BASE_TIME_VAL_MSEC(*timeout) : 9000;
 
     MTRACE( "start os_epoll_wait, msec=%d", msec);
     bTimeStampGet(&t1);
  
     //count = os_epoll_wait( ioqueue->epfd, events, ioqueue->max, msec);
-    count = os_epoll_wait( ioqueue->epfd, events, MAX_EVENTS, msec);
+    count = os_epoll_wait( shard->epfd, events, MAX_EVENTS, msec);
     if (count == 0)
 	{
 #if BASE_IOQUEUE_HAS_SAFE_UNREG
@@ -588,25 +1089,49 @@ int bioqueue_poll( bioqueue_t *ioqueue, const btime_val *timeout)
 		}
 #endif
 		MTRACE("os_epoll_wait timed out");
+		ioqueue_poll_done(ioqueue, shard);
 		return count;
     }
     else if (count < 0)
 	{
 		MTRACE( "os_epoll_wait error");
-		return -bget_netos_error();
+		count = -bget_netos_error();
+		ioqueue_poll_done(ioqueue, shard);
+		return count;
     }
 
     bTimeStampGet(&t2);
     MTRACE("os_epoll_wait returns %d, time=%d usec", count, belapsed_usec(&t1, &t2));
 
-    /* Lock ioqueue. */
-    block_acquire(ioqueue->lock);
+    /* Lock the shard; keys of other shards are served by other threads.
+     * Reference counters are incremented in place, under this lock.
+     */
+    bmutex_lock(shard->lock);
 
     for (event_cnt=0, i=0; i<count; ++i)
 	{
 		bioqueue_key_t *h = (bioqueue_key_t*)(epoll_data_type)events[i].epoll_data;
 
 		MTRACE("event %d: events=%d", i, events[i].events);
+		if ((void*)h == (void*)shard)
+		{
+			has_mail = BASE_TRUE;
+			continue;
+		}
+#if IOQUEUE_EDGE_TRIGGERED
+		/* One entry per key; the key is drained for all directions later */
+		if (IS_CLOSING(h))
+			continue;
+
+#if BASE_IOQUEUE_HAS_SAFE_UNREG
+		++h->ref_count;
+#endif
+		queue[event_cnt].key = h;
+		queue[event_cnt].event_type = NO_EVENT;
+		queue[event_cnt].events = events[i].events;
+		++event_cnt;
+		continue;
+#endif
 		/*
 		* Check readability.
 		*/
@@ -614,7 +1139,7 @@ int bioqueue_poll( bioqueue_t *ioqueue, const btime_val *timeout)
 		{
 
 #if BASE_IOQUEUE_HAS_SAFE_UNREG
-	    	increment_counter(h);
+	    	++h->ref_count;
 #endif
 		    queue[event_cnt].key = h;
 		    queue[event_cnt].event_type = READABLE_EVENT;
@@ -629,7 +1154,7 @@ int bioqueue_poll( bioqueue_t *ioqueue, const btime_val *timeout)
 		if ((events[i].events & EPOLLOUT) && key_has_pending_write(h) && !IS_CLOSING(h))
 		{
 #if BASE_IOQUEUE_HAS_SAFE_UNREG
-		    increment_counter(h);
+		    ++h->ref_count;
 #endif
 		    queue[event_cnt].key = h;
 	    	queue[event_cnt].event_type = WRITEABLE_EVENT;
@@ -644,7 +1169,7 @@ int bioqueue_poll( bioqueue_t *ioqueue, const btime_val *timeout)
 		if ((events[i].events & EPOLLOUT) && (h->connecting) && !IS_CLOSING(h))
 		{
 #if BASE_IOQUEUE_HAS_SAFE_UNREG
-		    increment_counter(h);
+		    ++h->ref_count;
 #endif
 		    queue[event_cnt].key = h;
 	    	queue[event_cnt].event_type = WRITEABLE_EVENT;
@@ -667,7 +1192,7 @@ int bioqueue_poll( bioqueue_t *ioqueue, const btime_val *timeout)
 			if (h->connecting)
 			{
 #if BASE_IOQUEUE_HAS_SAFE_UNREG
-				increment_counter(h);
+				++h->ref_count;
 #endif
 				queue[event_cnt].key = h;
 				queue[event_cnt].event_type = EXCEPTION_EVENT;
@@ -676,7 +1201,7 @@ int bioqueue_poll( bioqueue_t *ioqueue, const btime_val *timeout)
 			else if (key_has_pending_read(h) || key_has_pending_accept(h))
 			{
 #if BASE_IOQUEUE_HAS_SAFE_UNREG
-				increment_counter(h);
+				++h->ref_count;
 #endif
 				queue[event_cnt].key = h;
 				queue[event_cnt].event_type = READABLE_EVENT;
@@ -694,15 +1219,22 @@ int bioqueue_poll( bioqueue_t *ioqueue, const btime_val *timeout)
 
     BASE_RACE_ME(5);
 
-    block_release(ioqueue->lock);
+    bmutex_unlock(shard->lock);
 
     BASE_RACE_ME(5);
 
+    if (has_mail)
+	ioqueue_drain_mailbox(ioqueue, shard);
+
     processed_cnt = 0;
 
     /* Now process the events. */
     for (i=0; i<event_cnt; ++i)
 	{
+#if IOQUEUE_EDGE_TRIGGERED
+		/* No per-poll cap here: skipping a key would lose its edge */
+		processed_cnt += ioqueue_drain_key(ioqueue, queue[i].key, queue[i].events);
+#else
 		/* Just do not exceed BASE_IOQUEUE_MAX_EVENTS_IN_SINGLE_POLL */
 		if (processed_cnt < BASE_IOQUEUE_MAX_EVENTS_IN_SINGLE_POLL)
 		{
@@ -728,6 +1260,7 @@ int bioqueue_poll( bioqueue_t *ioqueue, const btime_val *timeout)
 					break;
 			}
 		}
+#endif
 
 #if BASE_IOQUEUE_HAS_SAFE_UNREG
 		decrement_counter(queue[i].key);
@@ -741,7 +1274,7 @@ int bioqueue_poll( bioqueue_t *ioqueue, const btime_val *timeout)
     /* Special case:
      * When epoll returns > 0 but no descriptors are actually set!
      */
-    if (count > 0 && !event_cnt && msec > 0)
+    if (count > 0 && !event_cnt && !has_mail && msec > 0)
 	{
 		bthreadSleepMs(msec);
 	}
@@ -749,8 +1282,9 @@ int bioqueue_poll( bioqueue_t *ioqueue, const btime_val *timeout)
     MTRACE("     poll: count=%d events=%d processed=%d", count, event_cnt, processed_cnt);
 
     bTimeStampGet(&t1);
-    MTRACE("ioqueue_poll() returns %d, time=%d usec",  processed, belapsed_usec(&t2, &t1));
+    MTRACE("ioqueue_poll() returns %d, time=%d usec",  processed_cnt, belapsed_usec(&t2, &t1));
 
+    ioqueue_poll_done(ioqueue, shard);
     return processed_cnt;
 }
 
@@ -9,7 +9,12 @@
  * Win32, Linux, Linux kernel, etc.).
  */
 
-#include <baseIoQueue.h>
+/* recvmmsg() and sendmmsg() are GNU extensions */
+#if defined(BASE_IOQUEUE_HAS_MMSG) && BASE_IOQUEUE_HAS_MMSG!=0 && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE
+#endif
+
+#include <baseIoqueue.h>
 #include <baseOs.h>
 #include <baseLock.h>
 #include <baseLog.h>
@@ -245,6 +250,19 @@ bstatus_t bioqueue_create( bpool_t *pool, bsize_t max_fd, bioqueue_t **p_ioqueue
 	return BASE_SUCCESS;
 }
 
+/*
+ * bioqueue_create2()
+ *
+ * select ioqueue has a single descriptor set, shard_cnt is ignored.
+ */
+bstatus_t bioqueue_create2(bpool_t *pool, bsize_t max_fd, const bioqueue_cfg *cfg, bioqueue_t **p_ioqueue)
+{
+	if (cfg && cfg->shard_cnt > 1)
+		BASE_WARN("select ioqueue has no shards, %u requested", cfg->shard_cnt);
+
+	return bioqueue_create(pool, max_fd, p_ioqueue);
+}
+
 /*
  * bioqueue_destroy()
  *
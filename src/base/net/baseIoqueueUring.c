@@ -0,0 +1,1607 @@
+/*
+ *
+ */
+
+/*
+ * This is the implementation of IOQueue framework using Linux io_uring.
+ *
+ * Receive, accept and connect operations are handed to the kernel when they
+ * are started and come back from the completion queue, so there is no
+ * readiness notification followed by a second system call. Operations
+ * started from callbacks are queued in the submission ring and handed to
+ * the kernel in one io_uring_enter() at the end of the poll.
+ *
+ * The epoll ioqueue is compiled into this file with its public functions
+ * renamed to epoll_ioqueue_xxx(). It still owns the keys (safe
+ * unregistration, free and closing lists), and it serves the whole ioqueue
+ * when the running kernel can not set up an io_uring with the features
+ * needed here (IORING_FEAT_SINGLE_MMAP, NODROP and EXT_ARG, Linux 5.11).
+ */
+
+/* recvmmsg() and sendmmsg() are GNU extensions */
+#if defined(BASE_IOQUEUE_HAS_MMSG) && BASE_IOQUEUE_HAS_MMSG!=0 && !defined(_GNU_SOURCE)
+#   define _GNU_SOURCE
+#endif
+
+#include <baseIoqueue.h>
+#include <baseOs.h>
+#include <baseLock.h>
+#include <baseLog.h>
+#include <baseList.h>
+#include <basePool.h>
+#include <baseString.h>
+#include <baseAssert.h>
+#include <baseErrno.h>
+#include <baseSock.h>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <signal.h>
+#include <poll.h>
+#include <errno.h>
+#include <unistd.h>
+
+struct uring_slot;
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+/* Address of the pending connect(), it must live until the completion */
+#define IOQUEUE_KEY_EXTRA_FIELDS					\
+    bsockaddr		    connect_addr;				\
+    int			    connect_addrlen;
+
+#define IOQUEUE_EXTRA_FIELDS						\
+    int			    ring_fd;	/* -1 when epoll is used */	\
+    bmutex_t		   *ring_mutex;					\
+    void		   *ring_ptr;					\
+    bsize_t		    ring_size;					\
+    struct io_uring_sqe	   *sqes;					\
+    bsize_t		    sqes_size;					\
+    unsigned		   *sq_head;					\
+    unsigned		   *sq_tail;					\
+    unsigned		   *sq_array;					\
+    unsigned		    sq_mask;					\
+    unsigned		    sq_entries;					\
+    unsigned		    sq_pending;	/* queued, not yet entered */	\
+    unsigned		   *cq_head;					\
+    unsigned		   *cq_tail;					\
+    struct io_uring_cqe	   *cqes;					\
+    unsigned		    cq_mask;					\
+    unsigned		    dispatching;				\
+    struct uring_slot	   *slots;					\
+    unsigned		   *free_slots;					\
+    unsigned		    free_cnt;
+
+#define bioqueue_name			epoll_ioqueue_name
+#define bioqueue_create			epoll_ioqueue_create
+#define bioqueue_create2		epoll_ioqueue_create2
+#define bioqueue_destroy		epoll_ioqueue_destroy
+#define bioqueue_register_sock		epoll_ioqueue_register_sock
+#define bioqueue_register_sock2		epoll_ioqueue_register_sock2
+#define bioqueue_unregister		epoll_ioqueue_unregister
+#define bioqueue_poll			epoll_ioqueue_poll
+#define bioqueue_recv			epoll_ioqueue_recv
+#define bioqueue_recvfrom		epoll_ioqueue_recvfrom
+#define bioqueue_send			epoll_ioqueue_send
+#define bioqueue_sendv			epoll_ioqueue_sendv
+#define bioqueue_sendto			epoll_ioqueue_sendto
+#define bioqueue_recvfrom_batch		epoll_ioqueue_recvfrom_batch
+#define bioqueue_sendto_batch		epoll_ioqueue_sendto_batch
+#define bioqueue_accept			epoll_ioqueue_accept
+#define bioqueue_connect		epoll_ioqueue_connect
+#define bioqueue_post_completion	epoll_ioqueue_post_completion
+
+#include "baseIoqueueEpoll.c"
+
+#undef bioqueue_name
+#undef bioqueue_create
+#undef bioqueue_create2
+#undef bioqueue_destroy
+#undef bioqueue_register_sock
+#undef bioqueue_register_sock2
+#undef bioqueue_unregister
+#undef bioqueue_poll
+#undef bioqueue_recv
+#undef bioqueue_recvfrom
+#undef bioqueue_send
+#undef bioqueue_sendv
+#undef bioqueue_sendto
+#undef bioqueue_recvfrom_batch
+#undef bioqueue_sendto_batch
+#undef bioqueue_accept
+#undef bioqueue_connect
+#undef bioqueue_post_completion
+
+#define IS_URING(ioqueue)	((ioqueue)->ring_fd >= 0)
+
+#define URING_FEATURES		(IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | \
+				 IORING_FEAT_EXT_ARG)
+
+/* Upper bound of the completion queue, whatever max_fd is */
+#define URING_MAX_CQ_ENTRIES	32768
+
+/*
+ * An operation in flight: the common operation key, followed by what the
+ * kernel reads for sendmsg()/recvmsg(). Overlaid on bioqueue_op_key_t.
+ */
+struct uring_operation
+{
+    union operation_key	    base;
+    struct msghdr	    msg;
+    struct iovec	    iov;
+};
+
+/*
+ * One slot per request in the ring; user_data of the request is the slot
+ * index plus one (zero marks cancel and poll requests). A slot whose type is
+ * BASE_IOQUEUE_OP_NONE is orphaned: the key was unregistered or the
+ * operation was posted, and the completion is dropped when it arrives.
+ */
+struct uring_slot
+{
+    bioqueue_key_t	   *key;
+    struct uring_operation *op;
+    bioqueue_operation_e    type;
+};
+
+/* Completion taken from the ring, dispatched outside of the ring lock */
+struct uring_event
+{
+    bioqueue_key_t	   *key;
+    struct uring_operation *op;
+    bioqueue_operation_e    type;
+    int			    res;
+};
+
+static int uring_supported = -1;
+
+static int uring_sys_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_sys_enter(int fd, unsigned to_submit, unsigned min_complete,
+			   unsigned flags, void *arg, bsize_t argsz)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+			flags, arg, argsz);
+}
+
+/* Check once if the running kernel has what this backend needs */
+static bbool_t uring_probe(void)
+{
+    if (uring_supported < 0) {
+	struct io_uring_params p;
+	int fd;
+
+	bbzero(&p, sizeof(p));
+	fd = uring_sys_setup(2, &p);
+	uring_supported = (fd >= 0 &&
+			   (p.features & URING_FEATURES) == URING_FEATURES);
+	if (fd >= 0)
+	    close(fd);
+    }
+    return uring_supported != 0;
+}
+
+static bstatus_t uring_init(bpool_t *pool, bioqueue_t *ioqueue,
+			    bsize_t max_fd)
+{
+    struct io_uring_params p;
+    unsigned cq_entries, i;
+    bsize_t cq_size;
+    char *ptr;
+    bstatus_t rc;
+    int fd;
+
+    /* Every operation in flight holds a completion entry, so the completion
+     * queue is sized for a few operations per descriptor.
+     */
+    cq_entries = BASE_IOQUEUE_URING_ENTRIES * 2;
+    while (cq_entries < max_fd * 4 && cq_entries < URING_MAX_CQ_ENTRIES)
+	cq_entries <<= 1;
+
+    bbzero(&p, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = cq_entries;
+
+    fd = uring_sys_setup(BASE_IOQUEUE_URING_ENTRIES, &p);
+    if (fd < 0)
+	return BASE_RETURN_OS_ERROR(bget_native_os_error());
+
+    if ((p.features & URING_FEATURES) != URING_FEATURES) {
+	close(fd);
+	return BASE_ENOTSUP;
+    }
+
+    /* With IORING_FEAT_SINGLE_MMAP both rings share one mapping */
+    ioqueue->ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (cq_size > ioqueue->ring_size)
+	ioqueue->ring_size = cq_size;
+
+    ptr = mmap(NULL, ioqueue->ring_size, PROT_READ | PROT_WRITE,
+	       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ptr == MAP_FAILED) {
+	rc = BASE_RETURN_OS_ERROR(bget_native_os_error());
+	close(fd);
+	return rc;
+    }
+
+    ioqueue->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    ioqueue->sqes = mmap(NULL, ioqueue->sqes_size, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ioqueue->sqes == MAP_FAILED) {
+	rc = BASE_RETURN_OS_ERROR(bget_native_os_error());
+	munmap(ptr, ioqueue->ring_size);
+	close(fd);
+	return rc;
+    }
+
+    ioqueue->ring_ptr = ptr;
+    ioqueue->sq_head = (unsigned*)(ptr + p.sq_off.head);
+    ioqueue->sq_tail = (unsigned*)(ptr + p.sq_off.tail);
+    ioqueue->sq_array = (unsigned*)(ptr + p.sq_off.array);
+    ioqueue->sq_mask = *(unsigned*)(ptr + p.sq_off.ring_mask);
+    ioqueue->sq_entries = p.sq_entries;
+    ioqueue->sq_pending = 0;
+    ioqueue->cq_head = (unsigned*)(ptr + p.cq_off.head);
+    ioqueue->cq_tail = (unsigned*)(ptr + p.cq_off.tail);
+    ioqueue->cqes = (struct io_uring_cqe*)(ptr + p.cq_off.cqes);
+    ioqueue->cq_mask = *(unsigned*)(ptr + p.cq_off.ring_mask);
+    ioqueue->dispatching = 0;
+
+    /* No more requests than completion entries can be in flight */
+    ioqueue->slots = bpool_calloc(pool, p.cq_entries, sizeof(struct uring_slot));
+    ioqueue->free_slots = bpool_calloc(pool, p.cq_entries, sizeof(unsigned));
+    for (i=0; i<p.cq_entries; ++i)
+	ioqueue->free_slots[i] = p.cq_entries - 1 - i;
+    ioqueue->free_cnt = p.cq_entries;
+
+    rc = bmutex_create_simple(pool, "uring%p", &ioqueue->ring_mutex);
+    if (rc != BASE_SUCCESS) {
+	munmap(ioqueue->sqes, ioqueue->sqes_size);
+	munmap(ptr, ioqueue->ring_size);
+	close(fd);
+	return rc;
+    }
+
+    ioqueue->ring_fd = fd;
+
+    BASE_INFO("io_uring: %u submission, %u completion entries",
+	      p.sq_entries, p.cq_entries);
+    return BASE_SUCCESS;
+}
+
+static void uring_deinit(bioqueue_t *ioqueue)
+{
+    munmap(ioqueue->sqes, ioqueue->sqes_size);
+    munmap(ioqueue->ring_ptr, ioqueue->ring_size);
+    close(ioqueue->ring_fd);
+    bmutex_destroy(ioqueue->ring_mutex);
+    ioqueue->ring_fd = -1;
+}
+
+/* Hand the queued requests to the kernel. Ring lock must be held. */
+static void uring_flush(bioqueue_t *ioqueue)
+{
+    int rc;
+
+    if (ioqueue->sq_pending == 0)
+	return;
+
+    rc = uring_sys_enter(ioqueue->ring_fd, ioqueue->sq_pending, 0, 0, NULL, 0);
+    if (rc > 0)
+	ioqueue->sq_pending -= rc;
+    /* On error (EBUSY while completions overflow) retry in the next poll */
+}
+
+/* Get a cleared submission entry. Ring lock must be held. */
+static struct io_uring_sqe* uring_get_sqe(bioqueue_t *ioqueue)
+{
+    unsigned tail = *ioqueue->sq_tail;
+    struct io_uring_sqe *sqe;
+
+    if (tail - __atomic_load_n(ioqueue->sq_head, __ATOMIC_ACQUIRE) >=
+	ioqueue->sq_entries)
+    {
+	uring_flush(ioqueue);
+	if (tail - __atomic_load_n(ioqueue->sq_head, __ATOMIC_ACQUIRE) >=
+	    ioqueue->sq_entries)
+	{
+	    return NULL;
+	}
+    }
+
+    sqe = &ioqueue->sqes[tail & ioqueue->sq_mask];
+    bbzero(sqe, sizeof(*sqe));
+    return sqe;
+}
+
+/* Publish the entry returned by uring_get_sqe(). Ring lock must be held. */
+static void uring_commit_sqe(bioqueue_t *ioqueue)
+{
+    unsigned tail = *ioqueue->sq_tail;
+
+    ioqueue->sq_array[tail & ioqueue->sq_mask] = tail & ioqueue->sq_mask;
+    __atomic_store_n(ioqueue->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ++ioqueue->sq_pending;
+}
+
+/*
+ * Point the message of a sendv() at the vectors not written yet. When the
+ * last write stopped in the middle of a vector, only the rest of that one
+ * is sent this time.
+ */
+static void uring_prep_sendv(struct uring_operation *op)
+{
+    struct write_operation *write_op = &op->base.write;
+    const bsock_iovec *iov = write_op->iov;
+    unsigned cnt = write_op->iov_cnt;
+    bsize_t skip = write_op->written;
+
+    while (cnt > 1 && skip >= iov->len) {
+	skip -= iov->len;
+	++iov;
+	--cnt;
+    }
+
+    bbzero(&op->msg, sizeof(op->msg));
+    if (skip == 0) {
+	op->msg.msg_iov = (struct iovec*)iov;
+	op->msg.msg_iovlen = cnt;
+    } else {
+	op->iov.iov_base = (char*)iov->base + skip;
+	op->iov.iov_len = iov->len - skip;
+	op->msg.msg_iov = &op->iov;
+	op->msg.msg_iovlen = 1;
+    }
+}
+
+static void uring_prep(struct io_uring_sqe *sqe, bioqueue_key_t *key,
+		       struct uring_operation *op, bioqueue_operation_e type)
+{
+    sqe->fd = key->fd;
+
+    switch (type) {
+    case BASE_IOQUEUE_OP_RECV:
+	sqe->opcode = IORING_OP_RECV;
+	sqe->addr = (unsigned long)op->base.read.buf;
+	sqe->len = (unsigned)op->base.read.size;
+	sqe->msg_flags = op->base.read.flags;
+	break;
+    case BASE_IOQUEUE_OP_RECV_FROM:
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->addr = (unsigned long)&op->msg;
+	sqe->len = 1;
+	sqe->msg_flags = op->base.read.flags;
+	break;
+    case BASE_IOQUEUE_OP_SEND:
+	if (op->base.write.iov) {
+	    uring_prep_sendv(op);
+	    sqe->opcode = IORING_OP_SENDMSG;
+	    sqe->addr = (unsigned long)&op->msg;
+	    sqe->len = 1;
+	    sqe->msg_flags = op->base.write.flags;
+	    break;
+	}
+	sqe->opcode = IORING_OP_SEND;
+	sqe->addr = (unsigned long)(op->base.write.buf + op->base.write.written);
+	sqe->len = (unsigned)(op->base.write.size - op->base.write.written);
+	sqe->msg_flags = op->base.write.flags;
+	break;
+    case BASE_IOQUEUE_OP_SEND_TO:
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->addr = (unsigned long)&op->msg;
+	sqe->len = 1;
+	sqe->msg_flags = op->base.write.flags;
+	break;
+#if BASE_HAS_TCP
+    case BASE_IOQUEUE_OP_ACCEPT:
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->addr = (unsigned long)op->base.accept.rmt_addr;
+	sqe->addr2 = (unsigned long)op->base.accept.addrlen;
+	break;
+    case BASE_IOQUEUE_OP_CONNECT:
+	sqe->opcode = IORING_OP_CONNECT;
+	sqe->addr = (unsigned long)&key->connect_addr;
+	sqe->off = key->connect_addrlen;
+	break;
+#endif
+    default:
+	bassert(!"Unexpected operation");
+	break;
+    }
+}
+
+/*
+ * Queue one operation. The request goes to the kernel right away, unless a
+ * thread is dispatching completions: then it is entered together with the
+ * others started from callbacks when that thread finishes.
+ */
+static bstatus_t uring_submit(bioqueue_key_t *key, struct uring_operation *op,
+			      bioqueue_operation_e type)
+{
+    bioqueue_t *ioqueue = key->ioqueue;
+    struct io_uring_sqe *sqe;
+    unsigned idx;
+
+    bmutex_lock(ioqueue->ring_mutex);
+
+    /* Checked under the ring lock, so bioqueue_unregister() sees this
+     * request when it cancels the key's requests.
+     */
+    if (IS_CLOSING(key)) {
+	bmutex_unlock(ioqueue->ring_mutex);
+	return BASE_ECANCELLED;
+    }
+
+    if (ioqueue->free_cnt == 0 || (sqe = uring_get_sqe(ioqueue)) == NULL) {
+	bmutex_unlock(ioqueue->ring_mutex);
+	BASE_WARN("io_uring is full, operation %d on key %p rejected", type, key);
+	return BASE_ETOOMANY;
+    }
+
+    idx = ioqueue->free_slots[--ioqueue->free_cnt];
+    ioqueue->slots[idx].key = key;
+    ioqueue->slots[idx].op = op;
+    ioqueue->slots[idx].type = type;
+
+    uring_prep(sqe, key, op, type);
+    sqe->user_data = idx + 1;
+    uring_commit_sqe(ioqueue);
+
+    if (ioqueue->dispatching == 0)
+	uring_flush(ioqueue);
+
+    bmutex_unlock(ioqueue->ring_mutex);
+    return BASE_SUCCESS;
+}
+
+/*
+ * Kernels which honour O_NONBLOCK in io_uring complete the request with
+ * EAGAIN; wait for readiness with a linked poll and try again, keeping the
+ * slot. Ring lock must be held.
+ */
+static bbool_t uring_resubmit_polled(bioqueue_t *ioqueue, unsigned idx)
+{
+    struct uring_slot *slot = &ioqueue->slots[idx];
+    struct io_uring_sqe *sqe;
+    unsigned poll_mask;
+
+    switch (slot->type) {
+    case BASE_IOQUEUE_OP_SEND:
+    case BASE_IOQUEUE_OP_SEND_TO:
+#if BASE_HAS_TCP
+    case BASE_IOQUEUE_OP_CONNECT:
+#endif
+	poll_mask = POLLOUT;
+	break;
+    default:
+	poll_mask = POLLIN;
+	break;
+    }
+
+    /* Both entries must be in the queue together */
+    if (*ioqueue->sq_tail + 2 - __atomic_load_n(ioqueue->sq_head, __ATOMIC_ACQUIRE) >
+	ioqueue->sq_entries)
+    {
+	uring_flush(ioqueue);
+	if (*ioqueue->sq_tail + 2 - __atomic_load_n(ioqueue->sq_head, __ATOMIC_ACQUIRE) >
+	    ioqueue->sq_entries)
+	{
+	    return BASE_FALSE;
+	}
+    }
+
+    sqe = uring_get_sqe(ioqueue);
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = slot->key->fd;
+    sqe->poll32_events = poll_mask;
+    sqe->flags = IOSQE_IO_LINK;
+    sqe->user_data = 0;
+    uring_commit_sqe(ioqueue);
+
+    sqe = uring_get_sqe(ioqueue);
+    uring_prep(sqe, slot->key, slot->op, slot->type);
+    sqe->user_data = idx + 1;
+    uring_commit_sqe(ioqueue);
+
+    return BASE_TRUE;
+}
+
+/*
+ * Take up to max completions from the ring. The keys are referenced for the
+ * dispatch, and when anything is returned the caller is counted in
+ * ioqueue->dispatching until uring_end_dispatch().
+ */
+static int uring_reap(bioqueue_t *ioqueue, struct uring_event *events, int max)
+{
+    unsigned head, tail;
+    int count = 0;
+
+    bmutex_lock(ioqueue->ring_mutex);
+
+    head = *ioqueue->cq_head;
+    tail = __atomic_load_n(ioqueue->cq_tail, __ATOMIC_ACQUIRE);
+
+    while (head != tail && count < max) {
+	struct io_uring_cqe *cqe = &ioqueue->cqes[head & ioqueue->cq_mask];
+	struct uring_slot *slot;
+	unsigned idx;
+
+	++head;
+
+	if (cqe->user_data == 0)
+	    continue;
+
+	idx = (unsigned)cqe->user_data - 1;
+	slot = &ioqueue->slots[idx];
+
+	if (slot->type != BASE_IOQUEUE_OP_NONE) {
+	    if (cqe->res == -EAGAIN && uring_resubmit_polled(ioqueue, idx))
+		continue;
+
+	    events[count].key = slot->key;
+	    events[count].op = slot->op;
+	    events[count].type = slot->type;
+	    events[count].res = cqe->res;
+
+#if BASE_IOQUEUE_HAS_SAFE_UNREG
+	    increment_counter(slot->key);
+#endif
+	    if (slot->key->grp_lock)
+		bgrp_lock_add_ref_dbg(slot->key->grp_lock, "ioqueue", 0);
+	    ++count;
+	}
+
+	slot->key = NULL;
+	slot->op = NULL;
+	slot->type = BASE_IOQUEUE_OP_NONE;
+	ioqueue->free_slots[ioqueue->free_cnt++] = idx;
+    }
+
+    __atomic_store_n(ioqueue->cq_head, head, __ATOMIC_RELEASE);
+
+    if (count)
+	++ioqueue->dispatching;
+
+    bmutex_unlock(ioqueue->ring_mutex);
+    return count;
+}
+
+static void uring_end_dispatch(bioqueue_t *ioqueue)
+{
+    bmutex_lock(ioqueue->ring_mutex);
+    if (--ioqueue->dispatching == 0)
+	uring_flush(ioqueue);
+    bmutex_unlock(ioqueue->ring_mutex);
+}
+
+/*
+ * Orphan the requests of the key (or only the one of op, when it is not
+ * NULL) and ask the kernel to cancel them. Returns the number of requests
+ * found.
+ */
+static unsigned uring_cancel(bioqueue_t *ioqueue, bioqueue_key_t *key,
+			     struct uring_operation *op)
+{
+    unsigned i, slot_cnt, found = 0;
+
+    bmutex_lock(ioqueue->ring_mutex);
+
+    slot_cnt = ioqueue->cq_mask + 1;
+    for (i=0; i<slot_cnt; ++i) {
+	struct uring_slot *slot = &ioqueue->slots[i];
+	struct io_uring_sqe *sqe;
+
+	if (slot->type == BASE_IOQUEUE_OP_NONE || slot->key != key ||
+	    (op && slot->op != op))
+	{
+	    continue;
+	}
+
+	if (slot->op)
+	    slot->op->base.generic_op.op = BASE_IOQUEUE_OP_NONE;
+#if BASE_HAS_TCP
+	else
+	    key->connecting = 0;
+#endif
+	slot->type = BASE_IOQUEUE_OP_NONE;
+	++found;
+
+	sqe = uring_get_sqe(ioqueue);
+	if (sqe) {
+	    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	    sqe->fd = -1;
+	    sqe->addr = i + 1;
+	    sqe->user_data = 0;
+	    uring_commit_sqe(ioqueue);
+	}
+    }
+
+    /* Buffers of the application must not be touched after we return */
+    if (found)
+	uring_flush(ioqueue);
+
+    bmutex_unlock(ioqueue->ring_mutex);
+    return found;
+}
+
+/*
+ * A stream write left the key: remove it from the write queue and start the
+ * next one, so that the data goes out in order.
+ */
+static void uring_stream_write_done(bioqueue_key_t *key,
+				    struct write_operation *write_op)
+{
+    bbool_t was_first;
+
+    bioqueue_lock_key(key);
+
+    was_first = (key->write_list.next == write_op);
+    blist_erase(write_op);
+
+    while (was_first && !blist_empty(&key->write_list)) {
+	struct write_operation *next = key->write_list.next;
+	bstatus_t rc;
+
+	rc = uring_submit(key, (struct uring_operation*)next, BASE_IOQUEUE_OP_SEND);
+	if (rc == BASE_SUCCESS || rc == BASE_ECANCELLED)
+	    break;
+
+	/* Can not be queued now, fail it and try the following one */
+	blist_erase(next);
+	next->op = BASE_IOQUEUE_OP_NONE;
+	if (key->cb.on_write_complete)
+	    (*key->cb.on_write_complete)(key, (bioqueue_op_key_t*)next, -rc);
+    }
+
+    bioqueue_unlock_key(key);
+}
+
+static void uring_dispatch(struct uring_event *event)
+{
+    bioqueue_key_t *h = event->key;
+    struct uring_operation *op = event->op;
+    bbool_t has_lock = BASE_FALSE;
+
+    if (!h->allow_concurrent) {
+	bioqueue_lock_key(h);
+	has_lock = BASE_TRUE;
+    }
+
+    if (IS_CLOSING(h))
+	goto on_return;
+
+    switch (event->type) {
+    case BASE_IOQUEUE_OP_RECV:
+    case BASE_IOQUEUE_OP_RECV_FROM:
+	{
+	    struct read_operation *read_op = &op->base.read;
+	    bssize_t bytes_read;
+
+	    if (event->res >= 0) {
+		bytes_read = event->res;
+		if (event->type == BASE_IOQUEUE_OP_RECV_FROM && read_op->rmt_addrlen)
+		    *read_op->rmt_addrlen = op->msg.msg_namelen;
+	    } else {
+		bytes_read = -(bssize_t)BASE_STATUS_FROM_OS(-event->res);
+	    }
+
+	    read_op->op = BASE_IOQUEUE_OP_NONE;
+	    if (h->cb.on_read_complete)
+		(*h->cb.on_read_complete)(h, (bioqueue_op_key_t*)op, bytes_read);
+	}
+	break;
+
+    case BASE_IOQUEUE_OP_SEND:
+    case BASE_IOQUEUE_OP_SEND_TO:
+	{
+	    struct write_operation *write_op = &op->base.write;
+
+	    if (event->res >= 0) {
+		write_op->written += event->res;
+
+		/* Partial write of a stream, send the rest first */
+		if (h->fd_type != bSOCK_DGRAM() &&
+		    write_op->written < (bssize_t)write_op->size)
+		{
+		    bstatus_t rc;
+
+		    rc = uring_submit(h, op, BASE_IOQUEUE_OP_SEND);
+		    if (rc == BASE_SUCCESS)
+			break;
+		    write_op->written = -rc;
+		}
+	    } else {
+		write_op->written = -(bssize_t)BASE_STATUS_FROM_OS(-event->res);
+	    }
+
+	    if (h->fd_type != bSOCK_DGRAM())
+		uring_stream_write_done(h, write_op);
+
+	    write_op->op = BASE_IOQUEUE_OP_NONE;
+	    if (h->cb.on_write_complete)
+		(*h->cb.on_write_complete)(h, (bioqueue_op_key_t*)op,
+					   write_op->written);
+	}
+	break;
+
+#if BASE_HAS_TCP
+    case BASE_IOQUEUE_OP_ACCEPT:
+	{
+	    struct accept_operation *accept_op = &op->base.accept;
+	    bstatus_t status = BASE_SUCCESS;
+	    bsock_t sock = BASE_INVALID_SOCKET;
+
+	    if (event->res >= 0) {
+		sock = event->res;
+		*accept_op->accept_fd = sock;
+
+		if (accept_op->local_addr) {
+		    status = bsock_getsockname(sock, accept_op->local_addr,
+					       accept_op->addrlen);
+		}
+	    } else {
+		status = BASE_STATUS_FROM_OS(-event->res);
+	    }
+
+	    accept_op->op = BASE_IOQUEUE_OP_NONE;
+	    if (h->cb.on_accept_complete)
+		(*h->cb.on_accept_complete)(h, (bioqueue_op_key_t*)op, sock, status);
+	}
+	break;
+
+    case BASE_IOQUEUE_OP_CONNECT:
+	h->connecting = 0;
+	if (h->cb.on_connect_complete) {
+	    (*h->cb.on_connect_complete)(h, event->res < 0 ?
+					 BASE_STATUS_FROM_OS(-event->res) :
+					 BASE_SUCCESS);
+	}
+	break;
+#endif
+
+    default:
+	bassert(!"Unexpected operation");
+	break;
+    }
+
+on_return:
+    if (has_lock)
+	bioqueue_unlock_key(h);
+
+#if BASE_IOQUEUE_HAS_SAFE_UNREG
+    decrement_counter(h);
+#endif
+    if (h->grp_lock)
+	bgrp_lock_dec_ref_dbg(h->grp_lock, "ioqueue", 0);
+}
+
+/*
+ * bioqueue_name()
+ */
+const char* bioqueue_name(void)
+{
+    return uring_probe() ? "io_uring" : epoll_ioqueue_name();
+}
+
+/*
+ * bioqueue_create2()
+ *
+ * Create io_uring ioqueue, or epoll ioqueue when io_uring is not available.
+ * The ring is not sharded; shard_cnt only applies to the epoll fallback.
+ */
+bstatus_t bioqueue_create2(bpool_t *pool,
+			   bsize_t max_fd,
+			   const bioqueue_cfg *cfg,
+			   bioqueue_t **p_ioqueue)
+{
+    bioqueue_t *ioqueue;
+    bioqueue_cfg ring_cfg;
+    bstatus_t rc;
+
+    /* Check that size of bioqueue_op_key_t is sufficient */
+    BASE_ASSERT_RETURN(sizeof(bioqueue_op_key_t)-sizeof(void*) >=
+                     sizeof(struct uring_operation), BASE_EBUG);
+
+    if (uring_probe()) {
+	if (cfg && cfg->shard_cnt > 1)
+	    BASE_WARN("io_uring ioqueue has no shards, %u requested", cfg->shard_cnt);
+	bioqueue_cfg_default(&ring_cfg);
+	cfg = &ring_cfg;
+    }
+
+    rc = epoll_ioqueue_create2(pool, max_fd, cfg, &ioqueue);
+    if (rc != BASE_SUCCESS)
+	return rc;
+
+    ioqueue->ring_fd = -1;
+
+    if (uring_probe()) {
+	rc = uring_init(pool, ioqueue, max_fd);
+	if (rc != BASE_SUCCESS) {
+	    char errmsg[BASE_ERR_MSG_SIZE];
+
+	    extStrError(rc, errmsg, sizeof(errmsg));
+	    BASE_WARN("io_uring setup failed (%s), using epoll", errmsg);
+	}
+    }
+
+    *p_ioqueue = ioqueue;
+    return BASE_SUCCESS;
+}
+
+/*
+ * bioqueue_create()
+ */
+bstatus_t bioqueue_create( bpool_t *pool,
+                                       bsize_t max_fd,
+                                       bioqueue_t **p_ioqueue)
+{
+    return bioqueue_create2(pool, max_fd, NULL, p_ioqueue);
+}
+
+/*
+ * bioqueue_destroy()
+ */
+bstatus_t bioqueue_destroy(bioqueue_t *ioqueue)
+{
+    BASE_ASSERT_RETURN(ioqueue, BASE_EINVAL);
+
+    if (IS_URING(ioqueue))
+	uring_deinit(ioqueue);
+
+    return epoll_ioqueue_destroy(ioqueue);
+}
+
+bstatus_t bioqueue_register_sock2(bpool_t *pool,
+				     bioqueue_t *ioqueue,
+				     bsock_t sock,
+				     bgrp_lock_t *grp_lock,
+				     void *user_data,
+				     const bioqueue_callback *cb,
+                                     bioqueue_key_t **p_key)
+{
+    return epoll_ioqueue_register_sock2(pool, ioqueue, sock, grp_lock,
+					user_data, cb, p_key);
+}
+
+bstatus_t bioqueue_register_sock( bpool_t *pool,
+				      bioqueue_t *ioqueue,
+				      bsock_t sock,
+				      void *user_data,
+				      const bioqueue_callback *cb,
+				      bioqueue_key_t **p_key)
+{
+    return bioqueue_register_sock2(pool, ioqueue, sock, NULL, user_data,
+			             cb, p_key);
+}
+
+/*
+ * bioqueue_unregister()
+ */
+bstatus_t bioqueue_unregister( bioqueue_key_t *key)
+{
+    bstatus_t rc;
+
+    BASE_ASSERT_RETURN(key != NULL, BASE_EINVAL);
+
+    rc = epoll_ioqueue_unregister(key);
+
+    /* The key is closing now and takes no new requests; drop what the
+     * kernel still holds for it. The key lock may be gone with the group
+     * lock, but nothing else touches the write queue of a closing key.
+     */
+    if (IS_URING(key->ioqueue)) {
+	struct write_operation *write_op;
+
+	uring_cancel(key->ioqueue, key, NULL);
+
+	for (write_op = key->write_list.next; write_op != &key->write_list;
+	     write_op = write_op->next)
+	{
+	    write_op->op = BASE_IOQUEUE_OP_NONE;
+	}
+	blist_init(&key->write_list);
+    }
+
+    return rc;
+}
+
+/*
+ * bioqueue_poll()
+ */
+int bioqueue_poll( bioqueue_t *ioqueue, const btime_val *timeout)
+{
+    enum { MAX_EVENTS = BASE_IOQUEUE_MAX_CAND_EVENTS };
+    struct uring_event events[MAX_EVENTS];
+    int i, count;
+
+    if (!IS_URING(ioqueue))
+	return epoll_ioqueue_poll(ioqueue, timeout);
+
+    BASE_CHECK_STACK();
+
+    count = uring_reap(ioqueue, events, MAX_EVENTS);
+    if (count == 0) {
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned to_submit;
+	int msec, rc;
+
+	msec = timeout ? BASE_TIME_VAL_MSEC(*timeout) : 9000;
+	ts.tv_sec = msec / 1000;
+	ts.tv_nsec = (msec % 1000) * 1000000;
+
+	bbzero(&arg, sizeof(arg));
+	arg.sigmask_sz = _NSIG / 8;
+	arg.ts = (unsigned long)&ts;
+
+	/* Queued requests are entered together with the wait */
+	bmutex_lock(ioqueue->ring_mutex);
+	to_submit = ioqueue->sq_pending;
+	ioqueue->sq_pending = 0;
+	bmutex_unlock(ioqueue->ring_mutex);
+
+	rc = uring_sys_enter(ioqueue->ring_fd, to_submit, 1,
+			     IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+			     &arg, sizeof(arg));
+	if (rc < 0 || (unsigned)rc < to_submit) {
+	    bmutex_lock(ioqueue->ring_mutex);
+	    ioqueue->sq_pending += to_submit - (rc < 0 ? 0 : rc);
+	    bmutex_unlock(ioqueue->ring_mutex);
+
+	    if (rc < 0 && errno != ETIME && errno != EINTR && errno != EBUSY) {
+		MTRACE("io_uring_enter error");
+		return -bget_netos_error();
+	    }
+	}
+
+	count = uring_reap(ioqueue, events, MAX_EVENTS);
+    }
+
+    if (count == 0) {
+#if BASE_IOQUEUE_HAS_SAFE_UNREG
+	if (!blist_empty(&ioqueue->closing_list)) {
+	    block_acquire(ioqueue->lock);
+	    scan_closing_keys(ioqueue);
+	    block_release(ioqueue->lock);
+	}
+#endif
+	return 0;
+    }
+
+    for (i=0; i<count; ++i)
+	uring_dispatch(&events[i]);
+
+    uring_end_dispatch(ioqueue);
+
+    return count;
+}
+
+/*
+ * bioqueue_recv()
+ */
+bstatus_t bioqueue_recv(  bioqueue_key_t *key,
+                                      bioqueue_op_key_t *op_key,
+				      void *buffer,
+				      bssize_t *length,
+				      unsigned flags )
+{
+    struct uring_operation *op;
+    bstatus_t rc;
+
+    BASE_ASSERT_RETURN(key && op_key && buffer && length, BASE_EINVAL);
+
+    if (!IS_URING(key->ioqueue))
+	return epoll_ioqueue_recv(key, op_key, buffer, length, flags);
+
+    if (IS_CLOSING(key))
+	return BASE_ECANCELLED;
+
+    op = (struct uring_operation*)op_key;
+    if (op->base.read.op != BASE_IOQUEUE_OP_NONE)
+	return BASE_EBUSY;
+
+    op->base.read.op = BASE_IOQUEUE_OP_RECV;
+    op->base.read.buf = buffer;
+    op->base.read.size = *length;
+    op->base.read.flags = flags & ~(BASE_IOQUEUE_ALWAYS_ASYNC);
+
+    rc = uring_submit(key, op, BASE_IOQUEUE_OP_RECV);
+    if (rc != BASE_SUCCESS) {
+	op->base.read.op = BASE_IOQUEUE_OP_NONE;
+	return rc;
+    }
+
+    return BASE_EPENDING;
+}
+
+/*
+ * bioqueue_recvfrom()
+ */
+bstatus_t bioqueue_recvfrom( bioqueue_key_t *key,
+                                         bioqueue_op_key_t *op_key,
+				         void *buffer,
+				         bssize_t *length,
+                                         unsigned flags,
+				         bsockaddr_t *addr,
+				         int *addrlen)
+{
+    struct uring_operation *op;
+    bstatus_t rc;
+
+    BASE_ASSERT_RETURN(key && op_key && buffer && length, BASE_EINVAL);
+
+    if (!IS_URING(key->ioqueue)) {
+	return epoll_ioqueue_recvfrom(key, op_key, buffer, length, flags,
+				      addr, addrlen);
+    }
+
+    if (IS_CLOSING(key))
+	return BASE_ECANCELLED;
+
+    op = (struct uring_operation*)op_key;
+    if (op->base.read.op != BASE_IOQUEUE_OP_NONE)
+	return BASE_EBUSY;
+
+    op->base.read.op = BASE_IOQUEUE_OP_RECV_FROM;
+    op->base.read.buf = buffer;
+    op->base.read.size = *length;
+    op->base.read.flags = flags & ~(BASE_IOQUEUE_ALWAYS_ASYNC);
+    op->base.read.rmt_addr = addr;
+    op->base.read.rmt_addrlen = addrlen;
+
+    bbzero(&op->msg, sizeof(op->msg));
+    op->iov.iov_base = buffer;
+    op->iov.iov_len = *length;
+    op->msg.msg_name = addr;
+    op->msg.msg_namelen = (addr && addrlen) ? *addrlen : 0;
+    op->msg.msg_iov = &op->iov;
+    op->msg.msg_iovlen = 1;
+
+    rc = uring_submit(key, op, BASE_IOQUEUE_OP_RECV_FROM);
+    if (rc != BASE_SUCCESS) {
+	op->base.read.op = BASE_IOQUEUE_OP_NONE;
+	return rc;
+    }
+
+    return BASE_EPENDING;
+}
+
+/*
+ * bioqueue_send()
+ *
+ * Data is sent right away when nothing is queued on the key; only what the
+ * socket can not take now goes through the ring.
+ */
+bstatus_t bioqueue_send( bioqueue_key_t *key,
+                                     bioqueue_op_key_t *op_key,
+			             const void *data,
+			             bssize_t *length,
+                                     unsigned flags)
+{
+    struct uring_operation *op;
+    struct write_operation *write_op;
+    bstatus_t status;
+    unsigned retry;
+    bssize_t sent;
+
+    BASE_ASSERT_RETURN(key && op_key && data && length, BASE_EINVAL);
+
+    if (!IS_URING(key->ioqueue))
+	return epoll_ioqueue_send(key, op_key, data, length, flags);
+
+    BASE_CHECK_STACK();
+
+    if (IS_CLOSING(key))
+	return BASE_ECANCELLED;
+
+    /* We can not use BASE_IOQUEUE_ALWAYS_ASYNC for socket write. */
+    flags &= ~(BASE_IOQUEUE_ALWAYS_ASYNC);
+
+    /* Fast track, see the note in the common implementation */
+    if (blist_empty(&key->write_list)) {
+        sent = *length;
+        status = bsock_send(key->fd, data, &sent, flags);
+        if (status == BASE_SUCCESS) {
+            *length = sent;
+            return BASE_SUCCESS;
+        } else if (status != BASE_STATUS_FROM_OS(BASE_BLOCKING_ERROR_VAL)) {
+            return status;
+        }
+    }
+
+    op = (struct uring_operation*)op_key;
+    write_op = &op->base.write;
+
+    /* Spin if write_op has pending operation */
+    for (retry=0; write_op->op != 0 && retry<PENDING_RETRY; ++retry)
+	bthreadSleepMs(0);
+
+    if (write_op->op)
+	return BASE_EBUSY;
+
+    write_op->op = BASE_IOQUEUE_OP_SEND;
+    write_op->buf = (char*)data;
+    write_op->iov = NULL;
+    write_op->size = *length;
+    write_op->written = 0;
+    write_op->flags = flags;
+
+    if (key->fd_type == bSOCK_DGRAM()) {
+	status = uring_submit(key, op, BASE_IOQUEUE_OP_SEND);
+    } else {
+	/* One write of a stream in flight at a time, the others wait in
+	 * write_list for their turn.
+	 */
+	bioqueue_lock_key(key);
+	if (IS_CLOSING(key)) {
+	    status = BASE_ECANCELLED;
+	} else {
+	    blist_push_back(&key->write_list, write_op);
+	    status = BASE_SUCCESS;
+	    if (key->write_list.next == write_op) {
+		status = uring_submit(key, op, BASE_IOQUEUE_OP_SEND);
+		if (status != BASE_SUCCESS)
+		    blist_erase(write_op);
+	    }
+	}
+	bioqueue_unlock_key(key);
+    }
+
+    if (status != BASE_SUCCESS) {
+	write_op->op = BASE_IOQUEUE_OP_NONE;
+	return status;
+    }
+
+    return BASE_EPENDING;
+}
+
+/*
+ * bioqueue_sendv()
+ *
+ * As bioqueue_send(): what the socket does not take right away is sent
+ * with IORING_OP_SENDMSG over the vectors.
+ */
+bstatus_t bioqueue_sendv( bioqueue_key_t *key,
+                                      bioqueue_op_key_t *op_key,
+				      const bsock_iovec *iov,
+				      unsigned count,
+				      bssize_t *length,
+                                      unsigned flags)
+{
+    struct uring_operation *op;
+    struct write_operation *write_op;
+    bstatus_t status;
+    unsigned i, retry;
+    bsize_t total = 0;
+    bssize_t sent = 0;
+
+    BASE_ASSERT_RETURN(key && op_key && iov && count && length, BASE_EINVAL);
+    BASE_ASSERT_RETURN(count <= BASE_SOCK_MAX_IOV, BASE_ETOOMANY);
+
+    if (!IS_URING(key->ioqueue))
+	return epoll_ioqueue_sendv(key, op_key, iov, count, length, flags);
+
+    BASE_CHECK_STACK();
+
+    if (IS_CLOSING(key))
+	return BASE_ECANCELLED;
+
+    /* We can not use BASE_IOQUEUE_ALWAYS_ASYNC for socket write. */
+    flags &= ~(BASE_IOQUEUE_ALWAYS_ASYNC);
+
+    for (i=0; i<count; ++i)
+	total += iov[i].len;
+
+    op = (struct uring_operation*)op_key;
+    write_op = &op->base.write;
+
+    /* The rest of a partial write goes with this key, it must be free */
+    for (retry=0; write_op->op != 0 && retry<PENDING_RETRY; ++retry)
+	bthreadSleepMs(0);
+
+    if (write_op->op)
+	return BASE_EBUSY;
+
+    /* Fast track, see the note in the common implementation */
+    if (blist_empty(&key->write_list)) {
+        status = bsock_sendv(key->fd, iov, count, &sent, flags);
+        if (status == BASE_SUCCESS) {
+	    if (sent == (bssize_t)total || key->fd_type == bSOCK_DGRAM()) {
+		*length = sent;
+		return BASE_SUCCESS;
+	    }
+        } else if (status != BASE_STATUS_FROM_OS(BASE_BLOCKING_ERROR_VAL)) {
+            return status;
+        } else {
+	    sent = 0;
+	}
+    }
+
+    write_op->op = BASE_IOQUEUE_OP_SEND;
+    write_op->buf = NULL;
+    write_op->iov = iov;
+    write_op->iov_cnt = count;
+    write_op->size = total;
+    write_op->written = sent;
+    write_op->flags = flags;
+
+    if (key->fd_type == bSOCK_DGRAM()) {
+	status = uring_submit(key, op, BASE_IOQUEUE_OP_SEND);
+    } else {
+	/* In order with the other writes of the stream, see bioqueue_send() */
+	bioqueue_lock_key(key);
+	if (IS_CLOSING(key)) {
+	    status = BASE_ECANCELLED;
+	} else {
+	    blist_push_back(&key->write_list, write_op);
+	    status = BASE_SUCCESS;
+	    if (key->write_list.next == write_op) {
+		status = uring_submit(key, op, BASE_IOQUEUE_OP_SEND);
+		if (status != BASE_SUCCESS)
+		    blist_erase(write_op);
+	    }
+	}
+	bioqueue_unlock_key(key);
+    }
+
+    if (status != BASE_SUCCESS) {
+	write_op->op = BASE_IOQUEUE_OP_NONE;
+	return status;
+    }
+
+    return BASE_EPENDING;
+}
+
+/*
+ * uring_queue_sendto()
+ * Hand a sendto() which could not complete right away to the ring.
+ */
+static bstatus_t uring_queue_sendto( bioqueue_key_t *key,
+                                     bioqueue_op_key_t *op_key,
+                                     const void *data,
+                                     bssize_t length,
+                                     buint32_t flags,
+                                     const bsockaddr_t *addr,
+                                     int addrlen)
+{
+    struct uring_operation *op;
+    struct write_operation *write_op;
+    bstatus_t status;
+    unsigned retry;
+
+    op = (struct uring_operation*)op_key;
+    write_op = &op->base.write;
+
+    /* Spin if write_op has pending operation */
+    for (retry=0; write_op->op != 0 && retry<PENDING_RETRY; ++retry)
+	bthreadSleepMs(0);
+
+    if (write_op->op)
+	return BASE_EBUSY;
+
+    /* Check that address storage can hold the address parameter. */
+    BASE_ASSERT_RETURN(addrlen <= (int)sizeof(bsockaddr_in), BASE_EBUG);
+
+    write_op->op = BASE_IOQUEUE_OP_SEND_TO;
+    write_op->buf = (char*)data;
+    write_op->iov = NULL;
+    write_op->size = length;
+    write_op->written = 0;
+    write_op->flags = flags;
+    bmemcpy(&write_op->rmt_addr, addr, addrlen);
+    write_op->rmt_addrlen = addrlen;
+
+    bbzero(&op->msg, sizeof(op->msg));
+    op->iov.iov_base = write_op->buf;
+    op->iov.iov_len = write_op->size;
+    op->msg.msg_name = &write_op->rmt_addr;
+    op->msg.msg_namelen = addrlen;
+    op->msg.msg_iov = &op->iov;
+    op->msg.msg_iovlen = 1;
+
+    status = uring_submit(key, op, BASE_IOQUEUE_OP_SEND_TO);
+    if (status != BASE_SUCCESS) {
+	write_op->op = BASE_IOQUEUE_OP_NONE;
+	return status;
+    }
+
+    return BASE_EPENDING;
+}
+
+/*
+ * bioqueue_sendto()
+ */
+bstatus_t bioqueue_sendto( bioqueue_key_t *key,
+                                       bioqueue_op_key_t *op_key,
+			               const void *data,
+			               bssize_t *length,
+                                       buint32_t flags,
+			               const bsockaddr_t *addr,
+			               int addrlen)
+{
+    bstatus_t status;
+    bssize_t sent;
+
+    BASE_ASSERT_RETURN(key && op_key && data && length, BASE_EINVAL);
+
+    if (!IS_URING(key->ioqueue)) {
+	return epoll_ioqueue_sendto(key, op_key, data, length, flags,
+				    addr, addrlen);
+    }
+
+    BASE_CHECK_STACK();
+
+    if (IS_CLOSING(key))
+	return BASE_ECANCELLED;
+
+    /* We can not use BASE_IOQUEUE_ALWAYS_ASYNC for socket write */
+    flags &= ~(BASE_IOQUEUE_ALWAYS_ASYNC);
+
+    /* Datagrams have no ordering to keep, try to send right away */
+    sent = *length;
+    status = bsock_sendto(key->fd, data, &sent, flags, addr, addrlen);
+    if (status == BASE_SUCCESS) {
+	*length = sent;
+	return BASE_SUCCESS;
+    } else if (status != BASE_STATUS_FROM_OS(BASE_BLOCKING_ERROR_VAL)) {
+	return status;
+    }
+
+    return uring_queue_sendto(key, op_key, data, *length, flags,
+			      addr, addrlen);
+}
+
+/*
+ * bioqueue_recvfrom_batch()
+ *
+ * The receives are handed to the kernel with the other submissions of
+ * the poll in one io_uring_enter(), there is nothing more to batch.
+ */
+bstatus_t bioqueue_recvfrom_batch( bioqueue_key_t *key,
+                                   bioqueue_op_key_t *op_key[],
+                                   void *buffer[],
+                                   const bssize_t length[],
+                                   unsigned count,
+                                   buint32_t flags,
+                                   bsockaddr_t *addr[],
+                                   int *addrlen[])
+{
+    unsigned i;
+
+    BASE_ASSERT_RETURN(key && op_key && buffer && length && count,
+		       BASE_EINVAL);
+    BASE_ASSERT_RETURN(!addr || addrlen, BASE_EINVAL);
+
+    if (!IS_URING(key->ioqueue)) {
+	return epoll_ioqueue_recvfrom_batch(key, op_key, buffer, length,
+					    count, flags, addr, addrlen);
+    }
+
+    for (i=0; i<count; ++i) {
+	bssize_t size = length[i];
+	bstatus_t rc;
+
+	rc = bioqueue_recvfrom(key, op_key[i], buffer[i], &size, flags,
+			       addr ? addr[i] : NULL,
+			       addr ? addrlen[i] : NULL);
+	if (rc != BASE_EPENDING)
+	    return rc;
+    }
+
+    return BASE_EPENDING;
+}
+
+/*
+ * bioqueue_sendto_batch()
+ */
+bstatus_t bioqueue_sendto_batch( bioqueue_key_t *key,
+                                 bioqueue_op_key_t *op_key[],
+                                 const void *data[],
+                                 bssize_t length[],
+                                 unsigned count,
+                                 buint32_t flags,
+                                 const bsockaddr_t *addr[],
+                                 const int addrlen[],
+                                 unsigned *sent_cnt)
+{
+    unsigned i;
+
+    BASE_ASSERT_RETURN(key && op_key && data && length && count && addr &&
+		       addrlen && sent_cnt, BASE_EINVAL);
+
+    if (!IS_URING(key->ioqueue)) {
+	return epoll_ioqueue_sendto_batch(key, op_key, data, length, count,
+					  flags, addr, addrlen, sent_cnt);
+    }
+
+    *sent_cnt = 0;
+
+    for (i=0; i<count; ++i) {
+	bstatus_t rc;
+
+	rc = bioqueue_sendto(key, op_key[i], data[i], &length[i], flags,
+			     addr[i], addrlen[i]);
+	if (rc == BASE_EPENDING)
+	    break;
+	if (rc != BASE_SUCCESS)
+	    return rc;
+	++*sent_cnt;
+    }
+
+    if (i == count)
+	return BASE_SUCCESS;
+
+    /* The rest goes behind the one which is pending */
+    for (++i; i<count; ++i) {
+	bstatus_t rc;
+
+	rc = uring_queue_sendto(key, op_key[i], data[i], length[i],
+				flags & ~(BASE_IOQUEUE_ALWAYS_ASYNC),
+				addr[i], addrlen[i]);
+	if (rc != BASE_EPENDING)
+	    return rc;
+    }
+
+    return BASE_EPENDING;
+}
+
+#if BASE_HAS_TCP
+/*
+ * bioqueue_accept()
+ */
+bstatus_t bioqueue_accept( bioqueue_key_t *key,
+                                       bioqueue_op_key_t *op_key,
+			               bsock_t *new_sock,
+			               bsockaddr_t *local,
+			               bsockaddr_t *remote,
+			               int *addrlen)
+{
+    struct uring_operation *op;
+    struct accept_operation *accept_op;
+    bstatus_t rc;
+
+    BASE_ASSERT_RETURN(key && op_key && new_sock, BASE_EINVAL);
+
+    if (!IS_URING(key->ioqueue)) {
+	return epoll_ioqueue_accept(key, op_key, new_sock, local, remote,
+				    addrlen);
+    }
+
+    if (IS_CLOSING(key))
+	return BASE_ECANCELLED;
+
+    op = (struct uring_operation*)op_key;
+    accept_op = &op->base.accept;
+    if (accept_op->op != BASE_IOQUEUE_OP_NONE)
+	return BASE_EBUSY;
+
+    accept_op->op = BASE_IOQUEUE_OP_ACCEPT;
+    accept_op->accept_fd = new_sock;
+    accept_op->rmt_addr = remote;
+    accept_op->addrlen = addrlen;
+    accept_op->local_addr = local;
+
+    rc = uring_submit(key, op, BASE_IOQUEUE_OP_ACCEPT);
+    if (rc != BASE_SUCCESS) {
+	accept_op->op = BASE_IOQUEUE_OP_NONE;
+	return rc;
+    }
+
+    return BASE_EPENDING;
+}
+
+/*
+ * bioqueue_connect()
+ */
+bstatus_t bioqueue_connect( bioqueue_key_t *key,
+					const bsockaddr_t *addr,
+					int addrlen )
+{
+    bstatus_t rc;
+
+    BASE_ASSERT_RETURN(key && addr && addrlen, BASE_EINVAL);
+
+    if (!IS_URING(key->ioqueue))
+	return epoll_ioqueue_connect(key, addr, addrlen);
+
+    if (IS_CLOSING(key))
+	return BASE_ECANCELLED;
+
+    /* Check if socket has not been marked for connecting */
+    if (key->connecting != 0)
+        return BASE_EPENDING;
+
+    BASE_ASSERT_RETURN(addrlen <= (int)sizeof(bsockaddr), BASE_EINVAL);
+
+    bmemcpy(&key->connect_addr, addr, addrlen);
+    key->connect_addrlen = addrlen;
+    key->connecting = 1;
+
+    rc = uring_submit(key, NULL, BASE_IOQUEUE_OP_CONNECT);
+    if (rc != BASE_SUCCESS) {
+	key->connecting = 0;
+	return rc;
+    }
+
+    return BASE_EPENDING;
+}
+#endif	/* BASE_HAS_TCP */
+
+/*
+ * bioqueue_post_completion()
+ */
+bstatus_t bioqueue_post_completion( bioqueue_key_t *key,
+                                                bioqueue_op_key_t *op_key,
+                                                bssize_t bytes_status )
+{
+    struct uring_operation *op = (struct uring_operation*)op_key;
+    bioqueue_operation_e type;
+
+    BASE_ASSERT_RETURN(key && op_key, BASE_EINVAL);
+
+    if (!IS_URING(key->ioqueue))
+	return epoll_ioqueue_post_completion(key, op_key, bytes_status);
+
+    type = op->base.generic_op.op;
+
+    if (!uring_cancel(key->ioqueue, key, op)) {
+	/* Not in the ring, it can still wait in the write queue */
+	bbool_t queued = BASE_FALSE;
+
+	if (type == BASE_IOQUEUE_OP_SEND) {
+	    struct write_operation *write_op;
+
+	    bioqueue_lock_key(key);
+	    for (write_op = key->write_list.next; write_op != &key->write_list;
+		 write_op = write_op->next)
+	    {
+		if (write_op == &op->base.write) {
+		    blist_erase(write_op);
+		    write_op->op = BASE_IOQUEUE_OP_NONE;
+		    queued = BASE_TRUE;
+		    break;
+		}
+	    }
+	    bioqueue_unlock_key(key);
+	}
+
+	if (!queued)
+	    return BASE_EINVALIDOP;
+
+    } else if (type == BASE_IOQUEUE_OP_SEND &&
+	       key->fd_type != bSOCK_DGRAM())
+    {
+	uring_stream_write_done(key, &op->base.write);
+    }
+
+    switch (type) {
+    case BASE_IOQUEUE_OP_RECV:
+    case BASE_IOQUEUE_OP_RECV_FROM:
+	if (key->cb.on_read_complete)
+	    (*key->cb.on_read_complete)(key, op_key, bytes_status);
+	break;
+    case BASE_IOQUEUE_OP_SEND:
+    case BASE_IOQUEUE_OP_SEND_TO:
+	if (key->cb.on_write_complete)
+	    (*key->cb.on_write_complete)(key, op_key, bytes_status);
+	break;
+#if BASE_HAS_TCP
+    case BASE_IOQUEUE_OP_ACCEPT:
+	if (key->cb.on_accept_complete)
+	    (*key->cb.on_accept_complete)(key, op_key, BASE_INVALID_SOCKET,
+					  (bstatus_t)bytes_status);
+	break;
+#endif
+    default:
+	break;
+    }
+
+    return BASE_SUCCESS;
+}
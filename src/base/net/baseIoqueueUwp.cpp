@@ -1,7 +1,7 @@
 /* 
  *
  */
-#include <baseIoQueue.h>
+#include <baseIoqueue.h>
 #include <baseErrno.h>
 #include <baseLock.h>
 #include <baseLog.h>
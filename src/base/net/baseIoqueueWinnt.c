@@ -1,7 +1,7 @@
 /* 
  *
  */
-#include <baseIoQueue.h>
+#include <baseIoqueue.h>
 #include <baseOs.h>
 #include <baseLock.h>
 #include <basePool.h>
@@ -46,6 +46,7 @@ typedef struct ioqueue_overlapped
     WSABUF		   wsabuf;
     bsockaddr_in         dummy_addr;
     int                    dummy_addrlen;
+    bssize_t		   sent;	/* By sendv() before the overlapped send */
 } ioqueue_overlapped;
 
 #if BASE_HAS_TCP
@@ -391,6 +392,30 @@ bstatus_t bioqueue_create( bpool_t *pool,
     return BASE_SUCCESS;
 }
 
+/*
+ * bioqueue_cfg_default()
+ */
+void bioqueue_cfg_default(bioqueue_cfg *cfg)
+{
+    bbzero(cfg, sizeof(*cfg));
+    cfg->shard_cnt = 1;
+}
+
+/*
+ * bioqueue_create2()
+ *
+ * The completion port is shared by all threads already, shard_cnt is
+ * ignored.
+ */
+bstatus_t bioqueue_create2( bpool_t *pool,
+				       bsize_t max_fd,
+				       const bioqueue_cfg *cfg,
+				       bioqueue_t **p_ioqueue)
+{
+    BASE_UNUSED_ARG(cfg);
+    return bioqueue_create(pool, max_fd, p_ioqueue);
+}
+
 /*
  * bioqueue_destroy()
  */
@@ -696,6 +721,8 @@ static bbool_t poll_iocp( HANDLE hIocp, DWORD dwTimeout,
 	case BASE_IOQUEUE_OP_SEND:
 	case BASE_IOQUEUE_OP_SEND_TO:
             pOv->operation = 0;
+	    if (size_status >= 0)
+		size_status += ((ioqueue_overlapped*)pOv)->sent;
             if (key->cb.on_write_complete)
 	        key->cb.on_write_complete(key, (bioqueue_op_key_t*)pOv, 
                                                 size_status);
@@ -1128,6 +1155,7 @@ bstatus_t bioqueue_sendto( bioqueue_key_t *key,
      */
     op_key_rec->overlapped.wsabuf.buf = (void*)data;
     op_key_rec->overlapped.wsabuf.len = *length;
+    op_key_rec->overlapped.sent = 0;
 
     dwFlags = flags;
 
@@ -1170,6 +1198,176 @@ bstatus_t bioqueue_sendto( bioqueue_key_t *key,
     return BASE_EPENDING;
 }
 
+/*
+ * bioqueue_sendv()
+ *
+ * Initiate overlapped Send operation of several buffers. WSASend() takes
+ * its own copy of the WSABUF array, only the buffers must stay.
+ */
+bstatus_t bioqueue_sendv(  bioqueue_key_t *key,
+                                      bioqueue_op_key_t *op_key,
+				      const bsock_iovec *iov,
+				      unsigned count,
+				      bssize_t *length,
+				      buint32_t flags )
+{
+    WSABUF bufs[BASE_SOCK_MAX_IOV];
+    WSABUF *rest = bufs;
+    DWORD bytesWritten = 0;
+    DWORD dwFlags;
+    bsize_t total = 0, skip;
+    unsigned i;
+    int rc;
+    union operation_key *op_key_rec;
+
+    BASE_CHECK_STACK();
+    BASE_ASSERT_RETURN(key && op_key && iov && count && length, BASE_EINVAL);
+    BASE_ASSERT_RETURN(count <= BASE_SOCK_MAX_IOV, BASE_ETOOMANY);
+
+#if BASE_IOQUEUE_HAS_SAFE_UNREG
+    /* Check key is not closing */
+    if (key->closing)
+	return BASE_ECANCELLED;
+#endif
+
+    op_key_rec = (union operation_key*)op_key->internal__;
+
+    for (i=0; i<count; ++i) {
+	bufs[i].buf = (char*)iov[i].base;
+	bufs[i].len = (ULONG)iov[i].len;
+	total += iov[i].len;
+    }
+
+    dwFlags = flags & ~(BASE_IOQUEUE_ALWAYS_ASYNC);
+
+    /*
+     * First try blocking write.
+     */
+    if ((flags & BASE_IOQUEUE_ALWAYS_ASYNC) == 0) {
+	rc = WSASend((SOCKET)key->hnd, bufs, count, &bytesWritten, dwFlags,
+		     NULL, NULL);
+	if (rc == 0) {
+	    if (bytesWritten == total) {
+		*length = bytesWritten;
+		return BASE_SUCCESS;
+	    }
+	} else {
+	    DWORD dwStatus = WSAGetLastError();
+	    if (dwStatus != WSAEWOULDBLOCK) {
+		*length = -1;
+		return BASE_RETURN_OS_ERROR(dwStatus);
+	    }
+	    bytesWritten = 0;
+	}
+    }
+
+    /* Skip what has been sent, the rest may start inside a buffer */
+    skip = bytesWritten;
+    while (count > 1 && skip >= rest->len) {
+	skip -= rest->len;
+	++rest;
+	--count;
+    }
+    rest->buf += skip;
+    rest->len -= (ULONG)skip;
+
+    /*
+     * Schedule asynchronous WSASend() of the rest.
+     */
+    bbzero( &op_key_rec->overlapped.overlapped, 
+              sizeof(op_key_rec->overlapped.overlapped));
+    op_key_rec->overlapped.operation = BASE_IOQUEUE_OP_SEND;
+    op_key_rec->overlapped.sent = bytesWritten;
+
+    rc = WSASend((SOCKET)key->hnd, rest, count, &bytesWritten, dwFlags,
+		 &op_key_rec->overlapped.overlapped, NULL);
+    if (rc == SOCKET_ERROR) {
+	DWORD dwStatus = WSAGetLastError();
+        if (dwStatus!=WSA_IO_PENDING)
+            return BASE_STATUS_FROM_OS(dwStatus);
+    }
+
+    /* Asynchronous operation successfully submitted. */
+    return BASE_EPENDING;
+}
+
+/*
+ * bioqueue_recvfrom_batch()
+ *
+ * Overlapped operations are already handed to the kernel together, post
+ * one WSARecvFrom() for each operation.
+ */
+bstatus_t bioqueue_recvfrom_batch( bioqueue_key_t *key,
+                                   bioqueue_op_key_t *op_key[],
+                                   void *buffer[],
+                                   const bssize_t length[],
+                                   unsigned count,
+                                   buint32_t flags,
+                                   bsockaddr_t *addr[],
+                                   int *addrlen[])
+{
+    unsigned i;
+
+    BASE_ASSERT_RETURN(key && op_key && buffer && length && count,
+		       BASE_EINVAL);
+    BASE_ASSERT_RETURN(!addr || addrlen, BASE_EINVAL);
+
+    for (i=0; i<count; ++i) {
+	bssize_t size = length[i];
+	bstatus_t rc;
+
+	rc = bioqueue_recvfrom(key, op_key[i], buffer[i], &size,
+			       flags | BASE_IOQUEUE_ALWAYS_ASYNC,
+			       addr ? addr[i] : NULL,
+			       addr ? addrlen[i] : NULL);
+	if (rc != BASE_EPENDING)
+	    return rc;
+    }
+
+    return BASE_EPENDING;
+}
+
+/*
+ * bioqueue_sendto_batch()
+ */
+bstatus_t bioqueue_sendto_batch( bioqueue_key_t *key,
+                                 bioqueue_op_key_t *op_key[],
+                                 const void *data[],
+                                 bssize_t length[],
+                                 unsigned count,
+                                 buint32_t flags,
+                                 const bsockaddr_t *addr[],
+                                 const int addrlen[],
+                                 unsigned *sent_cnt)
+{
+    bstatus_t status = BASE_SUCCESS;
+    unsigned i;
+
+    BASE_ASSERT_RETURN(key && op_key && data && length && count && addr &&
+		       addrlen && sent_cnt, BASE_EINVAL);
+
+    *sent_cnt = 0;
+
+    for (i=0; i<count; ++i) {
+	bstatus_t rc;
+
+	/* Once one datagram is pending, the rest queue behind it */
+	rc = bioqueue_sendto(key, op_key[i], data[i], &length[i],
+			     (status == BASE_EPENDING) ?
+				flags | BASE_IOQUEUE_ALWAYS_ASYNC : flags,
+			     addr[i], addrlen[i]);
+	if (rc == BASE_SUCCESS) {
+	    ++*sent_cnt;
+	} else if (rc == BASE_EPENDING) {
+	    status = BASE_EPENDING;
+	} else {
+	    return rc;
+	}
+    }
+
+    return status;
+}
+
 #if BASE_HAS_TCP
 
 /*
@@ -702,6 +702,67 @@ bstatus_t bsock_sendto(bsock_t sock,
 	return BASE_SUCCESS;
 }
 
+#if !(defined(BASE_WIN32) && BASE_WIN32!=0) && !(defined(BASE_WIN64) && BASE_WIN64!=0)
+/* bsock_iovec is given to the kernel as struct iovec */
+typedef char bsock_iovec_layout_check[(sizeof(bsock_iovec)==sizeof(struct iovec) &&
+    offsetof(bsock_iovec, len)==offsetof(struct iovec, iov_len)) ? 1 : -1];
+#endif
+
+/*
+ * Send data from several buffers.
+ */
+bstatus_t bsock_sendv(bsock_t sock,
+				  const bsock_iovec iov[],
+				  unsigned count,
+				  bssize_t *len,
+				  unsigned flags)
+{
+#if (defined(BASE_WIN32) && BASE_WIN32!=0) || (defined(BASE_WIN64) && BASE_WIN64!=0)
+    WSABUF bufs[BASE_SOCK_MAX_IOV];
+    DWORD sent;
+    unsigned i;
+
+    BASE_CHECK_STACK();
+    BASE_ASSERT_RETURN(iov && count && len, BASE_EINVAL);
+    BASE_ASSERT_RETURN(count <= BASE_SOCK_MAX_IOV, BASE_ETOOMANY);
+
+    for (i=0; i<count; ++i) {
+	bufs[i].buf = (char*)iov[i].base;
+	bufs[i].len = (ULONG)iov[i].len;
+    }
+
+    if (WSASend(sock, bufs, count, &sent, flags, NULL, NULL) != 0) {
+	*len = -1;
+	return BASE_RETURN_OS_ERROR(bget_native_netos_error());
+    }
+
+    *len = sent;
+    return BASE_SUCCESS;
+#else
+    struct msghdr msg;
+
+    BASE_CHECK_STACK();
+    BASE_ASSERT_RETURN(iov && count && len, BASE_EINVAL);
+    BASE_ASSERT_RETURN(count <= BASE_SOCK_MAX_IOV, BASE_ETOOMANY);
+
+#ifdef MSG_NOSIGNAL
+    /* Suppress SIGPIPE, as bsock_send() */
+    flags |= MSG_NOSIGNAL;
+#endif
+
+    bbzero(&msg, sizeof(msg));
+    msg.msg_iov = (struct iovec*)iov;
+    msg.msg_iovlen = count;
+
+    *len = sendmsg(sock, &msg, flags);
+
+    if (*len < 0)
+	return BASE_RETURN_OS_ERROR(bget_native_netos_error());
+    else
+	return BASE_SUCCESS;
+#endif
+}
+
 /*
  * Receive data.
  */
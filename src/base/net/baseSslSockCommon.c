@@ -36,6 +36,7 @@ void bssl_sock_param_default(bssl_sock_param *param)
 
     /* Security config */
     param->proto = BASE_SSL_SOCK_PROTO_DEFAULT;
+    param->session_cache = BASE_TRUE;
 }
 
 
@@ -30,8 +30,8 @@
 
 #define SSL_SOCK_IMP_USE_CIRC_BUF
 
-#include "ssl_sock_imp_common.h"
-#include "ssl_sock_imp_common.c"
+#include "baseSslSockImpCommon.h"
+#include "baseSslSockImpCommon.c"
 
 /* Maximum ciphers */
 #define MAX_CIPHERS             100
@@ -111,11 +111,7 @@ static OSStatus SocketRead(SSLConnectionRef connection,
     bssl_sock_t *ssock = (bssl_sock_t *)connection;
     bsize_t len = *dataLength;
 
-    block_acquire(ssock->circ_buf_input_mutex);
-
     if (circ_empty(&ssock->circ_buf_input)) {
-        block_release(ssock->circ_buf_input_mutex);
-
         /* Data buffers not yet filled */
         *dataLength = 0;
 	return errSSLWouldBlock;
@@ -126,8 +122,6 @@ static OSStatus SocketRead(SSLConnectionRef connection,
 
     circ_read(&ssock->circ_buf_input, data, read_size);
 
-    block_release(ssock->circ_buf_input_mutex);
-
     *dataLength = read_size;
 
     return (read_size < len? errSSLWouldBlock: noErr);
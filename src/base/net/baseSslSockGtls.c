@@ -46,8 +46,8 @@
 
 #define SSL_SOCK_IMP_USE_CIRC_BUF
 
-#include "ssl_sock_imp_common.h"
-#include "ssl_sock_imp_common.c"
+#include "baseSslSockImpCommon.h"
+#include "baseSslSockImpCommon.c"
 
 /* Maximum ciphers */
 #define MAX_CIPHERS             100
@@ -375,23 +375,20 @@ static ssize_t tls_data_pull(gnutls_transport_ptr_t ptr,
 {
     bssl_sock_t *ssock = (bssl_sock_t *)ptr;
     gnutls_sock_t *gssock = (gnutls_sock_t *)ssock;
+    buint8_t *rdata;
+    bsize_t read_size;
 
-    block_acquire(ssock->circ_buf_input_mutex);
-
-    if (circ_empty(&ssock->circ_buf_input)) {
-        block_release(ssock->circ_buf_input_mutex);
-
+    /* Contiguous part only, GnuTLS pulls again for the rest */
+    read_size = circ_read_peek(&ssock->circ_buf_input, &rdata);
+    if (read_size == 0) {
         /* Data buffers not yet filled */
         gnutls_transport_set_errno(gssock->session, EAGAIN);
         return -1;
     }
 
-    bsize_t circ_buf_size = circ_size(&ssock->circ_buf_input);
-    bsize_t read_size = BASE_MIN(circ_buf_size, len);
-
-    circ_read(&ssock->circ_buf_input, data, read_size);
-
-    block_release(ssock->circ_buf_input_mutex);
+    read_size = BASE_MIN(read_size, len);
+    bmemcpy(data, rdata, read_size);
+    circ_read_consume(&ssock->circ_buf_input, read_size);
 
     return read_size;
 }
@@ -21,10 +21,18 @@
 #include <baseErrno.h>
 #include <baseLog.h>
 #include <math.h>
+#include <baseMath.h>
+#include <baseOs.h>
 #include <basePool.h>
 #include <baseString.h>
+#include <baseTimer.h>
 
-#include "ssl_sock_imp_common.h"
+#include "baseSslSockImpCommon.h"
+
+#if defined(BASE_LINUX) && BASE_LINUX!=0
+#   include <stdio.h>
+#   include <sys/sendfile.h>
+#endif
 
 /* Workaround for ticket #985 and #1930 */
 #ifndef BASE_SSL_SOCK_DELAYED_CLOSE_TIMEOUT
@@ -40,130 +48,296 @@ enum { MAX_BIND_RETRY = 100 };
  *******************************************************************
  */
 
+/* Allocate memory of the circular buffer, in its own pool */
+static circ_mem_t *circ_mem_alloc(bpool_factory *factory, bsize_t cap)
+{
+    bpool_t *pool;
+    circ_mem_t *mem;
+
+    pool = bpool_create(factory, "tls-circ%p", cap + sizeof(circ_mem_t) + 64,
+			  512, NULL);
+    if (!pool)
+        return NULL;
+
+    mem = BASE_POOL_ZALLOC_T(pool, circ_mem_t);
+    mem->buf = (buint8_t*)bpool_alloc(pool, cap);
+    if (!mem->buf) {
+        bpool_release(pool);
+        return NULL;
+    }
+    mem->cap = cap;
+    mem->pool = pool;
+
+    return mem;
+}
+
 static bstatus_t circ_init(bpool_factory *factory,
                              circ_buf_t *cb, bsize_t cap)
 {
-    cb->cap    = cap;
-    cb->readp  = 0;
-    cb->writep = 0;
-    cb->size   = 0;
-
-    /* Initial pool holding the buffer elements */
-    cb->pool = bpool_create(factory, "tls-circ%p", cap, cap, NULL);
-    if (!cb->pool)
-        return BASE_ENOMEM;
+    cb->readp   = 0;
+    cb->writep  = 0;
+    cb->factory = factory;
 
-    /* Allocate circular buffer */
-    cb->buf = bpool_alloc(cb->pool, cap);
-    if (!cb->buf) {
-        bpool_release(cb->pool);
+    cb->mem = circ_mem_alloc(factory, cap);
+    if (!cb->mem)
         return BASE_ENOMEM;
-    }
 
     return BASE_SUCCESS;
 }
 
 static void circ_deinit(circ_buf_t *cb)
 {
-    if (cb->pool) {
-        bpool_release(cb->pool);
-        cb->pool = NULL;
+    while (cb->mem) {
+	circ_mem_t *prev = cb->mem->prev;
+
+        bpool_release(cb->mem->pool);
+	cb->mem = prev;
     }
 }
 
+static bsize_t circ_size(const circ_buf_t *cb)
+{
+    return __atomic_load_n(&cb->writep, __ATOMIC_ACQUIRE) -
+	   __atomic_load_n(&cb->readp, __ATOMIC_ACQUIRE);
+}
+
 static bbool_t circ_empty(const circ_buf_t *cb)
 {
-    return cb->size == 0;
+    return circ_size(cb) == 0;
 }
 
-static bsize_t circ_size(const circ_buf_t *cb)
+static bsize_t circ_read_peek(circ_buf_t *cb, buint8_t **data)
 {
-    return cb->size;
+    /* The write position first: memory published before it is current */
+    bsize_t writep = __atomic_load_n(&cb->writep, __ATOMIC_ACQUIRE);
+    circ_mem_t *mem = __atomic_load_n(&cb->mem, __ATOMIC_ACQUIRE);
+    bsize_t off = cb->readp & (mem->cap - 1);
+
+    *data = mem->buf + off;
+    return BASE_MIN(writep - cb->readp, mem->cap - off);
 }
 
-static bsize_t circ_avail(const circ_buf_t *cb)
+static void circ_read_consume(circ_buf_t *cb, bsize_t len)
 {
-    return cb->cap - cb->size;
+    __atomic_store_n(&cb->readp, cb->readp + len, __ATOMIC_RELEASE);
 }
 
 static void circ_read(circ_buf_t *cb, buint8_t *dst, bsize_t len)
 {
-    bsize_t size_after = cb->cap - cb->readp;
-    bsize_t tbc = BASE_MIN(size_after, len);
-    bsize_t rem = len - tbc;
+    while (len) {
+	buint8_t *data;
+	bsize_t n = BASE_MIN(circ_read_peek(cb, &data), len);
+
+	bmemcpy(dst, data, n);
+	circ_read_consume(cb, n);
+	dst += n;
+	len -= n;
+    }
+}
 
-    bmemcpy(dst, cb->buf + cb->readp, tbc);
-    bmemcpy(dst + tbc, cb->buf, rem);
+/* Move to bigger memory. The unread data keeps its position, and the old
+ * memory is kept, as the reader may still be reading from it.
+ */
+static bstatus_t circ_grow(circ_buf_t *cb, bsize_t min_cap, bsize_t readp)
+{
+    circ_mem_t *old = cb->mem, *mem;
+    bsize_t cap = old->cap, i;
 
-    cb->readp += len;
-    cb->readp &= (cb->cap - 1);
+    while (cap < min_cap)
+	cap <<= 1;
 
-    cb->size -= len;
+    mem = circ_mem_alloc(cb->factory, cap);
+    if (!mem)
+        return BASE_ENOMEM;
+
+    for (i = readp; i < cb->writep; ) {
+	bsize_t src = i & (old->cap - 1);
+	bsize_t dst = i & (cap - 1);
+	bsize_t n = cb->writep - i;
+
+	n = BASE_MIN(n, old->cap - src);
+	n = BASE_MIN(n, cap - dst);
+	bmemcpy(mem->buf + dst, old->buf + src, n);
+	i += n;
+    }
+
+    mem->prev = old;
+    __atomic_store_n(&cb->mem, mem, __ATOMIC_RELEASE);
+
+    return BASE_SUCCESS;
+}
+
+static bsize_t circ_write_reserve(circ_buf_t *cb, bsize_t min_len,
+				  buint8_t **data)
+{
+    bsize_t readp = __atomic_load_n(&cb->readp, __ATOMIC_ACQUIRE);
+    bsize_t used = cb->writep - readp;
+    bsize_t off;
+
+    if (cb->mem->cap - used < min_len &&
+	circ_grow(cb, used + min_len, readp) != BASE_SUCCESS)
+    {
+	return 0;
+    }
+
+    off = cb->writep & (cb->mem->cap - 1);
+    *data = cb->mem->buf + off;
+    return BASE_MIN(cb->mem->cap - used, cb->mem->cap - off);
+}
+
+static void circ_write_commit(circ_buf_t *cb, bsize_t len)
+{
+    __atomic_store_n(&cb->writep, cb->writep + len, __ATOMIC_RELEASE);
 }
 
 static bstatus_t circ_write(circ_buf_t *cb,
                               const buint8_t *src, bsize_t len)
 {
-    /* Overflow condition: resize */
-    if (len > circ_avail(cb)) {
-        /* Minimum required capacity */
-        bsize_t min_cap = len + cb->size;
-
-        /* Next 32-bit power of two */
-        min_cap--;
-        min_cap |= min_cap >> 1;
-        min_cap |= min_cap >> 2;
-        min_cap |= min_cap >> 4;
-        min_cap |= min_cap >> 8;
-        min_cap |= min_cap >> 16;
-        min_cap++;
-
-        /* Create a new pool to hold a bigger buffer, using the same factory */
-        bpool_t *pool = bpool_create(cb->pool->factory, "tls-circ%p",
-                                         min_cap, min_cap, NULL);
-        if (!pool)
-            return BASE_ENOMEM;
+    buint8_t *data;
 
-        /* Allocate our new buffer */
-        buint8_t *buf = bpool_alloc(pool, min_cap);
-        if (!buf) {
-            bpool_release(pool);
-            return BASE_ENOMEM;
-        }
+    /* Room for all of it first */
+    if (len && circ_write_reserve(cb, len, &data) == 0)
+	return BASE_ENOMEM;
+
+    while (len) {
+	bsize_t n = BASE_MIN(circ_write_reserve(cb, 0, &data), len);
+
+	bmemcpy(data, src, n);
+	circ_write_commit(cb, n);
+	src += n;
+	len -= n;
+    }
+
+    return BASE_SUCCESS;
+}
+
+/* Just for testing the circular buffer: a writer thread passes a byte
+ * pattern to the reader in random sizes, with circ_write() and with
+ * circ_write_reserve()/circ_write_commit(). The buffer starts small, so
+ * it grows while the reader is reading from it.
+ */
+enum { CIRC_TEST_INIT_CAP = 512, CIRC_TEST_MAX_CHUNK = 4000,
+       CIRC_TEST_MAX_USED = 64 * 1024 };
+
+typedef struct circ_test_t {
+    circ_buf_t	cb;
+    bsize_t	total;
+    bstatus_t	status;
+} circ_test_t;
+
+static buint8_t circ_test_byte(bsize_t pos)
+{
+    return (buint8_t)(pos * 7 % 251);
+}
+
+static int circ_test_writer(void *arg)
+{
+    circ_test_t *test = (circ_test_t*)arg;
+    buint8_t chunk[CIRC_TEST_MAX_CHUNK];
+    bsize_t off = 0, i;
+    unsigned rnd = 1;
+
+    while (off < test->total) {
+	buint8_t *data;
+	bsize_t n, room;
+
+	rnd = rnd * 1103515245 + 12345;
+	n = BASE_MIN((rnd >> 8) % CIRC_TEST_MAX_CHUNK + 1, test->total - off);
+
+	if ((rnd >> 20) & 1) {
+	    for (i = 0; i < n; ++i)
+		chunk[i] = circ_test_byte(off + i);
+	    if (circ_write(&test->cb, chunk, n) != BASE_SUCCESS) {
+		__atomic_store_n(&test->status, BASE_ENOMEM, __ATOMIC_RELEASE);
+		return -1;
+	    }
+	} else {
+	    room = circ_write_reserve(&test->cb, 0, &data);
+	    if (room == 0) {
+		/* Full: wait for the reader, or grow while little is unread */
+		if (circ_size(&test->cb) >= CIRC_TEST_MAX_USED) {
+		    bthreadSleepMs(0);
+		    continue;
+		}
+		room = circ_write_reserve(&test->cb, n, &data);
+		if (room == 0) {
+		    __atomic_store_n(&test->status, BASE_ENOMEM, __ATOMIC_RELEASE);
+		    return -1;
+		}
+	    }
 
-        /* Save old size, which we shall restore after the next read */
-        bsize_t old_size = cb->size;
+	    n = BASE_MIN(n, room);
+	    for (i = 0; i < n; ++i)
+		data[i] = circ_test_byte(off + i);
+	    circ_write_commit(&test->cb, n);
+	}
+	off += n;
+    }
 
-        /* Copy old data into beginning of new buffer */
-        circ_read(cb, buf, cb->size);
+    return 0;
+}
 
-        /* Restore old size now */
-        cb->size = old_size;
+bstatus_t bssl_sock_test_circ_buf(bpool_factory *factory, bsize_t total)
+{
+    circ_test_t test;
+    bpool_t *pool;
+    bthread_t *writer;
+    bsize_t off = 0, i;
+    bstatus_t status;
 
-        /* Release the previous pool */
-        bpool_release(cb->pool);
+    pool = bpool_create(factory, "circtest", 512, 512, NULL);
+    if (!pool)
+	return BASE_ENOMEM;
 
-        /* Update circular buffer members */
-        cb->pool = pool;
-        cb->buf = buf;
-        cb->readp = 0;
-        cb->writep = cb->size;
-        cb->cap = min_cap;
+    bbzero(&test, sizeof(test));
+    test.total = total;
+    status = circ_init(factory, &test.cb, CIRC_TEST_INIT_CAP);
+    if (status != BASE_SUCCESS) {
+	bpool_release(pool);
+	return status;
+    }
+
+    status = bthreadCreate(pool, "circwriter", &circ_test_writer, &test,
+			   0, 0, &writer);
+    if (status != BASE_SUCCESS) {
+	circ_deinit(&test.cb);
+	bpool_release(pool);
+	return status;
     }
 
-    bsize_t size_after = cb->cap - cb->writep;
-    bsize_t tbc = BASE_MIN(size_after, len);
-    bsize_t rem = len - tbc;
+    /* Keep reading after an error, the writer only stops at the end */
+    while (off < total &&
+	   __atomic_load_n(&test.status, __ATOMIC_ACQUIRE) == BASE_SUCCESS)
+    {
+	buint8_t *data;
+	bsize_t n = circ_read_peek(&test.cb, &data);
 
-    bmemcpy(cb->buf + cb->writep, src, tbc);
-    bmemcpy(cb->buf, src + tbc, rem);
+	if (n == 0) {
+	    bthreadSleepMs(0);
+	    continue;
+	}
 
-    cb->writep += len;
-    cb->writep &= (cb->cap - 1);
+	for (i = 0; i < n && status == BASE_SUCCESS; ++i) {
+	    if (data[i] != circ_test_byte(off + i))
+		status = BASE_EBUG;
+	}
+	circ_read_consume(&test.cb, n);
+	off += n;
+    }
 
-    cb->size += len;
+    bthreadJoin(writer);
+    bthreadDestroy(writer);
 
-    return BASE_SUCCESS;
+    if (status == BASE_SUCCESS)
+	status = test.status;
+    /* The test is meant to go through the growth */
+    if (status == BASE_SUCCESS && test.cb.mem->cap == CIRC_TEST_INIT_CAP)
+	status = BASE_EBUG;
+
+    circ_deinit(&test.cb);
+    bpool_release(pool);
+
+    return status;
 }
 #endif
 
@@ -573,7 +747,7 @@ bstatus_t bssl_sock_ossl_test_send_buf(bpool_t *pool)
 }
 #endif
 
-static void on_timer(btimer_heap_t *th, struct btimer_entry *te)
+static void on_timer(btimer_heap_t *th, btimer_entry *te)
 {
     bssl_sock_t *ssock = (bssl_sock_t*)te->user_data;
     int timer_id = te->id;
@@ -1288,11 +1462,15 @@ bstatus_t bssl_sock_create (bpool_t *pool,
     if (status != BASE_SUCCESS)
         return status;
 
-    /* Create input circular buffer mutex */
+#ifndef SSL_SOCK_IMP_USE_CIRC_BUF
+    /* Create input buffer mutex. The circular buffer needs none, it has
+     * only one writer (the read callback) and one reader (the TLS engine).
+     */
     status = block_create_simple_mutex(pool, pool->objName,
                                          &ssock->circ_buf_input_mutex);
     if (status != BASE_SUCCESS)
         return status;
+#endif
 
     /* Init secure socket param */
     bssl_sock_param_copy(pool, &ssock->param, param);
@@ -1404,8 +1582,15 @@ bstatus_t bssl_sock_get_info (bssl_sock_t *ssock,
 
 	/* Verification status */
 	info->verify_status = ssock->verify_status;
+
+	info->session_reused = ssock->session_reused;
+	info->ktls_tx = ssock->ktls_tx;
     }
 
+    /* Session cache counters */
+    info->session_hits = ssl_sess_stat.hits;
+    info->session_misses = ssl_sess_stat.misses;
+
     /* Last known SSL error code */
     info->last_native_err = ssock->last_err;
 
@@ -1729,6 +1914,65 @@ bstatus_t bssl_sock_sendto (bssl_sock_t *ssock,
 }
 
 
+/**
+ * Send part of a file using the socket.
+ */
+bstatus_t bssl_sock_sendfile (bssl_sock_t *ssock,
+					  bOsHandle_t fd,
+					  boff_t *offset,
+					  bssize_t *size)
+{
+#if defined(BASE_LINUX) && BASE_LINUX!=0
+    off_t off;
+    ssize_t sent;
+    bstatus_t status = BASE_SUCCESS;
+
+    BASE_ASSERT_RETURN(ssock && fd && offset && size && (*size>0),
+		       BASE_EINVAL);
+
+    if (ssock->ssl_state != SSL_STATE_ESTABLISHED)
+	return BASE_EINVALIDOP;
+
+    /* Without kernel TLS the file data must go through the SSL */
+    if (!ssock->ktls_tx)
+	return BASE_ENOTSUP;
+
+    /* The file data must follow any data sent before, so nothing may be
+     * waiting in the write BIO, the send buffer or the ioqueue.
+     */
+    block_acquire(ssock->write_mutex);
+    if (!io_empty(ssock, &ssock->circ_buf_output) ||
+	!blist_empty(&ssock->send_pending) ||
+	!blist_empty(&ssock->write_pending) ||
+	ssock->send_buf_pending.data_len)
+    {
+	block_release(ssock->write_mutex);
+	return BASE_EBUSY;
+    }
+
+    off = (off_t)*offset;
+    sent = sendfile(ssock->sock, fileno((FILE*)fd), &off, (size_t)*size);
+    if (sent < 0) {
+	status = bget_netos_error();
+	*size = 0;
+    } else {
+	*offset = off;
+	*size = sent;
+    }
+    block_release(ssock->write_mutex);
+
+    return status;
+#else
+    BASE_UNUSED_ARG(ssock);
+    BASE_UNUSED_ARG(fd);
+    BASE_UNUSED_ARG(offset);
+    BASE_UNUSED_ARG(size);
+
+    return BASE_ENOTSUP;
+#endif
+}
+
+
 /**
  * Starts asynchronous socket accept() operations on this secure socket. 
  */
@@ -64,15 +64,26 @@ typedef struct send_buf_t {
     bsize_t		 len;
 } send_buf_t;
 
-/* Circular buffer object */
+/* Memory of the circular buffer, replaced when the buffer grows */
+typedef struct circ_mem_t {
+    buint8_t		*buf;	/* data buffer */
+    bsize_t		 cap;	/* size of buf (must be power of 2) */
+    bpool_t		*pool;	/* pool of this memory */
+    struct circ_mem_t	*prev;	/* previous memory, the reader may still
+				 * use it, released by circ_deinit() */
+} circ_mem_t;
+
+/* Circular buffer object, a single-producer/single-consumer ring. The
+ * writer only moves writep and the reader only moves readp, both count
+ * the bytes from the start and are masked with the capacity. Only the
+ * writer grows the buffer.
+ */
 typedef struct circ_buf_t {
-    bssl_sock_t *owner;  /* owner of the circular buffer */
-    bsize_t      cap;    /* maximum number of elements (must be power of 2) */
-    bsize_t      readp;  /* index of oldest element */
-    bsize_t      writep; /* index at which to write new element  */
-    bsize_t      size;   /* number of elements */
-    buint8_t    *buf;    /* data buffer */
-    bpool_t     *pool;   /* where new allocations will take place */
+    bssl_sock_t   *owner;    /* owner of the circular buffer */
+    circ_mem_t    *mem;	     /* current memory */
+    bsize_t        readp;    /* count of bytes read */
+    bsize_t        writep;   /* count of bytes written */
+    bpool_factory *factory;  /* where new allocations will take place */
 } circ_buf_t;
 
 /*
@@ -90,6 +101,9 @@ struct bssl_sock_t
     bssl_cert_info	  remote_cert_info;
 
     bbool_t		  is_server;
+    bbool_t		  session_reused;
+    bbool_t		  ktls_tx;	/* records sent are encrypted by the
+					 * kernel, set by the backend	    */
     enum ssl_state	  ssl_state;
     bioqueue_op_key_t	  handshake_op_key;
     btimer_entry	  timer;
@@ -158,6 +172,12 @@ static struct ssl_curves_t {
     const char	    *name;
 } ssl_curves[BASE_SSL_SOCK_MAX_CURVES];
 
+/* ssl session resumption counters, updated by the backend */
+static struct ssl_sess_stat_t {
+    unsigned	     hits;
+    unsigned	     misses;
+} ssl_sess_stat;
+
 /*
  *******************************************************************
  * I/O functions.
@@ -187,7 +207,18 @@ static bstatus_t circ_init(bpool_factory *factory,
 static void circ_deinit(circ_buf_t *cb);
 static bbool_t circ_empty(const circ_buf_t *cb);
 static bsize_t circ_size(const circ_buf_t *cb);
+
+/* Reader side: contiguous data at the read position, and its release */
+static bsize_t circ_read_peek(circ_buf_t *cb, buint8_t **data);
+static void circ_read_consume(circ_buf_t *cb, bsize_t len);
 static void circ_read(circ_buf_t *cb, buint8_t *dst, bsize_t len);
+
+/* Writer side: contiguous space at the write position, growing the buffer
+ * to have at least min_len free, and its publication.
+ */
+static bsize_t circ_write_reserve(circ_buf_t *cb, bsize_t min_len,
+				  buint8_t **data);
+static void circ_write_commit(circ_buf_t *cb, bsize_t len);
 static bstatus_t circ_write(circ_buf_t *cb,
                               const buint8_t *src, bsize_t len);
 
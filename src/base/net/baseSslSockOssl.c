@@ -22,7 +22,7 @@
 #if defined(BASE_HAS_SSL_SOCK) && BASE_HAS_SSL_SOCK != 0 && \
     (BASE_SSL_SOCK_IMP == BASE_SSL_SOCK_IMP_OPENSSL)
 
-#include "ssl_sock_imp_common.c"
+#include "baseSslSockImpCommon.c"
 
 /* 
  * Include OpenSSL headers 
@@ -46,6 +46,22 @@
 #	define USING_LIBRESSL 0
 #endif
 
+/* Session resumption needs OpenSSL 1.1.1 */
+#if !USING_LIBRESSL && OPENSSL_VERSION_NUMBER >= 0x10101000L
+#  define SSL_SOCK_HAS_SESS_CACHE   1
+#else
+#  define SSL_SOCK_HAS_SESS_CACHE   0
+#endif
+
+/* Kernel TLS needs OpenSSL 3.0, which hands the keys to a socket BIO */
+#if defined(BASE_LINUX) && BASE_LINUX!=0 && !USING_LIBRESSL && \
+    OPENSSL_VERSION_NUMBER >= 0x30000000L && \
+    defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+#	define SSL_SOCK_HAS_KTLS 1
+#else
+#	define SSL_SOCK_HAS_KTLS 0
+#endif
+
 #if !USING_LIBRESSL && !defined(OPENSSL_NO_EC) \
 	&& OPENSSL_VERSION_NUMBER >= 0x1000200fL
 
@@ -152,6 +168,15 @@ typedef struct ossl_sock_t
     SSL			 *ossl_ssl;
     BIO			 *ossl_rbio;
     BIO			 *ossl_wbio;
+#if SSL_SOCK_HAS_SESS_CACHE
+    bbool_t		  has_ticket_keys; /* listener: key of the tickets
+					    * of the accepted sockets	    */
+    unsigned char	  ticket_keys[80]; /* name, HMAC and AES keys	    */
+#endif
+#if SSL_SOCK_HAS_KTLS
+    BIO			 *ktls_mem;	/* plain data to be sent when the
+					 * kernel encrypts the records	    */
+#endif
 } ossl_sock_t;
 
 /**
@@ -365,13 +390,25 @@ static bstr_t ssl_strerror(bstatus_t status,
  *******************************************************************
  */
 
+/* The data to be sent: the records in the write BIO, or the plain data
+ * when the kernel encrypts the records.
+ */
+static BIO *io_bio(ossl_sock_t *ossock)
+{
+#if SSL_SOCK_HAS_KTLS
+    if (ossock->ktls_mem)
+	return ossock->ktls_mem;
+#endif
+    return ossock->ossl_wbio;
+}
+
 static bbool_t io_empty(bssl_sock_t *ssock, circ_buf_t *cb)
 {
     ossl_sock_t *ossock = (ossl_sock_t *)ssock;
 
     BASE_UNUSED_ARG(cb);
 
-    return !BIO_pending(ossock->ossl_wbio);
+    return !BIO_pending(io_bio(ossock));
 }
 
 static bsize_t io_size(bssl_sock_t *ssock, circ_buf_t *cb)
@@ -381,7 +418,7 @@ static bsize_t io_size(bssl_sock_t *ssock, circ_buf_t *cb)
 
     BASE_UNUSED_ARG(cb);
 
-    return BIO_get_mem_data(ossock->ossl_wbio, &data);
+    return BIO_get_mem_data(io_bio(ossock), &data);
 }
 
 static void io_read(bssl_sock_t *ssock, circ_buf_t *cb,
@@ -392,11 +429,11 @@ static void io_read(bssl_sock_t *ssock, circ_buf_t *cb,
 
     BASE_UNUSED_ARG(cb);
 
-    BIO_get_mem_data(ossock->ossl_wbio, &data);
+    BIO_get_mem_data(io_bio(ossock), &data);
     bmemcpy(dst, data, len);
 
     /* Reset write BIO */
-    (void)BIO_reset(ossock->ossl_wbio);
+    (void)BIO_reset(io_bio(ossock));
 }
 
 static bstatus_t io_write(bssl_sock_t *ssock, circ_buf_t *cb,
@@ -419,6 +456,10 @@ static int openssl_init_count;
 /* OpenSSL application data index */
 static int sslsock_idx;
 
+#if SSL_SOCK_HAS_SESS_CACHE
+/* Free the cached sessions */
+static void sess_cache_destroy(void *data);
+#endif
 
 /* Initialize OpenSSL */
 static bstatus_t init_openssl(void)
@@ -443,6 +484,9 @@ static bstatus_t init_openssl(void)
 #else
     OPENSSL_init_ssl(0, NULL);
 #endif
+#if SSL_SOCK_HAS_SESS_CACHE
+    libBaseAtExit(&sess_cache_destroy, "SslSessCache", NULL);
+#endif
 #if OPENSSL_VERSION_NUMBER < 0x009080ffL
     /* This is now synonym of SSL_library_init() */
     OpenSSL_add_all_algorithms();
@@ -512,7 +556,7 @@ static bstatus_t init_openssl(void)
 	for (i = 0; i < ssl_curves_num; i++) {
 	    nid = SSL_get_shared_curve(ssl, i);
 
-	    if (nid & TLSBASE_nid_unknown) {
+	    if (nid & TLSEXT_nid_unknown) {
 		cname = "curve unknown";
 		nid &= 0xFFFF;
 	    } else {
@@ -607,7 +651,7 @@ static int verify_cb(int preverify_ok, X509_STORE_CTX *x509_ctx)
     case X509_V_ERR_UNABLE_TO_DECRYPT_CRL_SIGNATURE:
     case X509_V_ERR_CRL_SIGNATURE_FAILURE:
     case X509_V_ERR_ERROR_IN_CRL_LAST_UPDATE_FIELD:
-    case X509_V_ERR_ERROR_IN_CRL_NBASE_UPDATE_FIELD:
+    case X509_V_ERR_ERROR_IN_CRL_NEXT_UPDATE_FIELD:
 	ssock->verify_status |= BASE_SSL_CERT_ECRL_FAILURE;
 	break;	
 
@@ -668,6 +712,269 @@ static bstatus_t set_sigalgs(bssl_sock_t *ssock);
 static void set_entropy(bssl_sock_t *ssock);
 
 
+/*
+ *******************************************************************
+ * TLS session cache.
+ *******************************************************************
+ */
+
+#if SSL_SOCK_HAS_SESS_CACHE
+
+/* Client session of a server, keyed by "host:port" */
+typedef struct sess_entry
+{
+    char		 key[BASE_MAX_HOSTNAME + 8];
+    SSL_SESSION		*sess;
+    unsigned		 last_use;
+} sess_entry;
+
+/* Shared by all secure sockets, protected by the critical section */
+static struct sess_cache_t
+{
+    sess_entry		 entry[BASE_SSL_SOCK_SESS_CACHE_SIZE];
+    unsigned		 clock;
+} sess_cache;
+
+static void sess_cache_key(bssl_sock_t *ssock, char *key, int size)
+{
+    if (ssock->param.server_name.slen) {
+	bansi_snprintf(key, size, "%.*s:%u",
+		       (int)ssock->param.server_name.slen,
+		       ssock->param.server_name.ptr,
+		       bsockaddr_get_port(&ssock->rem_addr));
+    } else {
+	bsockaddr_print(&ssock->rem_addr, key, size, 3);
+    }
+}
+
+/* Offer the cached session of the server in the client handshake */
+static void sess_cache_attach(bssl_sock_t *ssock)
+{
+    ossl_sock_t *ossock = (ossl_sock_t *)ssock;
+    char key[sizeof(sess_cache.entry[0].key)];
+    btime_val now;
+    unsigned i;
+
+    sess_cache_key(ssock, key, sizeof(key));
+    bgettimeofday(&now);
+
+    benter_critical_section();
+    for (i = 0; i < BASE_ARRAY_SIZE(sess_cache.entry); ++i) {
+	sess_entry *e = &sess_cache.entry[i];
+
+	if (!e->sess || strcmp(e->key, key) != 0)
+	    continue;
+
+	if (SSL_SESSION_get_time(e->sess) + SSL_SESSION_get_timeout(e->sess)
+	    < now.sec)
+	{
+	    SSL_SESSION_free(e->sess);
+	    e->sess = NULL;
+	} else {
+	    SSL_set_session(ossock->ossl_ssl, e->sess);
+	    e->last_use = ++sess_cache.clock;
+	}
+	break;
+    }
+    bleave_critical_section();
+}
+
+/* New session of a client, which may come after the handshake with
+ * TLS 1.3. It replaces the session of the same server, or the least
+ * recently used one.
+ */
+static int sess_cache_new_cb(SSL *ssl, SSL_SESSION *sess)
+{
+    bssl_sock_t *ssock = (bssl_sock_t *)SSL_get_ex_data(ssl, sslsock_idx);
+    char key[sizeof(sess_cache.entry[0].key)];
+    sess_entry *e = NULL;
+    unsigned i;
+
+    if (!ssock || ssock->verify_status != BASE_SSL_CERT_ESUCCESS ||
+	!SSL_SESSION_is_resumable(sess))
+    {
+	return 0;
+    }
+
+    sess_cache_key(ssock, key, sizeof(key));
+
+    benter_critical_section();
+    for (i = 0; i < BASE_ARRAY_SIZE(sess_cache.entry); ++i) {
+	sess_entry *it = &sess_cache.entry[i];
+
+	if (it->sess && strcmp(it->key, key) == 0) {
+	    e = it;
+	    break;
+	}
+	if (!e || (e->sess && (!it->sess || it->last_use < e->last_use)))
+	    e = it;
+    }
+
+    if (e->sess)
+	SSL_SESSION_free(e->sess);
+    bmemcpy(e->key, key, sizeof(key));
+    e->sess = sess;
+    e->last_use = ++sess_cache.clock;
+    bleave_critical_section();
+
+    /* We keep the reference */
+    return 1;
+}
+
+static void sess_cache_destroy(void *data)
+{
+    unsigned i;
+
+    BASE_UNUSED_ARG(data);
+
+    benter_critical_section();
+    for (i = 0; i < BASE_ARRAY_SIZE(sess_cache.entry); ++i) {
+	if (sess_cache.entry[i].sess) {
+	    SSL_SESSION_free(sess_cache.entry[i].sess);
+	    sess_cache.entry[i].sess = NULL;
+	}
+    }
+    bleave_critical_section();
+}
+
+static void sess_digest_x509(EVP_MD_CTX *md, X509 *x)
+{
+    unsigned char buf[EVP_MAX_MD_SIZE];
+    unsigned len;
+
+    if (x && X509_digest(x, EVP_sha256(), buf, &len) == 1)
+	EVP_DigestUpdate(md, buf, len);
+}
+
+/* A session (or ticket) may only be resumed by a server with the same
+ * certificates and the same verification of the client, so the session
+ * ID context is a hash of them.
+ */
+static bstatus_t sess_set_id_context(bssl_sock_t *ssock, SSL_CTX *ctx)
+{
+    bssl_cert_t *cert = ssock->cert;
+    X509_STORE *store = SSL_CTX_get_cert_store(ctx);
+    unsigned char sid_ctx[EVP_MAX_MD_SIZE];
+    unsigned len = 0;
+    EVP_MD_CTX *md;
+    int rc;
+
+    md = EVP_MD_CTX_new();
+    if (!md || EVP_DigestInit_ex(md, EVP_sha256(), NULL) != 1) {
+	EVP_MD_CTX_free(md);
+	return BASE_ENOMEM;
+    }
+
+    /* Own certificates */
+    rc = SSL_CTX_set_current_cert(ctx, SSL_CERT_SET_FIRST);
+    while (rc == 1) {
+	sess_digest_x509(md, SSL_CTX_get0_certificate(ctx));
+	rc = SSL_CTX_set_current_cert(ctx, SSL_CERT_SET_NEXT);
+    }
+
+    /* Verification of the client */
+    EVP_DigestUpdate(md, &ssock->param.require_client_cert,
+		     sizeof(ssock->param.require_client_cert));
+    if (cert) {
+	EVP_DigestUpdate(md, cert->CA_file.ptr, cert->CA_file.slen);
+	EVP_DigestUpdate(md, "", 1);
+	EVP_DigestUpdate(md, cert->CA_path.ptr, cert->CA_path.slen);
+    }
+    if (store) {
+	STACK_OF(X509_OBJECT) *objs = X509_STORE_get0_objects(store);
+	int i;
+
+	for (i = 0; i < sk_X509_OBJECT_num(objs); ++i) {
+	    sess_digest_x509(md, X509_OBJECT_get0_X509(
+					sk_X509_OBJECT_value(objs, i)));
+	}
+    }
+
+    rc = EVP_DigestFinal_ex(md, sid_ctx, &len);
+    EVP_MD_CTX_free(md);
+    if (rc != 1)
+	return GET_SSL_STATUS(ssock);
+
+    if (len > SSL_MAX_SID_CTX_LENGTH)
+	len = SSL_MAX_SID_CTX_LENGTH;
+    if (SSL_CTX_set_session_id_context(ctx, sid_ctx, len) != 1)
+	return GET_SSL_STATUS(ssock);
+
+    return BASE_SUCCESS;
+}
+
+/* The sockets accepted by a listener share the key of the session
+ * tickets, so that a ticket is accepted by the next connection of the
+ * same listener only.
+ */
+static bbool_t sess_set_ticket_keys(bssl_sock_t *ssock, SSL_CTX *ctx)
+{
+    ossl_sock_t *listener = (ossl_sock_t *)ssock->parent;
+    bbool_t has_keys;
+
+    if (!listener)
+	return BASE_FALSE;
+
+    benter_critical_section();
+    if (!listener->has_ticket_keys) {
+	listener->has_ticket_keys =
+	    (RAND_bytes(listener->ticket_keys,
+			sizeof(listener->ticket_keys)) == 1);
+    }
+    has_keys = listener->has_ticket_keys;
+    bleave_critical_section();
+
+    return has_keys &&
+	   SSL_CTX_set_tlsext_ticket_keys(ctx, listener->ticket_keys,
+					  sizeof(listener->ticket_keys)) == 1;
+}
+
+#endif	/* SSL_SOCK_HAS_SESS_CACHE */
+
+
+/*
+ *******************************************************************
+ * Kernel TLS.
+ *******************************************************************
+ */
+
+#if SSL_SOCK_HAS_KTLS
+
+/* OpenSSL writes the handshake to the socket and, when the kernel takes
+ * the transmit key, encrypts nothing itself afterwards. Application data
+ * is then kept in a memory BIO and sent as is via ioqueue, otherwise the
+ * records go back to a memory write BIO as without kernel TLS.
+ */
+static bstatus_t ktls_established(ossl_sock_t *ossock)
+{
+    bssl_sock_t *ssock = &ossock->base;
+    BIO *mem;
+
+    if (BIO_method_type(ossock->ossl_wbio) != BIO_TYPE_SOCKET)
+	return BASE_SUCCESS;
+
+    mem = BIO_new(BIO_s_mem());
+    if (!mem)
+	return BASE_ENOMEM;
+
+    if (BIO_get_ktls_send(ossock->ossl_wbio)) {
+	/* Records are never renegotiated with the key in the kernel */
+	SSL_set_options(ossock->ossl_ssl, SSL_OP_NO_RENEGOTIATION);
+	ossock->ktls_mem = mem;
+	ssock->ktls_tx = BASE_TRUE;
+	BASE_STR_INFO(ssock->pool->objName, "Kernel TLS transmit enabled");
+	return BASE_SUCCESS;
+    }
+
+    BASE_STR_INFO(ssock->pool->objName, "Kernel TLS is not available");
+    SSL_set0_wbio(ossock->ossl_ssl, mem);
+    ossock->ossl_wbio = mem;
+    return BASE_SUCCESS;
+}
+
+#endif	/* SSL_SOCK_HAS_KTLS */
+
+
 static bssl_sock_t *ssl_alloc(bpool_t *pool)
 {
     return (bssl_sock_t *)BASE_POOL_ZALLOC_T(pool, ossl_sock_t);
@@ -851,7 +1158,7 @@ static bstatus_t ssl_create(bssl_sock_t *ssock)
     #endif
 				      SSL_OP_SINGLE_DH_USE;
 			    options = SSL_CTX_set_options(ctx, options);
-			    BASE_STR_INFO(ssock->pool->objName, "SSL DH initialized, PFS cipher-suites enabled"));
+			    BASE_STR_INFO(ssock->pool->objName, "SSL DH initialized, PFS cipher-suites enabled");
 			}
 			DH_free(dh);
 		    }
@@ -941,7 +1248,7 @@ static bstatus_t ssl_create(bssl_sock_t *ssock)
     #endif
 				      SSL_OP_SINGLE_DH_USE;
 			    options = SSL_CTX_set_options(ctx, options);
-			    BASE_STR_INFO(ssock->pool->objName, "SSL DH initialized, PFS cipher-suites enabled"));
+			    BASE_STR_INFO(ssock->pool->objName, "SSL DH initialized, PFS cipher-suites enabled");
 			}
 			DH_free(dh);
 		    }
@@ -1000,7 +1307,7 @@ static bstatus_t ssl_create(bssl_sock_t *ssock)
 
 	/* SSL_CTX_set_ecdh_auto(ctx,on) requires OpenSSL 1.0.2 which wraps: */
 	if (SSL_CTX_ctrl(ctx, SSL_CTRL_SET_ECDH_AUTO, 1, NULL)) {
-	    BASE_STR_INFO(ssock->pool->objName, "SSL ECDH initialized (automatic), faster PFS ciphers enabled"));
+	    BASE_STR_INFO(ssock->pool->objName, "SSL ECDH initialized (automatic), faster PFS ciphers enabled");
     #if !defined(OPENSSL_NO_ECDH) && OPENSSL_VERSION_NUMBER >= 0x10000000L && \
 	OPENSSL_VERSION_NUMBER < 0x10100000L
 	} else {
@@ -1036,6 +1343,25 @@ static bstatus_t ssl_create(bssl_sock_t *ssock)
 	bssl_cert_wipe_keys(cert);	
     }
 
+#if SSL_SOCK_HAS_SESS_CACHE
+    /* Session resumption */
+    if (ssock->is_server) {
+	if (ssock->param.session_cache) {
+	    status = sess_set_id_context(ssock, ctx);
+	    if (status != BASE_SUCCESS) {
+		SSL_CTX_free(ctx);
+		return status;
+	    }
+	}
+	if (!ssock->param.session_cache || !sess_set_ticket_keys(ssock, ctx))
+	    SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+    } else if (ssock->param.session_cache) {
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT |
+					    SSL_SESS_CACHE_NO_INTERNAL_STORE);
+	SSL_CTX_sess_set_new_cb(ctx, &sess_cache_new_cb);
+    }
+#endif
+
     /* Create SSL instance */
     ossock->ossl_ctx = ctx;
     ossock->ossl_ssl = SSL_new(ossock->ossl_ctx);
@@ -1046,6 +1372,11 @@ static bstatus_t ssl_create(bssl_sock_t *ssock)
     /* Set SSL sock as application data of SSL instance */
     SSL_set_ex_data(ossock->ossl_ssl, sslsock_idx, ssock);
 
+#if SSL_SOCK_HAS_SESS_CACHE
+    if (!ssock->is_server && ssock->param.session_cache)
+	sess_cache_attach(ssock);
+#endif
+
     /* SSL verification options */
     mode = SSL_VERIFY_PEER;
     if (ssock->is_server && ssock->param.require_client_cert)
@@ -1070,9 +1401,23 @@ static bstatus_t ssl_create(bssl_sock_t *ssock)
 
     /* Setup SSL BIOs */
     ossock->ossl_rbio = BIO_new(BIO_s_mem());
-    ossock->ossl_wbio = BIO_new(BIO_s_mem());
+    ossock->ossl_wbio = NULL;
+#if SSL_SOCK_HAS_KTLS
+    /* OpenSSL only hands the transmit key to a socket write BIO, so the
+     * handshake is written to the socket directly, see ktls_established().
+     */
+    if (ssock->param.ktls && ssock->param.sock_type == bSOCK_STREAM()) {
+	ossock->ossl_wbio = BIO_new_socket((int)ssock->sock, BIO_NOCLOSE);
+	if (ossock->ossl_wbio)
+	    SSL_set_options(ossock->ossl_ssl, SSL_OP_ENABLE_KTLS);
+    }
+    if (!ossock->ossl_wbio)
+#endif
+    {
+	ossock->ossl_wbio = BIO_new(BIO_s_mem());
+	(void)BIO_set_close(ossock->ossl_wbio, BIO_CLOSE);
+    }
     (void)BIO_set_close(ossock->ossl_rbio, BIO_CLOSE);
-    (void)BIO_set_close(ossock->ossl_wbio, BIO_CLOSE);
     SSL_set_bio(ossock->ossl_ssl, ossock->ossl_rbio, ossock->ossl_wbio);
 
     return BASE_SUCCESS;
@@ -1092,11 +1437,22 @@ static void ssl_destroy(bssl_sock_t *ssock)
 	 * SSL handshake, while previous versions always return 0.	 
 	 */
 	if (SSL_in_init(ossock->ossl_ssl) == 0) {
+#if SSL_SOCK_HAS_KTLS
+	    /* The socket may be closed already, don't write the alert */
+	    if (BIO_method_type(ossock->ossl_wbio) == BIO_TYPE_SOCKET)
+		SSL_set_quiet_shutdown(ossock->ossl_ssl, 1);
+#endif
 	    SSL_shutdown(ossock->ossl_ssl);
 	}   	
 	SSL_free(ossock->ossl_ssl); /* this will also close BIOs */
 	ossock->ossl_ssl = NULL;
     }
+#if SSL_SOCK_HAS_KTLS
+    if (ossock->ktls_mem) {
+	BIO_free(ossock->ktls_mem);
+	ossock->ktls_mem = NULL;
+    }
+#endif
 
     /* Destroy SSL context */
     if (ossock->ossl_ctx) {
@@ -1315,7 +1671,7 @@ static void set_entropy(bssl_sock_t *ssock)
     }
 
     if (ret < 0) {
-	BASE_STR_INFO(ssock->pool->objName, "SSL failed to reseed with entropy type %d [native err=%d]", ssock->param.entropy_type, ret));
+	BASE_STR_INFO(ssock->pool->objName, "SSL failed to reseed with entropy type %d [native err=%d]", ssock->param.entropy_type, ret);
     }
 }
 
@@ -1459,7 +1815,7 @@ static void get_cert_info(bpool_t *pool, bssl_cert_info *ci, X509 *x,
 
     /* Subject Alternative Name extension */
     if (ci->version >= 3) {
-	names = (GENERAL_NAMES*) X509_get_bd2i(x, NID_subject_alt_name,
+	names = (GENERAL_NAMES*) X509_get_ext_d2i(x, NID_subject_alt_name,
 						  NULL, NULL);
     }
     if (names) {
@@ -1642,19 +1998,19 @@ static void ssl_set_state(bssl_sock_t *ssock, bbool_t is_server)
 
 static void ssl_set_peer_name(bssl_sock_t *ssock)
 {
-#ifdef SSL_set_tlsbhost_name
+#ifdef SSL_set_tlsext_host_name
     ossl_sock_t *ossock = (ossl_sock_t *)ssock;
 
     /* Set server name to connect */
     if (ssock->param.server_name.slen) {
 	/* Server name is null terminated already */
-	if (!SSL_set_tlsbhost_name(ossock->ossl_ssl, 
+	if (!SSL_set_tlsext_host_name(ossock->ossl_ssl, 
 				      ssock->param.server_name.ptr))
 	{
 	    char err_str[BASE_ERR_MSG_SIZE];
 
 	    ERR_error_string_n(ERR_get_error(), err_str, sizeof(err_str));
-	    BASE_STR_INFO(ssock->pool->objName, "SSL_set_tlsbhost_name() failed: %s", err_str));
+	    BASE_STR_INFO(ssock->pool->objName, "SSL_set_tlsext_host_name() failed: %s", err_str);
 	}
     }
 #endif
@@ -1683,7 +2039,12 @@ static bstatus_t ssl_do_handshake(bssl_sock_t *ssock)
 
     if (err < 0) {
 	int err2 = SSL_get_error(ossock->ossl_ssl, err);
-	if (err2 != SSL_ERROR_NONE && err2 != SSL_ERROR_WANT_READ)
+	if (err2 != SSL_ERROR_NONE && err2 != SSL_ERROR_WANT_READ
+#if SSL_SOCK_HAS_KTLS
+	    /* The socket write BIO can't take the handshake now */
+	    && err2 != SSL_ERROR_WANT_WRITE
+#endif
+	    )
 	{
 	    /* Handshake fails */
 	    status = STATUS_FROM_SSL_ERR2("Handshake", ssock, err, err2, 0);
@@ -1693,7 +2054,25 @@ static bstatus_t ssl_do_handshake(bssl_sock_t *ssock)
 
     /* Check if handshake has been completed */
     if (SSL_is_init_finished(ossock->ossl_ssl)) {
+#if SSL_SOCK_HAS_KTLS
+	status = ktls_established(ossock);
+	if (status != BASE_SUCCESS)
+	    return status;
+#endif
 	ssock->ssl_state = SSL_STATE_ESTABLISHED;
+
+#if SSL_SOCK_HAS_SESS_CACHE
+	if (ssock->param.session_cache) {
+	    ssock->session_reused = (SSL_session_reused(ossock->ossl_ssl) != 0);
+
+	    benter_critical_section();
+	    if (ssock->session_reused)
+		++ssl_sess_stat.hits;
+	    else
+		++ssl_sess_stat.misses;
+	    bleave_critical_section();
+	}
+#endif
 	return BASE_SUCCESS;
     }
 
@@ -1755,6 +2134,14 @@ static bstatus_t ssl_write(bssl_sock_t *ssock, const void *data,
     ossl_sock_t *ossock = (ossl_sock_t *)ssock;
     bstatus_t status = BASE_SUCCESS;
 
+#if SSL_SOCK_HAS_KTLS
+    /* The kernel encrypts the records, the data is sent as is */
+    if (ossock->ktls_mem) {
+	*nwritten = BIO_write(ossock->ktls_mem, data, (int)size);
+	return (*nwritten == size)? BASE_SUCCESS : BASE_ENOMEM;
+    }
+#endif
+
     *nwritten = SSL_write(ossock->ossl_ssl, data, (int)size);
     if (*nwritten <= 0) {
 	/* SSL failed to process the data, it may just that re-negotiation
@@ -1786,6 +2173,11 @@ static bstatus_t ssl_renegotiate(bssl_sock_t *ssock)
     bstatus_t status = BASE_SUCCESS;
     int ret;
 
+#if SSL_SOCK_HAS_KTLS
+    if (ssock->ktls_tx)
+	return BASE_ENOTSUP;
+#endif
+
     if (SSL_renegotiate_pending(ossock->ossl_ssl))
 	return BASE_EPENDING;
 
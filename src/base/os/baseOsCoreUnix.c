@@ -771,6 +771,30 @@ bstatus_t bthreadLocalAlloc(long *p_index)
 #endif
 }
 
+/*
+ * bthreadLocalAlloc2()
+ */
+bstatus_t bthreadLocalAlloc2(long *p_index, void (*destructor)(void *value))
+{
+#if BASE_HAS_THREADS
+	pthread_key_t key;
+	int rc;
+
+	BASE_ASSERT_RETURN(p_index != NULL, BASE_EINVAL);
+
+	bassert( sizeof(pthread_key_t) <= sizeof(long));
+	if ((rc=pthread_key_create(&key, destructor)) != 0)
+		return BASE_RETURN_OS_ERROR(rc);
+
+	*p_index = key;
+	return BASE_SUCCESS;
+#else
+	/* Without threads no thread exits */
+	BASE_UNUSED_ARG(destructor);
+	return bthreadLocalAlloc(p_index);
+#endif
+}
+
 /*
  * bthreadLocalFree()
  */
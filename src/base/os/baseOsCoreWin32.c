@@ -565,6 +565,17 @@ bstatus_t bthreadLocalAlloc(long *index)
 		return BASE_SUCCESS;
 }
 
+/*
+ * bthreadLocalAlloc2()
+ */
+bstatus_t bthreadLocalAlloc2(long *index, void (*destructor)(void *value))
+{
+    /* TLS slots have no callback at thread exit */
+    BASE_UNUSED_ARG(index);
+    BASE_UNUSED_ARG(destructor);
+    return BASE_ENOTSUP;
+}
+
 /*
  * bthreadLocalFree()
  */
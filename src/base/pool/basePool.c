@@ -16,8 +16,30 @@
 #endif
 
 #define LOG(expr)   		    BASE_LOG(6,expr)
+
+/* Trace of block creation and pool growth, see BASE_LOG_HOT_PATH */
+#if BASE_LOG_HOT_PATH
+#   define HOT_LOG(expr)		    LOG(expr)
+#else
+#   define HOT_LOG(expr)
+#endif
+
 #define ALIGN_PTR(PTR,ALIGNMENT)    (PTR + (-(bssize_t)(PTR) & (ALIGNMENT-1)))
 
+/*
+ * Index of the blocks which are not the current block but have free space,
+ * a list for each power of 2 of the space. It makes the allocations which
+ * don't fit in the current block constant time instead of walking all the
+ * blocks of the pool.
+ */
+#define BLOCK_INDEX_SIZE	    32
+
+struct bpool_block_index
+{
+    buint32_t	    used;			    /* non-empty lists */
+    bpool_block	   *head[BLOCK_INDEX_SIZE];
+};
+
 int BASE_NO_MEMORY_EXCEPTION;
 
 int bNO_MEMORY_EXCEPTION()
@@ -25,6 +47,110 @@ int bNO_MEMORY_EXCEPTION()
     return BASE_NO_MEMORY_EXCEPTION;
 }
 
+/* Allocation size, as rounded by bpool_alloc_from_block() */
+static bsize_t block_alloc_size(bsize_t size)
+{
+    if (size & (BASE_POOL_ALIGNMENT-1))
+	size = (size + BASE_POOL_ALIGNMENT) & ~(BASE_POOL_ALIGNMENT-1);
+    return size;
+}
+
+/* floor(log2(size)), size > 0 */
+static unsigned block_index_of(bsize_t size)
+{
+    unsigned i = 0;
+
+    while (size >>= 1)
+	++i;
+    return (i < BLOCK_INDEX_SIZE) ? i : BLOCK_INDEX_SIZE-1;
+}
+
+static void block_index_add(bpool_t *pool, bpool_block *block)
+{
+    struct bpool_block_index *index = pool->block_index;
+    bsize_t space = block->end - block->cur;
+    unsigned i;
+
+    if (space < BASE_POOL_ALIGNMENT)
+	return;
+
+    i = block_index_of(space);
+    block->free_prev = NULL;
+    block->free_next = index->head[i];
+    if (block->free_next)
+	block->free_next->free_prev = block;
+    index->head[i] = block;
+    index->used |= (buint32_t)1 << i;
+}
+
+/* Must be called before the free space of the block changes */
+static void block_index_remove(bpool_t *pool, bpool_block *block)
+{
+    struct bpool_block_index *index = pool->block_index;
+    bsize_t space = block->end - block->cur;
+    unsigned i;
+
+    if (space < BASE_POOL_ALIGNMENT)
+	return;
+
+    i = block_index_of(space);
+    if (block->free_prev)
+	block->free_prev->free_next = block->free_next;
+    else
+	index->head[i] = block->free_next;
+    if (block->free_next)
+	block->free_next->free_prev = block->free_prev;
+    if (!index->head[i])
+	index->used &= ~((buint32_t)1 << i);
+}
+
+/* A block which has space for size bytes, or NULL */
+static bpool_block *block_index_find(bpool_t *pool, bsize_t size)
+{
+    struct bpool_block_index *index = pool->block_index;
+    unsigned i = size ? block_index_of(size) : 0;
+    buint32_t used;
+
+    /* The first block of the list of size may be large enough */
+    if (index->head[i] && (bsize_t)(index->head[i]->end - index->head[i]->cur) >= size)
+	return index->head[i];
+
+    /* Any block of the larger lists is */
+    if (i + 1 >= BLOCK_INDEX_SIZE)
+	return NULL;
+    used = index->used & ~(((buint32_t)2 << i) - 1);
+    if (!used)
+	return NULL;
+
+    for (i = i + 1; (used & ((buint32_t)1 << i)) == 0; ++i)
+	;
+    return index->head[i];
+}
+
+/* Create the index when the pool grows beyond its first block */
+static void block_index_create(bpool_t *pool)
+{
+    struct bpool_block_index *index;
+    bpool_block *block;
+
+    index = (struct bpool_block_index*)
+	(*pool->factory->policy.block_alloc)(pool->factory, sizeof(*index));
+    if (!index)
+	return;
+
+    bbzero(index, sizeof(*index));
+    pool->block_index = index;
+
+    /* Only the first block when created by a pool, but the index may have
+     * failed to be created before.
+     */
+    pool->wasted_size = 0;
+    for (block = pool->block_list.next->next; block != &pool->block_list; block = block->next) {
+	pool->wasted_size += block->end - block->cur;
+	block_index_add(pool, block);
+    }
+}
+
 /*
  * Create new block.
  * Create a new big chunk of memory block, from which user allocation will be
@@ -37,7 +163,7 @@ static bpool_block *bpool_create_block( bpool_t *pool, bsize_t size)
     BASE_CHECK_STACK();
     bassert(size >= sizeof(bpool_block));
 
-    LOG((pool->objName, "create_block(sz=%u), cur.cap=%u, cur.used=%u", 
+    HOT_LOG((pool->objName, "create_block(sz=%u), cur.cap=%u, cur.used=%u", 
 	 size, pool->capacity, bpool_get_used_size(pool)));
 
     /* Request memory from allocator. */
@@ -57,34 +183,57 @@ static bpool_block *bpool_create_block( bpool_t *pool, bsize_t size)
 
     /* Set the start pointer, aligning it as needed */
     block->cur = ALIGN_PTR(block->buf, BASE_POOL_ALIGNMENT);
+    block->free_prev = block->free_next = NULL;
 
     /* Insert in the front of the list. */
     blist_insert_after(&pool->block_list, block);
 
-    LOG((pool->objName," block created, buffer=%p-%p",block->buf, block->end));
+    HOT_LOG((pool->objName," block created, buffer=%p-%p",block->buf, block->end));
 
     return block;
 }
 
 /*
  * Allocate memory chunk for user from available blocks.
- * This will iterate through block list to find space to allocate the chunk.
- * If no space is available in all the blocks, a new block might be created
- * (depending on whether the pool is allowed to resize).
+ * The current block (the first block) has been tried by bpool_alloc(), the
+ * other blocks are found in the block index, or by iterating through block
+ * list when the pool has no index. If no space is available in all the 
+ * blocks, a new block might be created (depending on whether the pool is
+ * allowed to resize), and it becomes the current block.
  */
 void* bpool_allocate_find(bpool_t *pool, bsize_t size)
 {
     bpool_block *block = pool->block_list.next;
+    bpool_block *current;
     void *p;
     bsize_t block_size;
 
     BASE_CHECK_STACK();
 
-    while (block != &pool->block_list) {
+    if (pool->block_index) {
+	bsize_t space;
+
 	p = bpool_alloc_from_block(block, size);
 	if (p != NULL)
 	    return p;
-	block = block->next;
+
+	block = block_index_find(pool, block_alloc_size(size));
+	if (block) {
+	    space = block->end - block->cur;
+	    block_index_remove(pool, block);
+	    p = bpool_alloc_from_block(block, size);
+	    bassert(p != NULL);
+	    pool->wasted_size -= space - (block->end - block->cur);
+	    block_index_add(pool, block);
+	    return p;
+	}
+    } else {
+	while (block != &pool->block_list) {
+	    p = bpool_alloc_from_block(block, size);
+	    if (p != NULL)
+		return p;
+	    block = block->next;
+	}
     }
     /* No available space in all blocks. */
 
@@ -115,14 +264,23 @@ void* bpool_allocate_find(bpool_t *pool, bsize_t size)
         block_size = pool->increment_size;
     }
 
-    LOG((pool->objName, 
+    HOT_LOG((pool->objName, 
 	 "%u bytes requested, resizing pool by %u bytes (used=%u, cap=%u)",
 	 size, block_size, bpool_get_used_size(pool), pool->capacity));
 
+    if (!pool->block_index)
+	block_index_create(pool);
+
+    current = pool->block_list.next;
     block = bpool_create_block(pool, block_size);
     if (!block)
 	return NULL;
 
+    /* The previous current block goes to the index */
+    pool->wasted_size += current->end - current->cur;
+    if (pool->block_index)
+	block_index_add(pool, current);
+
     p = bpool_alloc_from_block(block, size);
     bassert(p != NULL);
 #if BASE_LIB_DEBUG
@@ -196,6 +354,7 @@ bpool_t* bpool_create_int( bpool_factory *f, const char *name, bsize_t initial_s
 
 	/* Set the start pointer, aligning it as needed */
 	block->cur = ALIGN_PTR(block->buf, BASE_POOL_ALIGNMENT);
+	block->free_prev = block->free_next = NULL;
 
 	blist_insert_after(&pool->block_list, block);
 
@@ -243,6 +402,11 @@ static void reset_pool(bpool_t *pool)
 	block->cur = ALIGN_PTR(block->buf, BASE_POOL_ALIGNMENT);
 
 	pool->capacity = block->end - (unsigned char*)pool;
+
+	/* The index is kept for the next growth of the pool */
+	if (pool->block_index)
+		bbzero(pool->block_index, sizeof(*pool->block_index));
+	pool->wasted_size = 0;
 }
 
 /*
@@ -271,6 +435,9 @@ void bpool_destroy_int(bpool_t *pool)
 	((bpool_block*)pool->block_list.next)->end));
 
     reset_pool(pool);
+    if (pool->block_index && pool->factory->policy.block_free)
+	(*pool->factory->policy.block_free)(pool->factory, pool->block_index,
+					    sizeof(*pool->block_index));
     initial_size = ((bpool_block*)pool->block_list.next)->end - 
 		   (unsigned char*)pool;
     if (pool->factory->policy.block_free)
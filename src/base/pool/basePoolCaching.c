@@ -4,6 +4,7 @@
 #include <baseLog.h>
 #include <baseString.h>
 #include <baseAssert.h>
+#include <baseErrno.h>
 #include <baseLock.h>
 #include <baseOs.h>
 #include <basePoolBuf.h>
@@ -21,21 +22,68 @@ static bsize_t pool_sizes[BASE_CACHING_POOL_ARRAY_SIZE] =
  */
 #define START_SIZE  5
 
-static bpool_t* _cpoolCreatePool(bpool_factory *pf, const char *name, bsize_t initial_size, bsize_t increment_sz, bpool_callback *callback)
+struct bcaching_pool_magazine;
+
+/* Factory data of the pools created with the thread caches: the size class,
+ * and the cache which has the pool in its used list. The factory data of
+ * the other pools is the size class itself.
+ */
+struct bcaching_pool_class
 {
-	bcaching_pool *cp = (bcaching_pool*)pf;
-	bpool_t *pool;
-	int idx;
+	struct bcaching_pool_magazine *mag;
+	int		idx;
+};
 
-	BASE_CHECK_STACK();
+/*
+ * Cache of released pools of one thread, a magazine for each size class.
+ * The thread holding the flag 'locked' owns the lists and the counters:
+ * normally the owner thread, without the lock of the caching pool, or
+ * another thread with the lock of the caching pool which moves the pools of
+ * an idle cache back to the free lists. _cpoolDumpStatus() only reads the
+ * counters.
+ *
+ * The pools created from the cache are in its used list until they are
+ * released, by any thread. The list has its own lock 'used_locked', which
+ * is held only to change or walk the list and no other lock is taken while
+ * holding it.
+ */
+struct bcaching_pool_magazine
+{
+	struct bcaching_pool_magazine *next;
 
-	block_acquire(cp->lock);
+	int		locked;
 
-	/* Use pool factory's policy when callback is NULL */
-	if (callback == NULL)
-	{
-		callback = pf->policy.callback;
-	}
+	int		used_locked;
+	blist		used_list;
+	bsize_t		used_count;
+	struct bcaching_pool_class class_data[BASE_CACHING_POOL_ARRAY_SIZE+1];
+
+	blist		free_list[BASE_CACHING_POOL_ARRAY_SIZE];
+	unsigned	count[BASE_CACHING_POOL_ARRAY_SIZE];
+
+	/* Capacity of the pools in the cache, and the part of it counted in
+	 * the capacity of the caching pool when the lock was last taken
+	 */
+	bsize_t		capacity;
+	bsize_t		accounted;
+
+	/* Pools created, and created from the cache, by the thread */
+	bsize_t		created;
+	bsize_t		hits;
+};
+
+/* Class data of a pool created with the thread caches, or NULL for the other pools */
+static struct bcaching_pool_class *_cpoolMagazineClass(bpool_t *pool)
+{
+	if ((bsize_t) (bssize_t) pool->factory_data <= BASE_CACHING_POOL_ARRAY_SIZE)
+		return NULL;
+
+	return (struct bcaching_pool_class*) pool->factory_data;
+}
+
+static int _cpoolSizeIndex(bsize_t initial_size)
+{
+	int idx;
 
 	/* Search the suitable size for the pool. 
 	* We'll just do linear search to the size array, as the array size itself
@@ -54,6 +102,267 @@ static bpool_t* _cpoolCreatePool(bpool_factory *pf, const char *name, bsize_t in
 			;
 	}
 
+	return idx;
+}
+
+/* Cache of the calling thread, created on its first use */
+static struct bcaching_pool_magazine *_cpoolMagazine(bcaching_pool *cp)
+{
+	struct bcaching_pool_magazine *mag;
+	int i;
+
+	mag = (struct bcaching_pool_magazine*)bthreadLocalGet(cp->magazine_tls);
+	if (mag)
+		return mag;
+
+	mag = (struct bcaching_pool_magazine*)(*cp->factory.policy.block_alloc)(&cp->factory, sizeof(*mag));
+	if (!mag)
+		return NULL;
+
+	bbzero(mag, sizeof(*mag));
+	for (i=0; i<BASE_CACHING_POOL_ARRAY_SIZE; ++i)
+		blist_init(&mag->free_list[i]);
+	blist_init(&mag->used_list);
+	for (i=0; i<=BASE_CACHING_POOL_ARRAY_SIZE; ++i)
+	{
+		mag->class_data[i].mag = mag;
+		mag->class_data[i].idx = i;
+	}
+
+	if (bthreadLocalSet(cp->magazine_tls, mag) != BASE_SUCCESS)
+	{
+		(*cp->factory.policy.block_free)(&cp->factory, mag, sizeof(*mag));
+		return NULL;
+	}
+
+	block_acquire(cp->lock);
+	mag->next = cp->magazines;
+	cp->magazines = mag;
+	block_release(cp->lock);
+
+	return mag;
+}
+
+/* Take the cache, fails when another thread is moving its pools back to the free lists */
+static bbool_t _cpoolMagazineTryLock(struct bcaching_pool_magazine *mag)
+{
+	int unlocked = 0;
+
+	return __atomic_compare_exchange_n(&mag->locked, &unlocked, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+static void _cpoolMagazineUnlock(struct bcaching_pool_magazine *mag)
+{
+	__atomic_store_n(&mag->locked, 0, __ATOMIC_RELEASE);
+}
+
+/* Take the used list of the cache, which any thread releasing a pool of the cache may hold for a moment */
+static void _cpoolMagazineUsedLock(struct bcaching_pool_magazine *mag)
+{
+	int unlocked = 0;
+
+	while (!__atomic_compare_exchange_n(&mag->used_locked, &unlocked, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+	{
+		unlocked = 0;
+		bthreadSleepMs(0);
+	}
+}
+
+static void _cpoolMagazineUsedUnlock(struct bcaching_pool_magazine *mag)
+{
+	__atomic_store_n(&mag->used_locked, 0, __ATOMIC_RELEASE);
+}
+
+/* Count the pools created from and released to the cache since the last call in the capacity of the caching pool.
+ * Called with the lock of the caching pool and the cache.
+ */
+static void _cpoolMagazineAccount(bcaching_pool *cp, struct bcaching_pool_magazine *mag)
+{
+	cp->capacity = cp->capacity + mag->capacity - mag->accounted;
+	mag->accounted = mag->capacity;
+}
+
+/* Move up to n of the oldest pools of the cache back to the free list, and destroy them when the caching pool is over
+ * its maximum capacity. Called with the lock of the caching pool and the cache, after _cpoolMagazineAccount().
+ */
+static void _cpoolMagazineMove(bcaching_pool *cp, struct bcaching_pool_magazine *mag, int idx, unsigned n)
+{
+	while (n-- && !blist_empty(&mag->free_list[idx]))
+	{
+		/* The oldest pools of the magazine are at the end of the list */
+		bpool_t *pool = (bpool_t*) mag->free_list[idx].prev;
+		bsize_t pool_capacity = bpool_get_capacity(pool);
+
+		blist_erase(pool);
+		--mag->count[idx];
+		mag->capacity -= pool_capacity;
+		mag->accounted -= pool_capacity;
+
+		if (cp->capacity > cp->max_capacity)
+		{
+			cp->capacity -= pool_capacity;
+			bpool_destroy_int(pool);
+			continue;
+		}
+
+		blist_insert_after(&cp->free_list[idx], pool);
+		++cp->magazine_flushes;
+	}
+}
+
+/* Move the pools of the caches of the idle threads, including the threads which have exited, back to the free lists.
+ * Only the pools of the size class idx when idx is less than BASE_CACHING_POOL_ARRAY_SIZE. Called with the lock of the
+ * caching pool.
+ */
+static void _cpoolMagazineDrain(bcaching_pool *cp, struct bcaching_pool_magazine *self, int idx)
+{
+	struct bcaching_pool_magazine *mag;
+	int i;
+
+	for (mag = cp->magazines; mag; mag = mag->next)
+	{
+		if (mag == self || !_cpoolMagazineTryLock(mag))
+			continue;
+
+		_cpoolMagazineAccount(cp, mag);
+		for (i=0; i<BASE_CACHING_POOL_ARRAY_SIZE; ++i)
+		{
+			if (idx == BASE_CACHING_POOL_ARRAY_SIZE || i == idx)
+				_cpoolMagazineMove(cp, mag, i, mag->count[i]);
+		}
+
+		_cpoolMagazineUnlock(mag);
+	}
+}
+
+/* Take half a magazine of pools from the free list of the caching pool, which takes the pools of this size from the
+ * caches of the idle threads when it is empty
+ */
+static void _cpoolMagazineRefill(bcaching_pool *cp, struct bcaching_pool_magazine *mag, int idx)
+{
+	unsigned n = (cp->magazine_size + 1) / 2;
+
+	block_acquire(cp->lock);
+
+	_cpoolMagazineAccount(cp, mag);
+	if (blist_empty(&cp->free_list[idx]))
+		_cpoolMagazineDrain(cp, mag, idx);
+
+	while (n-- && !blist_empty(&cp->free_list[idx]))
+	{
+		bpool_t *pool = (bpool_t*) cp->free_list[idx].next;
+		bsize_t pool_capacity = bpool_get_capacity(pool);
+
+		/* Still counted in the capacity of the caching pool */
+		blist_erase(pool);
+		blist_insert_after(&mag->free_list[idx], pool);
+		++mag->count[idx];
+		mag->capacity += pool_capacity;
+		mag->accounted += pool_capacity;
+		++cp->magazine_refills;
+	}
+
+	block_release(cp->lock);
+}
+
+/* Give half of a full magazine back to the free list of the caching pool */
+static void _cpoolMagazineFlush(bcaching_pool *cp, struct bcaching_pool_magazine *mag, int idx)
+{
+	block_acquire(cp->lock);
+
+	_cpoolMagazineAccount(cp, mag);
+	_cpoolMagazineMove(cp, mag, idx, (cp->magazine_size + 1) / 2);
+
+	block_release(cp->lock);
+}
+
+/* Create the pool from the cache of the thread, without the lock when the cache has one */
+static bpool_t* _cpoolMagazineCreate(bcaching_pool *cp, struct bcaching_pool_magazine *mag, int idx, const char *name, bsize_t initial_size, bsize_t increment_sz, bpool_callback *callback)
+{
+	bpool_t *pool;
+
+	if (idx < BASE_CACHING_POOL_ARRAY_SIZE && blist_empty(&mag->free_list[idx]))
+		_cpoolMagazineRefill(cp, mag, idx);
+
+	if (idx < BASE_CACHING_POOL_ARRAY_SIZE && !blist_empty(&mag->free_list[idx]))
+	{
+		pool = (bpool_t*) mag->free_list[idx].next;
+		blist_erase(pool);
+		--mag->count[idx];
+		mag->capacity -= bpool_get_capacity(pool);
+		++mag->hits;
+
+		bpool_init_int(pool, name, increment_sz, callback);
+	}
+	else
+	{
+		if (idx < BASE_CACHING_POOL_ARRAY_SIZE)
+			initial_size = pool_sizes[idx];
+
+		pool = bpool_create_int(&cp->factory, name, initial_size, increment_sz, callback);
+		if (!pool)
+			return NULL;
+	}
+
+	/* In the used list of the cache rather than of the caching pool */
+	pool->factory_data = &mag->class_data[idx];
+	_cpoolMagazineUsedLock(mag);
+	blist_insert_before(&mag->used_list, pool);
+	++mag->used_count;
+	_cpoolMagazineUsedUnlock(mag);
+	++mag->created;
+
+	return pool;
+}
+
+/* Keep the released pool in the cache of the thread, flushing half of the cache when it is full */
+static void _cpoolMagazineRelease(bcaching_pool *cp, struct bcaching_pool_magazine *mag, bpool_t *pool, unsigned i)
+{
+	if (bpool_get_capacity(pool) > pool_sizes[BASE_CACHING_POOL_ARRAY_SIZE-1] || i >= BASE_CACHING_POOL_ARRAY_SIZE)
+	{
+		bpool_destroy_int(pool);
+		return;
+	}
+
+	bpool_reset(pool);
+
+	if (mag->count[i] >= cp->magazine_size)
+		_cpoolMagazineFlush(cp, mag, i);
+
+	blist_insert_after(&mag->free_list[i], pool);
+	++mag->count[i];
+	mag->capacity += bpool_get_capacity(pool);
+}
+
+static bpool_t* _cpoolCreatePool(bpool_factory *pf, const char *name, bsize_t initial_size, bsize_t increment_sz, bpool_callback *callback)
+{
+	bcaching_pool *cp = (bcaching_pool*)pf;
+	bpool_t *pool;
+	int idx;
+
+	BASE_CHECK_STACK();
+
+	/* Use pool factory's policy when callback is NULL */
+	if (callback == NULL)
+	{
+		callback = pf->policy.callback;
+	}
+
+	idx = _cpoolSizeIndex(initial_size);
+
+	if (cp->magazine_size)
+	{
+		struct bcaching_pool_magazine *mag = _cpoolMagazine(cp);
+		if (mag && _cpoolMagazineTryLock(mag))
+		{
+			pool = _cpoolMagazineCreate(cp, mag, idx, name, initial_size, increment_sz, callback);
+			_cpoolMagazineUnlock(mag);
+			return pool;
+		}
+	}
+
+	block_acquire(cp->lock);
+
 	/* Check whether there's a pool in the list. */
 	if (idx==BASE_CACHING_POOL_ARRAY_SIZE || blist_empty(&cp->free_list[idx]))
 	{
@@ -109,6 +418,7 @@ static bpool_t* _cpoolCreatePool(bpool_factory *pf, const char *name, bsize_t in
 static void _cpoolReleasePool( bpool_factory *pf, bpool_t *pool)
 {
     bcaching_pool *cp = (bcaching_pool*)pf;
+    struct bcaching_pool_class *class_data;
     bsize_t pool_capacity;
     unsigned i;
 
@@ -116,21 +426,49 @@ static void _cpoolReleasePool( bpool_factory *pf, bpool_t *pool)
 
     BASE_ASSERT_ON_FAIL(pf && pool, return);
 
+    /* Pools created with the thread caches are in the used list of the
+     * cache which created them, and are counted by the caches even when
+     * they go back to the free lists
+     */
+    class_data = _cpoolMagazineClass(pool);
+    if (class_data) {
+	struct bcaching_pool_magazine *mag = class_data->mag;
+
+	i = (unsigned) class_data->idx;
+
+	_cpoolMagazineUsedLock(mag);
+	blist_erase(pool);
+	--mag->used_count;
+	_cpoolMagazineUsedUnlock(mag);
+
+	mag = (cp->magazine_tls != -1) ? _cpoolMagazine(cp) : NULL;
+	if (mag && cp->magazine_size && _cpoolMagazineTryLock(mag)) {
+	    _cpoolMagazineRelease(cp, mag, pool, i);
+	    _cpoolMagazineUnlock(mag);
+	    return;
+	}
+    } else {
+	i = (unsigned) (unsigned long) (bssize_t) pool->factory_data;
+    }
+
     block_acquire(cp->lock);
 
+    if (!class_data) {
 #if BASE_SAFE_POOL
-    /* Make sure pool is still in our used list */
-    if (blist_find_node(&cp->used_list, pool) != pool) {
-	bassert(!"Attempt to destroy pool that has been destroyed before");
-	return;
-    }
+	/* Make sure pool is still in our used list */
+	if (blist_find_node(&cp->used_list, pool) != pool) {
+	    bassert(!"Attempt to destroy pool that has been destroyed before");
+	    block_release(cp->lock);
+	    return;
+	}
 #endif
 
-    /* Erase from the used list. */
-    blist_erase(pool);
+	/* Erase from the used list. */
+	blist_erase(pool);
 
-    /* Decrement used count. */
-    --cp->used_count;
+	/* Decrement used count. */
+	--cp->used_count;
+    }
 
     pool_capacity = bpool_get_capacity(pool);
 
@@ -157,8 +495,6 @@ static void _cpoolReleasePool( bpool_factory *pf, bpool_t *pool)
     /*
      * Otherwise put the pool in our recycle list.
      */
-    i = (unsigned) (unsigned long) (bssize_t) pool->factory_data;
-
     bassert(i<BASE_CACHING_POOL_ARRAY_SIZE);
     if (i >= BASE_CACHING_POOL_ARRAY_SIZE ) {
 	/* Something has gone wrong with the pool. */
@@ -173,6 +509,26 @@ static void _cpoolReleasePool( bpool_factory *pf, bpool_t *pool)
     block_release(cp->lock);
 }
 
+#if BASE_LOG_MAX_LEVEL >= 3
+static void _cpoolDumpUsedList(blist *used_list, bsize_t *total_used, bsize_t *total_capacity)
+{
+    bpool_t *pool = (bpool_t*) used_list->next;
+
+    while (pool != (void*)used_list) {
+	bsize_t pool_capacity = bpool_get_capacity(pool);
+	BASE_INFO("   %16s: %8d of %8d (%d%%) used, %d wasted", 
+			      bpool_getobjname(pool), 
+			      bpool_get_used_size(pool), 
+			      pool_capacity,
+			      bpool_get_used_size(pool)*100/pool_capacity,
+			      bpool_get_wasted_size(pool));
+	*total_used += bpool_get_used_size(pool);
+	*total_capacity += pool_capacity;
+	pool = pool->next;
+    }
+}
+#endif
+
 static void _cpoolDumpStatus(bpool_factory *factory, bbool_t detail )
 {
 #if BASE_LOG_MAX_LEVEL >= 3
@@ -182,20 +538,38 @@ static void _cpoolDumpStatus(bpool_factory *factory, bbool_t detail )
 
     BASE_INFO(" Dumping caching pool:");
     BASE_INFO("   Capacity=%u, max_capacity=%u, used_cnt=%u", cp->capacity, cp->max_capacity, cp->used_count);
+    if (cp->magazines) {
+	struct bcaching_pool_magazine *mag;
+	bsize_t threads = 0, held = 0, capacity = 0, created = 0, hits = 0, used = 0;
+
+	for (mag = cp->magazines; mag; mag = mag->next) {
+	    int i;
+
+	    ++threads;
+	    used += __atomic_load_n(&mag->used_count, __ATOMIC_RELAXED);
+	    for (i=0; i<BASE_CACHING_POOL_ARRAY_SIZE; ++i)
+		held += mag->count[i];
+	    capacity += mag->capacity;
+	    created += mag->created;
+	    hits += mag->hits;
+	}
+
+	BASE_INFO("   Thread caches: size=%u, threads=%u, held=%u (%u bytes), used_cnt=%d",
+		  cp->magazine_size, threads, held, capacity, used);
+	BASE_INFO("   Thread caches: created=%u, hits=%u (%u%%), refills=%u, flushes=%u",
+		  created, hits, created ? (unsigned)(hits * 100 / created) : 0,
+		  cp->magazine_refills, cp->magazine_flushes);
+    }
     if (detail) {
-	bpool_t *pool = (bpool_t*) cp->used_list.next;
+	struct bcaching_pool_magazine *mag;
 	bsize_t total_used = 0, total_capacity = 0;
         BASE_INFO("  Dumping all active pools:");
-	while (pool != (void*)&cp->used_list) {
-	    bsize_t pool_capacity = bpool_get_capacity(pool);
-	    BASE_INFO("   %16s: %8d of %8d (%d%%) used", 
-				  bpool_getobjname(pool), 
-				  bpool_get_used_size(pool), 
-				  pool_capacity,
-				  bpool_get_used_size(pool)*100/pool_capacity);
-	    total_used += bpool_get_used_size(pool);
-	    total_capacity += pool_capacity;
-	    pool = pool->next;
+
+	_cpoolDumpUsedList(&cp->used_list, &total_used, &total_capacity);
+	for (mag = cp->magazines; mag; mag = mag->next) {
+	    _cpoolMagazineUsedLock(mag);
+	    _cpoolDumpUsedList(&mag->used_list, &total_used, &total_capacity);
+	    _cpoolMagazineUsedUnlock(mag);
 	}
 	if (total_capacity) {
 	    BASE_INFO("  Total %9d of %9d (%d %%) used!",
@@ -269,6 +643,46 @@ void bcaching_pool_init( bcaching_pool *cp, const bpool_factory_policy *policy,
 	{
 		BASE_ERROR("Mutex of pool failed");
 	}
+
+	cp->magazine_tls = -1;
+	if (BASE_CACHING_POOL_MAGAZINE_SIZE)
+		bcaching_pool_set_magazine(cp, BASE_CACHING_POOL_MAGAZINE_SIZE);
+}
+
+bstatus_t bcaching_pool_set_magazine( bcaching_pool *cp, unsigned size )
+{
+	BASE_ASSERT_RETURN(cp, BASE_EINVAL);
+
+#if BASE_SAFE_POOL
+	/* Keep all pools in the used list, which checks the releases */
+	size = 0;
+#endif
+
+	if (size && cp->magazine_tls == -1)
+	{
+		bstatus_t status = bthreadLocalAlloc(&cp->magazine_tls);
+		if (status != BASE_SUCCESS)
+		{
+			cp->magazine_tls = -1;
+			return status;
+		}
+	}
+
+	cp->magazine_size = size;
+	if (!size)
+		bcaching_pool_flush_magazines(cp);
+
+	return BASE_SUCCESS;
+}
+
+void bcaching_pool_flush_magazines( bcaching_pool *cp )
+{
+	BASE_ASSERT_ON_FAIL(cp, return);
+
+	/* The cache of the calling thread too */
+	block_acquire(cp->lock);
+	_cpoolMagazineDrain(cp, NULL, BASE_CACHING_POOL_ARRAY_SIZE);
+	block_release(cp->lock);
 }
 
 void bcaching_pool_destroy( bcaching_pool *cp )
@@ -278,6 +692,41 @@ void bcaching_pool_destroy( bcaching_pool *cp )
 
 	BASE_CHECK_STACK();
 
+	/* Delete the thread caches, the threads must not use the caching pool any more */
+	while (cp->magazines)
+	{
+		struct bcaching_pool_magazine *mag = cp->magazines;
+
+		for (i=0; i < BASE_CACHING_POOL_ARRAY_SIZE; ++i)
+		{
+			while (!blist_empty(&mag->free_list[i]))
+			{
+				pool = (bpool_t*) mag->free_list[i].next;
+				blist_erase(pool);
+				bpool_destroy_int(pool);
+			}
+		}
+
+		while (!blist_empty(&mag->used_list))
+		{
+			pool = (bpool_t*) mag->used_list.next;
+			blist_erase(pool);
+
+			BASE_STR_INFO(pool->objName, "Pool is not released by application, releasing now");
+			bpool_destroy_int(pool);
+		}
+
+		cp->magazines = mag->next;
+		(*cp->factory.policy.block_free)(&cp->factory, mag, sizeof(*mag));
+	}
+
+	if (cp->magazine_tls != -1)
+	{
+		bthreadLocalFree(cp->magazine_tls);
+		cp->magazine_tls = -1;
+	}
+	cp->magazine_size = 0;
+
 	/* Delete all pool in free list */
 	for (i=0; i < BASE_CACHING_POOL_ARRAY_SIZE; ++i)
 	{
@@ -119,6 +119,15 @@ bsize_t bpool_get_used_size_imp(bpool_t *pool)
     return pool->used_size;
 }
 
+/* Get wasted size */
+bsize_t bpool_get_wasted_size_imp(bpool_t *pool)
+{
+    BASE_UNUSED_ARG(pool);
+
+    /* Each allocation has its own memory */
+    return 0;
+}
+
 /* Allocate memory from the pool */
 void* bpool_alloc_imp( const char *file, int line, 
 				 bpool_t *pool, bsize_t sz)
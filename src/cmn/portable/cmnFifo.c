@@ -4,63 +4,220 @@
 
 #include <cmnOsPort.h>
 
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+/*
+* Elements are in a ring of slots (Vyukov's bounded queue): a producer claims the slot of 'tail'
+* with CAS and publishes the element by moving the sequence of the slot forward. The only consumer
+* reads slots in order from 'head'. Elements inserted at the beginning go to the locked 'front'
+* list, which the consumer checks first.
+*/
+
+/* ms < 0: no timeout */
+static void _cmnFifoSleep(cmn_fifo_t *ff, int ms)
+{
+#if defined(__linux__)
+	struct timespec timeout;
+
+	timeout.tv_sec = ms/1000;
+	timeout.tv_nsec = (ms%1000)*1000000L;
+	syscall(SYS_futex, &ff->waiting, FUTEX_WAIT_PRIVATE, 1, (ms < 0)?NULL:&timeout, NULL, 0);
+#else
+	struct timespec deadline;
+
+	if(ms >= 0)
+	{
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += ms/1000;
+		deadline.tv_nsec += (ms%1000)*1000000L;
+		if(deadline.tv_nsec >= 1000000000L)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000L;
+		}
+	}
+
+	cmn_mutex_lock(ff->qislocked);
+	if(__atomic_load_n(&ff->waiting, __ATOMIC_SEQ_CST))
+	{
+		if(ms < 0)
+			cmn_cond_wait(ff->qisempty, ff->qislocked);
+		else
+			cmn_cond_timedwait(ff->qisempty, ff->qislocked, &deadline);
+	}
+	cmn_mutex_unlock(ff->qislocked);
+#endif
+}
+
+/* wake consumer if it is blocked; called after element is published */
+static void _cmnFifoWake(cmn_fifo_t *ff)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&ff->waiting, __ATOMIC_RELAXED) == 0 ||
+		__atomic_exchange_n(&ff->waiting, 0, __ATOMIC_SEQ_CST) == 0)
+	{
+		return;
+	}
+
+#if defined(__linux__)
+	syscall(SYS_futex, &ff->waiting, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+#else
+	cmn_mutex_lock(ff->qislocked);
+	cmn_cond_signal(ff->qisempty);
+	cmn_mutex_unlock(ff->qislocked);
+#endif
+}
+
+static int _cmnFifoIsEmpty(cmn_fifo_t *ff)
+{
+	unsigned int pos = ff->head;
+
+	if(__atomic_load_n(&ff->nbFront, __ATOMIC_ACQUIRE) > 0)
+		return 0;
+	return __atomic_load_n(&ff->slots[pos & ff->mask].seq, __ATOMIC_ACQUIRE) != pos + 1;
+}
+
+/* block consumer until fifo is not empty, or ms elapsed, or the fifo is kicked when wakeable.
+* Producers check 'waiting' after publishing, consumer checks fifo after setting 'waiting', so one
+* of them always sees the other */
+static void _cmnFifoWait(cmn_fifo_t *ff, int wakeable, int ms)
+{
+	__atomic_store_n(&ff->waiting, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if(_cmnFifoIsEmpty(ff) && !(wakeable && __atomic_load_n(&ff->kick, __ATOMIC_SEQ_CST)) )
+	{
+		_cmnFifoSleep(ff, ms);
+	}
+
+	__atomic_store_n(&ff->waiting, 0, __ATOMIC_RELAXED);
+}
+
+static int _cmnFifoPush(cmn_fifo_t *ff, void *el)
+{
+	cmn_fifo_slot_t *slot;
+	unsigned int pos = __atomic_load_n(&ff->tail, __ATOMIC_RELAXED);
+	int dif;
+
+	while(1)
+	{
+		if((int)(pos - __atomic_load_n(&ff->head, __ATOMIC_ACQUIRE)) + __atomic_load_n(&ff->nbFront, __ATOMIC_RELAXED) >= ff->maxSize)
+			return -1;
+
+		slot = &ff->slots[pos & ff->mask];
+		dif = (int)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+		if(dif == 0)
+		{
+			if(__atomic_compare_exchange_n(&ff->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+		else if(dif < 0)
+		{/* slot not read yet: ring is full */
+			return -1;
+		}
+		else
+		{
+			pos = __atomic_load_n(&ff->tail, __ATOMIC_RELAXED);
+		}
+	}
+
+	slot->element = el;
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/* get elements in order, front list first; called by consumer only */
+static int _cmnFifoPop(cmn_fifo_t *ff, void **elements, int max)
+{
+	cmn_fifo_slot_t *slot;
+	unsigned int pos = ff->head;
+	int n = 0;
+
+	if(__atomic_load_n(&ff->nbFront, __ATOMIC_ACQUIRE) > 0)
+	{
+		cmn_mutex_lock (ff->qislocked);
+		while(n < max && cmn_list_size(ff->front) > 0)
+		{
+			elements[n++] = cmn_list_pop_front (ff->front);
+		}
+		__atomic_store_n(&ff->nbFront, cmn_list_size(ff->front), __ATOMIC_RELEASE);
+		cmn_mutex_unlock (ff->qislocked);
+	}
+
+	while(n < max)
+	{
+		slot = &ff->slots[pos & ff->mask];
+		if(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1)
+			break;
+
+		elements[n++] = slot->element;
+		__atomic_store_n(&slot->seq, pos + ff->mask + 1, __ATOMIC_RELEASE);
+		pos++;
+	}
+
+	/* one store for the whole batch */
+	if(pos != ff->head)
+		__atomic_store_n(&ff->head, pos, __ATOMIC_RELEASE);
+
+	return n;
+}
+
+
 /* always use this method to initiate cmn_fifo_t.*/
 void cmn_fifo_init (int _maxSize, cmn_fifo_t **_ff)
 {
 	cmn_fifo_t *ff = NULL;
+	unsigned int size = 1, i;
+
 	ff = MALLOC(sizeof(cmn_fifo_t) );
 	*_ff = ff;
-	
-	if(_maxSize < 0 )
+
+	if(_maxSize <= 0 )
 	{
 		_maxSize = 1;
 	}
-	
+	while(size < (unsigned int)_maxSize)
+	{
+		size <<= 1;
+	}
+
+	ff->slots = (cmn_fifo_slot_t *) MALLOC (size*sizeof (cmn_fifo_slot_t));
+	for(i = 0; i < size; i++)
+	{
+		ff->slots[i].seq = i;
+		ff->slots[i].element = NULL;
+	}
+	ff->mask = size - 1;
+	ff->tail = 0;
+	ff->head = 0;
+	ff->waiting = 0;
+	ff->kick = 0;
+
 	ff->qislocked = cmn_mutex_init ();
-	/*INIT SEMA TO BLOCK ON GET() WHEN QUEUE IS EMPTY */
-#if defined(HAVE_SEMAPHORE_H)
-	ff->qisempty = cmn_sem_init (0);
-#else
+#if !defined(__linux__)
 	ff->qisempty = cmn_cond_init();
 #endif
-	ff->queue = (cmn_list_t *) MALLOC (sizeof (cmn_list_t));
-	cmn_list_init (ff->queue);
-	/* ff->nb_elt = 0; */
-	ff->etat = vide;
+	ff->front = (cmn_list_t *) MALLOC (sizeof (cmn_list_t));
+	cmn_list_init (ff->front);
+	ff->nbFront = 0;
 
 	ff->maxSize = _maxSize;
 }
 
 int cmn_fifo_add (cmn_fifo_t * ff, void *el)
 {
-	cmn_mutex_lock (ff->qislocked);
-
-	if (ff->etat != plein)
-	{
-		/* ff->nb_elt++; */
-		cmn_list_add (ff->queue, el, -1);	/* insert at end of queue */
-	}
-	else
+	if(_cmnFifoPush(ff, el) != 0)
 	{
 		CMN_WARN("too much traffic in fifo.");
-
-		cmn_mutex_unlock (ff->qislocked);
 		return -1;		/* stack is full */
 	}
 
-	/* if (ff->nb_elt >= FIFO_MAX_SIZE) */
-	if (cmn_list_size (ff->queue) >= ff->maxSize )
-		ff->etat = plein;
-	else
-		ff->etat = ok;
-
-#if defined(HAVE_SEMAPHORE_H)
-	cmn_sem_post (ff->qisempty);
-#else
-	cmn_cond_signal(ff->qisempty);
-#endif
-	cmn_mutex_unlock (ff->qislocked);
-
+	_cmnFifoWake(ff);
 	return 0;
 }
 
@@ -69,83 +226,46 @@ int cmn_fifo_insert (cmn_fifo_t * ff, void *el)
 {
 	cmn_mutex_lock (ff->qislocked);
 
-	if (ff->etat != plein)
-	{
-		/* ff->nb_elt++; */
-		cmn_list_add (ff->queue, el, 0);	/* insert at end of queue */
-	}
-	else
+	if (cmn_fifo_size(ff) >= ff->maxSize)
 	{
 		CMN_WARN("too much traffic in fifo.");
 
 		cmn_mutex_unlock (ff->qislocked);
 		return -1;		/* stack is full */
 	}
-	/* if (ff->nb_elt >= FIFO_MAX_SIZE) */
-	if (cmn_list_size (ff->queue) >= ff->maxSize )
-		ff->etat = plein;
-	else
-		ff->etat = ok;
 
-#if defined(HAVE_SEMAPHORE_H)
-	cmn_sem_post (ff->qisempty);
-#else
-	cmn_cond_signal(ff->qisempty);
-#endif
+	if(cmn_list_push_front (ff->front, el) == NULL)	/* insert at beginning of queue */
+	{
+		cmn_mutex_unlock (ff->qislocked);
+		return -1;
+	}
+	__atomic_store_n(&ff->nbFront, cmn_list_size(ff->front), __ATOMIC_RELEASE);
+
 	cmn_mutex_unlock (ff->qislocked);
 
+	_cmnFifoWake(ff);
 	return 0;
 }
 
 
 int cmn_fifo_size (cmn_fifo_t * ff)
 {
-	int i;
-
-	cmn_mutex_lock (ff->qislocked);
-
-	i = cmn_list_size (ff->queue);
+	unsigned int head = __atomic_load_n(&ff->head, __ATOMIC_ACQUIRE);
+	unsigned int tail = __atomic_load_n(&ff->tail, __ATOMIC_ACQUIRE);
 
-	cmn_mutex_unlock (ff->qislocked);
-
-	return i;
+	return (int)(tail - head) + __atomic_load_n(&ff->nbFront, __ATOMIC_ACQUIRE);
 }
 
 
 void *cmn_fifo_get (cmn_fifo_t * ff)
 {
 	void *el = NULL;
-	int i;
-
-#if defined(HAVE_SEMAPHORE_H)
-	i = cmn_sem_wait (ff->qisempty);
-#else
-	i  = cmn_cond_wait(ff->qisempty, ff->qislocked);
-#endif
-
-	if (i != 0)
-		return NULL;
-	cmn_mutex_lock (ff->qislocked);
 
-	if (ff->etat != vide)
+	while(_cmnFifoPop(ff, &el, 1) == 0)
 	{
-		el = cmn_list_get (ff->queue, 0);
-		cmn_list_remove (ff->queue, 0);
-		/* ff->nb_elt--; */
+		_cmnFifoWait(ff, 0, -1);
 	}
-	else
-	{
-		CMN_ERROR("no element in fifo.");
-		cmn_mutex_unlock (ff->qislocked);
-		return 0;			/* pile vide */
-	}
-	/* if (ff->nb_elt <= 0) */
-	if (cmn_list_size (ff->queue) <= 0)
-		ff->etat = vide;
-	else
-		ff->etat = ok;
 
-	cmn_mutex_unlock (ff->qislocked);
 	return el;
 }
 
@@ -153,60 +273,95 @@ void *cmn_fifo_tryget (cmn_fifo_t * ff)
 {
 	void *el = NULL;
 
-#if defined(HAVE_SEMAPHORE_H)
-	if (0 != cmn_sem_trywait (ff->qisempty))
-#else
-	const struct timespec abstime = {0};
-	if( 0 != cmn_cond_timedwait(ff->qisempty, ff->qislocked, &abstime))
-#endif
-	{/* no elements... */
-		return NULL;
-	}
+	_cmnFifoPop(ff, &el, 1);
 
-	cmn_mutex_lock (ff->qislocked);
-	if (ff->etat == vide)
-		return NULL;
+	return el;
+}
 
-	if (ff->etat != vide)
+int cmn_fifo_get_batch (cmn_fifo_t * ff, void **elements, int max)
+{
+	int n;
+
+	if(max <= 0)
+		return 0;
+
+	while((n = _cmnFifoPop(ff, elements, max)) == 0)
 	{
-		el = cmn_list_get (ff->queue, 0);
-		cmn_list_remove (ff->queue, 0);
-		/* ff->nb_elt--; */
+		_cmnFifoWait(ff, 0, -1);
 	}
-	else
-	{/* this case MUST never happen... */
-		CMN_ERROR("no element in fifo.");
-		cmn_mutex_unlock (ff->qislocked);
+
+	return n;
+}
+
+int cmn_fifo_tryget_batch (cmn_fifo_t * ff, void **elements, int max)
+{
+	if(max <= 0)
 		return 0;
-	}
 
-	/* if (ff->nb_elt <= 0) */
-	if (cmn_list_size (ff->queue) <= 0)
-		ff->etat = vide;
-	else
-		ff->etat = ok;
+	return _cmnFifoPop(ff, elements, max);
+}
 
-	cmn_mutex_unlock (ff->qislocked);
+int cmn_fifo_get_batch_timed (cmn_fifo_t * ff, void **elements, int max, int ms)
+{
+	struct timespec start;
+	int n, left = ms;
 
-	return el;
+	if(max <= 0)
+		return 0;
+
+	if(ms > 0)
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while((n = _cmnFifoPop(ff, elements, max)) == 0)
+	{
+		if(__atomic_exchange_n(&ff->kick, 0, __ATOMIC_SEQ_CST) || left == 0)
+			break;
+
+		_cmnFifoWait(ff, 1, left);
+
+		if(ms > 0)
+		{/* the wait can end early on signals, so wait again for what is left */
+			struct timespec now;
+
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			left = ms - (int)((now.tv_sec - start.tv_sec)*1000 + (now.tv_nsec - start.tv_nsec)/1000000);
+			if(left < 0)
+				left = 0;
+		}
+	}
+
+	return n;
+}
+
+void cmn_fifo_wake (cmn_fifo_t * ff)
+{
+	__atomic_store_n(&ff->kick, 1, __ATOMIC_SEQ_CST);
+	_cmnFifoWake(ff);
 }
 
 void cmn_fifo_free (cmn_fifo_t * ff)
 {
+	void *el;
+
 	if (ff == NULL)
 		return;
 
+	/* elements left are freed as the list of the old fifo did */
+	while(_cmnFifoPop(ff, &el, 1) )
+	{
+		if(el)
+			FREE(el);
+	}
+
 	cmn_mutex_destroy (ff->qislocked);
 	/* seems that pthread_mutex_destroy does not free space by itself */
-#if defined(HAVE_SEMAPHORE_H)
-	cmn_sem_destroy (ff->qisempty);
-#else
+#if !defined(__linux__)
 	cmn_cond_destroy(ff->qisempty);
 #endif
 
-	cmn_list_ofchar_free(ff->queue, 0);
-	
-	FREE (ff->queue);
+	cmn_list_free (ff->front);
+	FREE (ff->front);
+	FREE (ff->slots);
 	FREE (ff);
 }
 
@@ -2,46 +2,317 @@
 * $Id$
 */
 
+#include <cmnOsPort.h>
+
 #include "compact.h"
 #include "cmnFsm.h"
 #include "cmnLog.h"
 
+/*
+* FSM is compiled into a jump table: states are indexed by state - minState, and transitions of
+* a state by event - minEvent, so one event is dispatched with 2 array lookups. Every transition has
+* a cell of counters, in the order of states and their transitions.
+*/
+
+/* beyond them, states or events are too sparse for a table and they are searched as before */
+#define	_CMN_FSM_MAX_STATES			4096
+#define	_CMN_FSM_MAX_JUMPS			65536
+
+typedef	struct
+{
+	transition_t			*transition;
+	CmnFsmStats			stats;
+}_cmn_fsm_cell_t;
+
+typedef	struct
+{
+	statemachine_t		*state;		/* NULL when FSM has no such state */
+	int					firstCell;	/* cell of its first transition */
+}_cmn_fsm_state_t;
+
+struct _cmn_fsm_table
+{
+	int					minState;
+	int					nbStates;	/* 0: states are searched */
+	int					minEvent;
+	int					nbEvents;	/* 0: transitions of state are searched */
+
+	volatile int			profile;
+
+	_cmn_fsm_state_t		*states;
+	int					*jumps;		/* cell + 1 of (state - minState)*nbEvents + event - minEvent, 0 when not handled */
+
+	int					nbCells;
+	_cmn_fsm_cell_t		*cells;
+};
+
+
 int _fsmStateHandle(statemachine_t *state, void *ctx, EVENT *event)
 {
 	int	i;
 	int	res;
 	transition_t *handle = state->eventHandlers;
-	
+
 	for(i=0; i< state->size; i++)
 	{
 		if(event->event == handle->event )
 		{
-//			CMN_DEBUG("Event '%s' is handled in state '%s'", handle->name, state->name);
+#if CMN_FSM_DEBUG
+			CMN_DEBUG("Event '%s' is handled in state '%s'", handle->name, state->name);
+#endif
 			res = (handle->handle)(ctx, event );
 
 			/* FSM is in shared library, so it does not manage memory allocated by the app: who allocate, then who free it */
 			/*
 			FREE(event);
-			*/			
+			*/
 			return res;
 		}
-		
+
 		handle++;
 	}
-	
+
 	return STATE_CONTINUE;
 }
 
+/* FSM without table */
+static int _cmnFsmSearchHandle(void *ctx, FSM_OWNER *owner, EVENT *event)
+{
+	int		j;
+	int		newState = STATE_CONTINUE;
+
+	for(j=0; j< owner->fsm->size; j++)
+	{
+		if( owner->fsm->states[j].state == owner->currentState )
+		{
+#if CMN_FSM_DEBUG
+			CMN_DEBUG("FSM '%s' handling in state '%s'", owner->name, owner->fsm->states[j].name);
+#endif
+			newState = _fsmStateHandle( &owner->fsm->states[j], ctx, event);
+			break;
+		}
+	}
+
+	if(newState != STATE_CONTINUE && newState != owner->currentState )
+	{
+		for(j=0; j< owner->fsm->size; j++)
+		{
+			if( owner->fsm->states[j].state == newState )
+			{
+				/* clean old timer for this device and new timer is set in enter_handle */
+				owner->timeout = 0;
+
+				if( owner->fsm->states[j].enter_handle!= NULL)
+					( owner->fsm->states[j].enter_handle)( owner);
+
+#if CMN_FSM_DEBUG
+				CMN_DEBUG("Entered into new state '%s' of FSM '%s'", owner->fsm->states[j].name, owner->name );
+#endif
+				break;
+			}
+		}
+
+		owner->currentState = newState;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+
+static void _cmnFsmFreeTable(cmn_fsm_table_t *table)
+{
+	if(table->states)
+		FREE(table->states);
+	if(table->jumps)
+		FREE(table->jumps);
+	if(table->cells)
+		FREE(table->cells);
+	FREE(table);
+}
+
+static cmn_fsm_table_t *_cmnFsmBuild(SERVICE_FSM *fsm)
+{
+	cmn_fsm_table_t *table;
+	int minState = 0, maxState = 0, minEvent = 0, maxEvent = -1;
+	int i, j, index, cell;
+	transition_t *tr;
+
+	table = (cmn_fsm_table_t *)MALLOC(sizeof(cmn_fsm_table_t));
+	if(table == NULL)
+		return NULL;
+	memset(table, 0, sizeof(cmn_fsm_table_t));
+
+	for(j = 0; j < fsm->size; j++)
+	{
+		if(j == 0 || fsm->states[j].state < minState)
+			minState = fsm->states[j].state;
+		if(j == 0 || fsm->states[j].state > maxState)
+			maxState = fsm->states[j].state;
+
+		for(i = 0; i < fsm->states[j].size; i++)
+		{
+			tr = &fsm->states[j].eventHandlers[i];
+			/* events lower are never dispatched */
+			if(tr->event <= EVENT_UNKNOWN)
+				continue;
+			if(maxEvent < minEvent || tr->event < minEvent)
+				minEvent = tr->event;
+			if(maxEvent < minEvent || tr->event > maxEvent)
+				maxEvent = tr->event;
+		}
+		table->nbCells += fsm->states[j].size;
+	}
+
+	if(table->nbCells > 0)
+	{
+		table->cells = (_cmn_fsm_cell_t *)MALLOC(table->nbCells*sizeof(_cmn_fsm_cell_t));
+		if(table->cells == NULL)
+			goto failed;
+		memset(table->cells, 0, table->nbCells*sizeof(_cmn_fsm_cell_t));
+
+		for(cell = 0, j = 0; j < fsm->size; j++)
+		{
+			for(i = 0; i < fsm->states[j].size; i++)
+				table->cells[cell++].transition = &fsm->states[j].eventHandlers[i];
+		}
+	}
+
+	if(fsm->size == 0 || maxState - minState >= _CMN_FSM_MAX_STATES)
+	{
+		CMN_WARN("FSM '%s' has %d states from %d to %d, it is not compiled", fsm->name, fsm->size, minState, maxState);
+		return table;
+	}
+
+	table->minState = minState;
+	table->nbStates = maxState - minState + 1;
+	table->states = (_cmn_fsm_state_t *)MALLOC(table->nbStates*sizeof(_cmn_fsm_state_t));
+	if(table->states == NULL)
+		goto failed;
+	memset(table->states, 0, table->nbStates*sizeof(_cmn_fsm_state_t));
+
+	for(cell = 0, j = 0; j < fsm->size; j++)
+	{
+		index = fsm->states[j].state - minState;
+		/* first one is used when state is defined twice, as searching does */
+		if(table->states[index].state == NULL)
+		{
+			table->states[index].state = &fsm->states[j];
+			table->states[index].firstCell = cell;
+		}
+		cell += fsm->states[j].size;
+	}
+
+	if(maxEvent >= minEvent && (long)table->nbStates*(maxEvent - minEvent + 1) <= _CMN_FSM_MAX_JUMPS)
+	{
+		table->minEvent = minEvent;
+		table->nbEvents = maxEvent - minEvent + 1;
+		table->jumps = (int *)MALLOC(table->nbStates*table->nbEvents*sizeof(int));
+		if(table->jumps == NULL)
+			goto failed;
+		memset(table->jumps, 0, table->nbStates*table->nbEvents*sizeof(int));
+
+		for(index = 0; index < table->nbStates; index++)
+		{
+			statemachine_t *state = table->states[index].state;
+
+			for(i = 0; state && i < state->size; i++)
+			{
+				int *jump;
+
+				if(state->eventHandlers[i].event <= EVENT_UNKNOWN)
+					continue;
+
+				jump = &table->jumps[index*table->nbEvents + state->eventHandlers[i].event - minEvent];
+				/* first one is used when event is handled twice, as searching does */
+				if(*jump == 0)
+					*jump = table->states[index].firstCell + i + 1;
+			}
+		}
+	}
+
+	return table;
+
+failed:
+	CMN_ERROR("No memory for table of FSM '%s'", fsm->name);
+	_cmnFsmFreeTable(table);
+	return NULL;
+}
+
+static statemachine_t *_cmnFsmState(cmn_fsm_table_t *table, int state, int *firstCell)
+{
+	int index = state - table->minState;
+
+	if(index < 0 || index >= table->nbStates)
+		return NULL;
+
+	*firstCell = table->states[index].firstCell;
+	return table->states[index].state;
+}
+
+/* cell of transition handling event in state, NULL if not handled */
+static _cmn_fsm_cell_t *_cmnFsmTransition(cmn_fsm_table_t *table, statemachine_t *state, int firstCell, int event)
+{
+	int i;
+
+	if(table->jumps)
+	{
+		int index = event - table->minEvent;
+
+		if(index < 0 || index >= table->nbEvents)
+			return NULL;
+
+		i = table->jumps[(state->state - table->minState)*table->nbEvents + index];
+		return (i)?&table->cells[i - 1]:NULL;
+	}
+
+	for(i = 0; i < state->size; i++)
+	{
+		if(state->eventHandlers[i].event == event)
+			return &table->cells[firstCell + i];
+	}
+
+	return NULL;
+}
+
+static int _cmnFsmRun(cmn_fsm_table_t *table, _cmn_fsm_cell_t *cell, void *ctx, EVENT *event)
+{
+	struct timespec start, end;
+	unsigned long long nsecs, max;
+	int res;
+
+	if(!table->profile)
+	{
+		return (cell->transition->handle)(ctx, event);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	res = (cell->transition->handle)(ctx, event);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	/* same FSM is shared by owners running in different threads */
+	nsecs = (end.tv_sec - start.tv_sec)*1000000000ULL + end.tv_nsec - start.tv_nsec;
+	__atomic_fetch_add(&cell->stats.hits, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&cell->stats.nsecs, nsecs, __ATOMIC_RELAXED);
+	max = __atomic_load_n(&cell->stats.maxNsecs, __ATOMIC_RELAXED);
+	while(nsecs > max && !__atomic_compare_exchange_n(&cell->stats.maxNsecs, &max, nsecs, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED) )
+	{
+	}
+
+	return res;
+}
 
 /* ctx is object which will be send to event handler of FSM */
 int cmnFsmHandle(void *ctx, void *_event)
 {
-	int		j;
 	int		newState = STATE_CONTINUE;
+	int		firstCell = 0;
+	cmn_fsm_table_t	*table;
+	statemachine_t	*state;
+	_cmn_fsm_cell_t	*cell;
 
 	EVENT	*event = (EVENT *)_event;
 	FSM_OWNER *owner = (FSM_OWNER *)event->ownerCtx;
-	
+
 	if(event->event <= EVENT_UNKNOWN )
 	{
 		CMN_WARN( "Unknown Event\n");
@@ -54,45 +325,150 @@ int cmnFsmHandle(void *ctx, void *_event)
 		exit(1);
 	}
 
-//	CMN_DEBUG("FSM Owner is '%s'", owner->fsm->name );
-
 	if(owner->fsm == NULL )
 	{
 		CMN_WARN("FSM is null\n");
 		exit(1);
 	}
 
-	for(j=0; j< owner->fsm->size; j++)
+	table = __atomic_load_n(&owner->fsm->table, __ATOMIC_ACQUIRE);
+	if(table == NULL)
 	{
-		if( owner->fsm->states[j].state == owner->currentState )
+		cmnFsmCompile(owner->fsm);
+		table = __atomic_load_n(&owner->fsm->table, __ATOMIC_ACQUIRE);
+	}
+
+	if(table == NULL || table->nbStates == 0)
+	{
+		return _cmnFsmSearchHandle(ctx, owner, event);
+	}
+
+	state = _cmnFsmState(table, owner->currentState, &firstCell);
+	if(state)
+	{
+		cell = _cmnFsmTransition(table, state, firstCell, event->event);
+		if(cell)
 		{
-			CMN_DEBUG("FSM '%s' handling in state '%s'", owner->name, owner->fsm->states[j].name);
-			newState = _fsmStateHandle( &owner->fsm->states[j], ctx, event);
-			break;
+#if CMN_FSM_DEBUG
+			CMN_DEBUG("FSM '%s' handling event '%s' in state '%s'", owner->name, cell->transition->name, state->name);
+#endif
+			newState = _cmnFsmRun(table, cell, ctx, event);
 		}
 	}
-	
+
 	if(newState != STATE_CONTINUE && newState != owner->currentState )
 	{
-		for(j=0; j< owner->fsm->size; j++)
+		state = _cmnFsmState(table, newState, &firstCell);
+		if(state)
 		{
-			if( owner->fsm->states[j].state == newState )
-			{
-				/* clean old timer for this device and new timer is set in enter_handle */
-				owner->timeout = 0;
-				
-				if( owner->fsm->states[j].enter_handle!= NULL)
-					( owner->fsm->states[j].enter_handle)( owner);
-				
-				CMN_DEBUG("Entered into new state '%s' of FSM '%s'", owner->fsm->states[j].name, owner->name );
-				break;
-			}
+			/* clean old timer for this device and new timer is set in enter_handle */
+			owner->timeout = 0;
+
+			if( state->enter_handle!= NULL)
+				( state->enter_handle)( owner);
+
+#if CMN_FSM_DEBUG
+			CMN_DEBUG("Entered into new state '%s' of FSM '%s'", state->name, owner->name );
+#endif
 		}
-		
+
 		owner->currentState = newState;
 	}
 
 	return EXIT_SUCCESS;
 }
 
+int cmnFsmHandleBatch(void *ctx, void **events, int size)
+{
+	int i;
+
+	for(i = 0; i < size; i++)
+	{
+		if(cmnFsmHandle(ctx, events[i]) < 0)
+			break;
+	}
+
+	return i;
+}
+
+int cmnFsmCompile(SERVICE_FSM *fsm)
+{
+	cmn_fsm_table_t *table, *expected = NULL;
+
+	if(__atomic_load_n(&fsm->table, __ATOMIC_ACQUIRE) )
+		return EXIT_SUCCESS;
+
+	table = _cmnFsmBuild(fsm);
+	if(table == NULL)
+		return -EXIT_FAILURE;
+
+	if(!__atomic_compare_exchange_n(&fsm->table, &expected, table, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+	{/* compiled by owner in other thread */
+		_cmnFsmFreeTable(table);
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/* no event can be handled by FSM when it is freed */
+void cmnFsmFree(SERVICE_FSM *fsm)
+{
+	cmn_fsm_table_t *table = __atomic_exchange_n(&fsm->table, NULL, __ATOMIC_ACQ_REL);
+
+	if(table)
+		_cmnFsmFreeTable(table);
+}
+
+void cmnFsmSetProfile(SERVICE_FSM *fsm, int enable)
+{
+	if(cmnFsmCompile(fsm) != EXIT_SUCCESS)
+		return;
+
+	fsm->table->profile = enable;
+}
+
+int cmnFsmGetStats(SERVICE_FSM *fsm, int state, int event, CmnFsmStats *stats)
+{
+	cmn_fsm_table_t *table = __atomic_load_n(&fsm->table, __ATOMIC_ACQUIRE);
+	statemachine_t *sm;
+	_cmn_fsm_cell_t *cell;
+	int firstCell = 0;
+
+	if(table == NULL || (sm = _cmnFsmState(table, state, &firstCell)) == NULL ||
+		(cell = _cmnFsmTransition(table, sm, firstCell, event)) == NULL)
+	{
+		return -EXIT_FAILURE;
+	}
+
+	stats->hits = __atomic_load_n(&cell->stats.hits, __ATOMIC_RELAXED);
+	stats->nsecs = __atomic_load_n(&cell->stats.nsecs, __ATOMIC_RELAXED);
+	stats->maxNsecs = __atomic_load_n(&cell->stats.maxNsecs, __ATOMIC_RELAXED);
+
+	return EXIT_SUCCESS;
+}
+
+void cmnFsmDumpStats(SERVICE_FSM *fsm)
+{
+	cmn_fsm_table_t *table = __atomic_load_n(&fsm->table, __ATOMIC_ACQUIRE);
+	int i, j, cell = 0;
+
+	if(table == NULL)
+		return;
+
+	for(j = 0; j < fsm->size; j++)
+	{
+		for(i = 0; i < fsm->states[j].size; i++, cell++)
+		{
+			CmnFsmStats *stats = &table->cells[cell].stats;
+			unsigned long hits = __atomic_load_n(&stats->hits, __ATOMIC_RELAXED);
+
+			if(hits == 0)
+				continue;
+
+			CMN_INFO("FSM '%s': event '%s' in state '%s': %lu hits, %llu ns per hit (max %llu ns)",
+				fsm->name, fsm->states[j].eventHandlers[i].name, fsm->states[j].name, hits,
+				__atomic_load_n(&stats->nsecs, __ATOMIC_RELAXED)/hits, __atomic_load_n(&stats->maxNsecs, __ATOMIC_RELAXED));
+		}
+	}
+}
 
@@ -5,24 +5,135 @@
 //#include <cmnList.h>
 #include <cmnOsPort.h>
 
+/* nodes of the first slab of a list; each new slab doubles up to the max */
+#define	_CMN_LIST_SLAB_MIN			8
+#define	_CMN_LIST_SLAB_MAX			256
+
+typedef struct _cmn_list_slab
+{
+	struct _cmn_list_slab	*next;
+	int						size;
+	__node_t				nodes[1];
+}_cmn_list_slab_t;
+
+static __node_t *_cmnListNewNode(cmn_list_t *li, void *el)
+{
+	__node_t *node;
+
+	if(li->freeNodes == NULL)
+	{
+		_cmn_list_slab_t *slab;
+		int i, size = (li->slabSize < _CMN_LIST_SLAB_MIN)?_CMN_LIST_SLAB_MIN:li->slabSize;
+
+		slab = (_cmn_list_slab_t *)MALLOC(sizeof(_cmn_list_slab_t) + (size-1)*sizeof(__node_t));
+		if(slab == NULL)
+			return NULL;
+
+		for(i = 0; i < size; i++)
+		{
+			slab->nodes[i].next = li->freeNodes;
+			li->freeNodes = &slab->nodes[i];
+		}
+		slab->size = size;
+		slab->next = (_cmn_list_slab_t *)li->slabs;
+		li->slabs = slab;
+		li->slabSize = (size*2 > _CMN_LIST_SLAB_MAX)?_CMN_LIST_SLAB_MAX:size*2;
+	}
+
+	node = li->freeNodes;
+	li->freeNodes = (__node_t *)node->next;
+	node->element = el;
+	return node;
+}
+
+static void _cmnListFreeNode(cmn_list_t *li, __node_t *node)
+{
+	node->next = li->freeNodes;
+	li->freeNodes = node;
+
+	/* an empty list keeps only its last and biggest slab, for the next burst; cmn_list_free() releases it */
+	if(li->nb_elt == 0 && li->slabs && ((_cmn_list_slab_t *)li->slabs)->next)
+	{
+		_cmn_list_slab_t *slab = (_cmn_list_slab_t *)li->slabs;
+		int i;
+
+		while(slab->next)
+		{
+			_cmn_list_slab_t *old = slab->next;
+			slab->next = old->next;
+			FREE(old);
+		}
+
+		li->freeNodes = NULL;
+		for(i = 0; i < slab->size; i++)
+		{
+			slab->nodes[i].next = li->freeNodes;
+			li->freeNodes = &slab->nodes[i];
+		}
+	}
+}
+
+/* link node before 'next', or at the end when next is NULL */
+static void _cmnListLink(cmn_list_t *li, __node_t *node, __node_t *next)
+{
+	__node_t *prev = (next)?(__node_t *)next->prev:li->tail;
+
+	node->next = next;
+	node->prev = prev;
+	if(prev)
+		prev->next = node;
+	else
+		li->node = node;
+	if(next)
+		next->prev = node;
+	else
+		li->tail = node;
+	li->nb_elt++;
+}
+
+/* node at pos, walking from the closer end; pos must be in the list */
+static __node_t *_cmnListNodeAt(const cmn_list_t *li, int pos)
+{
+	__node_t *ntmp;
+	int i;
+
+	if(pos <= li->nb_elt/2)
+	{
+		ntmp = li->node;
+		for(i = 0; i < pos; i++)
+			ntmp = (__node_t *) ntmp->next;
+	}
+	else
+	{
+		ntmp = li->tail;
+		for(i = li->nb_elt - 1; i > pos; i--)
+			ntmp = (__node_t *) ntmp->prev;
+	}
+	return ntmp;
+}
+
 int cmn_list_init (cmn_list_t * li)
 {
 	li->nb_elt = 0;
+	li->node = NULL;
+	li->tail = NULL;
+	li->freeNodes = NULL;
+	li->slabs = NULL;
+	li->slabSize = 0;
 	return 0;/* ok */
 }
 
 int cmn_list_iterate(cmn_list_t * li, int isContinue, int (*iterateFunc) (int, void *ele, void *priv), void *data)
 {
-	void *element;
+	__node_t *ntmp, *next;
 	int res;
 	int i = 0;
 
 	if (li == NULL)
 		return 0;
-	for(i=0; i< cmn_list_size(li); i++)
+	CMN_LIST_FOREACH_SAFE(li, ntmp, next)
 	{
-		element = (void *) cmn_list_get (li, i);
-		res = (iterateFunc)(i, element, data);
+		res = (iterateFunc)(i++, ntmp->element, data);
 		if( (res != 0) && (isContinue== 0) )
 			return res;
 	}
@@ -30,20 +141,33 @@ int cmn_list_iterate(cmn_list_t * li, int isContinue, int (*iterateFunc) (int, v
 	return 0;
 }
 
+void cmn_list_free (cmn_list_t * li)
+{
+	if (li == NULL)
+		return;
+
+	while(li->slabs)
+	{
+		_cmn_list_slab_t *slab = (_cmn_list_slab_t *)li->slabs;
+		li->slabs = slab->next;
+		FREE(slab);
+	}
+	cmn_list_init(li);
+}
+
 void cmn_list_special_free (cmn_list_t * li, void *(*free_func) (void *), int freeList)
 {
-	int pos = 0;
 	void *element;
 
 	if (li == NULL)
 		return;
-	while (!cmn_list_eol (li, pos))
+	while (li->nb_elt > 0)
 	{
-		element = (void *) cmn_list_get (li, pos);
-		cmn_list_remove (li, pos);
+		element = cmn_list_pop_front (li);
 		free_func (element);
 	}
-	
+	cmn_list_free(li);
+
 	if( freeList )
 	{
 		FREE (li);
@@ -52,22 +176,21 @@ void cmn_list_special_free (cmn_list_t * li, void *(*free_func) (void *), int fr
 
 void cmn_list_ofchar_free (cmn_list_t * li, int freeList)
 {
-	int pos = 0;
 	char *chain;
 //	int i =0;
 
 	if (li == NULL)
 		return;
-	while (!cmn_list_eol (li, pos))
+	while (li->nb_elt > 0)
 	{
-		chain = (char *) cmn_list_get (li, pos);
+		chain = (char *) cmn_list_pop_front (li);
 		if(chain==NULL)
 			continue;
-		
+
 //		CMN_DEBUG("No.%d item is removed from list", ++i);
-		cmn_list_remove (li, pos);
 		FREE (chain);
 	}
+	cmn_list_free(li);
 
 	if( freeList )
 	{
@@ -92,119 +215,88 @@ int cmn_list_eol (const cmn_list_t * li, int i)
 	return 1;			/* end of list */
 }
 
-/* index starts from 0; */
-int cmn_list_add (cmn_list_t * li, void *el, int pos)
+__node_t *cmn_list_push_back (cmn_list_t * li, void *el)
 {
-	__node_t *ntmp;
-	int i = 0;
+	__node_t *node = _cmnListNewNode(li, el);
 
-	if (pos == -1 || pos >= li->nb_elt)
-	{/* insert at the end  */
-		pos = li->nb_elt;
-	}
+	if(node)
+		_cmnListLink(li, node, NULL);
+	return node;
+}
 
-	if (li->nb_elt == 0)
-	{
-		li->node = (__node_t *) MALLOC (sizeof (__node_t));
-		li->node->element = el;
-		li->nb_elt++;
-		return li->nb_elt;
-	}
+__node_t *cmn_list_push_front (cmn_list_t * li, void *el)
+{
+	__node_t *node = _cmnListNewNode(li, el);
 
-	ntmp = li->node;		/* exist because nb_elt>0  */
+	if(node)
+		_cmnListLink(li, node, li->node);
+	return node;
+}
 
-	if (pos == 0)
-	{
-		li->node = (__node_t *) MALLOC (sizeof (__node_t));
-		li->node->element = el;
-		li->node->next = ntmp;
-		li->nb_elt++;
-		return li->nb_elt;
-	}
-	/* pos = 0 insert before first elt  */
+void *cmn_list_remove_node (cmn_list_t * li, __node_t *node)
+{
+	void *el = node->element;
+	__node_t *prev = (__node_t *)node->prev;
+	__node_t *next = (__node_t *)node->next;
 
-	while (pos > i + 1)
-	{
-		i++;
-		/* when pos>i next node exist  */
-		ntmp = (__node_t *) ntmp->next;
-	}
+	if(prev)
+		prev->next = next;
+	else
+		li->node = next;
+	if(next)
+		next->prev = prev;
+	else
+		li->tail = prev;
+	li->nb_elt--;
 
-	/* if pos==nb_elt next node does not exist  */
-	if (pos == li->nb_elt)
-	{
-		ntmp->next = (__node_t *) MALLOC (sizeof (__node_t));
-		ntmp = (__node_t *) ntmp->next;
-		ntmp->element = el;
-		li->nb_elt++;
-		return li->nb_elt;
-	}
+	_cmnListFreeNode(li, node);
+	return el;
+}
 
-	/* here pos==i so next node is where we want to insert new node */
-	{
-		__node_t *nextnode = (__node_t *) ntmp->next;
+void *cmn_list_pop_front (cmn_list_t * li)
+{
+	if(li->nb_elt == 0)
+		return NULL;
+	return cmn_list_remove_node(li, li->node);
+}
+
+/* index starts from 0; */
+int cmn_list_add (cmn_list_t * li, void *el, int pos)
+{
+	__node_t *node;
+
+	node = _cmnListNewNode(li, el);
+	if(node == NULL)
+		return -1;
 
-		ntmp->next = (__node_t *) MALLOC (sizeof (__node_t));
-		ntmp = (__node_t *) ntmp->next;
-		ntmp->element = el;
-		ntmp->next = nextnode;
-		li->nb_elt++;
+	if (pos == -1 || pos >= li->nb_elt)
+	{/* insert at the end  */
+		_cmnListLink(li, node, NULL);
 	}
+	else
+	{
+		_cmnListLink(li, node, _cmnListNodeAt(li, (pos < 0)?0:pos));
+	}
+
 	return li->nb_elt;
 }
 
 /* index starts from 0 */
 void *cmn_list_get (const cmn_list_t * li, int pos)
 {
-	__node_t *ntmp;
-	int i = 0;
-
 	if (pos < 0 || pos >= li->nb_elt)/* element does not exist */
 		return 0;
 
-	ntmp = li->node;/* exist because nb_elt>0 */
-	while (pos > i)
-	{
-		i++;
-		ntmp = (__node_t *) ntmp->next;
-	}
-	return ntmp->element;
+	return _cmnListNodeAt(li, pos)->element;
 }
 
 /* return -1 if failed */
 int cmn_list_remove (cmn_list_t *li, int pos)
 {
-	__node_t *ntmp;
-	int i = 0;
-
 	if (pos < 0 || pos >= li->nb_elt)/* element does not exist */
 		return -1;
 
-	ntmp = li->node;		/* exist because nb_elt>0 */
-
-	if ((pos == 0))
-	{				/* special case  */
-		li->node = (__node_t *) ntmp->next;
-		li->nb_elt--;
-		FREE (ntmp);
-		return li->nb_elt;
-	}
-
-	while (pos > i + 1)
-	{
-		i++;
-		ntmp = (__node_t *) ntmp->next;
-	}
-
-	/* insert new node */
-	{
-		__node_t *remnode;
-
-		remnode = (__node_t *) ntmp->next;
-		ntmp->next = ((__node_t *) ntmp->next)->next;
-		FREE (remnode);
-		li->nb_elt--;
-	}
+	cmn_list_remove_node(li, _cmnListNodeAt(li, pos));
 	return li->nb_elt;
 }
 
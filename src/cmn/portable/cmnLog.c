@@ -59,6 +59,283 @@ static log_stru_t logobj =
 
 unsigned long		cmnSystemDebug = 0;
 
+/* Buffered writer of USE_FILE: log_information() only appends to the buffer, which
+ * is written out when it is full, when an error is logged, and by the flush thread
+ * every flushMsec. File is rotated when it reaches maxSize or is older than
+ * rotateSeconds: logFileName is renamed to logFileName.1, and older ones are shifted
+ * up to logFileName.maxFiles. */
+typedef struct
+{
+	cmn_mutex_t		*lock;
+	cmn_cond_t		*cond;
+	pthread_t			flusher;
+	int				running;
+
+	char				*buf;
+	int				size;
+	volatile int		used;
+
+	volatile int		fd;
+	time_t			opened;
+}log_file_t;
+
+static log_file_t		logFile =
+{
+	.fd			=	-1
+};
+
+static int _logFileOpen(void)
+{
+	logFile.fd = open(logobj.logFileName, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+	logFile.opened = time(NULL);
+	logobj.offset = 0;
+
+	return logFile.fd;
+}
+
+static void _logFileWrite(const char *data, int len)
+{
+	int ret;
+
+	while(len > 0 && logFile.fd >= 0)
+	{
+		ret = write(logFile.fd, data, len);
+		if(ret < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			break;
+		}
+		data += ret;
+		len -= ret;
+	}
+}
+
+/* called with lock held */
+static void _logFileFlush(void)
+{
+	if(logFile.used > 0)
+	{
+		_logFileWrite(logFile.buf, logFile.used);
+		logobj.offset += logFile.used;
+		logFile.used = 0;
+	}
+}
+
+/* called with lock held and buffer flushed */
+static void _logFileRotate(void)
+{
+	char from[sizeof(logobj.logFileName)+16];
+	char to[sizeof(logobj.logFileName)+16];
+	int i;
+
+	if(logFile.fd >= 0)
+	{
+		close(logFile.fd);
+		logFile.fd = -1;
+	}
+
+	for(i = logobj.maxFiles-1; i > 0; i--)
+	{
+		snprintf(from, sizeof(from), "%s.%d", logobj.logFileName, i);
+		snprintf(to, sizeof(to), "%s.%d", logobj.logFileName, i+1);
+		remove(to);
+		rename(from, to);
+	}
+	snprintf(to, sizeof(to), "%s.1", logobj.logFileName);
+	remove(to);
+	rename(logobj.logFileName, to);
+
+	_logFileOpen();
+}
+
+static void _logFileAppend(const char *msg, int len, int flushNow)
+{
+	cmn_mutex_lock(logFile.lock);
+
+	if(logobj.offset + logFile.used + len > logobj.maxSize && logobj.offset + logFile.used > 0)
+	{
+		_logFileFlush();
+		_logFileRotate();
+	}
+
+	if(logFile.used + len > logFile.size)
+	{
+		_logFileFlush();
+	}
+
+	if(len > logFile.size)
+	{
+		_logFileWrite(msg, len);
+		logobj.offset += len;
+	}
+	else
+	{
+		memcpy(logFile.buf + logFile.used, msg, len);
+		logFile.used += len;
+	}
+
+	if(flushNow)
+	{
+		_logFileFlush();
+	}
+
+	cmn_mutex_unlock(logFile.lock);
+}
+
+static void *_logFileFlusher(void *data)
+{
+	struct timespec abstime;
+#ifndef	_MSC_VER
+	struct timeval now;
+#endif
+
+	cmn_mutex_lock(logFile.lock);
+	while(logFile.running)
+	{
+#ifdef	_MSC_VER
+		abstime.tv_sec = time(NULL) + (logobj.flushMsec+999)/1000;
+		abstime.tv_nsec = 0;
+#else
+		gettimeofday(&now, NULL);
+		abstime.tv_sec = now.tv_sec + logobj.flushMsec/1000;
+		abstime.tv_nsec = now.tv_usec*1000L + (logobj.flushMsec%1000)*1000000L;
+		if(abstime.tv_nsec >= 1000000000L)
+		{
+			abstime.tv_sec++;
+			abstime.tv_nsec -= 1000000000L;
+		}
+#endif
+		cmn_cond_timedwait(logFile.cond, logFile.lock, &abstime);
+
+		_logFileFlush();
+		if(logobj.rotateSeconds > 0 && logobj.offset > 0 && time(NULL) - logFile.opened >= logobj.rotateSeconds)
+		{
+			_logFileRotate();
+		}
+	}
+	cmn_mutex_unlock(logFile.lock);
+
+	return NULL;
+}
+
+#ifndef	_MSC_VER
+static const int _logFatalSignals[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+
+/* Best effort, without lock: the thread which crashed may hold it. Only async-signal-safe
+ * write() is used, then the signal is raised again with default action */
+static void _logFileOnSignal(int signum)
+{
+	int used = logFile.used;
+
+	if(logFile.fd >= 0 && used > 0 && used <= logFile.size)
+	{
+		_logFileWrite(logFile.buf, used);
+		logFile.used = 0;
+	}
+
+	raise(signum);
+}
+
+/* handlers installed by program are kept */
+static void _logFileCatchSignals(void)
+{
+	struct sigaction sa, old;
+	int i;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = _logFileOnSignal;
+	sa.sa_flags = SA_RESETHAND|SA_NODEFER;
+	sigemptyset(&sa.sa_mask);
+
+	for(i = 0; i < (int)(sizeof(_logFatalSignals)/sizeof(_logFatalSignals[0])); i++)
+	{
+		if(sigaction(_logFatalSignals[i], NULL, &old) == 0 && old.sa_handler == SIG_DFL)
+		{
+			sigaction(_logFatalSignals[i], &sa, NULL);
+		}
+	}
+}
+#endif
+
+static int _logFileStart(void)
+{
+	static int	atExit = 0;
+
+	logFile.size = logobj.bufferSize;
+	logFile.buf = malloc(logFile.size);
+	logFile.lock = cmn_mutex_init();
+	logFile.cond = cmn_cond_init();
+	if(!logFile.buf || !logFile.lock || !logFile.cond)
+	{
+		goto failed;
+	}
+
+	logFile.used = 0;
+	logFile.running = 1;
+	if(pthread_create(&logFile.flusher, NULL, _logFileFlusher, NULL) != 0)
+	{
+		logFile.running = 0;
+		goto failed;
+	}
+
+#ifndef	_MSC_VER
+	_logFileCatchSignals();
+#endif
+	if(!atExit)
+	{
+		atexit(cmn_log_flush);
+		atExit = 1;
+	}
+
+	return EXIT_SUCCESS;
+
+failed:
+	if(logFile.cond)
+		cmn_cond_destroy(logFile.cond);
+	if(logFile.lock)
+		cmn_mutex_destroy(logFile.lock);
+	free(logFile.buf);
+	logFile.buf = NULL;
+	logFile.lock = NULL;
+	logFile.cond = NULL;
+
+	return EXIT_FAILURE;
+}
+
+void cmn_log_flush(void)
+{
+	if(!logFile.buf)
+		return;
+
+	cmn_mutex_lock(logFile.lock);
+	_logFileFlush();
+	cmn_mutex_unlock(logFile.lock);
+}
+
+void cmn_log_close(void)
+{
+	if(!logFile.buf)
+		return;
+
+	cmn_mutex_lock(logFile.lock);
+	logFile.running = 0;
+	cmn_cond_signal(logFile.cond);
+	cmn_mutex_unlock(logFile.lock);
+	pthread_join(logFile.flusher, NULL);
+
+	_logFileFlush();
+	close(logFile.fd);
+	logobj.lstyle = USE_CONSOLE;
+	logobj.fp = stderr;
+
+	cmn_cond_destroy(logFile.cond);
+	cmn_mutex_destroy(logFile.lock);
+	free(logFile.buf);
+	memset(&logFile, 0, sizeof(logFile));
+	logFile.fd = -1;
+}
+
 void cmn_daemon_init()
 {
 #ifndef	_MSC_VER
@@ -127,6 +404,8 @@ int cmn_log_init(log_stru_t *lobj)
 {
 	int	isStdOut = 0;
 	
+	cmn_log_close();
+
 	if (lobj->llevel < CMN_LOG_EMERG)
 		;
 	else if (lobj->llevel > CMN_LOG_DEBUG) 
@@ -139,7 +418,7 @@ int cmn_log_init(log_stru_t *lobj)
 	logobj.isDaemonized = lobj->isDaemonized;
 
 	logobj.offset = 0;
-	if(lobj->maxSize < 0)
+	if(lobj->maxSize <= 0)
 	{
 		logobj.maxSize = UNIT_OF_KILO*256; 	/* default is 256K bytes */
 	}
@@ -147,6 +426,12 @@ int cmn_log_init(log_stru_t *lobj)
 	{
 		logobj.maxSize = lobj->maxSize;
 	}
+
+	snprintf(logobj.logFileName, sizeof(logobj.logFileName), "%s", lobj->logFileName);
+	logobj.maxFiles = (lobj->maxFiles > 0)? lobj->maxFiles: CMN_LOG_MAX_FILES;
+	logobj.rotateSeconds = (lobj->rotateSeconds > 0)? lobj->rotateSeconds: 0;
+	logobj.flushMsec = (lobj->flushMsec > 0)? lobj->flushMsec: CMN_LOG_FLUSH_MSEC;
+	logobj.bufferSize = (lobj->bufferSize > 0)? lobj->bufferSize: CMN_LOG_BUFFER_SIZE;
 	
 	if (logobj.lstyle == USE_SYSLOG)
 	{
@@ -165,13 +450,13 @@ int cmn_log_init(log_stru_t *lobj)
 		}
 		else
 		{
-			logobj.fp = fopen( lobj->logFileName, "w+");
+			logobj.fp = NULL;
 		}
 #else
-		logobj.fp = fopen( lobj->logFileName, "w+");
+		logobj.fp = NULL;
 #endif
 		
-		if(!logobj.fp)
+		if(!logobj.fp && _logFileOpen() < 0)
 		{
 			fprintf(stderr, "Log File '%s' initialized fail. %s\n\n",lobj->logFileName, strerror(errno) );
 			logobj.fp = stderr;
@@ -195,6 +480,15 @@ int cmn_log_init(log_stru_t *lobj)
 		cmn_daemon_init();
 	}
 
+	/* flush thread is started after fork() of daemon */
+	if(logFile.fd >= 0 && _logFileStart() != EXIT_SUCCESS)
+	{
+		fprintf(stderr, "Log File '%s' buffer initialized fail\n\n",lobj->logFileName );
+		close(logFile.fd);
+		logFile.fd = -1;
+		logobj.fp = stderr;
+	}
+
 
 #ifndef   __CMN_RELEASE__
 	fprintf(stderr, "Startup at %s\n", cmnTimestampStr() );
@@ -256,6 +550,21 @@ void log_information(int pri, const char* frmt,...)
 #endif
 #endif
 	}
+	else if(logFile.buf)
+	{
+		char msg[sizeof(buf)+256];
+
+#ifndef   __CMN_RELEASE__
+		ret = snprintf(msg, sizeof(msg), "%s%s [%s,%s] : %s:%d | %s\n"ERROR_TEXT_END, _colorEsc, cmnTimestampStr(), priname[pri_], cmnThreadGetName(), file, line,buf);
+#else
+		ret = snprintf(msg, sizeof(msg), "%s[%s,%s] : %s\n"ERROR_TEXT_END, _colorEsc, priname[pri_], cmnThreadGetName(), buf);
+#endif
+		if(ret > 0)
+		{
+			/* errors are written out at once, others wait for the buffer to fill or the flush thread */
+			_logFileAppend(msg, (ret < (int)sizeof(msg))? ret: (int)sizeof(msg)-1, pri_ <= CMN_LOG_ERR);
+		}
+	}
 	else
 	{
 #ifndef   __CMN_RELEASE__
@@ -283,16 +592,6 @@ void log_information(int pri, const char* frmt,...)
 			fflush(logobj.fp);	/* added this line, lizhijie, 2007.03.16 */
 	}
 
-	if(ret > 0 && logobj.lstyle != USE_SYSLOG)
-	{
-		logobj.offset += ret;
-		if(logobj.offset > logobj.maxSize && logobj.fp)
-		{
-			fseek(logobj.fp, 0L, SEEK_SET);
-			logobj.offset = 0;
-		}
-	}
-	
 }
 
 int safe_open (const char *pathname,int flags)
@@ -32,13 +32,94 @@ int	cmnThreadAddEvent(CmnThread *th, void *event)
 	return cmn_fifo_add( th->queue, event);
 }
 
-static int	_cmnThreadEventHandler(CmnThread *th)
+/* events got from the queue at once in batch mode */
+#define	_CMN_THREAD_EVENT_CHUNK		16
+
+static int _cmnThreadElapsedMs(const struct timespec *start)
 {
-	void *event;
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int)((now.tv_sec - start->tv_sec)*1000 + (now.tv_nsec - start->tv_nsec)/1000000);
+}
+
+static void _cmnThreadCountEvents(CmnThread *th, int handled, int depth)
+{
+	th->stats.events += handled;
+	th->stats.wakeups++;
+	if(handled > th->stats.maxBatch)
+		th->stats.maxBatch = handled;
+	if(depth > th->stats.maxDepth)
+		th->stats.maxDepth = depth;
+}
+
+/* handle queued events until the budget is used; events got but not handled when the thread quits
+* are freed, as the queue does with the events left in it */
+static int	_cmnThreadBatchEventHandler(CmnThread *th, int wait, int timeout)
+{
+	void *events[_CMN_THREAD_EVENT_CHUNK];
+	int budget = (th->eventBudget > 0)?th->eventBudget:CMN_THREAD_EVENT_BUDGET;
+	int timeBudget = (th->eventTimeBudget > 0)?th->eventTimeBudget:CMN_THREAD_EVENT_TIME_BUDGET;
+	struct timespec start;
+	int handled = 0, depth = 0;
+	int i, n, max;
+
+	while(handled < budget)
+	{
+		max = (budget - handled < _CMN_THREAD_EVENT_CHUNK)?(budget - handled):_CMN_THREAD_EVENT_CHUNK;
+		if(handled == 0 && wait)
+			n = cmn_fifo_get_batch_timed( th->queue, events, max, timeout);
+		else
+			n = cmn_fifo_tryget_batch( th->queue, events, max);
+		if(n == 0)
+			break;
+
+		if(handled == 0)
+		{
+			depth = n + cmn_fifo_size(th->queue);
+			clock_gettime(CLOCK_MONOTONIC, &start);
+		}
+
+		for(i = 0; i < n; i++)
+		{
+			if(th->eventHandler(th, events[i]) < 0)
+			{
+				_cmnThreadCountEvents(th, handled + i + 1, depth);
+				for(i++; i < n; i++)
+				{
+					if(events[i])
+						FREE(events[i]);
+				}
+				return -EXIT_FAILURE;
+			}
+		}
+		handled += n;
+
+		if(_cmnThreadElapsedMs(&start) >= timeBudget)
+			break;
+	}
 
-	if(CMN_THREAD_WAIT_CHECK(th) || th->mainLoop==NULL )
+	if(handled)
+		_cmnThreadCountEvents(th, handled, depth);
+
+	return 0;
+}
+
+/* timeout: ms until next timer of this thread, -1 for no timer; waiting is also broken by 
+* cmnThreadAddTimer() */
+static int	_cmnThreadEventHandler(CmnThread *th, int timeout)
+{
+	void *event = NULL;
+	int wait = (CMN_THREAD_WAIT_CHECK(th) || th->mainLoop==NULL);
+
+	if(CMN_THREAD_BATCH_CHECK(th))
 	{
-		event = cmn_fifo_get( th->queue);
+		return _cmnThreadBatchEventHandler(th, wait, timeout);
+	}
+
+	if(wait)
+	{
+		cmn_fifo_get_batch_timed( th->queue, &event, 1, timeout);
 	}
 	else
 	{
@@ -49,6 +130,7 @@ static int	_cmnThreadEventHandler(CmnThread *th)
 	/* only one event processed in one loop, so performance of send is optimzied */
 	if(event )
 	{
+		_cmnThreadCountEvents(th, 1, 1 + cmn_fifo_size(th->queue));
 		return th->eventHandler(th, event);
 	}
 #else
@@ -67,7 +149,7 @@ static int	_cmnThreadEventHandler(CmnThread *th)
 
 static void _cmnThreadCleanup(void *_data)
 {
-	int	i;
+	__node_t *node;
 	CmnThread *th = (CmnThread *)_data;
 	cmn_list_t *threads = NULL;
 
@@ -75,12 +157,12 @@ static void _cmnThreadCleanup(void *_data)
 	CMN_INFO("Thread '%s' exit and is removing.....", th->name );
 #endif
 	threads = cmnThreadLockList();
-	for(i=0; i < cmn_list_size(threads); i++)
+	CMN_LIST_FOREACH(threads, node)
 	{
-		CmnThread *temp = (CmnThread *)cmn_list_get(threads, i);
+		CmnThread *temp = (CmnThread *)cmn_list_node_element(node);
 		if(temp == th)
 		{
-			cmn_list_remove(threads, i);
+			cmn_list_remove_node(threads, node);
 
 #if CMN_THREAD_DEBUG
 			CMN_DEBUG("Remove thread '%s' from thread queue", th->name);
@@ -140,6 +222,14 @@ static void *_cmnThreadMain(void *param)
 	
 	while(1)
 	{
+		int timeout = -1;
+		cmn_timer_ctx_t *timers = __atomic_load_n(&th->timers, __ATOMIC_ACQUIRE);
+
+		if(timers)
+		{
+			timeout = cmn_timer_ctx_run(timers);
+		}
+
 		if( th->mainLoop != NULL)
 		{/* when mainLoop is null, only events are handled by this thread; 05.16,2017 */
 			if(th->mainLoop(th)< 0)
@@ -155,7 +245,7 @@ static void *_cmnThreadMain(void *param)
 
 		if(th->eventHandler)
 		{
-			if(_cmnThreadEventHandler( th) <0 )
+			if(_cmnThreadEventHandler( th, timeout) <0 )
 			{
 #if CMN_THREAD_DEBUG
 				CMN_WARN("Task '%s' Quit from EventHandler", th->name);
@@ -237,6 +327,12 @@ int	cmnThreadDestory(CmnThread *th )
 	cmn_fifo_free( th->queue);
 //	TRACE();
 
+	if(th->timers)
+	{
+		cmn_timer_ctx_destroy(th->timers);
+		th->timers = NULL;
+	}
+
 //	pthread_exit(&th->pId);
 
 #if CMN_THREAD_DEBUG
@@ -264,6 +360,7 @@ int	cmnThreadInit(CmnThread *th, void *data )
 
 	/* FIFO must be created before init: sometimes init will create event which needs FIFO; 05.26.2017 */	
 	cmn_fifo_init(DEFAULT_THREAD_QUEUE_LENGTH, &th->queue);
+	memset(&th->stats, 0, sizeof(th->stats));
 	
 	if( th->init)
 	{
@@ -470,6 +567,84 @@ void cmnThreadReleaseList(void )
 	cmn_mutex_unlock(_threadLock);
 }
 
+/* called with timers of thread locked */
+static void _cmnThreadTimerWakeup(void *data)
+{
+	CmnThread *th = (CmnThread *)data;
+
+	if(th->queue)
+	{
+		cmn_fifo_wake(th->queue);
+	}
+}
+
+void *cmnThreadAddTimer(CmnThread *th, int interval, CMN_THREAD_TIMER_CALLBACK callback, void *param, cmn_timer_type type, const char *name)
+{
+	cmn_timer_ctx_t *timers = __atomic_load_n(&th->timers, __ATOMIC_ACQUIRE);
+
+	if(timers == NULL)
+	{/* created on first timer; the first timer added wakes the thread up, so it begins to run them */
+		cmn_timer_ctx_t *expected = NULL;
+
+		timers = cmn_timer_ctx_create(th->name);
+		if(timers == NULL)
+		{
+			return NULL;
+		}
+		cmn_timer_ctx_set_wakeup(timers, _cmnThreadTimerWakeup, th);
+
+		if(!__atomic_compare_exchange_n(&th->timers, &expected, timers, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		{
+			cmn_timer_ctx_destroy(timers);
+			timers = expected;
+		}
+	}
+
+	return cmn_timer_ctx_add(timers, interval, callback, param, type, name);
+}
+
+int cmnThreadRemoveTimer(CmnThread *th, void *timer)
+{
+	cmn_timer_ctx_t *timers = __atomic_load_n(&th->timers, __ATOMIC_ACQUIRE);
+
+	if(timers == NULL)
+	{
+		return FALSE;
+	}
+
+	return cmn_timer_ctx_remove(timers, timer);
+}
+
+void cmnThreadGetStats(CmnThread *th, CmnThreadStats *stats)
+{
+	memcpy(stats, &th->stats, sizeof(CmnThreadStats));
+}
+
+static int _cmnThreadDumpStats(int index, void *ele, void *priv)
+{
+	CmnThread *th = (CmnThread *)ele;
+	CmnThreadStats stats;
+
+	(void)index;
+	(void)priv;
+
+	cmnThreadGetStats(th, &stats);
+	CMN_INFO("Thread '%s': %d queued (max %d), %lu events in %lu wake-ups (%lu per wake-up, max %d)",
+		th->name, cmn_fifo_size(th->queue), stats.maxDepth, stats.events, stats.wakeups,
+		stats.wakeups?(stats.events/stats.wakeups):0, stats.maxBatch);
+
+	return 0;
+}
+
+void cmnThreadDumpStats(void)
+{
+	cmn_list_t *threads = cmnThreadLockList();
+
+	cmn_list_iterate(threads, 1, _cmnThreadDumpStats, NULL);
+
+	cmnThreadReleaseList();
+}
+
 void cmnThreadMask(char *threadName)
 {
 #ifndef	OS_WINDOWS
@@ -6,6 +6,20 @@
 
 #include "extSysParams.h"
 
+#if defined(__linux__)
+#include <unistd.h>
+#include <poll.h>
+#include <sys/timerfd.h>
+#endif
+
+/*
+* Timers are in a hashed timing wheel: one slot per tick of CMN_TIMER_RESOLUTION ms, a timer is in
+* the slot of the tick it expires at, modulo the size of the wheel. Adding and removing only link the
+* timer in its slot; running visits the slots of the ticks elapsed since last run, and timers of
+* later turns stay in their slot. The thread running a context sleeps until the first slot not empty,
+* on the timerfd of the context or with the time returned by cmn_timer_ctx_run().
+*/
+
 typedef	enum _timer_state
 {
 	CMN_TIMER_STATE_UNINIT = 0,
@@ -15,7 +29,8 @@ typedef	enum _timer_state
 
 typedef enum
 {
-	cmn_timer_id_state_waiting = 0,
+	cmn_timer_id_state_free = 0,		/* in free list of context */
+	cmn_timer_id_state_waiting,
 	cmn_timer_id_state_servicing,		/* is servicing the callback */
 	cmn_timer_id_state_wait_stop,	/* when it is in servicing state, someone want it stop (remove) */
 }cmn_timer_id_state;
@@ -24,50 +39,77 @@ typedef enum
 typedef struct _cmn_timer_id
 {
 	int							interval;
+	unsigned long					ticks;		/* interval in ticks */
+	unsigned long					expires;		/* tick it expires at */
 	CMN_THREAD_TIMER_CALLBACK	cb;
 
 	cmn_timer_id_state			state;
 	cmn_timer_type				type;
-	
+
 	void 						*param;
-	int							lastAlarm;
-	struct _cmn_timer_id			*next;
+	cmn_timer_ctx_t				*ctx;
+	struct _cmn_timer_id			*next;		/* in slot, expired list or free list */
+	struct _cmn_timer_id			*prev;
 
 	char							name[CMN_TIMER_NAME_LENGTH];
 }cmn_timer_id_t;
 
-/*
-typedef	struct _timer_stat
+/* timers are allocated by slabs, which are freed with the context */
+#define	_CMN_TIMER_SLAB_SIZE			64
+
+typedef struct _cmn_timer_slab
 {
-	int							started;
-	int							running;
-	int							threaded;
+	struct _cmn_timer_slab		*next;
+	cmn_timer_id_t				timers[_CMN_TIMER_SLAB_SIZE];
+}_cmn_timer_slab_t;
 
-	int							listChanged;
-}cmn_timer_state_t;
-*/
-	
-typedef	struct cmn_timer
+#define	_CMN_TIMER_WHEEL_MASK		(CMN_TIMER_WHEEL_SIZE - 1)
+
+#define	_CMN_TIMER_NEVER				((unsigned long)-1)
+
+struct cmn_timer_ctx
 {
-	cmn_timer_state_t			state;
-	
-	/* used in threaded timers */
-	int							numOfTimers;
-	cmn_timer_id_t				*timers;
-	
 	cmn_mutex_t					*mutex;
-#if 0
-	pthread_t  					tId;
-#else
+
+	cmn_timer_id_t				*wheel[CMN_TIMER_WHEEL_SIZE];
+	unsigned long					tick;		/* next tick to run; no timer in wheel expires before it */
+	unsigned long					nextTick;	/* tick the running thread wakes up at */
+	struct timespec				start;		/* time of tick 0 */
+	int							numOfTimers;
+
+	cmn_timer_id_t				*expired;	/* timers being serviced by cmn_timer_ctx_run() */
+	cmn_timer_id_t				*freeTimers;
+	_cmn_timer_slab_t				*slabs;
+
+	int							fd;			/* timerfd, armed at nextTick */
+
+	void							(*wakeup)(void *data);
+	void							*wakeupData;
+
+	char							name[CMN_NAME_LENGTH];
+};
+
+typedef	struct cmn_timer
+{
+	volatile cmn_timer_state_t	state;
+
+	cmn_timer_ctx_t				*ctx;
 	CmnThread					*tId;
+	int							fd;
+
+	cmn_mutex_t					*mutex;
+	cmn_cond_t					*quitCond;	/* timer thread has quit */
+	int							quit;
+#if !defined(__linux__)
+	cmn_cond_t					*wakeCond;	/* timer added which expires earlier */
+	int							wakeup;
 #endif
 
-	int							timersChanged;
-	
-	/* used in alarm timers */
+	/* timer of cmn_set_timer() */
+	void							*alarm;
 	int							alarmInterval;
 	CMN_ALARM_TIMER_CALLBACK 	alarmCallback;
-	struct timeval				startTimeStamp;		/* The first ticks value of the application */
+	struct timespec				startTimeStamp;		/* The first ticks value of the application */
 
 }cmn_timer_t;
 
@@ -77,285 +119,479 @@ static cmn_timer_t		_timers =
 };
 
 
-int cmn_get_ticks (void)
+static long _cmnTimerElapsedMs(const struct timespec *start)
 {
-	struct timeval now;
-	int		ticks;
+	struct timespec now;
 
-	gettimeofday(&now, NULL);
-	ticks=(now.tv_sec - _timers.startTimeStamp.tv_sec)*1000+(now.tv_usec - _timers.startTimeStamp.tv_usec)/1000;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec)*1000L + (now.tv_nsec - start->tv_nsec)/1000000L;
+}
 
-	return(ticks);
+int cmn_get_ticks (void)
+{
+	return (int)_cmnTimerElapsedMs(&_timers.startTimeStamp);
 }
 
-static void __handle_alarm_timer(int sig)
+
+static cmn_timer_id_t *_cmnTimerNew(cmn_timer_ctx_t *ctx)
 {
-	int ms;
+	cmn_timer_id_t *t;
 
-	if ( _timers.alarmCallback )
+	if(ctx->freeTimers == NULL)
 	{
-		ms = (*_timers.alarmCallback)(_timers.alarmInterval );
-		if ( ms != _timers.alarmInterval)
+		_cmn_timer_slab_t *slab;
+		int i;
+
+		slab = (_cmn_timer_slab_t *)MALLOC(sizeof(_cmn_timer_slab_t));
+		if(slab == NULL)
+			return NULL;
+
+		for(i = 0; i < _CMN_TIMER_SLAB_SIZE; i++)
 		{
-			cmn_set_timer(ms, _timers.alarmCallback );
+			slab->timers[i].state = cmn_timer_id_state_free;
+			slab->timers[i].next = ctx->freeTimers;
+			ctx->freeTimers = &slab->timers[i];
 		}
+		slab->next = ctx->slabs;
+		ctx->slabs = slab;
 	}
+
+	t = ctx->freeTimers;
+	ctx->freeTimers = t->next;
+	return t;
 }
 
-static int _sys_timer_init_alarm(void)
+static void _cmnTimerFree(cmn_timer_ctx_t *ctx, cmn_timer_id_t *t)
 {
-	struct sigaction action;
-
-	/* Set the alarm handler (Linux specific) */
-	memset(&action, 0, sizeof(action));
-	action.sa_handler = __handle_alarm_timer;
-	action.sa_flags = SA_RESTART;
-	sigemptyset(&action.sa_mask);
-	sigaction(SIGALRM, &action, NULL);
-	
-	return(0);
+#if CMN_TIMER_DEBUG
+	CMN_DEBUG( "Removed Timer %s:%p, num_timers = %d ", t->name, t, ctx->numOfTimers );
+#endif
+	t->state = cmn_timer_id_state_free;
+	t->next = ctx->freeTimers;
+	ctx->freeTimers = t;
 }
 
-static int _sys_start_timer_alarm(void)
+static void _cmnTimerLink(cmn_timer_ctx_t *ctx, cmn_timer_id_t *t)
 {
-	struct itimerval timer;
+	cmn_timer_id_t **slot = &ctx->wheel[t->expires & _CMN_TIMER_WHEEL_MASK];
 
-	timer.it_value.tv_sec = (_timers.alarmInterval/1000);
-	timer.it_value.tv_usec = (_timers.alarmInterval%1000)*1000;
-	timer.it_interval.tv_sec = (_timers.alarmInterval/1000);
-	timer.it_interval.tv_usec = (_timers.alarmInterval%1000)*1000;
-	
-	setitimer(ITIMER_REAL, &timer, NULL);
-	return(0);
+	t->state = cmn_timer_id_state_waiting;
+	t->prev = NULL;
+	t->next = *slot;
+	if(*slot)
+		(*slot)->prev = t;
+	*slot = t;
+
+	++ ctx->numOfTimers;
 }
 
-static void _sys_stop_timer_alarm(void)
+static void _cmnTimerUnlink(cmn_timer_ctx_t *ctx, cmn_timer_id_t *t)
 {
-	struct itimerval timer;
+	if(t->prev)
+		t->prev->next = t->next;
+	else
+		ctx->wheel[t->expires & _CMN_TIMER_WHEEL_MASK] = t->next;
+	if(t->next)
+		t->next->prev = t->prev;
 
-	memset(&timer, 0, (sizeof timer));
-	setitimer(ITIMER_REAL, &timer, NULL);
+	-- ctx->numOfTimers;
 }
 
-
-static void __timer_remove(cmn_timer_t *timers, cmn_timer_id_t *prev, cmn_timer_id_t *t)
+/* tick of the first slot not empty; its timers may be turns later, then the thread wakes up for nothing */
+static unsigned long _cmnTimerCtxNextTick(cmn_timer_ctx_t *ctx)
 {
-	if ( prev )
+	unsigned long i;
+
+	if(ctx->numOfTimers == 0)
+		return _CMN_TIMER_NEVER;
+
+	for(i = 0; i < CMN_TIMER_WHEEL_SIZE; i++)
 	{
-		prev->next = t->next;
+		if(ctx->wheel[(ctx->tick + i) & _CMN_TIMER_WHEEL_MASK])
+			return ctx->tick + i;
 	}
-	else
+
+	return _CMN_TIMER_NEVER;
+}
+
+/* called with context locked */
+static void _cmnTimerCtxWakeAt(cmn_timer_ctx_t *ctx, unsigned long tick)
+{
+	ctx->nextTick = tick;
+
+#if defined(__linux__)
+	if(ctx->fd >= 0)
 	{
-		timers->timers = t->next;
-	}
+		struct itimerspec its;
+
+		memset(&its, 0, sizeof(its));
+		if(tick != _CMN_TIMER_NEVER)
+		{
+			unsigned long ms = tick*CMN_TIMER_RESOLUTION;
 
-	-- timers->numOfTimers;
+			its.it_value.tv_sec = ctx->start.tv_sec + ms/1000;
+			its.it_value.tv_nsec = ctx->start.tv_nsec + (ms%1000)*1000000L;
+			if(its.it_value.tv_nsec >= 1000000000L)
+			{
+				its.it_value.tv_sec++;
+				its.it_value.tv_nsec -= 1000000000L;
+			}
+		}
 
-#if CMN_TIMER_DEBUG
-	CMN_DEBUG( "Removed Timer %s:%p, num_timers = %d ", t->name, t, timers->numOfTimers );
+		if(timerfd_settime(ctx->fd, TFD_TIMER_ABSTIME, &its, NULL) != 0)
+		{
+			CMN_WARN("Timer '%s' failed in arming timerfd: %s", ctx->name, strerror(errno));
+		}
+	}
 #endif
-	FREE(t);
 }
 
 
-static void __threaded_timer_check(cmn_timer_t *timers)
+cmn_timer_ctx_t *cmn_timer_ctx_create(const char *name)
 {
-	int now, ms;
-	cmn_timer_id_t	*t, *prev, *next;
-	int removed;
+	cmn_timer_ctx_t *ctx;
 
-	now = cmn_get_ticks( );
+	ctx = (cmn_timer_ctx_t *)MALLOC(sizeof(cmn_timer_ctx_t));
+	if(ctx == NULL)
+		return NULL;
 
-	cmn_mutex_lock(timers->mutex);
+	memset(ctx, 0, sizeof(cmn_timer_ctx_t));
+	ctx->mutex = cmn_mutex_init();
+	clock_gettime(CLOCK_MONOTONIC, &ctx->start);
+	ctx->nextTick = _CMN_TIMER_NEVER;
+	ctx->fd = -1;
+	snprintf(ctx->name, sizeof(ctx->name), "%s", name);
 
-#if 0	
-	for ( prev = NULL, t = timers->timers; t; t = next )
-	{
-		removed = 0;
-		ms = t->interval - CMN_TIMESLICE;
-		next = t->next;
-		
-		if ( (t->lastAlarm < now) && ((now - t->lastAlarm) > ms) )
-		{
-			if ( (now - t->lastAlarm) < t->interval )
-			{
-				t->lastAlarm += t->interval;
-			}
-			else
-			{
-				t->lastAlarm = now;
-			}
+	return ctx;
+}
 
-			timers->timersChanged = FALSE;
+void cmn_timer_ctx_destroy(cmn_timer_ctx_t *ctx)
+{
+	if(ctx == NULL)
+		return;
 
-#if 1//CMN_TIMER_DEBUG
-			CMN_DEBUG( "Executing timer %s(%p) (thread = %s)", t->name, t, cmnThreadGetName() );
+#if defined(__linux__)
+	if(ctx->fd >= 0)
+		close(ctx->fd);
 #endif
 
-			cmn_mutex_unlock(timers->mutex );
+	while(ctx->slabs)
+	{
+		_cmn_timer_slab_t *slab = ctx->slabs;
+		ctx->slabs = slab->next;
+		FREE(slab);
+	}
 
-			ms = t->cb(t->interval, t->param);
-			
-			cmn_mutex_lock(timers->mutex);
-			
-			if ( timers->timersChanged )
-			{/* Abort, list of timers has been modified by other threads */
-				break;
-			}
+	cmn_mutex_destroy(ctx->mutex);
+	FREE(ctx);
+}
 
-			if ( ms != t->interval )
+/* in unit of ms, round to 10 ms */
+void *cmn_timer_ctx_add(cmn_timer_ctx_t *ctx, int interval, CMN_THREAD_TIMER_CALLBACK callback, void *param, cmn_timer_type type, const char *name)
+{
+	cmn_timer_id_t  *t;
+
+	cmn_mutex_lock(ctx->mutex);
+	t = _cmnTimerNew(ctx);
+	if ( t )
+	{
+		t->interval = (interval < CMN_TIMER_RESOLUTION)?CMN_TIMER_RESOLUTION:ROUND_RESOLUTION(interval);
+		t->ticks = t->interval/CMN_TIMER_RESOLUTION;
+		t->cb = callback;
+		t->type = type;
+		t->param = param;
+		t->ctx = ctx;
+		snprintf(t->name, CMN_TIMER_NAME_LENGTH, "%s", name);
+
+		/* first tick starting after interval, so it never expires early */
+		t->expires = (_cmnTimerElapsedMs(&ctx->start) + t->interval + CMN_TIMER_RESOLUTION - 1)/CMN_TIMER_RESOLUTION;
+		_cmnTimerLink(ctx, t);
+
+		if(t->expires < ctx->nextTick)
+		{
+			_cmnTimerCtxWakeAt(ctx, t->expires);
+			if(ctx->wakeup)
 			{
-				if ( ms )
-				{
-					t->interval = ROUND_RESOLUTION(ms);
-				}
-				else
-				{ /* Remove the timer from the linked list */
+				ctx->wakeup(ctx->wakeupData);
+			}
+		}
 
 #if CMN_TIMER_DEBUG
-					CMN_DEBUG("Removing timer %s(%p) after it has been executed", t->name, t);
+		CMN_WARN("Added Timer(%s: %d ms) = %p num_timers = %d", t->name, interval, t, ctx->numOfTimers );
 #endif
+	}
 
-					if ( prev )
-					{
-						prev->next = next;
-					}
-					else
-					{
-						timers->timers = next;
-					}
-
-					FREE(t);
-					-- timers->numOfTimers;
-					removed = 1;
-				}
-			}
-		}
-		
-		/* Don't update prev if the timer has disappeared */
-		if ( ! removed )
+	cmn_mutex_unlock(ctx->mutex);
+	return t;
+}
+
+int cmn_timer_ctx_remove(cmn_timer_ctx_t *ctx, void *_tid)
+{
+	cmn_timer_id_t *t = (cmn_timer_id_t *)_tid;
+	int removed = FALSE;
+
+	if(t == NULL)
+		return FALSE;
+
+	cmn_mutex_lock(ctx->mutex);
+	if(t->ctx == ctx)
+	{
+		if(t->state == cmn_timer_id_state_waiting)
 		{
-			prev = t;
+			_cmnTimerUnlink(ctx, t);
+			_cmnTimerFree(ctx, t);
+			removed = TRUE;
+		}
+		else if(t->state == cmn_timer_id_state_servicing)
+		{/* if this timer is working now, it must be waiting and removed(freed) in timer thread */
+			t->state = cmn_timer_id_state_wait_stop;
+			removed = TRUE;
 		}
 	}
-#else
-	for ( t = timers->timers; t; t = next )
+	cmn_mutex_unlock(ctx->mutex);
+
+	return removed;
+}
+
+static void _cmnTimerCtxRemoveAll(cmn_timer_ctx_t *ctx, void *keep)
+{
+	cmn_timer_id_t *t, *next;
+	int i;
+
+	cmn_mutex_lock(ctx->mutex);
+	for(i = 0; i < CMN_TIMER_WHEEL_SIZE; i++)
 	{
-#if 0
-		ms = t->interval - CMN_TIMESLICE;
-#else
-		ms = t->interval;
-#endif
-		next = t->next;
-		
-		if ( (t->lastAlarm < now) && ((now - t->lastAlarm) > ms) )
+		for(t = ctx->wheel[i]; t; t = next)
 		{
-			if ( (now - t->lastAlarm) < t->interval )
-			{
-				t->lastAlarm += t->interval;
-			}
-			else
+			next = t->next;
+			if(t != keep)
 			{
-				t->lastAlarm = now;
+				_cmnTimerUnlink(ctx, t);
+				_cmnTimerFree(ctx, t);
 			}
+		}
+	}
 
-			timers->timersChanged = FALSE;
-			t->state = cmn_timer_id_state_servicing;
+	for(t = ctx->expired; t; t = t->next)
+	{
+		if(t != keep && t->state == cmn_timer_id_state_servicing)
+			t->state = cmn_timer_id_state_wait_stop;
+	}
+	cmn_mutex_unlock(ctx->mutex);
+}
 
+void cmn_timer_ctx_remove_all(cmn_timer_ctx_t *ctx)
+{
+	_cmnTimerCtxRemoveAll(ctx, NULL);
+}
 
-#if CMN_TIMER_DEBUG
-			CMN_DEBUG("Executing timer %s(%p) ", t->name, t );
+int cmn_timer_ctx_run(cmn_timer_ctx_t *ctx)
+{
+	cmn_timer_id_t *t, *next, *last = NULL;
+	unsigned long now, i, n;
+	long ms;
+
+#if defined(__linux__)
+	if(ctx->fd >= 0)
+	{
+		uint64_t expirations;
+		/* not blocking, only clears the fd */
+		ssize_t res = read(ctx->fd, &expirations, sizeof(expirations));
+		(void)res;
+	}
 #endif
-			cmn_mutex_unlock(timers->mutex );
-
-			t->cb(t->interval, t->param);
-			
-			cmn_mutex_lock(timers->mutex);
-			
-			if ( timers->timersChanged )
-			{/* Abort, list of timers has been modified by other threads */
-				break;
+
+	cmn_mutex_lock(ctx->mutex);
+
+	now = _cmnTimerElapsedMs(&ctx->start)/CMN_TIMER_RESOLUTION;
+	if(now >= ctx->tick)
+	{
+		/* every slot is visited once at most, when the thread is late for more than one turn */
+		n = now - ctx->tick + 1;
+		if(n > CMN_TIMER_WHEEL_SIZE)
+			n = CMN_TIMER_WHEEL_SIZE;
+
+		for(i = 0; i < n; i++)
+		{
+			for(t = ctx->wheel[(ctx->tick + i) & _CMN_TIMER_WHEEL_MASK]; t; t = next)
+			{
+				next = t->next;
+				if(t->expires > now)
+					continue;
+
+				_cmnTimerUnlink(ctx, t);
+				t->state = cmn_timer_id_state_servicing;
+				t->next = NULL;
+				if(last)
+					last->next = t;
+				else
+					ctx->expired = t;
+				last = t;
 			}
 		}
+		ctx->tick = now + 1;
 	}
 
-
-//	sys_mutex_lock(&timers->mutex);
-	for ( prev = NULL, t = timers->timers; t; t = next )
+	/* timers expired in the same ticks are serviced in one pass */
+	for(t = ctx->expired; t; t = t->next)
 	{
-		removed = 0;
-#if 0		
-		ms = t->interval - CMN_TIMESLICE;
-#else
-		ms = t->interval;
+		if(t->state != cmn_timer_id_state_servicing)
+			continue;
+
+#if CMN_TIMER_DEBUG
+		CMN_DEBUG("Executing timer %s(%p) ", t->name, t );
 #endif
-		next = t->next;
+		cmn_mutex_unlock(ctx->mutex);
 
-		if( t->state == cmn_timer_id_state_wait_stop || 
-			(t->state == cmn_timer_id_state_servicing && t->type != cmn_timer_type_reload) )
-		{
-			__timer_remove(timers, prev, t);
-			removed = 1;
+		t->cb(t->interval, t->param);
+
+		cmn_mutex_lock(ctx->mutex);
+	}
+
+	for(t = ctx->expired; t; t = next)
+	{
+		next = t->next;
+		if(t->state == cmn_timer_id_state_servicing && t->type == cmn_timer_type_reload)
+		{/* same period as the timers expired at the same tick, so they keep on expiring together */
+			t->expires += t->ticks;
+			if(t->expires <= now)
+			{/* late for more than one period */
+				t->expires = now + t->ticks;
+			}
+			_cmnTimerLink(ctx, t);
 		}
-		else if(t->state== cmn_timer_id_state_servicing)
+		else
 		{
-			t->state = cmn_timer_id_state_waiting;
-#if 0
-			t->interval = ROUND_RESOLUTION(ms);
-#else
-			t->interval = ms;
-#endif
+			_cmnTimerFree(ctx, t);
+		}
+	}
+	ctx->expired = NULL;
 
-			BASE_ASSERT((t->interval > 0), "timer %s(%p) with interval of %d", t->name, t, t->interval);
-#if CMN_TIMER_DEBUG
-			CMN_DEBUG("Reload timer %s(%p) with interval of %d", t->name, t, t->interval);
-#endif
+	_cmnTimerCtxWakeAt(ctx, _cmnTimerCtxNextTick(ctx));
+	if(ctx->nextTick == _CMN_TIMER_NEVER)
+	{
+		ms = -1;
+	}
+	else
+	{
+		ms = (long)(ctx->nextTick*CMN_TIMER_RESOLUTION) - _cmnTimerElapsedMs(&ctx->start);
+		if(ms < 0)
+			ms = 0;
+	}
+
+	cmn_mutex_unlock(ctx->mutex);
+
+	return (int)ms;
+}
+
+int cmn_timer_ctx_fd(cmn_timer_ctx_t *ctx)
+{
+#if defined(__linux__)
+	cmn_mutex_lock(ctx->mutex);
+	if(ctx->fd < 0)
+	{
+		ctx->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK|TFD_CLOEXEC);
+		if(ctx->fd < 0)
+		{
+			CMN_WARN("Timer '%s' failed in creating timerfd: %s", ctx->name, strerror(errno));
 		}
-		
-		/* Don't update prev if the timer has disappeared */
-		if ( ! removed )
+		else
 		{
-			prev = t;
+			_cmnTimerCtxWakeAt(ctx, ctx->nextTick);
 		}
 	}
+	cmn_mutex_unlock(ctx->mutex);
 
+	return ctx->fd;
+#else
+	return -1;
 #endif
-	
+}
+
+void cmn_timer_ctx_set_wakeup(cmn_timer_ctx_t *ctx, void (*wakeup)(void *data), void *data)
+{
+	cmn_mutex_lock(ctx->mutex);
+	ctx->wakeup = wakeup;
+	ctx->wakeupData = data;
+	cmn_mutex_unlock(ctx->mutex);
+}
+
+
+#if !defined(__linux__)
+static void _cmnTimerWakeup(void *data)
+{
+	cmn_timer_t *timers = (cmn_timer_t *)data;
+
+	cmn_mutex_lock(timers->mutex);
+	timers->wakeup = TRUE;
+	cmn_cond_signal(timers->wakeCond);
 	cmn_mutex_unlock(timers->mutex);
 }
+#endif
 
 static int __run_thread_timers(CmnThread *th)
 {
 	cmn_timer_t *timers = (cmn_timer_t *)th->data;
-	
-	while( timers->state != CMN_TIMER_STATE_UNINIT )
+	int ms;
+
+	ms = cmn_timer_ctx_run(timers->ctx);
+
+	/* checked after running: the timer added by quit has woken this thread up, or is waited for */
+	if( timers->state == CMN_TIMER_STATE_UNINIT )
 	{
-		//CMN_DEBUG( "wakeup ...");
-		if ( timers->state == CMN_TIMER_STATE_RUNNING)
+		cmn_mutex_lock(timers->mutex);
+		timers->quit = TRUE;
+		cmn_cond_signal(timers->quitCond);
+		cmn_mutex_unlock(timers->mutex);
+		return -EXIT_FAILURE;
+	}
+
+#if defined(__linux__)
+	{
+		struct pollfd pfd;
+
+		(void)ms;
+		pfd.fd = timers->fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		poll(&pfd, 1, -1);
+	}
+#else
+	cmn_mutex_lock(timers->mutex);
+	if(!timers->wakeup)
+	{
+		if(ms < 0)
 		{
-		//	CMN_DEBUG( "wakeup to check timers...");
-			__threaded_timer_check(timers);
+			cmn_cond_wait(timers->wakeCond, timers->mutex);
+		}
+		else
+		{
+			struct timespec deadline;
+
+			clock_gettime(CLOCK_REALTIME, &deadline);
+			deadline.tv_sec += ms/1000;
+			deadline.tv_nsec += (ms%1000)*1000000L;
+			if(deadline.tv_nsec >= 1000000000L)
+			{
+				deadline.tv_sec++;
+				deadline.tv_nsec -= 1000000000L;
+			}
+			cmn_cond_timedwait(timers->wakeCond, timers->mutex, &deadline);
 		}
-		
-		cmn_delay(1);
 	}
-#if 0
-	return NULL;
-#else
-	return EXIT_SUCCESS;
+	timers->wakeup = FALSE;
+	cmn_mutex_unlock(timers->mutex);
 #endif
+
+	return EXIT_SUCCESS;
 }
 
 
 /* This is only called if the event thread is not running */
 static int _sys_timer_init(char *name)
 {
-#if 0
-	if( pthread_create(&_timers.tId, NULL, __run_thread_timers, NULL ) != 0)
-#else
 	_timers.tId = cmnThreadCreateThread(__run_thread_timers, &_timers, name);
 	if(!_timers.tId )
-#endif
 	{
 		return (-EXIT_FAILURE);
 	}
@@ -363,97 +599,60 @@ static int _sys_timer_init(char *name)
 	return EXIT_SUCCESS;
 }
 
+static int _cmnTimerQuitHandler(int interval, void *param)
+{
+	return 0;
+}
 
 static void _sys_timer_quit(void)
 {
+	if(_timers.state == CMN_TIMER_STATE_UNINIT)
+		return;
+
 	_timers.state = CMN_TIMER_STATE_UNINIT;
 
-//	if ( _timers.tId )
-	{
-#if 0	
-		pthread_join(_timers.tId, NULL);
-#else		
-		cmnThreadJoin(_timers.tId);
-#endif
-		cmn_mutex_destroy(_timers.mutex);
-		_timers.mutex = NULL;
+	if ( _timers.tId )
+	{/* timer thread is detached, so wait for it to leave its loop instead of joining it */
+		cmn_timer_ctx_add(_timers.ctx, 0, _cmnTimerQuitHandler, NULL, cmn_timer_type_once, "quit");
+
+		cmn_mutex_lock(_timers.mutex);
+		while(!_timers.quit)
+		{
+			cmn_cond_wait(_timers.quitCond, _timers.mutex);
+		}
+		cmn_mutex_unlock(_timers.mutex);
+		_timers.tId = NULL;
 	}
+
+	cmn_timer_ctx_destroy(_timers.ctx);
+	_timers.ctx = NULL;
+
+#if !defined(__linux__)
+	cmn_cond_destroy(_timers.wakeCond);
+#endif
+	cmn_cond_destroy(_timers.quitCond);
+	cmn_mutex_destroy(_timers.mutex);
+	_timers.mutex = NULL;
 }
 
 /* in unit of ms, round to 10 ms */
 void *cmn_add_timer(int interval, CMN_THREAD_TIMER_CALLBACK callback, void *param, cmn_timer_type type, const char *name)
 {
-	cmn_timer_id_t  *t;
-	
-	cmn_mutex_lock(_timers.mutex);
-	t = (cmn_timer_id_t *)MALLOC(sizeof( cmn_timer_id_t));
-	if ( t )
+	if(_timers.state == CMN_TIMER_STATE_UNINIT)
 	{
-		t->interval = ROUND_RESOLUTION(interval);
-		t->cb = callback;
-		t->type = type;
-		t->param = param;
-		
-		t->lastAlarm = cmn_get_ticks();
-		snprintf(t->name, CMN_TIMER_NAME_LENGTH, "%s", name);
-		
-		t->next = _timers.timers;
-		_timers.timers = t;
-
-		++ _timers.numOfTimers;
-		
-		_timers.timersChanged = TRUE;
-		_timers.state = CMN_TIMER_STATE_RUNNING;
+		CMN_WARN("Timer '%s' added before timer initialized", name);
+		return NULL;
 	}
-	
-#if CMN_TIMER_DEBUG
-	CMN_WARN("Added Timer(%s: %d ms) = %08x num_timers = %d", t->name, interval, (POINTRT_TO_INTEGER)t, _timers.numOfTimers );
-#endif
 
-	cmn_mutex_unlock(_timers.mutex);
-	return t;
+	return cmn_timer_ctx_add(_timers.ctx, interval, callback, param, type, name);
 }
 
 int cmn_remove_timer(void *_tid)
 {
-	cmn_timer_id_t *t, *prev = NULL;
-	int removed = FALSE;
-	cmn_timer_id_t *id = (cmn_timer_id_t *)_tid;
-	if(id == NULL)
+	if(_tid == NULL || _timers.state == CMN_TIMER_STATE_UNINIT)
 		return -EXIT_FAILURE;
 
-	cmn_mutex_lock(_timers.mutex);
-	/* Look for id in the linked list of timers */
-	for (t = _timers.timers; t; prev=t, t = t->next )
-	{
-		if ( t == id )
-		{
-			if(prev)
-			{
-				prev->next = t->next;
-			}
-			else
-			{
-				_timers.timers = t->next;
-			}
-			
-#if CMN_TIMER_DEBUG
-			CMN_DEBUG("Timer (%s: %08x) = %d num_timers = %d thread = %s is removed", t->name,
-				(POINTRT_TO_INTEGER)id, removed, _timers.numOfTimers, cmnThreadGetName() );
-#endif
-			FREE(t);
-			
-			-- _timers.numOfTimers;
-			
-			removed = TRUE;
-			_timers.timersChanged = TRUE;
-			break;
-		}
-	}
-	
-
-	cmn_mutex_unlock(_timers.mutex);
-	return removed;
+	return cmn_timer_ctx_remove(_timers.ctx, _tid);
 }
 
 
@@ -461,109 +660,79 @@ int cmn_remove_timer(void *_tid)
  * @param timer the timer to stop */
 void sys_timer_stop(void *td)
 {
-	cmn_timer_id_t *t, *prev = NULL;
-//	int removed = FALSE;
-	
-	cmn_timer_id_t *id = (cmn_timer_id_t *)td;
-	if(id == NULL)
+	cmn_remove_timer(td);
+}
+
+
+void cmn_cancel_timers(cmn_timer_mode_t mode)
+{
+	if(_timers.state == CMN_TIMER_STATE_UNINIT)
 	{
 		return;
 	}
 
-	cmn_mutex_lock(_timers.mutex);
-	/* Look for id in the linked list of timers */
-	for (t = _timers.timers; t; prev=t, t = t->next )
+	if(mode == CMN_TIMER_ITIMER)
 	{
-		if ( t == id )
-		{
-			if(t->state == cmn_timer_id_state_servicing)
-			{/* if this timer is working now, it must be waiting and removed(freed) in timer thread */
-				t->state = cmn_timer_id_state_wait_stop;
-				_timers.timersChanged = TRUE;
-				break;
-			}
+		void *alarm = __atomic_exchange_n(&_timers.alarm, NULL, __ATOMIC_SEQ_CST);
 
-#if 0
-			if(prev)
-			{
-				prev->next = t->next;
-			}
-			else
-			{
-				_timers.timers = t->next;
-			}
-			
-			BASE_DEBUGF(BASE_DBG_ON,  ("Timer %s = %d num_timers = %d is removed", t->name, removed, _timers.numOfTimers ) );
-			free(t);
-			
-			-- _timers.numOfTimers;
-#else
-			__timer_remove(&_timers, prev, t);
-#endif
-//			removed = TRUE;
-			_timers.timersChanged = TRUE;
-			break;
-		}
+		if(alarm)
+			cmn_timer_ctx_remove(_timers.ctx, alarm);
+		return;
 	}
 
-	cmn_mutex_unlock(_timers.mutex);
-	return;
+	/* Stop any currently running timer */
+	_cmnTimerCtxRemoveAll(_timers.ctx, __atomic_load_n(&_timers.alarm, __ATOMIC_SEQ_CST));
 }
 
-
-static void _remove_all_timers(cmn_timer_id_t *t)
+static int __handle_alarm_timer(int interval, void *param)
 {
-	cmn_timer_id_t *freeme;
-	/* Changed to non-recursive implementation.
-	   The recursive implementation is elegant, but subject to stack overflow if there are lots and lots of timers. */
-	while ( t )
-	{
-		freeme = t;
-		t = t->next;
-		FREE(freeme);
-	}
-}
+	CMN_ALARM_TIMER_CALLBACK callback = _timers.alarmCallback;
+	int ms = 0;
 
-void cmn_cancel_timers(cmn_timer_mode_t mode)
-{
-	if(mode == CMN_TIMER_ITIMER)
+	if ( callback )
 	{
-		return _sys_stop_timer_alarm();
-	}
-	
-	if( _timers.state == CMN_TIMER_STATE_RUNNING )
-	{/* Stop any currently running timer */
-		cmn_mutex_lock(_timers.mutex);
-		_remove_all_timers(_timers.timers );
-		_timers.timers = NULL;
-		cmn_mutex_unlock(_timers.mutex);
-		
-		_timers.state = CMN_TIMER_STATE_INITED;
+		ms = (*callback)(_timers.alarmInterval );
+		if ( ms != _timers.alarmInterval)
+		{
+			cmn_set_timer(ms, callback );
+		}
 	}
+
+	return ms;
 }
 
-/* function interface for alarm syscall implemented timer. eg. set_timer, not add_timer 
-* so remove current alarm timer and added this alarm timer 
+/* function interface of alarm timer. eg. set_timer, not add_timer
+* so remove current alarm timer and added this alarm timer; it runs as a reload timer in timer thread
 */
 int cmn_set_timer(int ms, CMN_ALARM_TIMER_CALLBACK callback)
 {
-	int retval = 0;
+	void *alarm;
 
 #if CMN_TIMER_DEBUG
 	CMN_DEBUG("cmn_set_timer(%d)", ms);
 #endif
 
 	cmn_cancel_timers(CMN_TIMER_ITIMER);
-	
+
 	if ( ms > 0 )
 	{
 		_timers.alarmInterval = ms;
 		_timers.alarmCallback = callback;
-		
-		retval = _sys_start_timer_alarm( );
+
+		alarm = cmn_add_timer(ms, __handle_alarm_timer, NULL, cmn_timer_type_reload, "alarm");
+		if(alarm == NULL)
+		{
+			return -1;
+		}
+
+		alarm = __atomic_exchange_n(&_timers.alarm, alarm, __ATOMIC_SEQ_CST);
+		if(alarm)
+		{
+			cmn_timer_ctx_remove(_timers.ctx, alarm);
+		}
 	}
-	
-	return retval;
+
+	return 0;
 }
 
 /* get thread ID of timer thread */
@@ -574,8 +743,6 @@ int cmn_timer_id(void)
 
 int cmn_timer_init(char *name)
 {
-	int ret1 = 0, ret2 = 0;
-
 	if( _timers.state != CMN_TIMER_STATE_UNINIT)
 	{
 		CMN_WARN("Timer already initialized");
@@ -583,16 +750,28 @@ int cmn_timer_init(char *name)
 	}
 
 	memset(&_timers, 0 , sizeof(cmn_timer_t) );
-	
-	gettimeofday(&_timers.startTimeStamp, NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &_timers.startTimeStamp);
+
+	_timers.mutex = cmn_mutex_init();
+	_timers.quitCond = cmn_cond_init();
+	_timers.ctx = cmn_timer_ctx_create(name);
+	if(_timers.ctx == NULL)
+		return EXIT_FAILURE;
+
+#if defined(__linux__)
+	_timers.fd = cmn_timer_ctx_fd(_timers.ctx);
+	if(_timers.fd < 0)
+		return EXIT_FAILURE;
+#else
+	_timers.wakeCond = cmn_cond_init();
+	cmn_timer_ctx_set_wakeup(_timers.ctx, _cmnTimerWakeup, &_timers);
+#endif
+
 	_timers.state = CMN_TIMER_STATE_INITED;
 
-	ret1 = _sys_timer_init(name);
-	ret2 = _sys_timer_init_alarm();
-	if(ret1 <0 || ret2 < 0)
+	if(_sys_timer_init(name) < 0)
 		return EXIT_FAILURE;
-	
-	_timers.mutex = cmn_mutex_init();
 
 	return EXIT_SUCCESS;
 }
@@ -604,4 +783,3 @@ void cmn_timer_quit(void)
 
 	_sys_timer_quit();
 }
-
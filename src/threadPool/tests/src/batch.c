@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include "../../thpool.h"
+
+
+/*
+ * This program takes 2 arguments: number of jobs to add,
+ *                                 number of threads
+ *
+ * Jobs are added in batches. Each job adds one more job from inside the
+ * threadpool, so the sum should be twice the number of jobs.
+ *
+ * */
+
+
+threadpool thpool;
+int sum=0;
+
+
+void increment() {
+	__sync_fetch_and_add(&sum, 1);
+}
+
+
+void increment_and_add() {
+	__sync_fetch_and_add(&sum, 1);
+	thpool_add_work(thpool, (void*)increment, NULL);
+}
+
+
+int main(int argc, char *argv[]){
+
+	char* p;
+	if (argc != 3){
+		puts("This testfile needs excactly two arguments");
+		exit(1);
+	}
+	int num_jobs    = strtol(argv[1], &p, 10);
+	int num_threads = strtol(argv[2], &p, 10);
+
+	thpool = thpool_init(num_threads);
+
+	void* args[100] = {0};
+	int n;
+	for (n=0; n<num_jobs; n+=100){
+		int batch = num_jobs - n < 100 ? num_jobs - n : 100;
+		if (thpool_add_work_batch(thpool, (void*)increment_and_add, args, batch) != 0){
+			puts("Could not add batch");
+			exit(1);
+		}
+	}
+
+	thpool_wait(thpool);
+
+	printf("%d\n", sum);
+
+	thpool_destroy(thpool);
+
+	return 0;
+}
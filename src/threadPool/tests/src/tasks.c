@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include "../../thpool.h"
+
+
+/*
+ * This program takes 2 arguments: size of the range,
+ *                                 number of threads
+ *
+ * Tasks square numbers and are continued by tasks adding one. A task
+ * depending on all of them sums up their results. Then a loop marks every
+ * number of the range, and tasks sum up the range with parallel_reduce
+ * from inside the threadpool. The last line is the sum of the range.
+ *
+ * */
+
+
+#define NUM_TASKS 64
+
+
+threadpool thpool;
+int range;
+char* marks;
+
+
+void* square(void* arg) {
+	long n = (long)arg;
+	return (void*)(n * n);
+}
+
+
+void* add_one(void* result, void* arg) {
+	(void)arg;
+	return (void*)((long)result + 1);
+}
+
+
+void* sum_results(void* arg) {
+	thpool_task* tasks = (thpool_task*)arg;
+	long sum = 0;
+	int n;
+	for (n=0; n<NUM_TASKS; n++){
+		sum += (long)thpool_task_wait(tasks[n]);
+	}
+	return (void*)sum;
+}
+
+
+void mark(int begin, int end, void* arg) {
+	(void)arg;
+	int n;
+	for (n=begin; n<end; n++){
+		marks[n]++;
+	}
+}
+
+
+void* sum_chunk(int begin, int end, void* arg) {
+	(void)arg;
+	long sum = 0;
+	int n;
+	for (n=begin; n<end; n++){
+		sum += n;
+	}
+	return (void*)sum;
+}
+
+
+void* add(void* left, void* right, void* arg) {
+	(void)arg;
+	return (void*)((long)left + (long)right);
+}
+
+
+void* sum_range(void* arg) {
+	(void)arg;
+	void* sum;
+	if (thpool_parallel_reduce(thpool, 0, range, 0, sum_chunk, add, NULL, &sum) != 0){
+		puts("Could not reduce");
+		exit(1);
+	}
+	return sum;
+}
+
+
+int main(int argc, char *argv[]){
+
+	char* p;
+	if (argc != 3){
+		puts("This testfile needs excactly two arguments");
+		exit(1);
+	}
+	range           = strtol(argv[1], &p, 10);
+	int num_threads = strtol(argv[2], &p, 10);
+
+	thpool = thpool_init(num_threads);
+
+	/* Continuations and dependencies */
+	thpool_task squares[NUM_TASKS];
+	thpool_task tasks[NUM_TASKS];
+	long expected = 0;
+	int n;
+	for (n=0; n<NUM_TASKS; n++){
+		squares[n] = thpool_submit(thpool, square, (void*)(long)n);
+		tasks[n]   = thpool_task_then(squares[n], add_one, NULL);
+		thpool_task_release(squares[n]);
+		expected  += (long)n * n + 1;
+	}
+	thpool_task total = thpool_submit_after(thpool, tasks, NUM_TASKS, sum_results, tasks);
+	if ((long)thpool_task_wait(total) != expected || !thpool_task_poll(total)){
+		printf("Expected sum of tasks %ld but got %ld\n", expected, (long)thpool_task_wait(total));
+		exit(1);
+	}
+	thpool_task_release(total);
+	for (n=0; n<NUM_TASKS; n++){
+		thpool_task_release(tasks[n]);
+	}
+
+	/* Parallel loop */
+	marks = calloc(range ? range : 1, 1);
+	if (thpool_parallel_for(thpool, 0, range, 0, mark, NULL) != 0){
+		puts("Could not run loop");
+		exit(1);
+	}
+	for (n=0; n<range; n++){
+		if (marks[n] != 1){
+			printf("Index %d marked %d times\n", n, marks[n]);
+			exit(1);
+		}
+	}
+	free(marks);
+
+	/* Parallel reduce nested in tasks */
+	for (n=0; n<NUM_TASKS; n++){
+		tasks[n] = thpool_submit(thpool, sum_range, NULL);
+	}
+	long sum = (long)thpool_task_wait(tasks[0]);
+	for (n=0; n<NUM_TASKS; n++){
+		if ((long)thpool_task_wait(tasks[n]) != sum){
+			printf("Sums differ: %ld and %ld\n", sum, (long)thpool_task_wait(tasks[n]));
+			exit(1);
+		}
+		thpool_task_release(tasks[n]);
+	}
+
+	thpool_wait(thpool);
+
+	printf("%ld\n", sum);
+
+	thpool_destroy(thpool);
+
+	return 0;
+}
@@ -21,9 +21,42 @@ function test_mass_addition { #endsum #threads
 }
 
 
+function test_batch_addition { #jobs #threads
+	echo "Adding $1 jobs in batches, each adding one more, with $2 threads"
+	compile src/batch.c
+	output=$(./test $1 $2)
+	num=$(echo $output | awk '{print $(NF)}')
+	if [ "$num" == "$(( $1 * 2 ))" ]; then
+		return
+	fi
+	err "Expected $(( $1 * 2 )) but got $output" "$output"
+	exit 1
+}
+
+
+function test_tasks { #range #threads
+	echo "Running tasks and parallel loops over $1 numbers with $2 threads"
+	compile src/tasks.c
+	output=$(./test $1 $2)
+	num=$(echo $output | awk '{print $(NF)}')
+	if [ "$num" == "$(( $1 * ($1 - 1) / 2 ))" ]; then
+		return
+	fi
+	err "Expected $(( $1 * ($1 - 1) / 2 )) but got $output" "$output"
+	exit 1
+}
+
+
 # Run tests
 test_mass_addition 100 4
 test_mass_addition 100 1000
 test_mass_addition 100000 1000
+test_batch_addition 1000 1
+test_batch_addition 100000 4
+test_batch_addition 100000 64
+test_tasks 0 4
+test_tasks 1000 1
+test_tasks 100000 4
+test_tasks 100000 32
 
 echo "No errors"
@@ -42,12 +42,24 @@ static volatile int threads_on_hold;
 /* ========================== STRUCTURES ============================ */
 
 
-/* Binary semaphore */
-typedef struct bsem {
-	pthread_mutex_t mutex;
-	pthread_cond_t   cond;
-	int v;
-} bsem;
+/* Size of the deque of each thread, must be a power of 2 */
+#ifndef THPOOL_DEQUE_SIZE
+#define THPOOL_DEQUE_SIZE 256
+#endif
+
+/* Size of the job queue ring, must be a power of 2. Jobs which do not fit
+ * go to a locked overflow list */
+#ifndef THPOOL_QUEUE_SIZE
+#define THPOOL_QUEUE_SIZE 4096
+#endif
+
+/* Max jobs a thread pulls from the job queue at once. The extra jobs go to
+ * its own deque, where idle threads can steal them */
+#ifndef THPOOL_PULL_BATCH
+#define THPOOL_PULL_BATCH 8
+#endif
+
+#define CACHE_LINE 64
 
 
 /* Job */
@@ -58,35 +70,136 @@ typedef struct job{
 } job;
 
 
-/* Job queue */
+/* Cell of the job queue ring */
+typedef struct jobcell{
+	volatile size_t seq;                 /* sequence of the cell      */
+	void   (*function)(void* arg);       /* function pointer          */
+	void*  arg;                          /* function's argument       */
+} jobcell;
+
+
+/* Job queue
+ *
+ * Jobs added from outside the pool. The ring is a bounded lock-free
+ * multi-producer/multi-consumer queue, the overflow list and the freelist
+ * of its jobs are protected by rwmutex.
+ */
 typedef struct jobqueue{
-	pthread_mutex_t rwmutex;             /* used for queue r/w access */
-	job  *front;                         /* pointer to front of queue */
-	job  *rear;                          /* pointer to rear  of queue */
-	bsem *has_jobs;                      /* flag as binary semaphore  */
-	int   len;                           /* number of jobs in queue   */
+	jobcell* cells;                      /* ring of jobs              */
+	char     pad0[CACHE_LINE];
+	volatile size_t enqueue_pos;         /* next cell to push to      */
+	char     pad1[CACHE_LINE];
+	volatile size_t dequeue_pos;         /* next cell to pull from    */
+	char     pad2[CACHE_LINE];
+	pthread_mutex_t rwmutex;             /* used for overflow access  */
+	job  *front;                         /* front of overflow list    */
+	job  *rear;                          /* rear of overflow list     */
+	job  *freelist;                      /* free jobs for overflow    */
+	volatile int len;                    /* number of overflow jobs   */
 } jobqueue;
 
 
+/* Deque of a thread
+ *
+ * Work-stealing deque (Chase-Lev). Only the owner thread pushes and takes
+ * jobs at the bottom, other threads steal jobs at the top.
+ */
+typedef struct deque{
+	volatile long top;                   /* next job to steal         */
+	char          pad[CACHE_LINE];
+	volatile long bottom;                /* next free slot            */
+	struct {
+		void   (*function)(void* arg);
+		void*  arg;
+	} slots[THPOOL_DEQUE_SIZE];
+} deque;
+
+
 /* Thread */
 typedef struct thread{
 	int       id;                        /* friendly id               */
 	pthread_t pthread;                   /* pointer to actual thread  */
 	struct thpool_* thpool_p;            /* access to thpool          */
+	unsigned  seed;                      /* picks the thread to steal */
+	deque     deque;                     /* jobs added by this thread */
 } thread;
 
 
 /* Threadpool */
 typedef struct thpool_{
 	thread**   threads;                  /* pointer to threads        */
+	int        num_threads;              /* threads in the pool       */
 	volatile int num_threads_alive;      /* threads currently alive   */
 	volatile int num_threads_working;    /* threads currently working */
+	volatile int num_threads_idle;       /* threads waiting for jobs  */
 	pthread_mutex_t  thcount_lock;       /* used for thread count etc */
 	pthread_cond_t  threads_all_idle;    /* signal to thpool_wait     */
+	pthread_mutex_t  idle_lock;          /* used for idle threads     */
+	pthread_cond_t  has_jobs;            /* signal to idle threads    */
+	volatile int jobs_queued;            /* jobs not taken by threads */
+	volatile int jobs_unfinished;        /* jobs added, not finished  */
 	jobqueue  jobqueue;                  /* job queue                 */
 } thpool_;
 
 
+/* Thread of the pool running this code, NULL for other threads */
+static __thread struct thread* thread_self;
+
+
+/* Latch
+ *
+ * Counts down to zero once. Threads of the pool waiting for a latch run
+ * other jobs meanwhile.
+ */
+typedef struct latch{
+	volatile int    count;               /* left to count down        */
+	pthread_mutex_t lock;                /* used for waiting          */
+	pthread_cond_t  zero;                /* signal to waiting threads */
+} latch;
+
+
+/* Task
+ *
+ * Job with a result, returned to the caller of thpool_submit(). It is
+ * queued once all the tasks it depends on have finished.
+ */
+typedef struct thpool_task_{
+	struct thpool_* thpool_p;            /* pool running the task     */
+	void*  (*function)(void* arg);       /* function pointer          */
+	void*  (*then)(void* result, void* arg); /* continuation of prev  */
+	void*  arg;                          /* function's argument       */
+	struct thpool_task_* prev;           /* task continued by this    */
+	void*  result;                       /* return value of function  */
+	volatile int refs;                   /* references to the task    */
+	volatile int deps;                   /* unfinished dependencies   */
+	struct tasklink* dependents;         /* tasks waiting for this    */
+	latch  done;                         /* counts down when finished */
+} thpool_task_;
+
+
+/* Link from a task to a task depending on it */
+typedef struct tasklink{
+	struct tasklink*     next;
+	struct thpool_task_* task_p;
+} tasklink;
+
+
+/* Parallel loop shared by the caller and the helper jobs */
+typedef struct parallel{
+	volatile int refs;                   /* caller and helper jobs    */
+	volatile int next;                   /* next chunk to run         */
+	int    begin;                        /* range of the loop         */
+	int    end;
+	int    grain;                        /* iterations of a chunk     */
+	int    num_chunks;
+	void   (*body)(int begin, int end, void* arg);
+	void*  (*map)(int begin, int end, void* arg);
+	void*  arg;
+	void** partials;                     /* map result of each chunk  */
+	latch  done;                         /* counts down chunks run    */
+} parallel;
+
+
 
 
 
@@ -96,19 +209,44 @@ typedef struct thpool_{
 static int  thread_init(thpool_* thpool_p, struct thread** thread_p, int id);
 static void* thread_do(struct thread* thread_p);
 static void  thread_hold(int sig_id);
+static int   thread_take(struct thread* thread_p, void (**function_p)(void*), void** arg_p);
+static void  thread_run(thpool_* thpool_p, void (*function_p)(void*), void* arg_p);
+static void  thread_idle(thpool_* thpool_p);
 static void  thread_destroy(struct thread* thread_p);
 
+static int   jobs_push(thpool_* thpool_p, void (*function_p)(void*), void* arg_p);
+static void  jobs_wake(thpool_* thpool_p, int all);
+
 static int   jobqueue_init(jobqueue* jobqueue_p);
 static void  jobqueue_clear(jobqueue* jobqueue_p);
-static void  jobqueue_push(jobqueue* jobqueue_p, struct job* newjob_p);
-static struct job* jobqueue_pull(jobqueue* jobqueue_p);
+static int   jobqueue_push(jobqueue* jobqueue_p, void (*function_p)(void*), void* arg_p);
+static int   jobqueue_pull(jobqueue* jobqueue_p, void (**function_p)(void*), void** arg_p);
 static void  jobqueue_destroy(jobqueue* jobqueue_p);
 
-static void  bsem_init(struct bsem *bsem_p, int value);
-static void  bsem_reset(struct bsem *bsem_p);
-static void  bsem_post(struct bsem *bsem_p);
-static void  bsem_post_all(struct bsem *bsem_p);
-static void  bsem_wait(struct bsem *bsem_p);
+static void  deque_init(deque* deque_p);
+static int   deque_push(deque* deque_p, void (*function_p)(void*), void* arg_p);
+static int   deque_take(deque* deque_p, void (**function_p)(void*), void** arg_p);
+static int   deque_steal(deque* deque_p, void (**function_p)(void*), void** arg_p);
+static int   deque_room(deque* deque_p);
+
+static void  latch_init(latch* latch_p, int count);
+static void  latch_count_down(latch* latch_p, int n);
+static int   latch_done(latch* latch_p);
+static void  latch_wait(thpool_* thpool_p, latch* latch_p);
+static void  latch_destroy(latch* latch_p);
+
+static thpool_task_* task_new(thpool_* thpool_p, int deps);
+static int   task_depend(thpool_task_* task_p, thpool_task_** deps, int num_deps);
+static void  task_schedule(thpool_task_* task_p);
+static void  task_run(void* task_vp);
+static void  task_complete(thpool_task_* task_p);
+
+static int   parallel_run(thpool_* thpool_p, int begin, int end, int grain,
+                          void (*body_p)(int, int, void*), void* (*map_p)(int, int, void*),
+                          void* arg_p, void*** partials_p, parallel** parallel_p);
+static void  parallel_job(void* parallel_vp);
+static void  parallel_work(parallel* parallel_p);
+static void  parallel_release(parallel* parallel_p);
 
 
 
@@ -134,8 +272,12 @@ struct thpool_* thpool_init(int num_threads){
 		err("thpool_init(): Could not allocate memory for thread pool\n");
 		return NULL;
 	}
+	thpool_p->num_threads         = num_threads;
 	thpool_p->num_threads_alive   = 0;
 	thpool_p->num_threads_working = 0;
+	thpool_p->num_threads_idle    = 0;
+	thpool_p->jobs_queued         = 0;
+	thpool_p->jobs_unfinished     = 0;
 
 	/* Initialise the job queue */
 	if (jobqueue_init(&thpool_p->jobqueue) == -1){
@@ -144,8 +286,9 @@ struct thpool_* thpool_init(int num_threads){
 		return NULL;
 	}
 
-	/* Make threads in pool */
-	thpool_p->threads = (struct thread**)malloc(num_threads * sizeof(struct thread *));
+	/* Make threads in pool, other threads look for jobs to steal in here
+	 * while it is being filled */
+	thpool_p->threads = (struct thread**)calloc(num_threads ? num_threads : 1, sizeof(struct thread *));
 	if (thpool_p->threads == NULL){
 		err("thpool_init(): Could not allocate memory for threads\n");
 		jobqueue_destroy(&thpool_p->jobqueue);
@@ -155,6 +298,8 @@ struct thpool_* thpool_init(int num_threads){
 
 	pthread_mutex_init(&(thpool_p->thcount_lock), NULL);
 	pthread_cond_init(&thpool_p->threads_all_idle, NULL);
+	pthread_mutex_init(&(thpool_p->idle_lock), NULL);
+	pthread_cond_init(&thpool_p->has_jobs, NULL);
 
 	/* Thread init */
 	int n;
@@ -174,29 +319,55 @@ struct thpool_* thpool_init(int num_threads){
 
 /* Add work to the thread pool */
 int thpool_add_work(thpool_* thpool_p, void (*function_p)(void*), void* arg_p){
-	job* newjob;
 
-	newjob=(struct job*)malloc(sizeof(struct job));
-	if (newjob==NULL){
+	/* Count the job before any thread can finish it */
+	__atomic_add_fetch(&thpool_p->jobs_unfinished, 1, __ATOMIC_SEQ_CST);
+
+	if (jobs_push(thpool_p, function_p, arg_p) == -1){
 		err("thpool_add_work(): Could not allocate memory for new job\n");
+		__atomic_sub_fetch(&thpool_p->jobs_unfinished, 1, __ATOMIC_SEQ_CST);
 		return -1;
 	}
 
-	/* add function and argument */
-	newjob->function=function_p;
-	newjob->arg=arg_p;
-
-	/* add job to queue */
-	jobqueue_push(&thpool_p->jobqueue, newjob);
+	__atomic_add_fetch(&thpool_p->jobs_queued, 1, __ATOMIC_SEQ_CST);
+	jobs_wake(thpool_p, 0);
 
 	return 0;
 }
 
 
+/* Add a batch of work to the thread pool */
+int thpool_add_work_batch(thpool_* thpool_p, void (*function_p)(void*), void** arg_p, int num_jobs){
+	int n;
+
+	if (num_jobs <= 0){
+		return 0;
+	}
+
+	__atomic_add_fetch(&thpool_p->jobs_unfinished, num_jobs, __ATOMIC_SEQ_CST);
+
+	for (n=0; n<num_jobs; n++){
+		if (jobs_push(thpool_p, function_p, arg_p[n]) == -1){
+			err("thpool_add_work_batch(): Could not allocate memory for new job\n");
+			__atomic_sub_fetch(&thpool_p->jobs_unfinished, num_jobs - n, __ATOMIC_SEQ_CST);
+			break;
+		}
+	}
+
+	/* One wake up for the whole batch */
+	if (n){
+		__atomic_add_fetch(&thpool_p->jobs_queued, n, __ATOMIC_SEQ_CST);
+		jobs_wake(thpool_p, n > 1);
+	}
+
+	return (n == num_jobs) ? 0 : -1;
+}
+
+
 /* Wait until all jobs have finished */
 void thpool_wait(thpool_* thpool_p){
 	pthread_mutex_lock(&thpool_p->thcount_lock);
-	while (thpool_p->jobqueue.len || thpool_p->num_threads_working) {
+	while (__atomic_load_n(&thpool_p->jobs_unfinished, __ATOMIC_SEQ_CST)) {
 		pthread_cond_wait(&thpool_p->threads_all_idle, &thpool_p->thcount_lock);
 	}
 	pthread_mutex_unlock(&thpool_p->thcount_lock);
@@ -219,17 +390,21 @@ void thpool_destroy(thpool_* thpool_p){
 	double tpassed = 0.0;
 	time (&start);
 	while (tpassed < TIMEOUT && thpool_p->num_threads_alive){
-		bsem_post_all(thpool_p->jobqueue.has_jobs);
+		jobs_wake(thpool_p, 1);
 		time (&end);
 		tpassed = difftime(end,start);
 	}
 
 	/* Poll remaining threads */
 	while (thpool_p->num_threads_alive){
-		bsem_post_all(thpool_p->jobqueue.has_jobs);
+		jobs_wake(thpool_p, 1);
 		sleep(1);
 	}
 
+	/* The last thread may still hold the lock after counting itself out */
+	pthread_mutex_lock(&thpool_p->thcount_lock);
+	pthread_mutex_unlock(&thpool_p->thcount_lock);
+
 	/* Job queue cleanup */
 	jobqueue_destroy(&thpool_p->jobqueue);
 	/* Deallocs */
@@ -263,7 +438,372 @@ void thpool_resume(thpool_* thpool_p) {
 
 
 int thpool_num_threads_working(thpool_* thpool_p){
-	return thpool_p->num_threads_working;
+	return __atomic_load_n(&thpool_p->num_threads_working, __ATOMIC_RELAXED);
+}
+
+
+
+
+
+/* ============================= TASKS ============================== */
+
+
+/* Submit a task to the thread pool */
+struct thpool_task_* thpool_submit(thpool_* thpool_p, void* (*function_p)(void*), void* arg_p){
+	return thpool_submit_after(thpool_p, NULL, 0, function_p, arg_p);
+}
+
+
+/* Submit a task to run once other tasks have finished */
+struct thpool_task_* thpool_submit_after(thpool_* thpool_p, struct thpool_task_** deps, int num_deps,
+                                         void* (*function_p)(void*), void* arg_p){
+	thpool_task_* task_p = task_new(thpool_p, num_deps);
+	if (task_p == NULL){
+		err("thpool_submit_after(): Could not allocate memory for new task\n");
+		return NULL;
+	}
+	task_p->function = function_p;
+	task_p->arg      = arg_p;
+
+	if (task_depend(task_p, deps, num_deps) == -1){
+		err("thpool_submit_after(): Could not allocate memory for dependencies\n");
+		latch_destroy(&task_p->done);
+		free(task_p);
+		return NULL;
+	}
+	return task_p;
+}
+
+
+/* Continue a task with another one */
+struct thpool_task_* thpool_task_then(struct thpool_task_* prev_p, void* (*function_p)(void*, void*), void* arg_p){
+	thpool_task_* task_p = task_new(prev_p->thpool_p, 1);
+	if (task_p == NULL){
+		err("thpool_task_then(): Could not allocate memory for new task\n");
+		return NULL;
+	}
+	task_p->then = function_p;
+	task_p->arg  = arg_p;
+	task_p->prev = prev_p;
+	__atomic_add_fetch(&prev_p->refs, 1, __ATOMIC_RELAXED);
+
+	if (task_depend(task_p, &prev_p, 1) == -1){
+		err("thpool_task_then(): Could not allocate memory for dependencies\n");
+		thpool_task_release(prev_p);
+		latch_destroy(&task_p->done);
+		free(task_p);
+		return NULL;
+	}
+	return task_p;
+}
+
+
+/* Check if a task has finished */
+int thpool_task_poll(struct thpool_task_* task_p){
+	return latch_done(&task_p->done);
+}
+
+
+/* Wait for a task to finish */
+void* thpool_task_wait(struct thpool_task_* task_p){
+	latch_wait(task_p->thpool_p, &task_p->done);
+	return task_p->result;
+}
+
+
+/* Release a task returned by the thread pool */
+void thpool_task_release(struct thpool_task_* task_p){
+	if (task_p == NULL){
+		return;
+	}
+	if (__atomic_sub_fetch(&task_p->refs, 1, __ATOMIC_ACQ_REL) == 0){
+		latch_destroy(&task_p->done);
+		free(task_p);
+	}
+}
+
+
+/* Make a task, referenced by the caller and by the pool until it has run
+ *
+ * @param deps          number of tasks it depends on
+ */
+static thpool_task_* task_new(thpool_* thpool_p, int deps){
+	thpool_task_* task_p = (struct thpool_task_*)malloc(sizeof(struct thpool_task_));
+	if (task_p == NULL){
+		return NULL;
+	}
+	task_p->thpool_p   = thpool_p;
+	task_p->function   = NULL;
+	task_p->then       = NULL;
+	task_p->arg        = NULL;
+	task_p->prev       = NULL;
+	task_p->result     = NULL;
+	task_p->refs       = 2;
+	task_p->deps       = deps + 1;      /* held until all links are made */
+	task_p->dependents = NULL;
+	latch_init(&task_p->done, 1);
+	return task_p;
+}
+
+
+/* Link a new task to the tasks it depends on, and queue it if they have
+ * all finished
+ *
+ * @return 0 on success, -1 otherwise (nothing is linked).
+ */
+static int task_depend(thpool_task_* task_p, thpool_task_** deps, int num_deps){
+	tasklink* links = NULL;
+	tasklink* link_p;
+	int n;
+
+	/* Allocate all links first, so failing leaves nothing to undo */
+	for (n=0; n<num_deps; n++){
+		link_p = (struct tasklink*)malloc(sizeof(struct tasklink));
+		if (link_p == NULL){
+			while (links){
+				link_p = links;
+				links = links->next;
+				free(link_p);
+			}
+			return -1;
+		}
+		link_p->task_p = task_p;
+		link_p->next   = links;
+		links = link_p;
+	}
+
+	for (n=0; n<num_deps; n++){
+		thpool_task_* dep_p = deps[n];
+		link_p = links;
+		links = links->next;
+
+		pthread_mutex_lock(&dep_p->done.lock);
+		if (dep_p->done.count){
+			link_p->next = dep_p->dependents;
+			dep_p->dependents = link_p;
+			link_p = NULL;
+		}
+		pthread_mutex_unlock(&dep_p->done.lock);
+
+		if (link_p){
+			/* Already finished */
+			free(link_p);
+			__atomic_sub_fetch(&task_p->deps, 1, __ATOMIC_ACQ_REL);
+		}
+	}
+
+	if (__atomic_sub_fetch(&task_p->deps, 1, __ATOMIC_ACQ_REL) == 0){
+		task_schedule(task_p);
+	}
+	return 0;
+}
+
+
+/* Queue a task whose dependencies have finished. Runs it right away if
+ * the job cannot be added. */
+static void task_schedule(thpool_task_* task_p){
+	if (thpool_add_work(task_p->thpool_p, task_run, task_p) == -1){
+		task_run(task_p);
+	}
+}
+
+
+/* Job running a task */
+static void task_run(void* task_vp){
+	thpool_task_* task_p = (struct thpool_task_*)task_vp;
+
+	if (task_p->prev){
+		task_p->result = task_p->then(task_p->prev->result, task_p->arg);
+		thpool_task_release(task_p->prev);
+		task_p->prev = NULL;
+	}
+	else {
+		task_p->result = task_p->function(task_p->arg);
+	}
+
+	task_complete(task_p);
+	thpool_task_release(task_p);
+}
+
+
+/* Mark a task as finished and queue the tasks waiting only for it */
+static void task_complete(thpool_task_* task_p){
+	tasklink* link_p;
+
+	/* Take the dependents in the same lock as counting down, so no task
+	 * links to it in between */
+	pthread_mutex_lock(&task_p->done.lock);
+	link_p = task_p->dependents;
+	task_p->dependents = NULL;
+	__atomic_store_n(&task_p->done.count, 0, __ATOMIC_RELEASE);
+	pthread_cond_broadcast(&task_p->done.zero);
+	pthread_mutex_unlock(&task_p->done.lock);
+
+	while (link_p){
+		tasklink* next_p = link_p->next;
+		if (__atomic_sub_fetch(&link_p->task_p->deps, 1, __ATOMIC_ACQ_REL) == 0){
+			task_schedule(link_p->task_p);
+		}
+		free(link_p);
+		link_p = next_p;
+	}
+}
+
+
+
+
+
+/* ============================ PARALLEL ============================ */
+
+
+/* Run a loop over a range in parallel */
+int thpool_parallel_for(thpool_* thpool_p, int begin, int end, int grain,
+                        void (*body_p)(int, int, void*), void* arg_p){
+	parallel* parallel_p;
+
+	if (parallel_run(thpool_p, begin, end, grain, body_p, NULL, arg_p, NULL, &parallel_p) == -1){
+		err("thpool_parallel_for(): Could not allocate memory for loop\n");
+		return -1;
+	}
+	parallel_release(parallel_p);
+	return 0;
+}
+
+
+/* Map chunks of a range in parallel and reduce their results in order */
+int thpool_parallel_reduce(thpool_* thpool_p, int begin, int end, int grain,
+                           void* (*map_p)(int, int, void*), void* (*reduce_p)(void*, void*, void*),
+                           void* arg_p, void** result_p){
+	parallel* parallel_p;
+	void**    partials;
+	int n;
+
+	if (parallel_run(thpool_p, begin, end, grain, NULL, map_p, arg_p, &partials, &parallel_p) == -1){
+		err("thpool_parallel_reduce(): Could not allocate memory for loop\n");
+		return -1;
+	}
+
+	*result_p = NULL;
+	if (parallel_p->num_chunks){
+		*result_p = partials[0];
+		for (n=1; n<parallel_p->num_chunks; n++){
+			*result_p = reduce_p(*result_p, partials[n], arg_p);
+		}
+	}
+	parallel_release(parallel_p);
+	return 0;
+}
+
+
+/* Split a range into chunks and run them on helper jobs and the calling
+ * thread
+ *
+ * Helper jobs claim chunks until none are left, so a helper which starts
+ * late finds nothing to do and the caller does not wait for it.
+ *
+ * @param partials_p    set to the result of map_p for each chunk, if not NULL
+ * @param parallel_p    set to the finished loop, to release by the caller
+ * @return 0 on success, -1 otherwise (nothing has run).
+ */
+static int parallel_run(thpool_* thpool_p, int begin, int end, int grain,
+                        void (*body_p)(int, int, void*), void* (*map_p)(int, int, void*),
+                        void* arg_p, void*** partials_p, parallel** parallel_p){
+	long range = end > begin ? (long)end - begin : 0;
+	int  num_helpers;
+	int  n;
+
+	/* A few chunks per thread balances uneven chunks */
+	if (grain <= 0){
+		grain = (int)(range / ((long)(thpool_p->num_threads + 1) * 4));
+		if (grain <= 0){
+			grain = 1;
+		}
+	}
+
+	parallel* par = (struct parallel*)malloc(sizeof(struct parallel));
+	if (par == NULL){
+		return -1;
+	}
+	par->next       = 0;
+	par->begin      = begin;
+	par->end        = end;
+	par->grain      = grain;
+	par->num_chunks = (int)((range + grain - 1) / grain);
+	par->body       = body_p;
+	par->map        = map_p;
+	par->arg        = arg_p;
+	par->partials   = NULL;
+	if (partials_p && par->num_chunks){
+		par->partials = (void**)malloc(par->num_chunks * sizeof(void*));
+		if (par->partials == NULL){
+			free(par);
+			return -1;
+		}
+	}
+	latch_init(&par->done, par->num_chunks);
+
+	/* The caller runs chunks too */
+	num_helpers = par->num_chunks - 1;
+	if (num_helpers > thpool_p->num_threads){
+		num_helpers = thpool_p->num_threads;
+	}
+	par->refs = 1 + (num_helpers > 0 ? num_helpers : 0);
+	for (n=0; n<num_helpers; n++){
+		if (thpool_add_work(thpool_p, parallel_job, par) == -1){
+			__atomic_sub_fetch(&par->refs, num_helpers - n, __ATOMIC_ACQ_REL);
+			break;
+		}
+	}
+
+	parallel_work(par);
+	latch_wait(thpool_p, &par->done);
+
+	if (partials_p){
+		*partials_p = par->partials;
+	}
+	*parallel_p = par;
+	return 0;
+}
+
+
+/* Job helping a parallel loop */
+static void parallel_job(void* parallel_vp){
+	parallel* parallel_p = (struct parallel*)parallel_vp;
+	parallel_work(parallel_p);
+	parallel_release(parallel_p);
+}
+
+
+/* Run chunks of a loop until none are left */
+static void parallel_work(parallel* parallel_p){
+	int num_run = 0;
+	int chunk;
+
+	while ((chunk = __atomic_fetch_add(&parallel_p->next, 1, __ATOMIC_RELAXED)) < parallel_p->num_chunks){
+		int b = parallel_p->begin + chunk * parallel_p->grain;
+		int e = (parallel_p->end - b > parallel_p->grain) ? b + parallel_p->grain : parallel_p->end;
+		if (parallel_p->map){
+			parallel_p->partials[chunk] = parallel_p->map(b, e, parallel_p->arg);
+		}
+		else {
+			parallel_p->body(b, e, parallel_p->arg);
+		}
+		num_run++;
+	}
+
+	if (num_run){
+		latch_count_down(&parallel_p->done, num_run);
+	}
+}
+
+
+/* Drop a reference to a parallel loop */
+static void parallel_release(parallel* parallel_p){
+	if (__atomic_sub_fetch(&parallel_p->refs, 1, __ATOMIC_ACQ_REL) == 0){
+		latch_destroy(&parallel_p->done);
+		free(parallel_p->partials);
+		free(parallel_p);
+	}
 }
 
 
@@ -281,17 +821,22 @@ int thpool_num_threads_working(thpool_* thpool_p){
  */
 static int thread_init (thpool_* thpool_p, struct thread** thread_p, int id){
 
-	*thread_p = (struct thread*)malloc(sizeof(struct thread));
-	if (*thread_p == NULL){
+	struct thread* new_thread = (struct thread*)malloc(sizeof(struct thread));
+	if (new_thread == NULL){
 		err("thread_init(): Could not allocate memory for thread\n");
 		return -1;
 	}
 
-	(*thread_p)->thpool_p = thpool_p;
-	(*thread_p)->id       = id;
+	new_thread->thpool_p = thpool_p;
+	new_thread->id       = id;
+	new_thread->seed     = (unsigned)id * 2654435761u + 1;
+	deque_init(&new_thread->deque);
+
+	/* Publish the initialised thread to the threads stealing jobs */
+	__atomic_store_n(thread_p, new_thread, __ATOMIC_RELEASE);
 
-	pthread_create(&(*thread_p)->pthread, NULL, (void * (*)(void *)) thread_do, (*thread_p));
-	pthread_detach((*thread_p)->pthread);
+	pthread_create(&new_thread->pthread, NULL, (void * (*)(void *)) thread_do, new_thread);
+	pthread_detach(new_thread->pthread);
 	return 0;
 }
 
@@ -331,6 +876,7 @@ static void* thread_do(struct thread* thread_p){
 
 	/* Assure all threads have been created before starting serving */
 	thpool_* thpool_p = thread_p->thpool_p;
+	thread_self = thread_p;
 
 	/* Register signal handler */
 	struct sigaction act;
@@ -348,39 +894,108 @@ static void* thread_do(struct thread* thread_p){
 
 	while(threads_keepalive){
 
-		bsem_wait(thpool_p->jobqueue.has_jobs);
+		/* Read job from queues and execute it */
+		void (*func_buff)(void*);
+		void*  arg_buff;
+		if (!thread_take(thread_p, &func_buff, &arg_buff)){
+			thread_idle(thpool_p);
+			continue;
+		}
 
-		if (threads_keepalive){
+		thread_run(thpool_p, func_buff, arg_buff);
+	}
+	pthread_mutex_lock(&thpool_p->thcount_lock);
+	thpool_p->num_threads_alive --;
+	pthread_mutex_unlock(&thpool_p->thcount_lock);
+
+	return NULL;
+}
 
-			pthread_mutex_lock(&thpool_p->thcount_lock);
-			thpool_p->num_threads_working++;
-			pthread_mutex_unlock(&thpool_p->thcount_lock);
 
-			/* Read job from queue and execute it */
+/* Get a job for a thread
+ *
+ * The thread takes the newest job of its own deque first, then pulls jobs
+ * added from outside the pool, and at last steals the oldest job of
+ * another thread.
+ *
+ * @return 1 if a job was taken, 0 otherwise.
+ */
+static int thread_take(struct thread* thread_p, void (**function_p)(void*), void** arg_p){
+	thpool_* thpool_p = thread_p->thpool_p;
+
+	if (deque_take(&thread_p->deque, function_p, arg_p)){
+		goto taken;
+	}
+
+	if (jobqueue_pull(&thpool_p->jobqueue, function_p, arg_p)){
+		/* Move some more jobs to the own deque */
+		int room = deque_room(&thread_p->deque);
+		int n;
+		for (n=1; n<THPOOL_PULL_BATCH && n<=room; n++){
 			void (*func_buff)(void*);
 			void*  arg_buff;
-			job* job_p = jobqueue_pull(&thpool_p->jobqueue);
-			if (job_p) {
-				func_buff = job_p->function;
-				arg_buff  = job_p->arg;
-				func_buff(arg_buff);
-				free(job_p);
+			if (!jobqueue_pull(&thpool_p->jobqueue, &func_buff, &arg_buff)){
+				break;
 			}
+			deque_push(&thread_p->deque, func_buff, arg_buff);
+		}
+		if (n > 1){
+			jobs_wake(thpool_p, n > 2);
+		}
+		goto taken;
+	}
 
-			pthread_mutex_lock(&thpool_p->thcount_lock);
-			thpool_p->num_threads_working--;
-			if (!thpool_p->num_threads_working) {
-				pthread_cond_signal(&thpool_p->threads_all_idle);
-			}
-			pthread_mutex_unlock(&thpool_p->thcount_lock);
-
+	/* Steal, starting from a random thread */
+	int num_threads = thpool_p->num_threads;
+	int n;
+	thread_p->seed = thread_p->seed * 1103515245u + 12345u;
+	int start = (int)((thread_p->seed >> 16) % (unsigned)(num_threads ? num_threads : 1));
+	for (n=0; n<num_threads; n++){
+		struct thread* victim = __atomic_load_n(&thpool_p->threads[(start + n) % num_threads], __ATOMIC_ACQUIRE);
+		if (victim == NULL || victim == thread_p){
+			continue;
+		}
+		if (deque_steal(&victim->deque, function_p, arg_p)){
+			goto taken;
 		}
 	}
-	pthread_mutex_lock(&thpool_p->thcount_lock);
-	thpool_p->num_threads_alive --;
-	pthread_mutex_unlock(&thpool_p->thcount_lock);
 
-	return NULL;
+	return 0;
+
+taken:
+	__atomic_sub_fetch(&thpool_p->jobs_queued, 1, __ATOMIC_SEQ_CST);
+	return 1;
+}
+
+
+/* Run a job taken by a thread and count it as finished */
+static void thread_run(thpool_* thpool_p, void (*function_p)(void*), void* arg_p){
+
+	__atomic_add_fetch(&thpool_p->num_threads_working, 1, __ATOMIC_RELAXED);
+	function_p(arg_p);
+	__atomic_sub_fetch(&thpool_p->num_threads_working, 1, __ATOMIC_RELAXED);
+
+	if (__atomic_sub_fetch(&thpool_p->jobs_unfinished, 1, __ATOMIC_SEQ_CST) == 0){
+		pthread_mutex_lock(&thpool_p->thcount_lock);
+		pthread_cond_broadcast(&thpool_p->threads_all_idle);
+		pthread_mutex_unlock(&thpool_p->thcount_lock);
+	}
+}
+
+
+/* Wait until jobs are added
+ *
+ * Idle threads are counted before checking for jobs, and threads adding
+ * jobs check the count after adding them, so a wake up is never lost.
+ */
+static void thread_idle(thpool_* thpool_p){
+	pthread_mutex_lock(&thpool_p->idle_lock);
+	__atomic_add_fetch(&thpool_p->num_threads_idle, 1, __ATOMIC_SEQ_CST);
+	while (threads_keepalive && __atomic_load_n(&thpool_p->jobs_queued, __ATOMIC_SEQ_CST) <= 0){
+		pthread_cond_wait(&thpool_p->has_jobs, &thpool_p->idle_lock);
+	}
+	__atomic_sub_fetch(&thpool_p->num_threads_idle, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&thpool_p->idle_lock);
 }
 
 
@@ -393,22 +1008,72 @@ static void thread_destroy (thread* thread_p){
 
 
 
+/* ============================== JOBS ============================== */
+
+
+/* Add a job to the own deque of the calling thread of the pool, or to the
+ * job queue
+ *
+ * @return 0 on success, -1 otherwise.
+ */
+static int jobs_push(thpool_* thpool_p, void (*function_p)(void*), void* arg_p){
+	struct thread* self = thread_self;
+
+	if (self && self->thpool_p == thpool_p &&
+	    deque_push(&self->deque, function_p, arg_p) == 0){
+		return 0;
+	}
+
+	return jobqueue_push(&thpool_p->jobqueue, function_p, arg_p);
+}
+
+
+/* Wake idle threads, if any
+ *
+ * @param all           wake all threads, otherwise only one
+ */
+static void jobs_wake(thpool_* thpool_p, int all){
+	if (__atomic_load_n(&thpool_p->num_threads_idle, __ATOMIC_SEQ_CST) == 0){
+		return;
+	}
+
+	pthread_mutex_lock(&thpool_p->idle_lock);
+	if (all){
+		pthread_cond_broadcast(&thpool_p->has_jobs);
+	}
+	else {
+		pthread_cond_signal(&thpool_p->has_jobs);
+	}
+	pthread_mutex_unlock(&thpool_p->idle_lock);
+}
+
+
+
+
+
 /* ============================ JOB QUEUE =========================== */
 
 
 /* Initialize queue */
 static int jobqueue_init(jobqueue* jobqueue_p){
-	jobqueue_p->len = 0;
-	jobqueue_p->front = NULL;
-	jobqueue_p->rear  = NULL;
+	size_t n;
 
-	jobqueue_p->has_jobs = (struct bsem*)malloc(sizeof(struct bsem));
-	if (jobqueue_p->has_jobs == NULL){
+	jobqueue_p->cells = (struct jobcell*)malloc(THPOOL_QUEUE_SIZE * sizeof(struct jobcell));
+	if (jobqueue_p->cells == NULL){
 		return -1;
 	}
+	for (n=0; n<THPOOL_QUEUE_SIZE; n++){
+		jobqueue_p->cells[n].seq = n;
+	}
+	jobqueue_p->enqueue_pos = 0;
+	jobqueue_p->dequeue_pos = 0;
+
+	jobqueue_p->len = 0;
+	jobqueue_p->front = NULL;
+	jobqueue_p->rear  = NULL;
+	jobqueue_p->freelist = NULL;
 
 	pthread_mutex_init(&(jobqueue_p->rwmutex), NULL);
-	bsem_init(jobqueue_p->has_jobs, 0);
 
 	return 0;
 }
@@ -416,25 +1081,71 @@ static int jobqueue_init(jobqueue* jobqueue_p){
 
 /* Clear the queue */
 static void jobqueue_clear(jobqueue* jobqueue_p){
+	void (*func_buff)(void*);
+	void*  arg_buff;
 
-	while(jobqueue_p->len){
-		free(jobqueue_pull(jobqueue_p));
+	while (jobqueue_pull(jobqueue_p, &func_buff, &arg_buff)){
 	}
 
-	jobqueue_p->front = NULL;
-	jobqueue_p->rear  = NULL;
-	bsem_reset(jobqueue_p->has_jobs);
-	jobqueue_p->len = 0;
-
+	while (jobqueue_p->freelist){
+		job* job_p = jobqueue_p->freelist;
+		jobqueue_p->freelist = job_p->prev;
+		free(job_p);
+	}
 }
 
 
-/* Add (allocated) job to queue
+/* Add job to queue
+ *
+ * The job goes to the ring (Vyukov's bounded MPMC queue): a producer
+ * claims a cell whose sequence equals the enqueue position and publishes
+ * the job by moving the sequence forward. A full ring spills into the
+ * overflow list.
+ *
+ * @return 0 on success, -1 otherwise.
  */
-static void jobqueue_push(jobqueue* jobqueue_p, struct job* newjob){
+static int jobqueue_push(jobqueue* jobqueue_p, void (*function_p)(void*), void* arg_p){
+	jobcell* cell;
+	size_t pos = __atomic_load_n(&jobqueue_p->enqueue_pos, __ATOMIC_RELAXED);
+
+	for (;;){
+		cell = &jobqueue_p->cells[pos & (THPOOL_QUEUE_SIZE - 1)];
+		size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		long dif = (long)seq - (long)pos;
+		if (dif == 0){
+			if (__atomic_compare_exchange_n(&jobqueue_p->enqueue_pos, &pos, pos + 1, 1,
+			                                __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+				cell->function = function_p;
+				cell->arg      = arg_p;
+				__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+				return 0;
+			}
+		}
+		else if (dif < 0){
+			break;          /* full */
+		}
+		else {
+			pos = __atomic_load_n(&jobqueue_p->enqueue_pos, __ATOMIC_RELAXED);
+		}
+	}
 
+	/* Ring is full, add to overflow list */
 	pthread_mutex_lock(&jobqueue_p->rwmutex);
-	newjob->prev = NULL;
+	job* newjob = jobqueue_p->freelist;
+	if (newjob){
+		jobqueue_p->freelist = newjob->prev;
+	}
+	else {
+		newjob = (struct job*)malloc(sizeof(struct job));
+		if (newjob == NULL){
+			pthread_mutex_unlock(&jobqueue_p->rwmutex);
+			return -1;
+		}
+	}
+
+	newjob->function = function_p;
+	newjob->arg      = arg_p;
+	newjob->prev     = NULL;
 
 	switch(jobqueue_p->len){
 
@@ -448,17 +1159,46 @@ static void jobqueue_push(jobqueue* jobqueue_p, struct job* newjob){
 					jobqueue_p->rear = newjob;
 
 	}
-	jobqueue_p->len++;
+	__atomic_store_n(&jobqueue_p->len, jobqueue_p->len + 1, __ATOMIC_RELEASE);
 
-	bsem_post(jobqueue_p->has_jobs);
 	pthread_mutex_unlock(&jobqueue_p->rwmutex);
+	return 0;
 }
 
 
-/* Get first job from queue(removes it from queue)
- * Notice: Caller MUST hold a mutex
+/* Get first job from queue (removes it from queue)
+ *
+ * @return 1 if a job was pulled, 0 if the queue is empty.
  */
-static struct job* jobqueue_pull(jobqueue* jobqueue_p){
+static int jobqueue_pull(jobqueue* jobqueue_p, void (**function_p)(void*), void** arg_p){
+	jobcell* cell;
+	size_t pos = __atomic_load_n(&jobqueue_p->dequeue_pos, __ATOMIC_RELAXED);
+
+	for (;;){
+		cell = &jobqueue_p->cells[pos & (THPOOL_QUEUE_SIZE - 1)];
+		size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		long dif = (long)seq - (long)(pos + 1);
+		if (dif == 0){
+			if (__atomic_compare_exchange_n(&jobqueue_p->dequeue_pos, &pos, pos + 1, 1,
+			                                __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+				*function_p = cell->function;
+				*arg_p      = cell->arg;
+				__atomic_store_n(&cell->seq, pos + THPOOL_QUEUE_SIZE, __ATOMIC_RELEASE);
+				return 1;
+			}
+		}
+		else if (dif < 0){
+			break;          /* empty */
+		}
+		else {
+			pos = __atomic_load_n(&jobqueue_p->dequeue_pos, __ATOMIC_RELAXED);
+		}
+	}
+
+	/* Ring is empty, try the overflow list */
+	if (__atomic_load_n(&jobqueue_p->len, __ATOMIC_ACQUIRE) == 0){
+		return 0;
+	}
 
 	pthread_mutex_lock(&jobqueue_p->rwmutex);
 	job* job_p = jobqueue_p->front;
@@ -471,77 +1211,207 @@ static struct job* jobqueue_pull(jobqueue* jobqueue_p){
 		case 1:  /* if one job in queue */
 					jobqueue_p->front = NULL;
 					jobqueue_p->rear  = NULL;
-					jobqueue_p->len = 0;
 					break;
 
 		default: /* if >1 jobs in queue */
 					jobqueue_p->front = job_p->prev;
-					jobqueue_p->len--;
-					/* more than one job in queue -> post it */
-					bsem_post(jobqueue_p->has_jobs);
 
 	}
 
+	if (job_p){
+		__atomic_store_n(&jobqueue_p->len, jobqueue_p->len - 1, __ATOMIC_RELEASE);
+		*function_p = job_p->function;
+		*arg_p      = job_p->arg;
+		job_p->prev = jobqueue_p->freelist;
+		jobqueue_p->freelist = job_p;
+	}
+
 	pthread_mutex_unlock(&jobqueue_p->rwmutex);
-	return job_p;
+	return job_p != NULL;
 }
 
 
 /* Free all queue resources back to the system */
 static void jobqueue_destroy(jobqueue* jobqueue_p){
 	jobqueue_clear(jobqueue_p);
-	free(jobqueue_p->has_jobs);
+	free(jobqueue_p->cells);
+}
+
+
+
+
+
+/* ============================== DEQUE ============================= */
+
+
+/* Initialize deque */
+static void deque_init(deque* deque_p){
+	deque_p->top    = 0;
+	deque_p->bottom = 0;
 }
 
 
+/* Add job at the bottom, called by the owner only
+ *
+ * @return 0 on success, -1 if the deque is full.
+ */
+static int deque_push(deque* deque_p, void (*function_p)(void*), void* arg_p){
+	long b = __atomic_load_n(&deque_p->bottom, __ATOMIC_RELAXED);
+	long t = __atomic_load_n(&deque_p->top, __ATOMIC_ACQUIRE);
+
+	if (b - t >= THPOOL_DEQUE_SIZE){
+		return -1;
+	}
 
+	__atomic_store_n(&deque_p->slots[b & (THPOOL_DEQUE_SIZE - 1)].function, function_p, __ATOMIC_RELAXED);
+	__atomic_store_n(&deque_p->slots[b & (THPOOL_DEQUE_SIZE - 1)].arg, arg_p, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&deque_p->bottom, b + 1, __ATOMIC_RELAXED);
+	return 0;
+}
+
+
+/* Take job from the bottom, called by the owner only. Races with thieves
+ * for the last job.
+ *
+ * @return 1 if a job was taken, 0 if the deque is empty.
+ */
+static int deque_take(deque* deque_p, void (**function_p)(void*), void** arg_p){
+	long b = __atomic_load_n(&deque_p->bottom, __ATOMIC_RELAXED) - 1;
+	long t;
+	int  taken = 1;
+
+	__atomic_store_n(&deque_p->bottom, b, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	t = __atomic_load_n(&deque_p->top, __ATOMIC_RELAXED);
+
+	if (t <= b){
+		*function_p = __atomic_load_n(&deque_p->slots[b & (THPOOL_DEQUE_SIZE - 1)].function, __ATOMIC_RELAXED);
+		*arg_p      = __atomic_load_n(&deque_p->slots[b & (THPOOL_DEQUE_SIZE - 1)].arg, __ATOMIC_RELAXED);
+		if (t == b){
+			/* Last job */
+			if (!__atomic_compare_exchange_n(&deque_p->top, &t, t + 1, 0,
+			                                 __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)){
+				taken = 0;
+			}
+			__atomic_store_n(&deque_p->bottom, b + 1, __ATOMIC_RELAXED);
+		}
+	}
+	else {
+		taken = 0;
+		__atomic_store_n(&deque_p->bottom, b + 1, __ATOMIC_RELAXED);
+	}
 
+	return taken;
+}
 
-/* ======================== SYNCHRONISATION ========================= */
 
+/* Steal job from the top, called by other threads
+ *
+ * @return 1 if a job was stolen, 0 if the deque is empty or another
+ *         thread got the job first.
+ */
+static int deque_steal(deque* deque_p, void (**function_p)(void*), void** arg_p){
+	long t = __atomic_load_n(&deque_p->top, __ATOMIC_ACQUIRE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	long b = __atomic_load_n(&deque_p->bottom, __ATOMIC_ACQUIRE);
 
-/* Init semaphore to 1 or 0 */
-static void bsem_init(bsem *bsem_p, int value) {
-	if (value < 0 || value > 1) {
-		err("bsem_init(): Binary semaphore can take only values 1 or 0");
-		exit(1);
+	if (t >= b){
+		return 0;
 	}
-	pthread_mutex_init(&(bsem_p->mutex), NULL);
-	pthread_cond_init(&(bsem_p->cond), NULL);
-	bsem_p->v = value;
+
+	/* The slot cannot be reused before top moves past it, so the job read
+	 * here is valid whenever the CAS below succeeds */
+	*function_p = __atomic_load_n(&deque_p->slots[t & (THPOOL_DEQUE_SIZE - 1)].function, __ATOMIC_RELAXED);
+	*arg_p      = __atomic_load_n(&deque_p->slots[t & (THPOOL_DEQUE_SIZE - 1)].arg, __ATOMIC_RELAXED);
+
+	return __atomic_compare_exchange_n(&deque_p->top, &t, t + 1, 0,
+	                                   __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
 }
 
 
-/* Reset semaphore to 0 */
-static void bsem_reset(bsem *bsem_p) {
-	bsem_init(bsem_p, 0);
+/* Free slots of the deque, called by the owner only */
+static int deque_room(deque* deque_p){
+	long b = __atomic_load_n(&deque_p->bottom, __ATOMIC_RELAXED);
+	long t = __atomic_load_n(&deque_p->top, __ATOMIC_ACQUIRE);
+	return (int)(THPOOL_DEQUE_SIZE - (b - t));
 }
 
 
-/* Post to at least one thread */
-static void bsem_post(bsem *bsem_p) {
-	pthread_mutex_lock(&bsem_p->mutex);
-	bsem_p->v = 1;
-	pthread_cond_signal(&bsem_p->cond);
-	pthread_mutex_unlock(&bsem_p->mutex);
+
+
+
+/* ============================== LATCH ============================= */
+
+
+/* Initialize latch */
+static void latch_init(latch* latch_p, int count){
+	latch_p->count = count;
+	pthread_mutex_init(&latch_p->lock, NULL);
+	pthread_cond_init(&latch_p->zero, NULL);
+}
+
+
+/* Count down, waking the waiting threads at zero */
+static void latch_count_down(latch* latch_p, int n){
+	pthread_mutex_lock(&latch_p->lock);
+	if (__atomic_sub_fetch(&latch_p->count, n, __ATOMIC_RELEASE) == 0){
+		pthread_cond_broadcast(&latch_p->zero);
+	}
+	pthread_mutex_unlock(&latch_p->lock);
 }
 
 
-/* Post to all threads */
-static void bsem_post_all(bsem *bsem_p) {
-	pthread_mutex_lock(&bsem_p->mutex);
-	bsem_p->v = 1;
-	pthread_cond_broadcast(&bsem_p->cond);
-	pthread_mutex_unlock(&bsem_p->mutex);
+/* @return 1 if the latch is at zero, 0 otherwise */
+static int latch_done(latch* latch_p){
+	return __atomic_load_n(&latch_p->count, __ATOMIC_ACQUIRE) == 0;
 }
 
 
-/* Wait on semaphore until semaphore has value 0 */
-static void bsem_wait(bsem* bsem_p) {
-	pthread_mutex_lock(&bsem_p->mutex);
-	while (bsem_p->v != 1) {
-		pthread_cond_wait(&bsem_p->cond, &bsem_p->mutex);
+/* Wait for the latch to be at zero
+ *
+ * A thread of the pool runs the jobs it can take while waiting, so jobs
+ * waiting for other jobs do not tie up the pool. When there are none it
+ * sleeps shortly, since new jobs do not wake up a waiting latch.
+ */
+static void latch_wait(thpool_* thpool_p, latch* latch_p){
+	struct thread* self = thread_self;
+
+	if (self && self->thpool_p == thpool_p){
+		while (!latch_done(latch_p)){
+			void (*func_buff)(void*);
+			void*  arg_buff;
+			if (thread_take(self, &func_buff, &arg_buff)){
+				thread_run(thpool_p, func_buff, arg_buff);
+				continue;
+			}
+
+			struct timespec ts;
+			clock_gettime(CLOCK_REALTIME, &ts);
+			ts.tv_nsec += 1000000;
+			if (ts.tv_nsec >= 1000000000){
+				ts.tv_sec  += 1;
+				ts.tv_nsec -= 1000000000;
+			}
+			pthread_mutex_lock(&latch_p->lock);
+			if (!latch_done(latch_p)){
+				pthread_cond_timedwait(&latch_p->zero, &latch_p->lock, &ts);
+			}
+			pthread_mutex_unlock(&latch_p->lock);
+		}
+		return;
 	}
-	bsem_p->v = 0;
-	pthread_mutex_unlock(&bsem_p->mutex);
+
+	pthread_mutex_lock(&latch_p->lock);
+	while (!latch_done(latch_p)){
+		pthread_cond_wait(&latch_p->zero, &latch_p->lock);
+	}
+	pthread_mutex_unlock(&latch_p->lock);
+}
+
+
+/* Free latch resources */
+static void latch_destroy(latch* latch_p){
+	pthread_mutex_destroy(&latch_p->lock);
+	pthread_cond_destroy(&latch_p->zero);
 }
@@ -67,6 +67,41 @@ threadpool thpool_init(int num_threads);
 int thpool_add_work(threadpool, void (*function_p)(void*), void* arg_p);
 
 
+/**
+ * @brief Add a batch of work to the job queue
+ *
+ * Same as calling thpool_add_work() for each argument with the same
+ * function, but the idle threads are woken only once for the whole batch.
+ * Use it for many small jobs.
+ *
+ * When called from a job running in the threadpool, the jobs go to the
+ * deque of the calling thread first, and idle threads steal them from
+ * there.
+ *
+ * @example
+ *
+ *    void process(void* item){
+ *       ..
+ *    }
+ *
+ *    int main() {
+ *       ..
+ *       void* items[100];
+ *       ..
+ *       thpool_add_work_batch(thpool, process, items, 100);
+ *       ..
+ *    }
+ *
+ * @param  threadpool    threadpool to which the work will be added
+ * @param  function_p    pointer to function to add as work
+ * @param  arg_p         array of num_jobs arguments, one per job
+ * @param  num_jobs      number of jobs to add
+ * @return 0 on success, -1 otherwise (the jobs before the failing one
+ *         have been added).
+ */
+int thpool_add_work_batch(threadpool, void (*function_p)(void*), void** arg_p, int num_jobs);
+
+
 /**
  * @brief Wait for all queued jobs to finish
  *
@@ -180,6 +215,201 @@ void thpool_destroy(threadpool);
 int thpool_num_threads_working(threadpool);
 
 
+/* ================================== TASKS ====================================== */
+
+
+typedef struct thpool_task_* thpool_task;
+
+
+/**
+ * @brief Submit a task with a result to the threadpool
+ *
+ * Like thpool_add_work(), but the function returns a result and the call
+ * returns a handle to the task. Use the handle to wait for this task only,
+ * or to continue it with other tasks.
+ *
+ * The handle must be released with thpool_task_release() when no longer
+ * needed, whether the task has finished or not.
+ *
+ * @example
+ *
+ *    void* square(void* arg){
+ *       long n = (long)arg;
+ *       return (void*)(n * n);
+ *    }
+ *
+ *    int main() {
+ *       ..
+ *       thpool_task task = thpool_submit(thpool, square, (void*)7L);
+ *       long result = (long)thpool_task_wait(task);   // 49
+ *       thpool_task_release(task);
+ *       ..
+ *    }
+ *
+ * @param  threadpool    threadpool to which the task will be added
+ * @param  function_p    pointer to function to run as task
+ * @param  arg_p         pointer to an argument
+ * @return thpool_task   handle of the task on success,
+ *                       NULL on error
+ */
+thpool_task thpool_submit(threadpool, void* (*function_p)(void*), void* arg_p);
+
+
+/**
+ * @brief Submit a task which runs once other tasks have finished
+ *
+ * The task is added to the job queue when the last of deps has finished.
+ * The tasks in deps can be released right after this call.
+ *
+ * @example
+ *
+ *    thpool_task deps[2];
+ *    deps[0] = thpool_submit(thpool, load_config, dev1);
+ *    deps[1] = thpool_submit(thpool, load_config, dev2);
+ *    thpool_task done = thpool_submit_after(thpool, deps, 2, report, NULL);
+ *
+ * @param  threadpool    threadpool to which the task will be added
+ * @param  deps          tasks to wait for
+ * @param  num_deps      number of tasks in deps, can be 0
+ * @param  function_p    pointer to function to run as task
+ * @param  arg_p         pointer to an argument
+ * @return thpool_task   handle of the task on success,
+ *                       NULL on error
+ */
+thpool_task thpool_submit_after(threadpool, thpool_task* deps, int num_deps,
+                                void* (*function_p)(void*), void* arg_p);
+
+
+/**
+ * @brief Continue a task with another task
+ *
+ * Once task has finished, function_p runs in the same threadpool with the
+ * result of task and arg_p. Its own result is the result of the returned
+ * task. Continuations can be chained.
+ *
+ * @example
+ *
+ *    void* add_one(void* result, void* arg){
+ *       return (void*)((long)result + 1);
+ *    }
+ *
+ *    thpool_task t1 = thpool_submit(thpool, square, (void*)7L);
+ *    thpool_task t2 = thpool_task_then(t1, add_one, NULL);
+ *    long result = (long)thpool_task_wait(t2);     // 50
+ *
+ * @param  task          task to continue
+ * @param  function_p    pointer to function getting the result of task
+ * @param  arg_p         pointer to an argument
+ * @return thpool_task   handle of the continuation on success,
+ *                       NULL on error
+ */
+thpool_task thpool_task_then(thpool_task task, void* (*function_p)(void* result, void* arg), void* arg_p);
+
+
+/**
+ * @brief Check if a task has finished
+ *
+ * @param  task          the task of interest
+ * @return 1 if the task has finished, 0 otherwise
+ */
+int thpool_task_poll(thpool_task task);
+
+
+/**
+ * @brief Wait for a task to finish
+ *
+ * Can be called from a job running in the same threadpool: the thread then
+ * runs other jobs while waiting.
+ *
+ * @param  task          the task to wait for
+ * @return the result of the task's function
+ */
+void* thpool_task_wait(thpool_task task);
+
+
+/**
+ * @brief Release a task
+ *
+ * The task still runs if it has not finished yet. The handle must not be
+ * used afterwards.
+ *
+ * @param  task          the task to release, can be NULL
+ * @return nothing
+ */
+void thpool_task_release(thpool_task task);
+
+
+/**
+ * @brief Run a loop over a range in parallel
+ *
+ * Splits [begin, end) into chunks of grain iterations and calls body_p
+ * for each chunk with its own sub-range. The calling thread runs chunks
+ * too, and the call returns once all chunks have run.
+ *
+ * @example
+ *
+ *    void push_configs(int begin, int end, void* arg){
+ *       int i;
+ *       for (i=begin; i<end; i++){
+ *          push_config(((device**)arg)[i]);
+ *       }
+ *    }
+ *
+ *    thpool_parallel_for(thpool, 0, num_devices, 1, push_configs, devices);
+ *
+ * @param  threadpool    threadpool to run the loop
+ * @param  begin         first index of the range
+ * @param  end           index after the last one of the range
+ * @param  grain         iterations per chunk, or 0 to pick one from the
+ *                       number of threads
+ * @param  body_p        pointer to function running a chunk
+ * @param  arg_p         pointer to an argument
+ * @return 0 on success, -1 otherwise (nothing has run).
+ */
+int thpool_parallel_for(threadpool, int begin, int end, int grain,
+                        void (*body_p)(int begin, int end, void* arg), void* arg_p);
+
+
+/**
+ * @brief Map and reduce a range in parallel
+ *
+ * Like thpool_parallel_for(), but map_p returns a partial result for its
+ * chunk. The partial results are then combined with reduce_p in the order
+ * of the chunks by the calling thread, so reduce_p only needs to be
+ * associative.
+ *
+ * @example
+ *
+ *    void* sum_chunk(int begin, int end, void* arg){
+ *       long sum = 0;
+ *       ..
+ *       return (void*)sum;
+ *    }
+ *
+ *    void* add(void* left, void* right, void* arg){
+ *       return (void*)((long)left + (long)right);
+ *    }
+ *
+ *    void* sum;
+ *    thpool_parallel_reduce(thpool, 0, n, 0, sum_chunk, add, data, &sum);
+ *
+ * @param  threadpool    threadpool to run the loop
+ * @param  begin         first index of the range
+ * @param  end           index after the last one of the range
+ * @param  grain         iterations per chunk, or 0 to pick one from the
+ *                       number of threads
+ * @param  map_p         pointer to function running a chunk
+ * @param  reduce_p      pointer to function combining two results
+ * @param  arg_p         pointer to an argument, passed to both functions
+ * @param  result_p      set to the reduced result, NULL for an empty range
+ * @return 0 on success, -1 otherwise (nothing has run).
+ */
+int thpool_parallel_reduce(threadpool, int begin, int end, int grain,
+                           void* (*map_p)(int begin, int end, void* arg),
+                           void* (*reduce_p)(void* left, void* right, void* arg),
+                           void* arg_p, void** result_p);
+
+
 #ifdef __cplusplus
 }
 #endif
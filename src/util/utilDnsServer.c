@@ -7,12 +7,14 @@
 #include <baseAssert.h>
 #include <baseList.h>
 #include <baseLog.h>
+#include <baseOs.h>
 #include <basePool.h>
 #include <baseString.h>
 
 #define MAX_ANS	    16
 #define MAX_PKT	    1500
 #define MAX_LABEL   32
+#define MAX_BURST   8	/* Queries read with one system call */
 
 struct label_tab
 {
@@ -30,13 +32,24 @@ struct rr
     bdns_parsed_rr	rec;
 };
 
+/* Answer being sent. It has its own buffer since the read buffer of the
+ * query is given back to the next read before the answer has been sent.
+ */
+struct send_slot
+{
+    BASE_DECL_LIST_MEMBER(struct send_slot);
+    bioqueue_op_key_t	key;
+    buint8_t		pkt[MAX_PKT];
+};
+
 
 struct bdns_server
 {
     bpool_t		*pool;
     bpool_factory	*pf;
     bactivesock_t	*asock;
-    bioqueue_op_key_t	 send_key;
+    bmutex_t		*mutex;
+    struct send_slot	 free_slot;
     struct rr		 rr_list;
 };
 
@@ -47,6 +60,9 @@ static bbool_t on_data_recvfrom(bactivesock_t *asock,
 				  const bsockaddr_t *src_addr,
 				  int addr_len,
 				  bstatus_t status);
+static bbool_t on_data_sent(bactivesock_t *asock,
+			      bioqueue_op_key_t *send_key,
+			      bssize_t sent);
 
 
 bstatus_t bdns_server_create( bpool_factory *pf,
@@ -59,6 +75,7 @@ bstatus_t bdns_server_create( bpool_factory *pf,
     bpool_t *pool;
     bdns_server *srv;
     bsockaddr sock_addr;
+    bactivesock_cfg sock_cfg;
     bactivesock_cb sock_cb;
     bstatus_t status;
 
@@ -70,21 +87,29 @@ bstatus_t bdns_server_create( bpool_factory *pf,
     srv->pool = pool;
     srv->pf = pf;
     blist_init(&srv->rr_list);
+    blist_init(&srv->free_slot);
+
+    status = bmutex_create_simple(pool, "dnsserver", &srv->mutex);
+    if (status != BASE_SUCCESS)
+	goto on_error;
 
     bbzero(&sock_addr, sizeof(sock_addr));
     sock_addr.addr.sa_family = (buint16_t)af;
     bsockaddr_set_port(&sock_addr, (buint16_t)port);
     
+    bactivesock_cfg_default(&sock_cfg);
+    sock_cfg.async_cnt = MAX_BURST;
+    sock_cfg.batch_recv = BASE_TRUE;
+
     bbzero(&sock_cb, sizeof(sock_cb));
     sock_cb.on_data_recvfrom = &on_data_recvfrom;
+    sock_cb.on_data_sent = &on_data_sent;
 
-    status = bactivesock_create_udp(pool, &sock_addr, NULL, ioqueue,
+    status = bactivesock_create_udp(pool, &sock_addr, &sock_cfg, ioqueue,
 				      &sock_cb, srv, &srv->asock, NULL);
     if (status != BASE_SUCCESS)
 	goto on_error;
 
-    bioqueue_op_key_init(&srv->send_key, sizeof(srv->send_key));
-
     status = bactivesock_start_recvfrom(srv->asock, pool, MAX_PKT, 0);
     if (status != BASE_SUCCESS)
 	goto on_error;
@@ -107,6 +132,11 @@ bstatus_t bdns_server_destroy(bdns_server *srv)
 	srv->asock = NULL;
     }
 
+    if (srv->mutex) {
+	bmutex_destroy(srv->mutex);
+	srv->mutex = NULL;
+    }
+
     bpool_safe_release(&srv->pool);
 
     return BASE_SUCCESS;
@@ -429,6 +459,45 @@ static int print_packet(const bdns_parsed_packet *rec, buint8_t *pkt,
 }
 
 
+static struct send_slot* get_send_slot(bdns_server *srv)
+{
+    struct send_slot *slot;
+
+    bmutex_lock(srv->mutex);
+    if (!blist_empty(&srv->free_slot)) {
+	slot = srv->free_slot.next;
+	blist_erase(slot);
+    } else {
+	slot = BASE_POOL_ZALLOC_T(srv->pool, struct send_slot);
+	bioqueue_op_key_init(&slot->key, sizeof(slot->key));
+	slot->key.user_data = slot;
+    }
+    bmutex_unlock(srv->mutex);
+
+    return slot;
+}
+
+static void put_send_slot(bdns_server *srv, struct send_slot *slot)
+{
+    bmutex_lock(srv->mutex);
+    blist_push_back(&srv->free_slot, slot);
+    bmutex_unlock(srv->mutex);
+}
+
+
+static bbool_t on_data_sent(bactivesock_t *asock,
+			      bioqueue_op_key_t *send_key,
+			      bssize_t sent)
+{
+    bdns_server *srv = (bdns_server*) bactivesock_get_user_data(asock);
+
+    BASE_UNUSED_ARG(sent);
+
+    put_send_slot(srv, (struct send_slot*) send_key->user_data);
+    return BASE_TRUE;
+}
+
+
 static bbool_t on_data_recvfrom(bactivesock_t *asock,
 				  void *data,
 				  bsize_t size,
@@ -437,6 +506,7 @@ static bbool_t on_data_recvfrom(bactivesock_t *asock,
 				  bstatus_t status)
 {
     bdns_server *srv;
+    struct send_slot *slot;
     bpool_t *pool;
     bdns_parsed_packet *req;
     bdns_parsed_packet ans;
@@ -528,17 +598,23 @@ static bbool_t on_data_recvfrom(bactivesock_t *asock,
     }
 
 send_pkt:
-    pkt_len = print_packet(&ans, (buint8_t*)data, MAX_PKT);
+    slot = get_send_slot(srv);
+    pkt_len = print_packet(&ans, slot->pkt, MAX_PKT);
     if (pkt_len < 1) {
 	BASE_ERROR( "Error: answer too large");
+	put_send_slot(srv, slot);
 	goto on_return;
     }
 
-    status = bactivesock_sendto(srv->asock, &srv->send_key, data, &pkt_len,
+    status = bactivesock_sendto(srv->asock, &slot->key, slot->pkt, &pkt_len,
 				  0, src_addr, addr_len);
-    if (status != BASE_SUCCESS && status != BASE_EPENDING) {
-	BASE_PERROR(4,(THIS_FILE, status, "Error sending answer"));
-	goto on_return;
+    if (status != BASE_EPENDING) {
+	/* Sent already, or failed */
+	put_send_slot(srv, slot);
+	if (status != BASE_SUCCESS) {
+	    BASE_PERROR(4,(THIS_FILE, status, "Error sending answer"));
+	    goto on_return;
+	}
     }
 
 on_return:
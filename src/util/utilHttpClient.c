@@ -103,6 +103,7 @@ struct bhttp_req
     bbool_t               resolved;   /* Whether URL's host is resolved */
     bhttp_resp            response;   /* HTTP response */
     bioqueue_op_key_t	    op_key;
+    bsock_iovec           send_iov[2];/* Header and body sent together */
     struct tcp_state
     {
         /* Total data sent so far if the data is sent in segments (i.e.
@@ -1545,10 +1546,28 @@ static bstatus_t http_req_start_sending(bhttp_req *hreq)
     /* Send the request */
     len = bstrlen(&pkt);
     bioqueue_op_key_init(&hreq->op_key, sizeof(hreq->op_key));
-    hreq->tcp_state.send_size = len;
     hreq->tcp_state.current_send_size = 0;
-    status = bactivesock_send(hreq->asock, &hreq->op_key, 
-                                pkt.ptr, &len, 0);
+    if (hreq->state == SENDING_REQUEST && hreq->param.reqdata.size > 0 &&
+        hreq->param.reqdata.total_size == 0)
+    {
+        /* The whole body is in memory: send it behind the header in one
+         * go, without copying it into the buffer. On completion, the
+         * request is sent.
+         */
+        hreq->send_iov[0].base = pkt.ptr;
+        hreq->send_iov[0].len = len;
+        hreq->send_iov[1].base = (void*)hreq->param.reqdata.data;
+        hreq->send_iov[1].len = hreq->param.reqdata.size;
+        hreq->state = SENDING_REQUEST_BODY;
+        hreq->tcp_state.tot_chunk_size = 0;
+        hreq->tcp_state.send_size = len + hreq->param.reqdata.size;
+        status = bactivesock_sendv(hreq->asock, &hreq->op_key,
+                                   hreq->send_iov, 2, &len, 0);
+    } else {
+        hreq->tcp_state.send_size = len;
+        status = bactivesock_send(hreq->asock, &hreq->op_key, 
+                                    pkt.ptr, &len, 0);
+    }
 
     if (status == BASE_SUCCESS) {
         http_on_data_sent(hreq->asock, &hreq->op_key, len);
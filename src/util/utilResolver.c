@@ -8,7 +8,7 @@
 #include <baseCtype.h>
 #include <baseExcept.h>
 #include <baseHash.h>
-#include <baseIoQueue.h>
+#include <baseIoqueue.h>
 #include <baseLog.h>
 #include <baseOs.h>
 #include <basePool.h>
@@ -27,7 +27,7 @@
 #endif
 
 
-#define RES_HASH_TABLE_SIZE 127		/**< Hash table size (must be 2^n-1 */
+#define RES_HASH_TABLE_SIZE 127		/**< Initial cache size (grows)	    */
 #define PORT		    53		/**< Default NS port.		    */
 #define Q_HASH_TABLE_SIZE   127		/**< Query hash table size	    */
 #define TIMER_SIZE	    127		/**< Initial number of timers.	    */
@@ -136,7 +136,6 @@ struct cached_res
 
     bpool_t		    *pool;	    /**< Cache's pool.		    */
     struct res_key	     key;	    /**< Resource key.		    */
-    bhash_entry_buf	     hbuf;	    /**< Hash buffer		    */
     btime_val		     expiry_time;   /**< Expiration time.	    */
     bdns_parsed_packet    *pkt;	    /**< The response packet.	    */
     unsigned		     ref_cnt;	    /**< Reference counter.	    */
@@ -190,7 +189,7 @@ struct bdns_resolver
     buint16_t		 last_id;
 
     /* Hash table for cached response */
-    bhash_table_t	*hrescache;	/**< Cached response in hash table  */
+    bohash_table_t	*hrescache;	/**< Cached response in hash table  */
 
     /* Pending asynchronous query, hashed by transaction ID. */
     bhash_table_t	*hquerybyid;
@@ -417,7 +416,11 @@ bstatus_t bdns_resolver_create( bpool_factory *pf,
     }
 
     /* Response cache hash table */
-    resv->hrescache = bhash_create(pool, RES_HASH_TABLE_SIZE);
+    resv->hrescache = bohash_create(pool, RES_HASH_TABLE_SIZE);
+    if (resv->hrescache == NULL) {
+	status = BASE_ENOMEM;
+	goto on_error;
+    }
 
     /* Query hash table and free list. */
     resv->hquerybyid = bhash_create(pool, Q_HASH_TABLE_SIZE);
@@ -478,16 +481,23 @@ bstatus_t bdns_resolver_destroy( bdns_resolver *resolver,
     }
 
     /* Destroy cached entries */
-    it = bhash_first(resolver->hrescache, &it_buf);
-    while (it) {
-	struct cached_res *cache;
+    if (resolver->hrescache) {
+	bohash_iterator_t rit_buf, *rit;
+
+	rit = bohash_first(resolver->hrescache, &rit_buf);
+	while (rit) {
+	    struct cached_res *cache;
 
-	cache = (struct cached_res*) bhash_this(resolver->hrescache, it);
-	bhash_set(NULL, resolver->hrescache, &cache->key, 
-		    sizeof(cache->key), 0, NULL);
-	bpool_release(cache->pool);
+	    cache = (struct cached_res*) bohash_this(resolver->hrescache, rit);
+	    bohash_set(NULL, resolver->hrescache, &cache->key, 
+			sizeof(cache->key), 0, NULL);
+	    bpool_release(cache->pool);
 
-	it = bhash_first(resolver->hrescache, &it_buf);
+	    rit = bohash_next(resolver->hrescache, rit);
+	}
+
+	bohash_destroy(resolver->hrescache);
+	resolver->hrescache = NULL;
     }
 
     if (resolver->own_timer && resolver->timer) {
@@ -879,8 +889,8 @@ bstatus_t bdns_resolver_start_query( bdns_resolver *resolver,
      * and the cached entry has not expired.
      */
     hval = 0;
-    cache = (struct cached_res *) bhash_get(resolver->hrescache, &key, 
-    					      sizeof(key), &hval);
+    cache = (struct cached_res *) bohash_get(resolver->hrescache, &key, 
+    					       sizeof(key), &hval);
     if (cache) {
 	/* We've found a cached entry. */
 
@@ -937,7 +947,7 @@ bstatus_t bdns_resolver_start_query( bdns_resolver *resolver,
 	/* At this point, we have a cached entry, but this entry has expired.
 	 * Remove this entry from the cached list.
 	 */
-	bhash_set(NULL, resolver->hrescache, &key, sizeof(key), 0, NULL);
+	bohash_set(NULL, resolver->hrescache, &key, sizeof(key), 0, NULL);
 
 	/* Also free the cache, if it is not being used (by callback). */
 	cache->ref_cnt--;
@@ -1441,10 +1451,10 @@ static void update_res_cache(bdns_resolver *resolver,
 
     /* If status is unsuccessful, clear the same entry from the cache */
     if (status != BASE_SUCCESS) {
-	cache = (struct cached_res *) bhash_get(resolver->hrescache, key, 
-						  sizeof(*key), &hval);
+	cache = (struct cached_res *) bohash_get(resolver->hrescache, key, 
+						   sizeof(*key), &hval);
 	/* Remove the entry before releasing its pool (see ticket #1710) */
-	bhash_set(NULL, resolver->hrescache, key, sizeof(*key), hval, NULL);
+	bohash_set(NULL, resolver->hrescache, key, sizeof(*key), hval, NULL);
 	
 	/* Free the entry */
 	if (cache && --cache->ref_cnt <= 0)
@@ -1479,13 +1489,13 @@ static void update_res_cache(bdns_resolver *resolver,
 	ttl = resolver->settings.cache_max_ttl;
 
     /* Get a cache response entry */
-    cache = (struct cached_res *) bhash_get(resolver->hrescache, key,
-    					      sizeof(*key), &hval);
+    cache = (struct cached_res *) bohash_get(resolver->hrescache, key,
+    					       sizeof(*key), &hval);
 
     /* If TTL is zero, clear the same entry in the hash table */
     if (ttl == 0) {
 	/* Remove the entry before releasing its pool (see ticket #1710) */
-	bhash_set(NULL, resolver->hrescache, key, sizeof(*key), hval, NULL);
+	bohash_set(NULL, resolver->hrescache, key, sizeof(*key), hval, NULL);
 
 	/* Free the entry */
 	if (cache && --cache->ref_cnt <= 0)
@@ -1497,7 +1507,7 @@ static void update_res_cache(bdns_resolver *resolver,
 	cache = alloc_entry(resolver);
     } else {
 	/* Remove the entry before resetting its pool (see ticket #1710) */
-	bhash_set(NULL, resolver->hrescache, key, sizeof(*key), hval, NULL);
+	bohash_set(NULL, resolver->hrescache, key, sizeof(*key), hval, NULL);
 
 	if (cache->ref_cnt > 1) {
 	    /* When cache entry is being used by callback (to app),
@@ -1535,8 +1545,11 @@ static void update_res_cache(bdns_resolver *resolver,
     bmemcpy(&cache->key, key, sizeof(*key));
 
     /* Update the hash table */
-    bhash_set_np(resolver->hrescache, &cache->key, sizeof(*key), hval,
-		   cache->hbuf, cache);
+    if (bohash_set(NULL, resolver->hrescache, &cache->key, sizeof(*key), hval,
+		   cache) != BASE_SUCCESS)
+    {
+	free_entry(resolver, cache);
+    }
 
 }
 
@@ -1859,7 +1872,7 @@ unsigned bdns_resolver_get_cached_count(bdns_resolver *resolver)
     BASE_ASSERT_RETURN(resolver, 0);
 
     bgrp_lock_acquire(resolver->grp_lock);
-    count = bhash_count(resolver->hrescache);
+    count = bohash_count(resolver->hrescache);
     bgrp_lock_release(resolver->grp_lock);
 
     return count;
@@ -1897,18 +1910,18 @@ void bdns_resolver_dump(bdns_resolver *resolver,
 		  BASE_TIME_VAL_MSEC(ns->rt_delay));
     }
 
-    BASE_STR_INFO(resolver->name.ptr, "  Nb. of cached responses: %u", bhash_count(resolver->hrescache));
+    BASE_STR_INFO(resolver->name.ptr, "  Nb. of cached responses: %u", bohash_count(resolver->hrescache));
     if (detail) {
-	bhash_iterator_t itbuf, *it;
-	it = bhash_first(resolver->hrescache, &itbuf);
+	bohash_iterator_t itbuf, *it;
+	it = bohash_first(resolver->hrescache, &itbuf);
 	while (it) {
 	    struct cached_res *cache;
-	    cache = (struct cached_res*)bhash_this(resolver->hrescache, it);
+	    cache = (struct cached_res*)bohash_this(resolver->hrescache, it);
 	    BASE_STR_INFO(resolver->name.ptr, 
 		      "   Type %s: %s",
 		      bdns_get_type_name(cache->key.qtype), 
 		      cache->key.name);
-	    it = bhash_next(resolver->hrescache, it);
+	    it = bohash_next(resolver->hrescache, it);
 	}
     }
     BASE_STR_INFO(resolver->name.ptr, "  Nb. of pending queries: %u (%u)",
@@ -67,7 +67,7 @@ static bbool_t udp_echo_srv_on_data_recvfrom(bactivesock_t *asock, void *data, b
 }
 
 
-static bstatus_t udp_echo_srv_create(bpool_t *pool, bioqueue_t *ioqueue, bbool_t enable_echo, struct udp_echo_srv **p_srv)
+static bstatus_t udp_echo_srv_create(bpool_t *pool, bioqueue_t *ioqueue, bbool_t enable_echo, const bactivesock_cfg *cfg, struct udp_echo_srv **p_srv)
 {
 	struct udp_echo_srv *srv;
 	bsock_t sock_fd = BASE_INVALID_SOCKET;
@@ -83,7 +83,7 @@ static bstatus_t udp_echo_srv_create(bpool_t *pool, bioqueue_t *ioqueue, bbool_t
 	bbzero(&activesock_cb, sizeof(activesock_cb));
 	activesock_cb.on_data_recvfrom = &udp_echo_srv_on_data_recvfrom;
 
-	status = bactivesock_create_udp(pool, &addr, NULL, ioqueue, &activesock_cb,  srv, &srv->asock, &addr);
+	status = bactivesock_create_udp(pool, &addr, cfg, ioqueue, &activesock_cb,  srv, &srv->asock, &addr);
 	if (status != BASE_SUCCESS) {
 		bsock_close(sock_fd);
 		udp_echo_err("bactivesock_create()", status);
@@ -136,14 +136,14 @@ static int udp_ping_pong_test(void)
 		goto on_return;
     }
 
-    status = udp_echo_srv_create(pool, ioqueue, BASE_TRUE, &srv1);
+    status = udp_echo_srv_create(pool, ioqueue, BASE_TRUE, NULL, &srv1);
     if (status != BASE_SUCCESS)
 	{
 		ret = -30;
 		goto on_return;
     }
 
-    status = udp_echo_srv_create(pool, ioqueue, BASE_TRUE, &srv2);
+    status = udp_echo_srv_create(pool, ioqueue, BASE_TRUE, NULL, &srv2);
     if (status != BASE_SUCCESS)
 	{
 		ret = -40;
@@ -225,6 +225,145 @@ on_return:
 }
 
 
+/*
+ * UDP burst test: a burst sent with bioqueue_sendto_batch() is received by
+ * a server which reads in batches.
+ */
+#define BURST_CNT	64
+
+static unsigned burst_tx_cnt;
+
+static void burst_on_write_complete(bioqueue_key_t *key, bioqueue_op_key_t *op_key, bssize_t bytes_sent)
+{
+	BASE_UNUSED_ARG(key);
+	BASE_UNUSED_ARG(op_key);
+
+	if (bytes_sent > 0)
+		++burst_tx_cnt;
+}
+
+static int udp_burst_test(void)
+{
+	bioqueue_t *ioqueue = NULL;
+	bpool_t *pool = NULL;
+	struct udp_echo_srv *srv = NULL;
+	bsock_t sock = BASE_INVALID_SOCKET;
+	bioqueue_key_t *key = NULL;
+	bioqueue_callback cb;
+	bactivesock_cfg cfg;
+	bioqueue_op_key_t send_keys[BURST_CNT];
+	bioqueue_op_key_t *op_key[BURST_CNT];
+	unsigned payload[BURST_CNT];
+	const void *data[BURST_CNT];
+	bssize_t length[BURST_CNT];
+	const bsockaddr_t *addr[BURST_CNT];
+	int addrlen[BURST_CNT];
+	bstr_t loopback;
+	bsockaddr_in dst;
+	unsigned i, sent_cnt;
+	int ret;
+	bstatus_t status;
+
+	pool = bpool_create(mem, "burst", 4000, 4000, NULL);
+	if (!pool)
+		return -200;
+
+	status = bioqueue_create(pool, 4, &ioqueue);
+	if (status != BASE_SUCCESS)
+	{
+		ret = -210;
+		udp_echo_err("bioqueue_create()", status);
+		goto on_return;
+	}
+
+	bactivesock_cfg_default(&cfg);
+	cfg.async_cnt = 8;
+	cfg.batch_recv = BASE_TRUE;
+	status = udp_echo_srv_create(pool, ioqueue, BASE_FALSE, &cfg, &srv);
+	if (status != BASE_SUCCESS)
+	{
+		ret = -220;
+		goto on_return;
+	}
+
+	status = bsock_socket(bAF_INET(), bSOCK_DGRAM(), 0, &sock);
+	if (status != BASE_SUCCESS)
+	{
+		ret = -230;
+		udp_echo_err("socket()", status);
+		goto on_return;
+	}
+
+	bbzero(&cb, sizeof(cb));
+	cb.on_write_complete = &burst_on_write_complete;
+	status = bioqueue_register_sock(pool, ioqueue, sock, NULL, &cb, &key);
+	if (status != BASE_SUCCESS)
+	{
+		ret = -240;
+		udp_echo_err("bioqueue_register_sock()", status);
+		goto on_return;
+	}
+
+	loopback = bstr("127.0.0.1");
+	bsockaddr_in_init(&dst, &loopback, srv->port);
+
+	for (i=0; i<BURST_CNT; ++i)
+	{
+		bioqueue_op_key_init(&send_keys[i], sizeof(send_keys[i]));
+		op_key[i] = &send_keys[i];
+		payload[i] = i;
+		data[i] = &payload[i];
+		length[i] = sizeof(payload[i]);
+		addr[i] = &dst;
+		addrlen[i] = sizeof(dst);
+	}
+
+	burst_tx_cnt = 0;
+	status = bioqueue_sendto_batch(key, op_key, data, length, BURST_CNT, 0, addr, addrlen, &sent_cnt);
+	if (status != BASE_SUCCESS && status != BASE_EPENDING)
+	{
+		ret = -250;
+		udp_echo_err("bioqueue_sendto_batch()", status);
+		goto on_return;
+	}
+	burst_tx_cnt += sent_cnt;
+
+	for (i=0; i<100 && srv->rx_cnt < BURST_CNT; ++i)
+	{
+		btime_val delay = {0, 10};
+		bioqueue_poll(ioqueue, &delay);
+	}
+
+	if (srv->rx_err_cnt != 0)
+	{
+		ret = -260;
+		goto on_return;
+	}
+
+	if (burst_tx_cnt != BURST_CNT || srv->rx_cnt != BURST_CNT)
+	{
+		BASE_ERROR("   error: sent %u, received %u of %u datagrams", burst_tx_cnt, srv->rx_cnt, BURST_CNT);
+		ret = -270;
+		goto on_return;
+	}
+
+	ret = 0;
+
+on_return:
+	if (key)
+		bioqueue_unregister(key);
+	else if (sock != BASE_INVALID_SOCKET)
+		bsock_close(sock);
+	if (srv)
+		udp_echo_srv_destroy(srv);
+	if (ioqueue)
+		bioqueue_destroy(ioqueue);
+	if (pool)
+		bpool_release(pool);
+
+	return ret;
+}
+
 
 #define SIGNATURE   0xdeadbeef
 struct tcp_pkt
@@ -496,6 +635,351 @@ on_return:
     return status;
 }
 
+/* Vectors of different sizes, large enough to be written partially, so
+ * that the rest is sent from the middle of a vector.
+ */
+#define SENDV_CNT	    12
+#define SENDV_BYTE(off)	    ((buint8_t)((off) * 7 % 251))
+
+struct sendv_state
+{
+	bbool_t			err;
+	bssize_t		sent;
+	bsize_t			nbrecv;
+};
+
+static bbool_t sendv_on_data_read(bactivesock_t *asock, void *data, bsize_t size, bstatus_t status, bsize_t *remainder)
+{
+	struct sendv_state *st = (struct sendv_state*) bactivesock_get_user_data(asock);
+	buint8_t *p = (buint8_t*) data;
+	bsize_t i;
+
+	BASE_UNUSED_ARG(remainder);
+
+	if (status != BASE_SUCCESS)
+	{
+		st->err = BASE_TRUE;
+		return BASE_FALSE;
+	}
+
+	for (i=0; i<size; ++i, ++st->nbrecv)
+	{
+		if (p[i] != SENDV_BYTE(st->nbrecv))
+		{
+			BASE_CRIT("   err: wrong data at offset %lu", (unsigned long)st->nbrecv);
+			st->err = BASE_TRUE;
+			return BASE_FALSE;
+		}
+	}
+
+	return BASE_TRUE;
+}
+
+static bbool_t sendv_on_data_sent(bactivesock_t *asock, bioqueue_op_key_t *op_key, bssize_t sent)
+{
+	struct sendv_state *st = (struct sendv_state*) bactivesock_get_user_data(asock);
+
+	BASE_UNUSED_ARG(op_key);
+
+	st->sent = sent;
+	if (sent < 1)
+		st->err = BASE_TRUE;
+
+	return BASE_TRUE;
+}
+
+static int _tcpSendvTest(void)
+{
+	bpool_t *pool = NULL;
+	bioqueue_t *ioqueue = NULL;
+	bsock_t sockSvr = BASE_INVALID_SOCKET, sockClient = BASE_INVALID_SOCKET;
+	bactivesock_t *asockSvr = NULL, *asockClient = NULL;
+	bactivesock_cb cb;
+	struct sendv_state *stateSvr, *stateClient;
+	bsock_iovec iov[SENDV_CNT];
+	bioqueue_op_key_t op_key;
+	bsize_t total = 0;
+	bssize_t len;
+	bbool_t pending = BASE_FALSE;
+	int sndbuf = 8192, rc = 0;
+	unsigned i;
+	bstatus_t status;
+
+	pool = bpool_create(mem, "tcpsendv", 4000, 4000, NULL);
+
+	status = app_socketpair(bAF_INET(), bSOCK_STREAM(), 0, &sockSvr, &sockClient);
+	if (status != BASE_SUCCESS)
+	{
+		rc = -200;
+		goto on_return;
+	}
+
+	/* Small socket buffers, so the writes are partial */
+	bsock_setsockopt(sockClient, bSOL_SOCKET(), bSO_SNDBUF(), &sndbuf, sizeof(sndbuf));
+	bsock_setsockopt(sockSvr, bSOL_SOCKET(), bSO_RCVBUF(), &sndbuf, sizeof(sndbuf));
+
+	status = bioqueue_create(pool, 4, &ioqueue);
+	if (status != BASE_SUCCESS)
+	{
+		rc = -210;
+		goto on_return;
+	}
+
+	bbzero(&cb, sizeof(cb));
+	cb.on_data_read = &sendv_on_data_read;
+	cb.on_data_sent = &sendv_on_data_sent;
+
+	stateSvr = BASE_POOL_ZALLOC_T(pool, struct sendv_state);
+	stateClient = BASE_POOL_ZALLOC_T(pool, struct sendv_state);
+	if (bactivesock_create(pool, sockSvr, bSOCK_STREAM(), NULL, ioqueue, &cb, stateSvr, &asockSvr) != BASE_SUCCESS ||
+		bactivesock_create(pool, sockClient, bSOCK_STREAM(), NULL, ioqueue, &cb, stateClient, &asockClient) != BASE_SUCCESS)
+	{
+		rc = -220;
+		goto on_return;
+	}
+
+	for (i=0; i<SENDV_CNT; ++i)
+	{
+		bsize_t j;
+
+		iov[i].len = 1 + (i * 7919) % 30000;
+		iov[i].base = bpool_alloc(pool, iov[i].len);
+		for (j=0; j<iov[i].len; ++j)
+			((buint8_t*)iov[i].base)[j] = SENDV_BYTE(total + j);
+		total += iov[i].len;
+	}
+
+	bioqueue_op_key_init(&op_key, sizeof(op_key));
+	status = bactivesock_sendv(asockClient, &op_key, iov, SENDV_CNT, &len, 0);
+	if (status == BASE_SUCCESS)
+	{
+		stateClient->sent = len;
+	}
+	else if (status == BASE_EPENDING)
+	{
+		pending = BASE_TRUE;
+	}
+	else
+	{
+		BASE_CRIT("   err: sendv status=%d", status);
+		rc = -230;
+		goto on_return;
+	}
+
+	/* Data is read only now, after the send buffer has been filled */
+	status = bactivesock_start_read(asockSvr, pool, 4000, 0);
+	if (status != BASE_SUCCESS)
+	{
+		rc = -240;
+		goto on_return;
+	}
+
+	for (i=0; i<10000 && !stateSvr->err && !stateClient->err && stateSvr->nbrecv < total; ++i)
+	{
+		btime_val timeout = {0, 10};
+		bioqueue_poll(ioqueue, &timeout);
+	}
+
+	if (stateSvr->err || stateClient->err)
+	{
+		rc = -250;
+	}
+	else if (stateClient->sent != (bssize_t)total || stateSvr->nbrecv != total)
+	{
+		BASE_ERROR("   err: sent %ld, received %lu of %lu bytes", (long)stateClient->sent,
+			(unsigned long)stateSvr->nbrecv, (unsigned long)total);
+		rc = -260;
+	}
+	else
+	{
+		BASE_INFO("   %lu bytes in %d vectors, %s", (unsigned long)total, SENDV_CNT,
+			pending ? "pending" : "immediately");
+	}
+
+on_return:
+	if (asockClient)
+		bactivesock_close(asockClient);
+	else if (sockClient != BASE_INVALID_SOCKET)
+		bsock_close(sockClient);
+
+	if (asockSvr)
+		bactivesock_close(asockSvr);
+	else if (sockSvr != BASE_INVALID_SOCKET)
+		bsock_close(sockSvr);
+
+	if (ioqueue)
+		bioqueue_destroy(ioqueue);
+
+	if (pool)
+		bpool_release(pool);
+
+	return rc;
+}
+
+/* The server keeps every other buffer it reads, and checks them only after
+ * all data has arrived, so they must not have been read into again.
+ */
+#define READBUF_SIZE	    512
+#define READBUF_TOTAL	    (64 * 1000)
+#define READBUF_MAX_KEEP    (READBUF_TOTAL / READBUF_SIZE + 16)
+
+struct readbuf_state
+{
+	bbool_t			err;
+	bsize_t			nbrecv;
+	unsigned		reads;
+	unsigned		kept;
+	bactivesock_buf		*buf[READBUF_MAX_KEEP];
+	bsize_t			size[READBUF_MAX_KEEP];
+	bsize_t			offset[READBUF_MAX_KEEP];
+};
+
+static bbool_t readbuf_on_data_read(bactivesock_t *asock, bactivesock_buf *buf, bsize_t size, bstatus_t status, bsize_t *remainder)
+{
+	struct readbuf_state *st = (struct readbuf_state*) bactivesock_get_user_data(asock);
+
+	BASE_UNUSED_ARG(remainder);
+
+	if (status != BASE_SUCCESS)
+	{
+		st->err = BASE_TRUE;
+		return BASE_FALSE;
+	}
+
+	if ((st->reads++ & 1) == 0 && st->kept < READBUF_MAX_KEEP)
+	{
+		bactivesock_buf_add_ref(buf);
+		st->buf[st->kept] = buf;
+		st->size[st->kept] = size;
+		st->offset[st->kept] = st->nbrecv;
+		++st->kept;
+	}
+	st->nbrecv += size;
+
+	return BASE_TRUE;
+}
+
+static int _tcpReadBufTest(void)
+{
+	bpool_t *pool = NULL;
+	bioqueue_t *ioqueue = NULL;
+	bactivesock_buf_pool *bufpool = NULL;
+	bsock_t sockSvr = BASE_INVALID_SOCKET, sockClient = BASE_INVALID_SOCKET;
+	bactivesock_t *asockSvr = NULL;
+	bactivesock_cb cb;
+	struct readbuf_state *st = NULL;
+	buint8_t *data;
+	bsize_t sent = 0;
+	int rc = 0;
+	unsigned i;
+	bstatus_t status;
+
+	pool = bpool_create(mem, "tcpreadbuf", 4000, 4000, NULL);
+
+	status = app_socketpair(bAF_INET(), bSOCK_STREAM(), 0, &sockSvr, &sockClient);
+	if (status != BASE_SUCCESS)
+	{
+		rc = -300;
+		goto on_return;
+	}
+
+	status = bioqueue_create(pool, 4, &ioqueue);
+	if (status == BASE_SUCCESS)
+		status = bactivesock_buf_pool_create(pool, NULL, READBUF_SIZE, 0, &bufpool);
+	if (status != BASE_SUCCESS)
+	{
+		rc = -310;
+		goto on_return;
+	}
+
+	bbzero(&cb, sizeof(cb));
+	cb.on_data_read_buf = &readbuf_on_data_read;
+
+	st = BASE_POOL_ZALLOC_T(pool, struct readbuf_state);
+	if (bactivesock_create(pool, sockSvr, bSOCK_STREAM(), NULL, ioqueue, &cb, st, &asockSvr) != BASE_SUCCESS ||
+		bactivesock_start_read_buf(asockSvr, pool, bufpool, 0) != BASE_SUCCESS)
+	{
+		rc = -320;
+		goto on_return;
+	}
+
+	data = (buint8_t*) bpool_alloc(pool, READBUF_TOTAL);
+	for (i=0; i<READBUF_TOTAL; ++i)
+		data[i] = SENDV_BYTE(i);
+
+	for (i=0; i<10000 && !st->err && st->nbrecv < READBUF_TOTAL; ++i)
+	{
+		btime_val timeout = {0, 10};
+
+		if (sent < READBUF_TOTAL)
+		{
+			bssize_t len = (bssize_t)(READBUF_TOTAL - sent);
+
+			if (len > 1000)
+				len = 1000;
+			if (bsock_send(sockClient, data + sent, &len, 0) == BASE_SUCCESS)
+				sent += len;
+		}
+		bioqueue_poll(ioqueue, &timeout);
+	}
+
+	if (st->err || st->nbrecv != READBUF_TOTAL)
+	{
+		BASE_ERROR("   err: received %lu of %u bytes", (unsigned long)st->nbrecv, READBUF_TOTAL);
+		rc = -330;
+		goto on_return;
+	}
+
+	for (i=0; i<st->kept && rc == 0; ++i)
+	{
+		buint8_t *p = (buint8_t*) st->buf[i]->data;
+		bsize_t j;
+
+		for (j=0; j<st->size[i]; ++j)
+		{
+			if (p[j] != SENDV_BYTE(st->offset[i] + j))
+			{
+				BASE_CRIT("   err: kept buffer %u overwritten at offset %lu", i, (unsigned long)j);
+				rc = -340;
+				break;
+			}
+		}
+	}
+
+	if (rc == 0)
+		BASE_INFO("   %u reads, %u buffers kept past the callback", st->reads, st->kept);
+
+on_return:
+	if (asockSvr)
+		bactivesock_close(asockSvr);
+	else if (sockSvr != BASE_INVALID_SOCKET)
+		bsock_close(sockSvr);
+
+	if (sockClient != BASE_INVALID_SOCKET)
+		bsock_close(sockClient);
+
+	if (bufpool)
+	{
+		/* The kept buffers hold the pool */
+		if (st && st->kept && rc == 0 && bactivesock_buf_pool_destroy(bufpool) != BASE_EBUSY)
+			rc = -350;
+
+		for (i=0; st && i<st->kept; ++i)
+			bactivesock_buf_dec_ref(st->buf[i]);
+
+		if (bactivesock_buf_pool_destroy(bufpool) != BASE_SUCCESS && rc == 0)
+			rc = -360;
+	}
+
+	if (ioqueue)
+		bioqueue_destroy(ioqueue);
+
+	if (pool)
+		bpool_release(pool);
+
+	return rc;
+}
+
 int activesock_test(void)
 {
     int ret;
@@ -505,6 +989,11 @@ int activesock_test(void)
     if (ret != 0)
 		return ret;
 
+    BASE_INFO("..udp burst test");
+    ret = udp_burst_test();
+    if (ret != 0)
+		return ret;
+
     BASE_INFO("..tcp perf test");
     ret = _tcpPerfTest();
     if (ret != 0)
@@ -513,6 +1002,22 @@ int activesock_test(void)
 		return ret;
     }
 
+    BASE_INFO("..tcp sendv test");
+    ret = _tcpSendvTest();
+    if (ret != 0)
+    {
+    	BASE_ERROR("TCP sendv failed: %d", ret);
+		return ret;
+    }
+
+    BASE_INFO("..tcp pooled read buffer test");
+    ret = _tcpReadBufTest();
+    if (ret != 0)
+    {
+    	BASE_ERROR("TCP pooled read buffer failed: %d", ret);
+		return ret;
+    }
+
     return 0;
 }
 
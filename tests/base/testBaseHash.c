@@ -21,6 +21,9 @@
 #include <baseRand.h>
 #include <baseLog.h>
 #include <basePool.h>
+#include <baseString.h>
+#include <baseErrno.h>
+#include <baseOs.h>
 #include "testBaseTest.h"
 
 #if INCLUDE_HASH_TEST
@@ -130,6 +133,161 @@ static int hash_collision_test(bpool_t *pool)
 }
 
 
+/*
+ * Case-insensitive keys, both copied to the pool and given by the
+ * application, which keep their case.
+ */
+static int hash_lower_test(bpool_t *pool)
+{
+    static char key_np[] = "Content-Type";
+    bhash_entry_buf entry_buf;
+    bhash_table_t *ht;
+    bstr_t call_id = bstr("Call-ID");
+    buint32_t hval;
+    unsigned value = 0x5678;
+
+    ht = bhash_create(pool, HASH_COUNT);
+    if (!ht)
+	return -250;
+
+    bhash_set_lower(pool, ht, "Call-ID", BASE_HASH_KEY_STRING, 0, &value);
+    bhash_set_np_lower(ht, key_np, BASE_HASH_KEY_STRING, 0, entry_buf, &value);
+
+    if (bhash_get_lower(ht, "CALL-id", BASE_HASH_KEY_STRING, NULL) != &value)
+	return -260;
+
+    if (bhash_get_lower(ht, "content-TYPE", BASE_HASH_KEY_STRING, NULL) != &value)
+	return -270;
+
+    if (bhash_get_lower(ht, "Content-Typf", BASE_HASH_KEY_STRING, NULL) != NULL)
+	return -280;
+
+    /* The key copied to the pool keeps its case: only the exact key matches
+     * without folding, with the hash value of the folded key.
+     */
+    hval = bhash_calc_tolower(0, NULL, &call_id);
+    if (bhash_get(ht, "Call-ID", BASE_HASH_KEY_STRING, &hval) != &value)
+	return -290;
+    if (bhash_get(ht, "call-id", BASE_HASH_KEY_STRING, &hval) != NULL)
+	return -295;
+
+    return 0;
+}
+
+/*
+ * Open addressing hash table: grow through several resizes, delete while
+ * the entries are being moved, fill the table with deleted slots, and use
+ * long and lowercase keys.
+ */
+static int ohash_test(bpool_t *pool)
+{
+    enum {
+	COUNT = 5000,
+	CHURN = 8,
+	NAMED = 100
+    };
+    bohash_table_t *ht;
+    bohash_iterator_t it_buf, *it;
+    unsigned *keys;
+    unsigned i, j;
+    buint32_t hval;
+    char name[64];
+    int rc = 0;
+
+    ht = bohash_create(pool, 4);
+    if (!ht)
+	return -300;
+
+    keys = (unsigned*) bpool_alloc(pool, COUNT * sizeof(unsigned));
+
+    for (i=0; i<COUNT; ++i) {
+	keys[i] = i;
+	if (bohash_set(NULL, ht, &keys[i], sizeof(keys[i]), 0, &keys[i]) != BASE_SUCCESS) {
+	    rc = -310;
+	    goto on_return;
+	}
+    }
+
+    if (bohash_count(ht) != COUNT) {
+	rc = -320;
+	goto on_return;
+    }
+
+    for (i=0; i<COUNT; ++i) {
+	if (bohash_get(ht, &i, sizeof(i), NULL) != &keys[i]) {
+	    rc = -330;
+	    goto on_return;
+	}
+    }
+
+    /* Delete the odd keys */
+    for (i=1; i<COUNT; i+=2)
+	bohash_set(NULL, ht, &i, sizeof(i), 0, NULL);
+
+    for (j=0; j<CHURN; ++j) {
+	for (i=1; i<COUNT; i+=2)
+	    bohash_set(NULL, ht, &keys[i], sizeof(keys[i]), 0, &keys[i]);
+	for (i=1; i<COUNT; i+=2)
+	    bohash_set(NULL, ht, &i, sizeof(i), 0, NULL);
+    }
+
+    if (bohash_count(ht) != COUNT/2) {
+	rc = -340;
+	goto on_return;
+    }
+
+    for (i=0; i<COUNT; ++i) {
+	void *value = bohash_get(ht, &i, sizeof(i), NULL);
+	if (value != ((i & 1) ? NULL : &keys[i])) {
+	    rc = -350;
+	    goto on_return;
+	}
+    }
+
+    /* Delete every entry while iterating */
+    i = 0;
+    it = bohash_first(ht, &it_buf);
+    while (it) {
+	unsigned *value = (unsigned*) bohash_this(ht, it);
+	if (!value || (*value & 1)) {
+	    rc = -360;
+	    goto on_return;
+	}
+	bohash_set(NULL, ht, value, sizeof(*value), 0, NULL);
+	++i;
+	it = bohash_next(ht, it);
+    }
+
+    if (i != COUNT/2 || bohash_count(ht) != 0) {
+	rc = -370;
+	goto on_return;
+    }
+
+    /* Long keys, copied to the pool, looked up in another case */
+    for (i=0; i<NAMED; ++i) {
+	bansi_snprintf(name, sizeof(name), "Long-Key-Of-The-Open-Addressing-Hash-%u", i);
+	bohash_set_lower(pool, ht, name, BASE_HASH_KEY_STRING, 0, &keys[i]);
+    }
+
+    for (i=0; i<NAMED; ++i) {
+	bansi_snprintf(name, sizeof(name), "LONG-KEY-OF-THE-OPEN-ADDRESSING-HASH-%u", i);
+	hval = 0;
+	if (bohash_get_lower(ht, name, BASE_HASH_KEY_STRING, &hval) != &keys[i]) {
+	    rc = -380;
+	    goto on_return;
+	}
+	bohash_set_lower(NULL, ht, name, BASE_HASH_KEY_STRING, hval, NULL);
+    }
+
+    if (bohash_count(ht) != 0)
+	rc = -390;
+
+on_return:
+    bohash_destroy(ht);
+    return rc;
+}
+
+
 /*
  * Hash table test.
  */
@@ -155,9 +313,111 @@ int hash_test(void)
 	return rc;
     }
 
+    rc = hash_lower_test(pool);
+    if (rc != 0) {
+	bpool_release(pool);
+	return rc;
+    }
+
+    rc = ohash_test(pool);
+    if (rc != 0) {
+	bpool_release(pool);
+	return rc;
+    }
+
     bpool_release(pool);
     return 0;
 }
 
+
+/*
+ * Micro-benchmark of insertion and lookup with header-like keys. The
+ * *_lower functions insert the keys as they are and look them up in
+ * uppercase, so they are expected to cost the same as the plain ones.
+ * The fastest of a few rounds is reported.
+ */
+#define PERF_KEYS   2000
+#define PERF_LOOP   50
+#define PERF_ROUNDS 5
+#define PERF_KEYLEN 32
+
+static void hash_perf_ns(const btimestamp *t1, const btimestamp *t2,
+			 unsigned ops, unsigned *best)
+{
+    unsigned ns = (unsigned)(belapsed_usec(t1, t2) * 1000.0 / ops);
+
+    if (ns < *best)
+	*best = ns;
+}
+
+int hash_perf_test(void)
+{
+    bpool_t *pool;
+    char **keys, **upper;
+    btimestamp t1, t2;
+    unsigned i, j, r, found = 0;
+    unsigned t_set, t_set_lower, t_get, t_get_lower;
+
+    pool = bpool_create(mem, "hashperf", 64000, 64000, NULL);
+    if (!pool)
+	return -400;
+
+    keys = (char**) bpool_calloc(pool, PERF_KEYS, sizeof(char*));
+    upper = (char**) bpool_calloc(pool, PERF_KEYS, sizeof(char*));
+    for (i=0; i<PERF_KEYS; ++i) {
+	keys[i] = (char*) bpool_alloc(pool, PERF_KEYLEN);
+	upper[i] = (char*) bpool_alloc(pool, PERF_KEYLEN);
+	bansi_snprintf(keys[i], PERF_KEYLEN, "X-Header-Name-%u", i);
+	bansi_snprintf(upper[i], PERF_KEYLEN, "X-HEADER-NAME-%u", i);
+    }
+
+    t_set = t_set_lower = t_get = t_get_lower = (unsigned)-1;
+
+    for (r=0; r<PERF_ROUNDS; ++r) {
+	bhash_table_t *ht, *ht_lower;
+
+	ht = bhash_create(pool, PERF_KEYS);
+	ht_lower = bhash_create(pool, PERF_KEYS);
+
+	bTimeStampGet(&t1);
+	for (i=0; i<PERF_KEYS; ++i)
+	    bhash_set(pool, ht, keys[i], BASE_HASH_KEY_STRING, 0, keys[i]);
+	bTimeStampGet(&t2);
+	hash_perf_ns(&t1, &t2, PERF_KEYS, &t_set);
+
+	bTimeStampGet(&t1);
+	for (i=0; i<PERF_KEYS; ++i)
+	    bhash_set_lower(pool, ht_lower, keys[i], BASE_HASH_KEY_STRING, 0, keys[i]);
+	bTimeStampGet(&t2);
+	hash_perf_ns(&t1, &t2, PERF_KEYS, &t_set_lower);
+
+	bTimeStampGet(&t1);
+	for (j=0; j<PERF_LOOP; ++j) {
+	    for (i=0; i<PERF_KEYS; ++i)
+		found += (bhash_get(ht, keys[i], BASE_HASH_KEY_STRING, NULL) == keys[i]);
+	}
+	bTimeStampGet(&t2);
+	hash_perf_ns(&t1, &t2, PERF_KEYS * PERF_LOOP, &t_get);
+
+	bTimeStampGet(&t1);
+	for (j=0; j<PERF_LOOP; ++j) {
+	    for (i=0; i<PERF_KEYS; ++i)
+		found += (bhash_get_lower(ht_lower, upper[i], BASE_HASH_KEY_STRING, NULL) == keys[i]);
+	}
+	bTimeStampGet(&t2);
+	hash_perf_ns(&t1, &t2, PERF_KEYS * PERF_LOOP, &t_get_lower);
+    }
+
+    bpool_release(pool);
+
+    if (found != 2 * PERF_KEYS * PERF_LOOP * PERF_ROUNDS)
+	return -410;
+
+    BASE_INFO(TEST_LEVEL_RESULT"%u keys: set %u ns, set_lower %u ns, get %u ns, get_lower %u ns",
+	      PERF_KEYS, t_set, t_set_lower, t_get, t_get_lower);
+
+    return 0;
+}
+
 #endif	/* INCLUDE_HASH_TEST */
 
@@ -204,6 +204,7 @@ static int perform_test(bbool_t allow_concur,
     test_item *items;
     bthread_t **thread;
     bioqueue_t *ioqueue;
+    bioqueue_cfg ioqueue_cfg;
     bstatus_t rc;
     bioqueue_callback ioqueue_callback;
     buint32_t total_elapsed_usec, total_received;
@@ -226,8 +227,12 @@ static int perform_test(bbool_t allow_concur,
     thread = (bthread_t**)
     	     bpool_alloc(pool, thread_cnt*sizeof(bthread_t*));
 
+    /* One shard per worker thread, where the ioqueue has shards */
     MTRACE( "     creating ioqueue..");
-    rc = bioqueue_create(pool, sockpair_cnt*2, &ioqueue);
+    bioqueue_cfg_default(&ioqueue_cfg);
+    if (thread_cnt <= sockpair_cnt*2)
+	ioqueue_cfg.shard_cnt = thread_cnt;
+    rc = bioqueue_create2(pool, sockpair_cnt*2, &ioqueue_cfg, &ioqueue);
     if (rc != BASE_SUCCESS) {
         app_perror("...error: unable to create ioqueue", rc);
         return -15;
@@ -399,7 +404,7 @@ static int perform_test(bbool_t allow_concur,
     /* Calculate total bytes received. */
     total_received = 0;
     for (i=0; i<sockpair_cnt; ++i) {
-        total_received = (buint32_t)items[i].bytes_recv;
+        total_received += (buint32_t)items[i].bytes_recv;
     }
 
     /* bandwidth = total_received*1000/total_elapsed_usec */
@@ -444,6 +449,8 @@ static int ioqueue_perf_test_imp(bbool_t allow_concur)
         { bSOCK_DGRAM(), "udp", 4, 4},
         { bSOCK_DGRAM(), "udp", 4, 8},
         { bSOCK_DGRAM(), "udp", 4, 16},
+        { bSOCK_DGRAM(), "udp", 8, 16},
+        { bSOCK_DGRAM(), "udp", 16, 16},
         { bSOCK_STREAM(), "tcp", 1, 1},
         { bSOCK_STREAM(), "tcp", 1, 2},
         { bSOCK_STREAM(), "tcp", 1, 4},
@@ -457,6 +464,8 @@ static int ioqueue_perf_test_imp(bbool_t allow_concur)
         { bSOCK_STREAM(), "tcp", 4, 4},
         { bSOCK_STREAM(), "tcp", 4, 8},
         { bSOCK_STREAM(), "tcp", 4, 16},
+        { bSOCK_STREAM(), "tcp", 8, 16},
+        { bSOCK_STREAM(), "tcp", 16, 16},
 /*
 	{ bSOCK_DGRAM(), "udp", 32, 1},
 	{ bSOCK_DGRAM(), "udp", 32, 1},
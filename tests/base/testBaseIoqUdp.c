@@ -580,6 +580,123 @@ static int many_handles_test(bbool_t allow_concur)
     return 0;
 }
 
+/*
+ * shard_test()
+ * With several shards, one thread polling must still serve the keys of
+ * all shards: shards without poller are taken over.
+ */
+static int shard_read_cnt;
+
+static void on_shard_read(bioqueue_key_t *key, bioqueue_op_key_t *op_key,
+			  bssize_t bytes_read)
+{
+    BASE_UNUSED_ARG(key);
+    BASE_UNUSED_ARG(op_key);
+    if (bytes_read > 0)
+	++shard_read_cnt;
+}
+
+static int shard_test(bbool_t allow_concur)
+{
+    enum { SHARDS = 4, MAX_POLL = 500 };
+    bpool_t *pool;
+    bioqueue_t *ioqueue;
+    bioqueue_cfg cfg;
+    bioqueue_callback cb;
+    bsock_t sock[SHARDS], csock = BASE_INVALID_SOCKET;
+    bioqueue_key_t *key[SHARDS];
+    bioqueue_op_key_t read_op[SHARDS];
+    char buf[SHARDS][16];
+    bsockaddr_in addr;
+    bstr_t localhost = bstr("127.0.0.1");
+    bstatus_t rc;
+    int i, status = 0;
+
+    BASE_INFO("...shard test (%s)", bioqueue_name());
+
+    pool = bpool_create(mem, NULL, 4000, 4000, NULL);
+    if (!pool)
+	return BASE_ENOMEM;
+
+    bioqueue_cfg_default(&cfg);
+    cfg.shard_cnt = SHARDS;
+    rc = bioqueue_create2(pool, SHARDS, &cfg, &ioqueue);
+    if (rc != BASE_SUCCESS) {
+	app_perror("...error in bioqueue_create2", rc);
+	bpool_release(pool);
+	return -300;
+    }
+    bioqueue_set_default_concurrency(ioqueue, allow_concur);
+
+    bbzero(&cb, sizeof(cb));
+    cb.on_read_complete = &on_shard_read;
+    shard_read_cnt = 0;
+
+    rc = bsock_socket(bAF_INET(), bSOCK_DGRAM(), 0, &csock);
+    if (rc != BASE_SUCCESS) {
+	status = -310; goto on_return;
+    }
+
+    /* Keys are spread over the shards in turn */
+    for (i=0; i<SHARDS; ++i) {
+	bssize_t bytes = sizeof(buf[i]);
+	int addrlen = sizeof(addr);
+
+	key[i] = NULL;
+	bsockaddr_in_init(&addr, &localhost, 0);
+	rc = bsock_socket(bAF_INET(), bSOCK_DGRAM(), 0, &sock[i]);
+	if (rc == BASE_SUCCESS)
+	    rc = bsock_bind(sock[i], &addr, sizeof(addr));
+	if (rc == BASE_SUCCESS)
+	    rc = bioqueue_register_sock(pool, ioqueue, sock[i], NULL, &cb,
+					  &key[i]);
+	if (rc != BASE_SUCCESS) {
+	    app_perror("...error creating socket", rc);
+	    status = -320; goto on_return;
+	}
+
+	bioqueue_op_key_init(&read_op[i], sizeof(read_op[i]));
+	rc = bioqueue_recv(key[i], &read_op[i], buf[i], &bytes, 0);
+	if (rc != BASE_EPENDING) {
+	    app_perror("...error: bioqueue_recv", rc);
+	    status = -330; goto on_return;
+	}
+
+	bsock_getsockname(sock[i], &addr, &addrlen);
+	bytes = sizeof(buf[i]);
+	rc = bsock_sendto(csock, "shard", &bytes, 0, &addr, sizeof(addr));
+	if (rc != BASE_SUCCESS) {
+	    app_perror("...error: bsock_sendto", rc);
+	    status = -340; goto on_return;
+	}
+    }
+
+    for (i=0; i<MAX_POLL && shard_read_cnt < SHARDS; ++i) {
+	btime_val timeout = { 0, 10 };
+	bioqueue_poll(ioqueue, &timeout);
+    }
+
+    if (shard_read_cnt != SHARDS) {
+	BASE_ERROR("....error: only %d of %d shards served by one thread",
+		   shard_read_cnt, SHARDS);
+	status = -350;
+    }
+
+on_return:
+    for (i=0; i<SHARDS; ++i) {
+	if (key[i])
+	    bioqueue_unregister(key[i]);
+    }
+    if (csock != BASE_INVALID_SOCKET)
+	bsock_close(csock);
+    bioqueue_destroy(ioqueue);
+    bpool_release(pool);
+
+    if (status == 0)
+	BASE_INFO("....shard test ok");
+    return status;
+}
+
 /*
  * Multi-operation test.
  */
@@ -870,6 +987,11 @@ static int udp_ioqueue_test_imp(bbool_t allow_concur)
 		return status;
 	}
 
+	if ((status=shard_test(allow_concur)) != 0)
+	{
+		return status;
+	}
+
 	//return 0;
 
 	BASE_INFO("...benchmarking different buffer size:");
@@ -9,7 +9,7 @@
  */
 
 #include <baseErrno.h>
-#include <baseIoQueue.h>
+#include <baseIoqueue.h>
 #include <baseLog.h>
 #include <baseOs.h>
 #include <basePool.h>
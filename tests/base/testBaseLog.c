@@ -0,0 +1,721 @@
+/*
+ *
+ */
+#include "testBaseTest.h"
+
+/**
+ * \page page_baselib_testBaseLog Test: Asynchronous and Binary Log
+ *
+ * This file provides implementation of \b log_async_test() and
+ * \b log_bin_test().
+ *
+ * log_async_test() tests:
+ *  - order: several threads log numbered messages in asynchronous mode,
+ *    the messages of each thread must arrive in order and none may be lost
+ *    or duplicated, also while switching between the modes,
+ *  - churn: threads log one after another, each reusing the ring of the
+ *    exited one while its messages may still be queued,
+ *  - drop: messages which don't fit in a small ring must be counted,
+ *  - cost: time spent by the logging thread per message in synchronous and
+ *    asynchronous mode, with a writer which flushes a file.
+ *
+ * log_bin_test() tests:
+ *  - decode: messages with all kinds of conversions, decoded from the
+ *    binary log, must be the same as formatted by blog(),
+ *  - wrap: a small ring keeps the newest messages,
+ *  - threads: messages of several threads are all recorded in order,
+ *  - cost: time per message with formatting and with the binary log.
+ *
+ * APIs tested:
+ *  - blog_set_async()
+ *  - blog_set_batch_func()
+ *  - blog_get_dropped()
+ *  - blog_bin_start()
+ *  - blog_bin_stop()
+ *  - blog_bin_decode()
+ */
+
+#if INCLUDE_LOG_TEST || INCLUDE_LOG_BIN_TEST
+
+#include <libBase.h>
+
+#define LA_THREADS		4
+#define LA_MSGS			20000
+#define LA_PERF_MSGS		20000
+#define LA_SWITCHES		10
+#define LA_CHURN_THREADS	32
+#define LA_CHURN_MSGS		1000
+#define LA_FILE			"logasync.tmp"
+
+static unsigned la_next[LA_THREADS];
+static unsigned la_count[LA_THREADS];	/* per thread, as they write concurrently in sync mode */
+static unsigned la_errors;
+static int la_dropped_msg;
+static FILE *la_file;
+static bpool_t *la_pool;
+static unsigned la_decor;
+static int la_level;
+
+/* Check one message "#<thread> <sequence>" */
+static void la_check(const char *data)
+{
+	int id;
+	unsigned seq;
+
+	if (strstr(data, "dropped>"))
+	{
+		la_dropped_msg = 1;
+		return;
+	}
+
+	if (sscanf(data, "#%d %u", &id, &seq) != 2 || id < 0 || id >= LA_THREADS)
+	{
+		++la_errors;
+		return;
+	}
+
+	/* Dropped messages leave gaps, but the order must hold */
+	if (seq < la_next[id])
+		++la_errors;
+
+	la_next[id] = seq + 1;
+	++la_count[id];
+}
+
+static void la_writer(int level, const char *data, int len)
+{
+	BASE_UNUSED_ARG(level);
+	BASE_UNUSED_ARG(len);
+	la_check(data);
+}
+
+static void la_batch_writer(const blog_msg msgs[], unsigned count)
+{
+	unsigned i;
+
+	for (i=0; i<count; ++i)
+		la_check(msgs[i].data);
+}
+
+static int la_thread(void *arg)
+{
+	int id = (int)(bssize_t)arg;
+	unsigned i;
+
+	for (i=0; i<LA_MSGS; ++i)
+		BASE_LOG(1, (THIS_FILE, "#%d %u", id, i));
+
+	return 0;
+}
+
+/* Continue the sequence of the thread before */
+static int la_churn_thread(void *arg)
+{
+	unsigned base = (unsigned)(bssize_t)arg;
+	unsigned i;
+
+	for (i=0; i<LA_CHURN_MSGS; ++i)
+		BASE_LOG(1, (THIS_FILE, "#%d %u", 0, base + i));
+
+	return 0;
+}
+
+static unsigned la_received(void)
+{
+	unsigned i, received = 0;
+
+	for (i=0; i<LA_THREADS; ++i)
+		received += la_count[i];
+
+	return received;
+}
+
+/* Only the messages of the test, without decoration, go to the writers */
+static void la_begin(blog_func *writer, blog_batch_func *batch_writer)
+{
+	bbzero(la_next, sizeof(la_next));
+	bbzero(la_count, sizeof(la_count));
+	la_errors = 0;
+	la_dropped_msg = 0;
+
+	la_decor = blog_get_decor();
+	la_level = blog_get_level();
+	blog_set_decor(BASE_LOG_HAS_NEWLINE);
+	blog_set_level(1);
+	blog_set_log_func(writer);
+	blog_set_batch_func(batch_writer);
+}
+
+static void la_end(void)
+{
+	blog_set_log_func(&blog_write);
+	blog_set_batch_func(NULL);
+	blog_set_level(la_level);
+	blog_set_decor(la_decor);
+}
+
+#if INCLUDE_LOG_TEST
+static int la_order_test(void)
+{
+	bthread_t *threads[LA_THREADS];
+	blog_async_cfg cfg;
+	bsize_t dropped;
+	int i, j, rc = 0;
+	bstatus_t status;
+
+	BASE_INFO(TEST_LEVEL_CASE"order of messages of %d threads", LA_THREADS);
+
+	la_begin(&la_writer, &la_batch_writer);
+	dropped = blog_get_dropped();
+
+	blog_async_cfg_default(&cfg);
+	cfg.flush_msec = 1;
+	status = blog_set_async(BASE_TRUE, &cfg);
+	if (status != BASE_SUCCESS)
+	{
+		rc = -10;
+		goto on_return;
+	}
+
+	for (i=0; i<LA_THREADS; ++i)
+	{
+		status = bthreadCreate(la_pool, "logtest", &la_thread, (void*)(bssize_t)i, 0, 0, &threads[i]);
+		if (status != BASE_SUCCESS)
+		{
+			rc = -20;
+			break;
+		}
+	}
+
+	/* Switch the mode back and forth while the threads are logging */
+	for (j=0; rc == 0 && j<LA_SWITCHES; ++j)
+	{
+		bthreadSleepMs(1);
+		blog_set_async(BASE_FALSE, NULL);
+		bthreadSleepMs(1);
+		blog_set_async(BASE_TRUE, &cfg);
+	}
+
+	while (i > 0)
+	{
+		bthreadJoin(threads[--i]);
+		bthreadDestroy(threads[i]);
+	}
+	blog_set_async(BASE_FALSE, NULL);
+
+	dropped = blog_get_dropped() - dropped;
+	if (rc == 0 && (la_errors != 0 || la_received() + dropped != LA_THREADS * LA_MSGS))
+	{
+		rc = -30;
+	}
+
+on_return:
+	la_end();
+	if (rc != 0)
+	{
+		BASE_ERROR("...error: %d, %u received, %u out of order, %u dropped", rc, la_received(), la_errors, (unsigned)dropped);
+	}
+	else
+	{
+		BASE_INFO(TEST_LEVEL_RESULT"%u received, %u dropped", la_received(), (unsigned)dropped);
+	}
+	return rc;
+}
+
+static int la_churn_test(void)
+{
+	bthread_t *thread;
+	blog_async_cfg cfg;
+	bsize_t dropped;
+	int i, rc = 0;
+
+	BASE_INFO(TEST_LEVEL_CASE"messages of %d threads one after another", LA_CHURN_THREADS);
+
+	la_begin(&la_writer, &la_batch_writer);
+	dropped = blog_get_dropped();
+
+	blog_async_cfg_default(&cfg);
+	cfg.flush_msec = 5;
+	if (blog_set_async(BASE_TRUE, &cfg) != BASE_SUCCESS)
+	{
+		rc = -35;
+		goto on_return;
+	}
+
+	for (i=0; i<LA_CHURN_THREADS; ++i)
+	{
+		if (bthreadCreate(la_pool, "logtest", &la_churn_thread, (void*)(bssize_t)(i * LA_CHURN_MSGS), 0, 0, &thread) != BASE_SUCCESS)
+		{
+			rc = -36;
+			break;
+		}
+		bthreadJoin(thread);
+		bthreadDestroy(thread);
+	}
+	blog_set_async(BASE_FALSE, NULL);
+
+	dropped = blog_get_dropped() - dropped;
+	if (rc == 0 && (la_errors != 0 || la_received() + dropped != LA_CHURN_THREADS * LA_CHURN_MSGS))
+	{
+		rc = -37;
+	}
+
+on_return:
+	la_end();
+	if (rc != 0)
+	{
+		BASE_ERROR("...error: %d, %u received, %u out of order, %u dropped", rc, la_received(), la_errors, (unsigned)dropped);
+	}
+	else
+	{
+		BASE_INFO(TEST_LEVEL_RESULT"%u received, %u dropped", la_received(), (unsigned)dropped);
+	}
+	return rc;
+}
+
+static int la_drop_test(void)
+{
+	blog_async_cfg cfg;
+	bsize_t dropped;
+	int rc = 0;
+
+	BASE_INFO(TEST_LEVEL_CASE"dropping messages when the ring is full");
+
+	la_begin(&la_writer, NULL);
+	dropped = blog_get_dropped();
+
+	/* Smallest ring, and no draining while logging. The ring size applies
+	 * to new rings only, so log from a new thread.
+	 */
+	blog_async_cfg_default(&cfg);
+	cfg.ring_size = 0;
+	cfg.flush_msec = 1000;
+	if (blog_set_async(BASE_TRUE, &cfg) != BASE_SUCCESS)
+	{
+		rc = -40;
+		goto on_return;
+	}
+
+	{
+		bthread_t *thread;
+
+		if (bthreadCreate(la_pool, "logtest", &la_thread, (void*)0, 0, 0, &thread) != BASE_SUCCESS)
+		{
+			blog_set_async(BASE_FALSE, NULL);
+			rc = -50;
+			goto on_return;
+		}
+		bthreadJoin(thread);
+		bthreadDestroy(thread);
+	}
+	blog_set_async(BASE_FALSE, NULL);
+
+	dropped = blog_get_dropped() - dropped;
+	if (dropped == 0 || la_errors != 0 || la_received() + dropped != LA_MSGS || !la_dropped_msg)
+		rc = -60;
+
+on_return:
+	la_end();
+	if (rc != 0)
+	{
+		BASE_ERROR("...error: %d, %u received, %u out of order, %u dropped", rc, la_received(), la_errors, (unsigned)dropped);
+	}
+	else
+	{
+		BASE_INFO(TEST_LEVEL_RESULT"%u received, %u dropped", la_received(), (unsigned)dropped);
+	}
+	return rc;
+}
+
+static void la_file_writer(int level, const char *data, int len)
+{
+	BASE_UNUSED_ARG(level);
+	fwrite(data, 1, len, la_file);
+	fflush(la_file);
+}
+
+static void la_file_batch_writer(const blog_msg msgs[], unsigned count)
+{
+	unsigned i;
+
+	for (i=0; i<count; ++i)
+		fwrite(msgs[i].data, 1, msgs[i].len, la_file);
+	fflush(la_file);
+}
+
+/* Nanoseconds per message spent by the logging thread */
+static unsigned la_perf(void)
+{
+	btimestamp t1, t2;
+	unsigned i;
+
+	bTimeStampGet(&t1);
+	for (i=0; i<LA_PERF_MSGS; ++i)
+		BASE_LOG(1, (THIS_FILE, "#%d %u", 0, i));
+	bTimeStampGet(&t2);
+
+	return (unsigned)(belapsed_usec(&t1, &t2) * 1000.0 / LA_PERF_MSGS);
+}
+
+static int la_perf_test(void)
+{
+	blog_async_cfg cfg;
+	unsigned t_sync, t_async;
+	int rc = 0;
+
+	BASE_INFO(TEST_LEVEL_CASE"time per message, writer flushes a file");
+
+	la_file = fopen(LA_FILE, "wb");
+	if (!la_file)
+		return -70;
+
+	la_begin(&la_file_writer, &la_file_batch_writer);
+
+	t_sync = la_perf();
+
+	blog_async_cfg_default(&cfg);
+	cfg.ring_size = 1 << 20;
+	if (blog_set_async(BASE_TRUE, &cfg) != BASE_SUCCESS)
+	{
+		rc = -80;
+	}
+	else
+	{
+		t_async = la_perf();
+		blog_set_async(BASE_FALSE, NULL);
+	}
+
+	la_end();
+	fclose(la_file);
+	bfile_delete(LA_FILE);
+
+	if (rc == 0)
+	{
+		BASE_INFO(TEST_LEVEL_RESULT"sync %u ns, async %u ns", t_sync, t_async);
+	}
+	return rc;
+}
+
+int log_async_test(void)
+{
+	int rc;
+
+	la_pool = bpool_create(mem, NULL, 4000, 4000, NULL);
+	if (!la_pool)
+		return -1;
+
+	rc = la_order_test();
+	if (rc == 0)
+		rc = la_churn_test();
+	if (rc == 0)
+		rc = la_drop_test();
+	if (rc == 0)
+		rc = la_perf_test();
+
+	bpool_release(la_pool);
+	return rc;
+}
+#endif	/* INCLUDE_LOG_TEST */
+
+#if INCLUDE_LOG_BIN_TEST
+
+#define LB_FILE			"logbin.tmp"
+#define LB_DECOR		(BASE_LOG_HAS_LEVEL_TEXT | BASE_LOG_HAS_SENDER | BASE_LOG_HAS_SPACE | \
+				 BASE_LOG_HAS_INDENT | BASE_LOG_HAS_NEWLINE)
+#define LB_MAX_CASES		32
+#define LB_WRAP_MSGS		5000
+
+static char lb_text[2][LB_MAX_CASES][256];
+static unsigned lb_count[2];
+static int lb_pass;
+
+static void lb_writer(int level, const char *data, int len)
+{
+	BASE_UNUSED_ARG(level);
+	BASE_UNUSED_ARG(len);
+
+	if (lb_count[lb_pass] < LB_MAX_CASES)
+		bansi_strncpy(lb_text[lb_pass][lb_count[lb_pass]++], data, sizeof(lb_text[0][0]) - 1);
+}
+
+static void lb_null_writer(int level, const char *data, int len)
+{
+	BASE_UNUSED_ARG(level);
+	BASE_UNUSED_ARG(data);
+	BASE_UNUSED_ARG(len);
+}
+
+static void lb_log_cases(void)
+{
+	static const char name[] = "hello world";
+	char raw[4] = { 'a', 'b', 'c', 'd' };	/* not NULL terminated */
+
+	BASE_LOG(1, (THIS_FILE, "int %d %i %u %x %X %o %c", -5, 7, 4000000000U, 255, 255, 8, 'z'));
+	BASE_LOG(1, (THIS_FILE, "width |%5d|%-5d|%05d|%+d|% d|%*d|%-*d|", 42, 42, 42, 42, 42, 6, 42, 6, 42));
+	BASE_LOG(1, (THIS_FILE, "long %ld %lu %lx %lld %llu", -123456789L, 123456789UL, 0xabcdefUL,
+		-1234567890123LL, 18446744073709551615ULL));
+	BASE_LOG(1, (THIS_FILE, "size %zu %zd %hd %hhu", (bsize_t)123456, (bssize_t)-9, (short)-3, (unsigned char)200));
+	BASE_LOG(1, (THIS_FILE, "pointer %p", (void*)raw));
+	BASE_LOG(1, (THIS_FILE, "double %f %.2f %e %g %10.3f", 3.14159, 2.71828, 12345.678, 0.0001, -1.5));
+	BASE_LOG(1, (THIS_FILE, "string %s|%10s|%-10s|%.5s|%.*s|%*.*s|", name, "ab", "cd", name, 5, name, 8, 3, name));
+	BASE_LOG(1, (THIS_FILE, "raw %.*s %.4s", (int)sizeof(raw), raw, raw));
+	BASE_LOG(1, (THIS_FILE, "percent 100%% %s", "done"));
+	BASE_LOG(1, (THIS_FILE, "no arguments"));
+	BASE_LOG(1, (THIS_FILE, "unknown %Lf", (long double)1.25));
+	BASE_LOG(1, (THIS_FILE, "many %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d %d",
+		1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18));
+	blog_push_indent();
+	BASE_LOG(1, (THIS_FILE, "indented %d", 1));
+	blog_pop_indent();
+	BASE_LOG(1, ("a_sender_longer_than_the_width", "sender %d", 2));
+}
+
+/* Decode the file to the writer */
+static int lb_decode(blog_func *writer)
+{
+	FILE *file;
+	bpool_t *pool;
+	char *data;
+	long size;
+	int rc = 0;
+
+	file = fopen(LB_FILE, "rb");
+	if (!file)
+		return -100;
+
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	pool = bpool_create(mem, NULL, size + 1000, 1000, NULL);
+	data = pool ? (char*)bpool_alloc(pool, size) : NULL;
+	if (!data || fread(data, 1, size, file) != (size_t)size)
+		rc = -110;
+	else if (blog_bin_decode(data, size, writer) != BASE_SUCCESS)
+		rc = -120;
+
+	if (pool)
+		bpool_release(pool);
+	fclose(file);
+	bfile_delete(LB_FILE);
+
+	return rc;
+}
+
+static int lb_decode_test(void)
+{
+	blog_bin_cfg cfg;
+	unsigned i;
+	int rc = 0;
+
+	BASE_INFO(TEST_LEVEL_CASE"decoded messages are the same as formatted");
+
+	la_begin(&lb_writer, NULL);
+	blog_set_decor(LB_DECOR);
+
+	lb_pass = 0;
+	lb_count[0] = lb_count[1] = 0;
+	lb_log_cases();
+
+	blog_bin_cfg_default(&cfg);
+	cfg.ring_size = 0;
+	cfg.text_level = -1;
+	if (blog_bin_start(LB_FILE, &cfg) != BASE_SUCCESS)
+	{
+		la_end();
+		return -200;
+	}
+
+	lb_pass = 1;
+	lb_log_cases();
+	blog_bin_stop();
+
+	/* Nothing is formatted in binary mode */
+	if (lb_count[1] != 0)
+		rc = -210;
+	else
+		rc = lb_decode(&lb_writer);
+
+	la_end();
+
+	if (rc == 0 && lb_count[0] != lb_count[1])
+		rc = -220;
+
+	for (i=0; rc == 0 && i<lb_count[0]; ++i)
+	{
+		if (bansi_strcmp(lb_text[0][i], lb_text[1][i]) != 0)
+		{
+			BASE_ERROR("...error: formatted \"%s\", decoded \"%s\"", lb_text[0][i], lb_text[1][i]);
+			rc = -230;
+		}
+	}
+
+	if (rc != 0)
+	{
+		BASE_ERROR("...error: %d, %u formatted, %u decoded", rc, lb_count[0], lb_count[1]);
+	}
+	return rc;
+}
+
+static int lb_wrap_test(void)
+{
+	blog_bin_cfg cfg;
+	unsigned i;
+	int rc;
+
+	BASE_INFO(TEST_LEVEL_CASE"small ring keeps the newest messages");
+
+	la_begin(&la_writer, NULL);
+
+	blog_bin_cfg_default(&cfg);
+	cfg.ring_size = 0;
+	cfg.text_level = -1;
+	if (blog_bin_start(LB_FILE, &cfg) != BASE_SUCCESS)
+	{
+		la_end();
+		return -300;
+	}
+
+	for (i=0; i<LB_WRAP_MSGS; ++i)
+		BASE_LOG(1, (THIS_FILE, "#%d %u", 0, i));
+	blog_bin_stop();
+
+	rc = lb_decode(&la_writer);
+	la_end();
+
+	if (rc == 0 && (la_errors != 0 || la_next[0] != LB_WRAP_MSGS || la_count[0] == 0 || la_count[0] >= LB_WRAP_MSGS))
+		rc = -310;
+
+	if (rc != 0)
+	{
+		BASE_ERROR("...error: %d, %u decoded, %u out of order, last %u", rc, la_count[0], la_errors, la_next[0]);
+	}
+	else
+	{
+		BASE_INFO(TEST_LEVEL_RESULT"%u of %u messages kept", la_count[0], LB_WRAP_MSGS);
+	}
+	return rc;
+}
+
+static int lb_thread_test(void)
+{
+	bthread_t *threads[LA_THREADS];
+	blog_bin_cfg cfg;
+	int i, rc = 0;
+
+	BASE_INFO(TEST_LEVEL_CASE"messages of %d threads", LA_THREADS);
+
+	la_begin(&la_writer, NULL);
+
+	blog_bin_cfg_default(&cfg);
+	cfg.text_level = -1;
+	if (blog_bin_start(LB_FILE, &cfg) != BASE_SUCCESS)
+	{
+		la_end();
+		return -400;
+	}
+
+	for (i=0; i<LA_THREADS; ++i)
+	{
+		if (bthreadCreate(la_pool, "logtest", &la_thread, (void*)(bssize_t)i, 0, 0, &threads[i]) != BASE_SUCCESS)
+		{
+			rc = -410;
+			break;
+		}
+	}
+
+	while (i > 0)
+	{
+		bthreadJoin(threads[--i]);
+		bthreadDestroy(threads[i]);
+	}
+	blog_bin_stop();
+
+	if (rc == 0)
+		rc = lb_decode(&la_writer);
+	la_end();
+
+	if (rc == 0 && (la_errors != 0 || la_received() != LA_THREADS * LA_MSGS))
+		rc = -420;
+
+	if (rc != 0)
+	{
+		BASE_ERROR("...error: %d, %u decoded, %u out of order", rc, la_received(), la_errors);
+	}
+	return rc;
+}
+
+/* Nanoseconds per message */
+static unsigned lb_perf(void)
+{
+	btimestamp t1, t2;
+	unsigned i;
+
+	bTimeStampGet(&t1);
+	for (i=0; i<LA_PERF_MSGS; ++i)
+		BASE_LOG(1, (THIS_FILE, "#%d %u %s %p", 0, i, "perf", &i));
+	bTimeStampGet(&t2);
+
+	return (unsigned)(belapsed_usec(&t1, &t2) * 1000.0 / LA_PERF_MSGS);
+}
+
+static int lb_perf_test(void)
+{
+	blog_bin_cfg cfg;
+	unsigned t_text, t_bin;
+	int rc = 0;
+
+	BASE_INFO(TEST_LEVEL_CASE"time per message, formatted and binary");
+
+	la_begin(&lb_null_writer, NULL);
+	blog_set_decor(blog_get_decor() | BASE_LOG_HAS_TIME | BASE_LOG_HAS_MICRO_SEC | BASE_LOG_HAS_SENDER);
+
+	t_text = lb_perf();
+
+	blog_bin_cfg_default(&cfg);
+	cfg.text_level = -1;
+	if (blog_bin_start(LB_FILE, &cfg) != BASE_SUCCESS)
+	{
+		rc = -500;
+	}
+	else
+	{
+		t_bin = lb_perf();
+		blog_bin_stop();
+		bfile_delete(LB_FILE);
+	}
+
+	la_end();
+
+	if (rc == 0)
+	{
+		BASE_INFO(TEST_LEVEL_RESULT"formatted %u ns, binary %u ns", t_text, t_bin);
+	}
+	return rc;
+}
+
+int log_bin_test(void)
+{
+	int rc;
+
+	la_pool = bpool_create(mem, NULL, 4000, 4000, NULL);
+	if (!la_pool)
+		return -1;
+
+	rc = lb_decode_test();
+	if (rc == 0)
+		rc = lb_wrap_test();
+	if (rc == 0)
+		rc = lb_thread_test();
+	if (rc == 0)
+		rc = lb_perf_test();
+
+	bpool_release(la_pool);
+	return rc;
+}
+#endif	/* INCLUDE_LOG_BIN_TEST */
+
+#else
+/* To prevent warning about "translation unit is empty" when this test is disabled */
+int dummy_log_async_test;
+#endif
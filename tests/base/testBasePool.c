@@ -6,6 +6,8 @@
 #include <baseRand.h>
 #include <baseLog.h>
 #include <baseExcept.h>
+#include <baseString.h>
+#include <baseOs.h>
 #include "testBaseTest.h"
 
 /**
@@ -206,6 +208,91 @@ on_error:
     return status;
 }
 
+/* Sum of the free space of the blocks other than the current one */
+static bsize_t get_tail_size(bpool_t *pool)
+{
+    bpool_block *b = pool->block_list.next->next;
+    bsize_t size = 0;
+
+    while (b != &pool->block_list) {
+	size += b->end - b->cur;
+	b = b->next;
+    }
+    return size;
+}
+
+/* Test that the tails of the old blocks are used before the pool grows,
+ * and that the wasted size statistic follows them.
+ */
+static int block_index_test(void)
+{
+    enum { BLOCKS = 64, LARGE = 600, SMALL = 64 };
+    bpool_t *pool = bpool_create(mem, NULL, 1024, 1024, &null_callback);
+    bpool_block *b;
+    bsize_t capacity;
+    unsigned i, count;
+    int status = 0;
+
+    BASE_INFO("...block index test");
+
+    if (!pool)
+	return -80;
+
+    /* Each large allocation leaves the tail of the previous block */
+    for (i=0; i<BLOCKS; ++i) {
+	if (!bpool_alloc(pool, LARGE)) {
+	    status = -81; goto on_error;
+	}
+    }
+
+    if (bpool_get_wasted_size(pool) != get_tail_size(pool) ||
+	bpool_get_wasted_size(pool) == 0)
+    {
+	BASE_ERROR("....error: wasted=%u, expecting %u", 
+		   bpool_get_wasted_size(pool), get_tail_size(pool));
+	status = -82; goto on_error;
+    }
+
+    /* The small allocations fit in the tails without growing the pool */
+    count = 0;
+    for (b = pool->block_list.next->next; b != &pool->block_list; b = b->next)
+	count += (unsigned)((b->end - b->cur) / SMALL);
+
+    capacity = bpool_get_capacity(pool);
+    for (i=0; i<count; ++i) {
+	void *p = bpool_alloc(pool, SMALL);
+	if (!p) {
+	    status = -83; goto on_error;
+	}
+	bmemset(p, i, SMALL);
+    }
+
+    if (bpool_get_capacity(pool) != capacity) {
+	BASE_ERROR("....error: pool grew from %u to %u with free tails", 
+		   capacity, bpool_get_capacity(pool));
+	status = -84; goto on_error;
+    }
+
+    if (bpool_get_wasted_size(pool) != get_tail_size(pool)) {
+	status = -85; goto on_error;
+    }
+
+    /* Reset forgets the tails */
+    bpool_reset(pool);
+    if (bpool_get_wasted_size(pool) != 0) {
+	status = -86; goto on_error;
+    }
+    if (!bpool_alloc(pool, LARGE) || !bpool_alloc(pool, LARGE) ||
+	bpool_get_wasted_size(pool) != get_tail_size(pool))
+    {
+	status = -87; goto on_error;
+    }
+
+on_error:
+    bpool_release(pool);
+    return status;
+}
+
 /* Test the buffer based pool */
 static int pool_buf_test(void)
 {
@@ -253,6 +340,74 @@ static int pool_buf_test(void)
     return 0;
 }
 
+#if BASE_HAS_THREADS
+static int magazine_release_thread(void *arg)
+{
+    bpool_release((bpool_t*)arg);
+    return 0;
+}
+#endif
+
+/* Pools created with the thread caches, released by another thread or not
+ * released at all, are all freed by bcaching_pool_destroy().
+ */
+static int magazine_used_test(void)
+{
+    bcaching_pool cp;
+    bpool_t *pool1, *pool2, *leaked;
+    int status = 0;
+
+    BASE_INFO("...magazine used list test");
+
+    bcaching_pool_init(&cp, NULL, 64 * SIZE);
+    if (bcaching_pool_set_magazine(&cp, 4) != BASE_SUCCESS) {
+	bcaching_pool_destroy(&cp);
+	return -500;
+    }
+
+    pool1 = bpool_create(&cp.factory, "mag1", SIZE, SIZE, &null_callback);
+    pool2 = bpool_create(&cp.factory, "mag2", SIZE, SIZE, &null_callback);
+    leaked = bpool_create(&cp.factory, "leaked", SIZE, SIZE, &null_callback);
+    if (!pool1 || !pool2 || !leaked) {
+	status = -510;
+	goto on_return;
+    }
+    bpool_alloc(leaked, 2 * SIZE);
+
+#if BASE_HAS_THREADS
+    {
+	bpool_t *tpool = bpool_create(mem, "magtest", 4000, 4000, NULL);
+	bthread_t *thread;
+
+	if (!tpool || bthreadCreate(tpool, "magtest", &magazine_release_thread,
+				    pool2, 0, 0, &thread) != BASE_SUCCESS)
+	{
+	    bpool_release(pool2);
+	}
+	else {
+	    bthreadJoin(thread);
+	    bthreadDestroy(thread);
+	}
+	if (tpool)
+	    bpool_release(tpool);
+    }
+#else
+    bpool_release(pool2);
+#endif
+    bpool_release(pool1);
+
+    /* Dump lists the leaked pool */
+    bpool_factory_dump(&cp.factory, BASE_TRUE);
+
+on_return:
+    bcaching_pool_destroy(&cp);
+    if (status == 0 && cp.used_size != 0) {
+	BASE_ERROR("...error: %u bytes still used after destroying the caching pool",
+		   (unsigned)cp.used_size);
+	status = -520;
+    }
+    return status;
+}
 
 int pool_test(void)
 {
@@ -285,6 +440,14 @@ int pool_test(void)
     if (rc != 0)
 	return rc;
 
+    rc = block_index_test();
+    if (rc != 0)
+	return rc;
+
+    rc = magazine_used_test();
+    if (rc != 0)
+	return rc;
+
 
     return 0;
 }
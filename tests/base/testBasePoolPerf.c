@@ -114,6 +114,106 @@ static int pool_test_malloc_free()
 
 #endif /* BASE_SYMBIAN */
 
+/*
+ * Create/release mix from many threads: each thread keeps a few pools
+ * alive, like sessions do, and replaces a random one at each step.
+ */
+#define MT_THREADS	    8
+#define MT_LOOP	    20000
+#define MT_LIVE	    8
+#define MT_MAGAZINE	    8
+
+static bcaching_pool mt_cp;
+
+static int mt_worker(void *arg)
+{
+    bpool_t *live[MT_LIVE];
+    unsigned i;
+
+    BASE_UNUSED_ARG(arg);
+
+    bbzero(live, sizeof(live));
+    for (i=0; i<MT_LOOP; ++i) {
+	unsigned slot = brand() % MT_LIVE;
+
+	if (live[slot])
+	    bpool_release(live[slot]);
+
+	live[slot] = bpool_create(&mt_cp.factory, "mt", sizes[i % COUNT] + 512, 512, NULL);
+	if (!live[slot])
+	    return -1;
+	bpool_alloc(live[slot], sizes[i % COUNT]);
+    }
+
+    for (i=0; i<MT_LIVE; ++i) {
+	if (live[i])
+	    bpool_release(live[i]);
+    }
+    return 0;
+}
+
+static int pool_perf_mt(unsigned magazine, buint32_t *usec)
+{
+    bpool_t *pool;
+    bthread_t *threads[MT_THREADS];
+    btimestamp start, end;
+    unsigned i;
+    int rc = 0;
+
+    pool = bpool_create(mem, "mt", 4000, 4000, NULL);
+    if (!pool)
+	return -1;
+
+    bcaching_pool_init(&mt_cp, NULL, 1024*1024);
+    if (bcaching_pool_set_magazine(&mt_cp, magazine) != BASE_SUCCESS) {
+	bcaching_pool_destroy(&mt_cp);
+	bpool_release(pool);
+	return -2;
+    }
+
+    bTimeStampGet(&start);
+    for (i=0; i<MT_THREADS; ++i) {
+	if (bthreadCreate(pool, "mt", &mt_worker, NULL, 0, 0, &threads[i]) != BASE_SUCCESS) {
+	    rc = -3;
+	    break;
+	}
+    }
+    while (i > 0) {
+	--i;
+	bthreadJoin(threads[i]);
+	bthreadDestroy(threads[i]);
+    }
+    bTimeStampGet(&end);
+    *usec = belapsed_usec(&start, &end);
+
+    bpool_factory_dump(&mt_cp.factory, BASE_FALSE);
+
+    /* The threads have exited: their caches go back to the free lists,
+     * which then hold the whole capacity of the caching pool.
+     */
+    if (rc == 0 && magazine) {
+	bsize_t capacity = 0;
+
+	bcaching_pool_set_magazine(&mt_cp, 0);
+	for (i=0; i<BASE_CACHING_POOL_ARRAY_SIZE; ++i) {
+	    blist *node;
+
+	    for (node = mt_cp.free_list[i].next; node != &mt_cp.free_list[i]; node = node->next)
+		capacity += bpool_get_capacity((bpool_t*)node);
+	}
+
+	if (capacity == 0 || capacity != mt_cp.capacity || capacity > mt_cp.max_capacity) {
+	    BASE_ERROR("..free lists hold %u bytes after flushing the thread caches, capacity=%u",
+		       (unsigned)capacity, (unsigned)mt_cp.capacity);
+	    rc = -4;
+	}
+    }
+
+    bcaching_pool_destroy(&mt_cp);
+    bpool_release(pool);
+    return rc;
+}
+
 int pool_perf_test()
 {
     unsigned i;
@@ -182,6 +282,24 @@ int pool_perf_test()
     BASE_INFO("..pool speedup over malloc best=%dx, worst=%dx", 
 			  (int)(malloc_time/best),
 			  (int)(malloc_time/worst));
+
+#if BASE_HAS_THREADS
+    {
+	buint32_t locked_time, magazine_time;
+
+	BASE_INFO("Benchmarking caching pool with %d threads..", MT_THREADS);
+
+	if (pool_perf_mt(0, &locked_time))
+	    return 8;
+	if (pool_perf_mt(MT_MAGAZINE, &magazine_time))
+	    return 16;
+
+	BASE_INFO("..create/release per thread:         %u", MT_LOOP);
+	BASE_INFO("..with the caching pool lock:        %u usec", locked_time);
+	BASE_INFO("..with thread caches of %2d pools:    %u usec", MT_MAGAZINE, magazine_time);
+    }
+#endif
+
     return 0;
 }
 
@@ -100,6 +100,9 @@ static void dump_ssl_info(const bssl_sock_info *si)
 	tmp_st = "[Unknown]";
     BASE_INFO(".....Cipher: %s", tmp_st);
 
+    if (si->ktls_tx)
+	BASE_INFO(".....Records sent are encrypted by kernel TLS");
+
     /* Print remote certificate info and verification result */
     if (si->remote_cert_info && si->remote_cert_info->subject.info.slen) 
     {
@@ -745,6 +748,194 @@ on_return:
 }
 
 
+/* Server sends a bulk of data to the client over loopback, which checks
+ * it, with or without kernel TLS. The kernel TLS run silently falls back
+ * to the normal path when the kernel or SSL backend has no support.
+ */
+static int ktls_test(bbool_t ktls, bsize_t total_len)
+{
+    bpool_t *pool = NULL;
+    bioqueue_t *ioqueue = NULL;
+    bssl_sock_t *ssock_serv = NULL;
+    bssl_sock_t *ssock_cli = NULL;
+    bssl_sock_param param;
+    struct test_state state_serv = { 0 };
+    struct test_state state_cli = { 0 };
+    bsockaddr addr, listen_addr;
+    bssl_cert_t *cert = NULL;
+    btimestamp t1, t2;
+    buint32_t elapsed;
+    bstatus_t status;
+
+    pool = bpool_create(mem, "ssl_ktls", 256, 256, NULL);
+
+    status = bioqueue_create(pool, 4, &ioqueue);
+    if (status != BASE_SUCCESS) {
+	goto on_return;
+    }
+
+    bssl_sock_param_default(&param);
+    param.cb.on_accept_complete = &ssl_on_accept_complete;
+    param.cb.on_connect_complete = &ssl_on_connect_complete;
+    param.cb.on_data_read = &ssl_on_data_read;
+    param.cb.on_data_sent = &ssl_on_data_sent;
+    param.ioqueue = ioqueue;
+    param.ktls = ktls;
+
+    /* Init default bind address */
+    {
+	bstr_t tmp_st;
+	bsockaddr_init(BASE_AF_INET, &addr, bstrset2(&tmp_st, "127.0.0.1"), 0);
+    }
+
+    /* Data to send, the client gets it as "echo" */
+    state_serv.send_str_len = total_len;
+    state_serv.send_str = (char*)bpool_alloc(pool, total_len);
+    {
+	bsize_t i;
+	for (i = 0; i < total_len; ++i)
+	    state_serv.send_str[i] = (char)(brand() % 256);
+    }
+
+    /* === SERVER === */
+    param.user_data = &state_serv;
+
+    state_serv.pool = pool;
+    state_serv.is_server = BASE_TRUE;
+    state_serv.is_verbose = BASE_TRUE;
+
+    status = bssl_sock_create(pool, &param, &ssock_serv);
+    if (status != BASE_SUCCESS) {
+	goto on_return;
+    }
+
+    /* Set server cert */
+    {
+	bstr_t ca_file = bstr(CERT_CA_FILE);
+	bstr_t cert_file = bstr(CERT_FILE);
+	bstr_t privkey_file = bstr(CERT_PRIVKEY_FILE);
+	bstr_t privkey_pass = bstr(CERT_PRIVKEY_PASS);
+
+#if (defined(TEST_LOAD_FROM_FILES) && TEST_LOAD_FROM_FILES==1)
+	status = bssl_cert_load_from_files(pool, &ca_file, &cert_file, 
+					     &privkey_file, &privkey_pass,
+					     &cert);
+#else
+	bssl_cert_buffer ca_buf, cert_buf, privkey_buf;
+
+	status = load_cert_to_buf(pool, &ca_file, &ca_buf);
+	if (status != BASE_SUCCESS) {
+	    goto on_return;
+	}
+
+	status = load_cert_to_buf(pool, &cert_file, &cert_buf);
+	if (status != BASE_SUCCESS) {
+	    goto on_return;
+	}
+
+	status = load_cert_to_buf(pool, &privkey_file, &privkey_buf);
+	if (status != BASE_SUCCESS) {
+	    goto on_return;
+	}
+
+	status = bssl_cert_load_from_buffer(pool, &ca_buf, &cert_buf,
+					      &privkey_buf, &privkey_pass, 
+					      &cert);
+#endif
+	if (status != BASE_SUCCESS) {
+	    goto on_return;
+	}
+
+	status = bssl_sock_set_certificate(ssock_serv, pool, cert);
+	if (status != BASE_SUCCESS) {
+	    goto on_return;
+	}
+    }
+
+    status = bssl_sock_start_accept(ssock_serv, pool, &addr, bsockaddr_get_len(&addr));
+    if (status != BASE_SUCCESS) {
+	goto on_return;
+    }
+
+    /* Get listener address */
+    {
+	bssl_sock_info info;
+
+	bssl_sock_get_info(ssock_serv, &info);
+	bsockaddr_cp(&listen_addr, &info.local_addr);
+    }
+
+    /* === CLIENT === */
+    param.user_data = &state_cli;
+
+    state_cli.pool = pool;
+    state_cli.check_echo = BASE_TRUE;
+    state_cli.send_str = state_serv.send_str;
+    state_cli.send_str_len = total_len;
+    /* Client only receives */
+    state_cli.sent = total_len;
+
+    status = bssl_sock_create(pool, &param, &ssock_cli);
+    if (status != BASE_SUCCESS) {
+	goto on_return;
+    }
+
+    bTimeStampGet(&t1);
+
+    status = bssl_sock_start_connect(ssock_cli, pool, &addr, &listen_addr, bsockaddr_get_len(&addr));
+    if (status == BASE_SUCCESS) {
+	ssl_on_connect_complete(ssock_cli, BASE_SUCCESS);
+    } else if (status == BASE_EPENDING) {
+	status = BASE_SUCCESS;
+    } else {
+	goto on_return;
+    }
+
+    /* Wait until everything has been received or error */
+    while (!state_serv.err && !state_cli.err && !state_cli.done)
+    {
+	btime_val delay = {0, 100};
+	bioqueue_poll(ioqueue, &delay);
+    }
+
+    bTimeStampGet(&t2);
+
+    /* Clean up sockets */
+    {
+	btime_val delay = {0, 100};
+	while (bioqueue_poll(ioqueue, &delay) > 0);
+    }
+
+    if (state_serv.err || state_cli.err) {
+	if (state_serv.err != BASE_SUCCESS)
+	    status = state_serv.err;
+	else
+	    status = state_cli.err;
+
+	goto on_return;
+    }
+
+    elapsed = belapsed_msec(&t1, &t2);
+    if (elapsed == 0)
+	elapsed = 1;
+    BASE_INFO("...Received %u KB in %u ms (%u KB/s)",
+	      (unsigned)(total_len >> 10), elapsed,
+	      (unsigned)((total_len >> 10) * 1000 / elapsed));
+
+on_return:
+    if (ssock_serv)
+	bssl_sock_close(ssock_serv);
+    if (ssock_cli && !state_cli.err && !state_cli.done) 
+	bssl_sock_close(ssock_cli);
+    if (ioqueue)
+	bioqueue_destroy(ioqueue);
+    if (pool)
+	bpool_release(pool);
+
+    return status;
+}
+
+
 static bbool_t asock_on_data_read(bactivesock_t *asock,
 				    void *data,
 				    bsize_t size,
@@ -1468,6 +1659,39 @@ static int ossl_test_send_buf()
 }
 #endif
 
+/* Circular buffers are used by the GnuTLS and Darwin implementations */
+#if (BASE_SSL_SOCK_IMP == BASE_SSL_SOCK_IMP_GNUTLS) || \
+    (defined(BASE_SSL_SOCK_IMP_DARWIN) && \
+     BASE_SSL_SOCK_IMP == BASE_SSL_SOCK_IMP_DARWIN)
+bstatus_t bssl_sock_test_circ_buf(bpool_factory *factory, bsize_t total);
+static int circ_buf_test()
+{
+    enum { TOTAL = 64 * 1024 * 1024 };
+    btimestamp t1, t2;
+    buint32_t usec;
+    bstatus_t status;
+
+    bTimeStampGet(&t1);
+    status = bssl_sock_test_circ_buf(mem, TOTAL);
+    bTimeStampGet(&t2);
+
+    if (status != BASE_SUCCESS) {
+	app_perror("...error: circular buffer test failed", status);
+	return -600;
+    }
+
+    usec = belapsed_usec(&t1, &t2);
+    BASE_INFO("...%u MB through the circular buffer: %u MB/s",
+	      TOTAL / 1000000, usec ? (unsigned)(TOTAL / usec) : 0);
+    return 0;
+}
+#else
+static int circ_buf_test()
+{
+    return 0;
+}
+#endif
+
 int ssl_sock_test(void)
 {
     int ret;
@@ -1477,6 +1701,11 @@ int ssl_sock_test(void)
     if (ret != 0)
 	return ret;
 
+    BASE_INFO("..circular buffer test");
+    ret = circ_buf_test();
+    if (ret != 0)
+	return ret;
+
     BASE_INFO("..get cipher list test");
     ret = get_cipher_list();
     if (ret != 0)
@@ -1537,6 +1766,16 @@ int ssl_sock_test(void)
     if (ret != 0)
 	return ret;
 
+    BASE_INFO("..loopback throughput test w/o kernel TLS");
+    ret = ktls_test(BASE_FALSE, 1024 * 1024);
+    if (ret != 0)
+	return ret;
+
+    BASE_INFO("..loopback throughput test w/ kernel TLS");
+    ret = ktls_test(BASE_TRUE, 1024 * 1024);
+    if (ret != 0)
+	return ret;
+
     BASE_INFO("..performance test");
     ret = perf_test(BASE_IOQUEUE_MAX_HANDLES/2 - 1, 0);
     if (ret != 0)
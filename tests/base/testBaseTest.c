@@ -101,6 +101,7 @@ int _baseTestInner(void)
 
 #if 0//INCLUDE_HASH_TEST
 	DO_TEST( hash_test() );
+	DO_TEST( hash_perf_test() );
 #endif
 
 #if 0//INCLUDE_TIMESTAMP_TEST
@@ -119,6 +120,10 @@ int _baseTestInner(void)
 	DO_TEST( testBaseTimer() );
 #endif
 
+#if 0//INCLUDE_TIMER_PERF_TEST
+	DO_TEST( timer_perf_test() );
+#endif
+
 #if 0//INCLUDE_SLEEP_TEST
 	DO_TEST( sleep_test() );
 #endif
@@ -127,6 +132,14 @@ int _baseTestInner(void)
 	DO_TEST( testBaseThread() );
 #endif
 
+#if 0//INCLUDE_LOG_TEST
+	DO_TEST( log_async_test() );
+#endif
+
+#if 0//INCLUDE_LOG_BIN_TEST
+	DO_TEST( log_bin_test() );
+#endif
+
 #if 0//INCLUDE_SOCK_TEST
 	DO_TEST( testBaseSock() );
 #endif
@@ -163,8 +176,8 @@ int _baseTestInner(void)
 	DO_TEST( testBaseFile() );
 #endif
 
-#if INCLUDE_SSLSOCK_TEST
-	0//DO_TEST( ssl_sock_test() );
+#if 0//INCLUDE_SSLSOCK_TEST
+	DO_TEST( ssl_sock_test() );
 #endif
 
 #if 0//INCLUDE_ECHO_SERVER
@@ -30,11 +30,14 @@
 #define INCLUDE_FIFOBUF_TEST	    0	// GROUP_DATA_STRUCTURE
 #define INCLUDE_RBTREE_TEST	    GROUP_DATA_STRUCTURE
 #define INCLUDE_TIMER_TEST							GROUP_DATA_STRUCTURE
+#define INCLUDE_TIMER_PERF_TEST					GROUP_DATA_STRUCTURE
 #define INCLUDE_ATOMIC_TEST         GROUP_OS
 #define INCLUDE_MUTEX_TEST	    (BASE_HAS_THREADS && GROUP_OS)
 #define INCLUDE_SLEEP_TEST          GROUP_OS
 #define INCLUDE_OS_TEST             GROUP_OS
 #define INCLUDE_THREAD_TEST         (BASE_HAS_THREADS && GROUP_OS)
+#define INCLUDE_LOG_TEST            (BASE_LOG_HAS_ASYNC && GROUP_OS)
+#define INCLUDE_LOG_BIN_TEST        (BASE_LOG_HAS_BINARY && GROUP_OS)
 #define INCLUDE_SOCK_TEST	    GROUP_NETWORK
 #define INCLUDE_SOCK_PERF_TEST	    GROUP_NETWORK
 #define INCLUDE_SELECT_TEST	    GROUP_NETWORK
@@ -67,17 +70,21 @@ extern int testBaseRand(void);
 extern int testBaseTimestamp(void);
 extern int list_test(void);
 extern int hash_test(void);
+extern int hash_perf_test(void);
 extern int pool_test(void);
 extern int pool_perf_test(void);
 extern int string_test(void);
 extern int fifobuf_test(void);
 extern int testBaseTimer(void);
+extern int timer_perf_test(void);
 
 extern int rbtree_test(void);
 extern int atomic_test(void);
 extern int testBaseMutex(void);
 extern int sleep_test(void);
 extern int testBaseThread(void);
+extern int log_async_test(void);
+extern int log_bin_test(void);
 extern int testBaseSock(void);
 extern int sock_perf_test(void);
 extern int select_test(void);
@@ -30,7 +30,7 @@ static void __timerCallback(btimer_heap_t *ht, btimer_entry *e)
 	BASE_INFO("Timer#%d is called", e->id);
 }
 
-static int _testTimerHeap(void)
+static int _testTimerHeap(const btimer_heap_cfg *cfg)
 {
 	int i, j;
 	btimer_entry *entry;
@@ -42,7 +42,7 @@ static int _testTimerHeap(void)
 	bsize_t size;
 	unsigned count;
 
-	BASE_INFO(TEST_LEVEL_CASE"Basic test: %d timers", MAX_COUNT);
+	BASE_INFO(TEST_LEVEL_CASE"Basic test: %d timers, %s%s", MAX_COUNT, cfg->type == BASE_TIMER_HEAP_WHEEL ? "wheel" : "heap", cfg->batch_poll ? ", batch poll" : "");
 
 	size = btimer_heap_mem_size(MAX_COUNT)+MAX_COUNT*sizeof(btimer_entry);
 	pool = bpool_create( mem, NULL, size, 4000, NULL);
@@ -62,7 +62,7 @@ static int _testTimerHeap(void)
 		entry[i].id = i;
 	}
 	
-	status = btimer_heap_create(pool, MAX_COUNT, &timer);
+	status = btimer_heap_create2(pool, MAX_COUNT, cfg, &timer);
 	if (status != BASE_SUCCESS)
 	{
 		app_perror("...error: unable to create timer heap", status);
@@ -302,7 +302,7 @@ static int cancel_worker(void *arg)
 	return 0;
 }
 
-static int _timerStressTest(void)
+static int _timerStressTest(const btimer_heap_cfg *cfg)
 {
 	int i;
 	btimer_entry *entries = NULL;
@@ -317,7 +317,7 @@ static int _timerStressTest(void)
 	struct thread_param tparam = {0};
 	btime_val now;
 
-	BASE_INFO("...Stress test");
+	BASE_INFO("...Stress test, %s%s", cfg->type == BASE_TIMER_HEAP_WHEEL ? "wheel" : "heap", cfg->batch_poll ? ", batch poll" : "");
 
 	bgettimeofday(&now);
 	bsrand(now.sec);
@@ -330,7 +330,7 @@ static int _timerStressTest(void)
 	}
 
 	/* Create timer heap */
-	status = btimer_heap_create(pool, ST_ENTRY_COUNT, &timer);
+	status = btimer_heap_create2(pool, ST_ENTRY_COUNT, cfg, &timer);
 	if (status != BASE_SUCCESS)
 	{
 		app_perror("...error: unable to create timer heap", status);
@@ -498,17 +498,129 @@ on_return:
 	return err;
 }
 
+/*
+ * Timers which expire in the same poll, where the first callback cancels the
+ * second timer and cancels and reschedules the third: neither of them may be called by
+ * this poll, and the group lock of the cancelled one must be released.
+ */
+#define BC_COUNT	4
+
+static btimer_entry *_bcEntries;
+static int _bcCalled[BC_COUNT];
+static int _bcCancelled;
+
+static void _batchCancelCallback(btimer_heap_t *ht, btimer_entry *e)
+{
+	_bcCalled[e->id]++;
+
+	if (e->id == 0)
+	{
+		btime_val delay = { 60, 0 };
+
+		_bcCancelled = btimer_heap_cancel(ht, &_bcEntries[1]);
+		btimer_heap_cancel(ht, &_bcEntries[2]);
+		btimer_heap_schedule(ht, &_bcEntries[2], &delay);
+	}
+}
+
+static int _timerBatchCancelTest(const btimer_heap_cfg *cfg)
+{
+	btimer_entry entries[BC_COUNT];
+	bpool_t *pool;
+	btimer_heap_t *timer = NULL;
+	bgrp_lock_t *grp_lock = NULL;
+	bstatus_t status;
+	int i, err = 0;
+
+	BASE_INFO("...Cancel in callback test, %s%s", cfg->type == BASE_TIMER_HEAP_WHEEL ? "wheel" : "heap", cfg->batch_poll ? ", batch poll" : "");
+
+	pool = bpool_create( mem, NULL, 4000, 4000, NULL);
+	if (!pool)
+		return -500;
+
+	status = btimer_heap_create2(pool, BC_COUNT, cfg, &timer);
+	if (status == BASE_SUCCESS)
+		status = bgrp_lock_create(pool, NULL, &grp_lock);
+	if (status != BASE_SUCCESS)
+	{
+		app_perror("...error: unable to create timer heap", status);
+		err = -510;
+		goto on_return;
+	}
+	bgrp_lock_add_ref(grp_lock);
+
+	_bcEntries = entries;
+	_bcCancelled = 0;
+	for (i=0; i<BC_COUNT; ++i)
+	{
+		btime_val delay = { 0, i*2 };
+
+		_bcCalled[i] = 0;
+		btimer_entry_init(&entries[i], i, NULL, &_batchCancelCallback);
+		status = btimer_heap_schedule_w_grp_lock(timer, &entries[i], &delay, i, grp_lock);
+		if (status != BASE_SUCCESS)
+		{
+			app_perror("...error: unable to schedule timer", status);
+			err = -520;
+			goto on_return;
+		}
+	}
+
+	bthreadSleepMs(20);
+	btimer_heap_poll(timer, NULL);
+
+	if (_bcCalled[0] != 1 || _bcCalled[1] != 0 || _bcCalled[2] != 0 || _bcCalled[3] != 1 || _bcCancelled != 1)
+	{
+		BASE_ERROR("...error: called %d %d %d %d times, cancel returned %d", _bcCalled[0], _bcCalled[1], _bcCalled[2], _bcCalled[3], _bcCancelled);
+		err = -530;
+	}
+	else if (btimer_heap_count(timer) != 1 || btimer_heap_cancel(timer, &entries[2]) != 1)
+	{
+		BASE_ERROR("...error: rescheduled timer is not in the timer heap");
+		err = -540;
+	}
+	else if (bgrp_lock_get_ref(grp_lock) != 1)
+	{
+		BASE_ERROR("...error: group lock has %d references", bgrp_lock_get_ref(grp_lock));
+		err = -550;
+	}
+
+on_return:
+	if (grp_lock)
+		bgrp_lock_dec_ref(grp_lock);
+	if (timer)
+		btimer_heap_destroy(timer);
+	bpool_release(pool);
+
+	return err;
+}
+
 int testBaseTimer()
 {
+	static const btimer_heap_type types[] = { BASE_TIMER_HEAP_BINARY, BASE_TIMER_HEAP_WHEEL };
+	btimer_heap_cfg cfg;
+	unsigned i;
 	int rc = 0;
 
-//	rc = _testTimerHeap();
-	if (rc != 0)
-		return rc;
+	btimer_heap_cfg_default(&cfg);
+
+	for (i=0; i<BASE_ARRAY_SIZE(types)*2; ++i)
+	{
+		cfg.type = types[i / 2];
+		cfg.batch_poll = (i % 2) ? BASE_TRUE : BASE_FALSE;
+
+//		rc = _testTimerHeap(&cfg);
+		if (rc != 0)
+			return rc;
+
+		rc = _timerBatchCancelTest(&cfg);
+		if (rc != 0)
+			return rc;
 
-	rc = _timerStressTest();
-	if (rc != 0)
-		return rc;
+		rc = _timerStressTest(&cfg);
+		if (rc != 0)
+			return rc;
+	}
 
 	return 0;
 }
@@ -0,0 +1,263 @@
+/*
+ *
+ */
+#include "testBaseTest.h"
+
+/**
+ * \page page_baselib_testBaseTimerPerf Test: Timer Performance
+ *
+ * This file provides implementation of \b timer_perf_test(). It compares
+ * the binary heap and the timing wheel implementations of the timer heap
+ * with these mixes of operations:
+ *  - schedule: schedule all timers with long random delays,
+ *  - cancel: cancel all of them in random order,
+ *  - churn: cancel and reschedule random running timers, as keep-alive
+ *    and retransmission timers do,
+ *  - expire: let all timers expire, with short random delays, polling
+ *    one by one and in batches.
+ *
+ * Schedule, churn and cancel are run several rounds, and the best round is
+ * reported, so that other load of the machine does not hide the difference.
+ * The cost of reading the clock and of drawing the random delay, which is
+ * part of every schedule and is the same for both, is reported as "clock".
+ *
+ */
+
+
+#if INCLUDE_TIMER_PERF_TEST
+
+#include <libBase.h>
+
+#if !BASE_HAS_HIGH_RES_TIMER
+# error Need high resolution timer for this test.
+#endif
+
+#define TP_MAX_DELAY_MS		30000	/* delays of schedule, cancel and churn */
+#define TP_EXPIRE_DELAY_MS	100	/* delays of expire */
+#define TP_CHURN_LOOP		4	/* churn operations per timer */
+#define TP_ROUNDS		5	/* rounds of schedule, churn and cancel */
+
+static const unsigned tp_counts[] = { 1000, 10000, 100000 };
+
+static void tp_callback(btimer_heap_t *ht, btimer_entry *e)
+{
+	BASE_UNUSED_ARG(ht);
+	BASE_UNUSED_ARG(e);
+}
+
+static void tp_random_delay(btime_val *delay, unsigned max_msec)
+{
+	delay->sec = 0;
+	delay->msec = brand() % max_msec;
+	btime_val_normalize(delay);
+}
+
+/* Nanoseconds per operation, keeping the best round in <best> */
+static void tp_per_op(const btimestamp *start, const btimestamp *end, unsigned ops, unsigned *best)
+{
+	unsigned nsec = (unsigned)(belapsed_usec(start, end) * 1000.0 / ops);
+
+	if (nsec < *best)
+		*best = nsec;
+}
+
+static btimer_heap_t *tp_create(bpool_t *pool, unsigned count, const btimer_heap_cfg *cfg)
+{
+	btimer_heap_t *timer;
+	bstatus_t status;
+
+	status = btimer_heap_create2(pool, count, cfg, &timer);
+	if (status != BASE_SUCCESS)
+	{
+		app_perror("...error: unable to create timer heap", status);
+		return NULL;
+	}
+	btimer_heap_set_max_timed_out_per_poll(timer, count);
+
+	return timer;
+}
+
+/* Let all timers expire, only the time spent in poll is counted. The timer
+ * heap is locked from here on, as the cost of the lock is what batch poll saves.
+ */
+static int tp_expire(bpool_t *pool, btimer_heap_t *timer, btimer_entry *entries, unsigned count, unsigned *t_expire)
+{
+	btimestamp t1, t2;
+	btime_val delay;
+	block_t *lock;
+	unsigned i, done = 0, usec = 0;
+	bstatus_t status;
+
+	status = block_create_simple_mutex(pool, "timer", &lock);
+	if (status != BASE_SUCCESS)
+	{
+		app_perror("...error: unable to create lock", status);
+		return -1;
+	}
+	btimer_heap_set_lock(timer, lock, BASE_TRUE);
+
+	for (i=0; i<count; ++i)
+	{
+		tp_random_delay(&delay, TP_EXPIRE_DELAY_MS);
+		btimer_heap_schedule(timer, &entries[i], &delay);
+	}
+
+	bthreadSleepMs(TP_EXPIRE_DELAY_MS / 4);
+	while (btimer_heap_count(timer) > 0)
+	{
+		bthreadSleepMs(1);
+
+		bTimeStampGet(&t1);
+		done += btimer_heap_poll(timer, NULL);
+		bTimeStampGet(&t2);
+
+		usec += belapsed_usec(&t1, &t2);
+	}
+
+	*t_expire = (unsigned)(usec * 1000.0 / count);
+	return (done == count) ? 0 : -1;
+}
+
+static int tp_run(const btimer_heap_cfg *cfg, unsigned count)
+{
+	const char *name = (cfg->type == BASE_TIMER_HEAP_WHEEL) ? "wheel" : "heap";
+	btimer_heap_cfg batch_cfg = *cfg;
+	btimer_entry *entries;
+	btimer_heap_t *timer, *batch_timer;
+	bpool_t *pool;
+	btimestamp t1, t2;
+	btime_val delay;
+	unsigned i, r, done, t_expire, t_batch;
+	unsigned t_sched = (unsigned)-1, t_cancel = (unsigned)-1, t_churn = (unsigned)-1, t_clock = (unsigned)-1;
+	int rc;
+
+	batch_cfg.batch_poll = BASE_TRUE;
+
+	pool = bpool_create(mem, NULL, 2*btimer_heap_mem_size(count) + count*sizeof(btimer_entry) + 4000, 4000, NULL);
+	if (!pool)
+		return -10;
+
+	entries = (btimer_entry*)bpool_calloc(pool, count, sizeof(btimer_entry));
+	if (!entries)
+	{
+		bpool_release(pool);
+		return -20;
+	}
+
+	for (i=0; i<count; ++i)
+		btimer_entry_init(&entries[i], i, NULL, &tp_callback);
+
+	timer = tp_create(pool, count, cfg);
+	batch_timer = tp_create(pool, count, &batch_cfg);
+	if (!timer || !batch_timer)
+	{
+		bpool_release(pool);
+		return -30;
+	}
+
+	for (r=0; r<TP_ROUNDS; ++r)
+	{
+		/* clock, what schedule does besides the timer heap itself */
+		bTimeStampGet(&t1);
+		for (i=0; i<count; ++i)
+		{
+			btime_val now;
+
+			tp_random_delay(&delay, TP_MAX_DELAY_MS);
+			bgettickcount(&now);
+		}
+		bTimeStampGet(&t2);
+		tp_per_op(&t1, &t2, count, &t_clock);
+
+		/* schedule */
+		bTimeStampGet(&t1);
+		for (i=0; i<count; ++i)
+		{
+			tp_random_delay(&delay, TP_MAX_DELAY_MS);
+			btimer_heap_schedule(timer, &entries[i], &delay);
+		}
+		bTimeStampGet(&t2);
+		tp_per_op(&t1, &t2, count, &t_sched);
+
+		/* churn */
+		bTimeStampGet(&t1);
+		for (i=0; i<count*TP_CHURN_LOOP; ++i)
+		{
+			btimer_entry *e = &entries[brand() % count];
+
+			btimer_heap_cancel(timer, e);
+			tp_random_delay(&delay, TP_MAX_DELAY_MS);
+			btimer_heap_schedule(timer, e, &delay);
+		}
+		bTimeStampGet(&t2);
+		tp_per_op(&t1, &t2, count*TP_CHURN_LOOP, &t_churn);
+
+		/* cancel, in random order */
+		done = 0;
+		bTimeStampGet(&t1);
+		for (i=0; i<count; ++i)
+			done += btimer_heap_cancel(timer, &entries[(i * 7919) % count]);
+		bTimeStampGet(&t2);
+		tp_per_op(&t1, &t2, count, &t_cancel);
+
+		if (done != count || btimer_heap_count(timer) != 0)
+		{
+			BASE_ERROR("...error: %s cancelled %u of %u timers", name, done, count);
+			rc = -40;
+			goto on_return;
+		}
+	}
+
+	/* expire, one by one and in batches */
+	rc = tp_expire(pool, timer, entries, count, &t_expire);
+	if (rc == 0)
+		rc = tp_expire(pool, batch_timer, entries, count, &t_batch);
+	if (rc != 0)
+	{
+		BASE_ERROR("...error: %s expiry failed", name);
+		rc = -50;
+		goto on_return;
+	}
+
+	BASE_INFO(TEST_LEVEL_RESULT"%-5s %6u timers: schedule %4u ns, churn %4u ns, cancel %4u ns, expire %4u ns, batch expire %4u ns, clock %4u ns",
+		name, count, t_sched, t_churn, t_cancel, t_expire, t_batch, t_clock);
+
+on_return:
+	btimer_heap_destroy(timer);
+	btimer_heap_destroy(batch_timer);
+	bpool_release(pool);
+
+	return rc;
+}
+
+int timer_perf_test(void)
+{
+	static const btimer_heap_type types[] = { BASE_TIMER_HEAP_BINARY, BASE_TIMER_HEAP_WHEEL };
+	btimer_heap_cfg cfg;
+	unsigned i, j;
+	int rc;
+
+	BASE_INFO(TEST_LEVEL_CASE"Benchmarking timer heap, time per operation");
+
+	btimer_heap_cfg_default(&cfg);
+
+	for (i=0; i<BASE_ARRAY_SIZE(tp_counts); ++i)
+	{
+		for (j=0; j<BASE_ARRAY_SIZE(types); ++j)
+		{
+			cfg.type = types[j];
+
+			rc = tp_run(&cfg, tp_counts[i]);
+			if (rc != 0)
+				return rc;
+		}
+	}
+
+	return 0;
+}
+
+#else
+/* To prevent warning about "translation unit is empty" when this test is disabled */
+int dummy_timer_perf_test;
+#endif
+
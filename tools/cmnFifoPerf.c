@@ -0,0 +1,155 @@
+/*
+ *
+ */
+/*
+ * Throughput of the event fifo of CmnThread: several producer threads add events to one
+ * CmnThread, which only counts them. With an event budget, the thread runs in batch mode.
+ *
+ * Usage: cmnFifoPerf [producers] [events per producer] [event budget]
+ */
+#include <cmnOsPort.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+/* events added and not handled yet, kept below the size of the fifo, so adding never fails */
+#define	PERF_MAX_IN_FLIGHT		(DEFAULT_THREAD_QUEUE_LENGTH - 1)
+
+static int				_eventsPerProducer;
+static int				_total;
+static volatile int		_handled;
+static volatile int		_inFlight;
+static volatile long		_yields;
+
+static int				_event;
+static int				_quitEvent;
+
+static pthread_mutex_t	_doneLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	_doneCond = PTHREAD_COND_INITIALIZER;
+
+static int _perfEventHandler(CmnThread *th, void *event)
+{
+	(void)th;
+
+	if(event == &_quitEvent)
+	{
+		return -1;
+	}
+
+	__atomic_sub_fetch(&_inFlight, 1, __ATOMIC_RELAXED);
+	if(__atomic_add_fetch(&_handled, 1, __ATOMIC_RELAXED) == _total)
+	{
+		pthread_mutex_lock(&_doneLock);
+		pthread_cond_signal(&_doneCond);
+		pthread_mutex_unlock(&_doneLock);
+	}
+
+	return 0;
+}
+
+static void *_perfProducer(void *param)
+{
+	CmnThread *th = (CmnThread *)param;
+	int i;
+
+	for(i = 0; i < _eventsPerProducer; i++)
+	{
+		while(__atomic_add_fetch(&_inFlight, 1, __ATOMIC_RELAXED) > PERF_MAX_IN_FLIGHT)
+		{
+			__atomic_sub_fetch(&_inFlight, 1, __ATOMIC_RELAXED);
+			__atomic_add_fetch(&_yields, 1, __ATOMIC_RELAXED);
+			sched_yield();
+		}
+
+		if(cmnThreadAddEvent(th, &_event) != 0)
+		{
+			fprintf(stderr, "Event %d of producer dropped\n", i);
+			exit(1);
+		}
+	}
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	int producers = (argc > 1) ? atoi(argv[1]) : 4;
+	pthread_t *ids;
+	CmnThread *th;
+	CmnThreadStats stats;
+	int budget = (argc > 3) ? atoi(argv[3]) : 0;
+	struct timespec start, end;
+	double secs;
+	int i;
+
+	_eventsPerProducer = (argc > 2) ? atoi(argv[2]) : 1000000;
+	if(producers <= 0 || _eventsPerProducer <= 0)
+	{
+		fprintf(stderr, "Usage: %s [producers] [events per producer] [event budget]\n", argv[0]);
+		return 1;
+	}
+	_total = producers * _eventsPerProducer;
+
+	cmnThreadLibInit();
+
+	/* freed by the thread when it quits */
+	th = MALLOC(sizeof(CmnThread));
+	memset(th, 0, sizeof(CmnThread));
+	snprintf(th->name, sizeof(th->name), "%s", "fifoPerf");
+	th->eventHandler = _perfEventHandler;
+	if(budget > 0)
+	{
+		CMN_THREAD_BATCH_SET(th);
+		th->eventBudget = budget;
+	}
+	if(cmnThreadInit(th, NULL) != EXIT_SUCCESS)
+	{
+		fprintf(stderr, "Can't start thread\n");
+		return 1;
+	}
+
+	ids = (pthread_t *)malloc(producers * sizeof(pthread_t));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i = 0; i < producers; i++)
+	{
+		pthread_create(&ids[i], NULL, _perfProducer, th);
+	}
+	for(i = 0; i < producers; i++)
+	{
+		pthread_join(ids[i], NULL);
+	}
+
+	pthread_mutex_lock(&_doneLock);
+	while(__atomic_load_n(&_handled, __ATOMIC_RELAXED) != _total)
+	{
+		pthread_cond_wait(&_doneCond, &_doneLock);
+	}
+	pthread_mutex_unlock(&_doneLock);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%d producers, %d events: %.3f sec, %.0f events/sec, %ld yields on full fifo\n",
+		producers, _total, secs, _total / secs, _yields);
+
+	cmnThreadGetStats(th, &stats);
+	printf("%lu wake-ups, %.1f events per wake-up (max %d), max queue depth %d\n",
+		stats.wakeups, stats.wakeups ? (double)stats.events / stats.wakeups : 0.0, stats.maxBatch, stats.maxDepth);
+
+	cmnThreadAddEvent(th, &_quitEvent);
+	while(1)
+	{
+		int left = cmn_list_size(cmnThreadLockList());
+		cmnThreadReleaseList();
+		if(left == 0)
+			break;
+		usleep(1000);
+	}
+	cmnThreadLibDestroy();
+
+	free(ids);
+	return 0;
+}
@@ -0,0 +1,181 @@
+/*
+ *
+ */
+/*
+ * Randomized test of cmn_list_t against a reference array: elements are added, removed and got at
+ * random positions and at both ends, and the list is walked in both directions. The list is
+ * drained to empty from time to time, which must keep one slab of nodes, and cmn_list_free()
+ * must release it.
+ *
+ * Usage: cmnListTest [steps] [seed]
+ */
+#include <cmnOsPort.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define	LIST_TEST_MAX_SIZE		4000
+#define	LIST_TEST_DRAIN			50000	/* steps between drains of the list */
+
+static long	_ref[LIST_TEST_MAX_SIZE];
+static int	_refSize;
+
+#define	LIST_TEST_CHECK(cond, ...)	\
+	do { if(!(cond)) { fprintf(stderr, "step %d: ", step); fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); return 1; } }while(0)
+
+static void _refInsert(int pos, long value)
+{
+	memmove(_ref + pos + 1, _ref + pos, (_refSize - pos) * sizeof(long));
+	_ref[pos] = value;
+	_refSize++;
+}
+
+static void _refRemove(int pos)
+{
+	memmove(_ref + pos, _ref + pos + 1, (_refSize - pos - 1) * sizeof(long));
+	_refSize--;
+}
+
+static int _listTestIterate(int index, void *element, void *priv)
+{
+	int *count = (int *)priv;
+
+	if((long)element != _ref[index])
+	{
+		return -1;
+	}
+	(*count)++;
+	return 0;
+}
+
+/* walk the list forward and backward */
+static int _listTestWalk(cmn_list_t *li, int step)
+{
+	__node_t *node;
+	int i, count = 0;
+
+	LIST_TEST_CHECK(cmn_list_iterate(li, 0, _listTestIterate, &count) == 0 && count == _refSize,
+		"forward walk: %d of %d elements", count, _refSize);
+
+	node = cmn_list_last(li);
+	for(i = _refSize - 1; i >= 0; i--)
+	{
+		LIST_TEST_CHECK(node != NULL && (long)cmn_list_node_element(node) == _ref[i], "backward walk at %d", i);
+		node = cmn_list_prev(node);
+	}
+	LIST_TEST_CHECK(node == NULL, "backward walk goes past the first element");
+
+	return 0;
+}
+
+static int _listTestStep(cmn_list_t *li, int step)
+{
+	long value = rand();
+	int op = rand() % 8;
+	int pos;
+
+	if(op <= 2 && _refSize < LIST_TEST_MAX_SIZE)
+	{/* add at the end, at the beginning, or at a random position */
+		if(op == 0)
+		{
+			_refInsert(_refSize, value);
+			LIST_TEST_CHECK(((rand() % 2) ? cmn_list_push_back(li, (void *)value) != NULL : cmn_list_append(li, (void *)value) >= 0), "add at end");
+		}
+		else if(op == 1)
+		{
+			_refInsert(0, value);
+			LIST_TEST_CHECK(((rand() % 2) ? cmn_list_push_front(li, (void *)value) != NULL : cmn_list_add(li, (void *)value, 0) >= 0), "add at beginning");
+		}
+		else
+		{
+			pos = rand() % (_refSize + 1);
+			_refInsert(pos, value);
+			LIST_TEST_CHECK(cmn_list_add(li, (void *)value, pos) >= 0, "add at %d", pos);
+		}
+	}
+	else if(op <= 4 && _refSize > 0)
+	{/* remove at a random position, by index or by node */
+		pos = rand() % _refSize;
+		if(op == 3)
+		{
+			LIST_TEST_CHECK((long)cmn_list_get(li, pos) == _ref[pos], "get at %d", pos);
+			LIST_TEST_CHECK(cmn_list_remove(li, pos) >= 0, "remove at %d", pos);
+		}
+		else
+		{
+			__node_t *node;
+			int i = 0;
+
+			CMN_LIST_FOREACH(li, node)
+			{
+				if(i++ == pos)
+					break;
+			}
+			LIST_TEST_CHECK((long)cmn_list_remove_node(li, node) == _ref[pos], "remove node at %d", pos);
+		}
+		_refRemove(pos);
+	}
+	else if(op == 5 && _refSize > 0)
+	{
+		LIST_TEST_CHECK((long)cmn_list_pop_front(li) == _ref[0], "pop front");
+		_refRemove(0);
+	}
+	else if(op == 6)
+	{
+		pos = rand() % (_refSize + 1);
+		LIST_TEST_CHECK(cmn_list_eol(li, pos) == (pos >= _refSize), "end of list at %d", pos);
+	}
+	else if(op == 7 && rand() % 64 == 0)
+	{
+		if(_listTestWalk(li, step))
+			return 1;
+	}
+
+	LIST_TEST_CHECK(cmn_list_size(li) == _refSize, "size %d, expected %d", cmn_list_size(li), _refSize);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int steps = (argc > 1) ? atoi(argv[1]) : 1000000;
+	unsigned seed = (argc > 2) ? (unsigned)atoi(argv[2]) : 1;
+	cmn_list_t li;
+	int step, drains = 0;
+
+	srand(seed);
+	cmn_list_init(&li);
+
+	for(step = 0; step < steps; step++)
+	{
+		if(_listTestStep(&li, step))
+		{
+			fprintf(stderr, "Failed with seed %u\n", seed);
+			return 1;
+		}
+
+		if(step % LIST_TEST_DRAIN == LIST_TEST_DRAIN - 1)
+		{
+			while(_refSize > 0)
+			{
+				int pos = rand() % _refSize;
+				LIST_TEST_CHECK((long)cmn_list_get(&li, pos) == _ref[pos], "drain at %d", pos);
+				cmn_list_remove(&li, pos);
+				_refRemove(pos);
+			}
+
+			LIST_TEST_CHECK(cmn_list_size(&li) == 0 && cmn_list_first(&li) == NULL && cmn_list_last(&li) == NULL, "drained list is not empty");
+			LIST_TEST_CHECK(li.slabs != NULL && *(void **)li.slabs == NULL, "drained list keeps %s slab", li.slabs ? "more than one" : "no");
+			drains++;
+		}
+	}
+
+	cmn_list_free(&li);
+	if(li.slabs != NULL || li.freeNodes != NULL || cmn_list_size(&li) != 0)
+	{
+		fprintf(stderr, "cmn_list_free() left nodes in the list\n");
+		return 1;
+	}
+
+	printf("%d steps, %d drains: OK\n", steps, drains);
+	return 0;
+}
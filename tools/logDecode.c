@@ -0,0 +1,61 @@
+/*
+ *
+ */
+/*
+ * Render a file of the binary log (see blog_bin_start()) as text, to stdout.
+ *
+ * Usage: logDecode <file>
+ */
+#include <libBase.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char *argv[])
+{
+	FILE *file;
+	char *data;
+	long size;
+	bstatus_t status;
+
+	if (argc != 2)
+	{
+		fprintf(stderr, "Usage: %s <binary log file>\n", argv[0]);
+		return 1;
+	}
+
+	file = fopen(argv[1], "rb");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Can't open %s\n", argv[1]);
+		return 1;
+	}
+
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	data = (char*) malloc(size > 0 ? size : 1);
+	if (data == NULL || fread(data, 1, size, file) != (size_t)size)
+	{
+		fprintf(stderr, "Can't read %s\n", argv[1]);
+		fclose(file);
+		free(data);
+		return 1;
+	}
+	fclose(file);
+
+	/* The decoration is the one of the file, only no color for stdout */
+	blog_set_decor(blog_get_decor() & ~BASE_LOG_HAS_COLOR);
+
+	status = blog_bin_decode(data, size, &blog_write);
+	free(data);
+	fflush(stdout);
+
+	if (status != BASE_SUCCESS)
+	{
+		fprintf(stderr, "%s is not a binary log file\n", argv[1]);
+		return 1;
+	}
+
+	return 0;
+}
@@ -57,6 +57,7 @@ namespace ienso
 				/* when return iD >0, status must be BASE_SUCCESS(sent out immediately), or BASE_EPENDING(wait on sent event)*/
 				int				asyncSend(bsock_t newSock, void *data, bssize_t *size, SockCbSent cb);/* TCP server, send on new socket*/
 				int				asyncSend(void *data, bssize_t *size, SockCbSent cb);/* TCP client */
+				int				asyncSendv(const bsock_iovec *iov, unsigned count, bssize_t *size, SockCbSent cb);/* TCP client, iov is kept until sent */
 				int				asyncRead(bsock_t newSock, SockCbRead cb);/* read     of TCP server */
 				int				asyncRead(SockCbRead cb);/* read of TCP client */
 				
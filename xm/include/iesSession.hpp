@@ -53,6 +53,9 @@ namespace ienso
 				char* getBuffer(void);
 				unsigned int getBufferSize(void);
 
+				/* header and body of request from generateRequest(), sent without coalescing */
+				const bsock_iovec* getIovec(unsigned int *count);
+
 				bool isEmpty();
 //				const std::string 
 
@@ -62,6 +65,9 @@ namespace ienso
 				unsigned int			_mSize;
 				unsigned int			_mHeaderSize;
 
+				std::string				_mBody;
+				bsock_iovec				_mIov[2];
+
 				Session					*_mSession;
 		};
 		
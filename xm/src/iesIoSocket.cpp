@@ -28,6 +28,7 @@ namespace ienso
 
 			/* when BASE_PENDING, means wait onSent event; when BASE_SUCCESS, means sent out immediately, without onSent event */
 			bstatus_t		asyncSend(void *data, bssize_t *size, SockCbSent cb);
+			bstatus_t		asyncSendv(const bsock_iovec *iov, unsigned count, bssize_t *size, SockCbSent cb);
 			bstatus_t		asyncRead(SockCbRead cb);
 			
 			/* when BASE_PENDING, means wait onSent event; when BASE_SUCCESS, means sent out immediately, without onSent event */
@@ -281,6 +282,24 @@ BTRACE();
 		return bactivesock_send(_mActiveSock, &_mOpKey/* op key */, data, size, 0/* flags to ioqueue_send()*/ );			
 	}
 
+	bstatus_t SocketImpl::asyncSendv(const bsock_iovec *iov, unsigned count, bssize_t *size, SockCbSent cb)
+	{
+		if(_mSockType != BASE_SOCK_STREAM)
+		{
+			BASE_ERROR("UDP socket must send to dest address");
+			return BASE_FAILED;
+		}
+		_mCbSent = cb;
+
+		_mActiveCallback.on_data_sent = _onDataSent;
+		if(_mParent->getMode()!=SocketAsyncMode::ONE_ASYNC_PER_SOCKET)
+		{
+			_initActiveSocket();
+		}
+		BASE_INFO("%s send %d buffers on socket %d", _mParent->getName().c_str(), count, _mSock);
+		return bactivesock_sendv(_mActiveSock, &_mOpKey/* op key */, iov, count, size, 0/* flags to ioqueue_sendv()*/ );
+	}
+
 	bstatus_t SocketImpl::asyncRead(SockCbRead cb)
 	{
 		if(_mSockType != BASE_SOCK_STREAM)
@@ -748,6 +767,26 @@ BTRACE();
 		return _mImpl->asyncRead(cb);
 	}
 
+	int IesSocket::asyncSendv(const bsock_iovec *iov, unsigned count, bssize_t *size, SockCbSent cb)
+	{
+		bstatus_t rc;
+		if(_mSockType != BASE_SOCK_STREAM || _mSock == BASE_INVALID_SOCKET)
+		{
+			BASE_ERROR("UDP socket must send to dest address");
+			return BASE_FAILED;
+		}
+
+		rc = _mImpl->asyncSendv(iov, count, size, cb);
+		if(rc != BASE_SUCCESS && rc != BASE_EPENDING )
+		{
+			BASE_ERROR("ActiveSocket send failed on socket %d", _mSock);
+			sdkPerror(rc, "ActiveSocket send failed on socket %d", _mSock);
+			return BASE_FAILED;
+		}
+		
+		return rc;
+	}
+
 	int IesSocket::asyncSendTo(void *data, bssize_t *size, SockCbSent cb, const std::string& destIp, unsigned short port)
 	{
 		bsockaddr_in addr;
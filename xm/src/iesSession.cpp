@@ -32,6 +32,7 @@ namespace ienso
 	/* called after recved packet into the buffer */
 	void Packet::setSize(unsigned int size)
 	{
+		_mBody.clear();
 		_mSize = size;
 	}
 	
@@ -46,6 +47,7 @@ namespace ienso
 	void Packet::clear(void)
 	{
 		std::fill(std::begin(_mBuf), std::end(_mBuf), 0);
+		_mBody.clear();
 		_mSize = 0;
 	}
 	
@@ -59,11 +61,11 @@ namespace ienso
 		return fillData(jsonStr.c_str());
 	}
 	
+	/* body to be sent, kept in its string as by generateRequest() */
 	bool Packet::fillData(const char *jsonStr)
 	{
-		std::fill(std::begin(_mBuf)+ _mHeaderSize, std::end(_mBuf), 0);
-		memcpy(_mBuf.data()+_mHeaderSize, jsonStr, strlen(jsonStr));
-		_mSize = _mHeaderSize + strlen(jsonStr);
+		_mBody = jsonStr;
+		_mSize = _mHeaderSize + _mBody.size();
 
 		return true;
 	}
@@ -76,6 +78,13 @@ namespace ienso
 			return nullptr;
 		}
 		
+		/* body of a request, or of a packet received into the buffer */
+		if(!_mBody.empty())
+		{
+			*size = _mBody.size();
+			return _mBody.data();
+		}
+
 		*size = _mSize - _mHeaderSize;
 		return _mBuf.data()+_mHeaderSize;
 	}
@@ -95,13 +104,25 @@ namespace ienso
 		return (_mSize <= _mHeaderSize);
 	}
 
+	const bsock_iovec* Packet::getIovec(unsigned int *count)
+	{
+		_mIov[0].base = _mBuf.data();
+		_mIov[0].len = _mHeaderSize;
+		_mIov[1].base = const_cast<char *>(_mBody.data());
+		_mIov[1].len = _mBody.size();
+
+		*count = _mBody.empty()? 1: 2;
+		return _mIov;
+	}
+
 	
 	int Packet::generateRequest(MgmtObj *request)
 	{
 		XmControlHeader *xmHeader = (XmControlHeader *)_mBuf.data();
 
-		const std::string data = request->serialize();
-		fillData(data);
+		/* body stays in its string, it is sent behind the header by getIovec() */
+		_mBody = request->serialize();
+		_mSize = _mHeaderSize + _mBody.size();
 		
 		xmHeader->flags = 0xFF;
 		xmHeader->version = 1;
@@ -110,7 +131,7 @@ namespace ienso
 		xmHeader->dataLength = bhtonl(dataLength);
 #else
 		xmHeader->msgId = static_cast<unsigned short>(request->getRequestCode());
-		xmHeader->dataLength = getDataSize();
+		xmHeader->dataLength = _mBody.size();
 #endif
 		xmHeader->sessionId = _mSession->getSessionId();
 		xmHeader->sequenceNumber = _mSession->getSequenceNo();
@@ -227,11 +248,17 @@ namespace ienso
 		XmControlHeader *xmHeader = (XmControlHeader *)_mBuffer->getHeader();
 
 		bssize_t size = _mBuffer->generateRequest(cmd.get() );
+		unsigned int count;
+		const bsock_iovec *iov = _mBuffer->getIovec(&count);
 		
 		BASE_DEBUG("packet length: %d", size);
-		CMN_HEX_DUMP(_mBuffer->getBuffer(), size, "Send content:");
+		CMN_HEX_DUMP((char *)iov[0].base, iov[0].len, "Send header:");
+		if(count > 1)
+		{
+			CMN_HEX_DUMP((char *)iov[1].base, iov[1].len, "Send content:");
+		}
 
-		rc = _mIoSocket->asyncSend(_mBuffer->getBuffer(), &size, 
+		rc = _mIoSocket->asyncSendv(iov, count, &size, 
 			std::bind(&Session::_onSent, this, std::placeholders::_1, std::placeholders::_2));
 		if(rc == BASE_FAILED || size != _mBuffer->getSize() )
 		{